@@ -0,0 +1,158 @@
+/**
+ * @file base64_test.cpp
+ * @brief Checks every base64 code path against a reference implementation
+ *
+ * Builds without Win32 (see build.sh). Forces the scalar, SSSE3 and AVX2
+ * paths in turn (those the CPU lacks are reported and skipped) and checks
+ * for each: round trips of every length up to past the decoder's 1024-char
+ * window, so that every 12/24/48-byte SIMD block boundary is crossed with
+ * every tail; the streaming encoder and decoder fed in random chunks; and
+ * rejection of invalid characters at every position, of data after padding
+ * and of a dangling sextet. Exits non-zero if any check fails.
+ */
+
+#include "check.h"
+
+#include "../src/base64.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+constexpr size_t kMaxLength = 1100;  // Bytes; encodes past the decoder's 1024-char SIMD window
+
+/**
+ * @brief Straightforward encoder the fast paths are checked against
+ */
+string ReferenceEncode(const vector<uint8_t>& in) {
+    static const char kAlphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    string out;
+    for (size_t i = 0; i < in.size(); i += 3) {
+        uint32_t n = static_cast<uint32_t>(in[i]) << 16;
+        if (i + 1 < in.size()) n |= static_cast<uint32_t>(in[i + 1]) << 8;
+        if (i + 2 < in.size()) n |= in[i + 2];
+        out += kAlphabet[(n >> 18) & 63];
+        out += kAlphabet[(n >> 12) & 63];
+        out += i + 1 < in.size() ? kAlphabet[(n >> 6) & 63] : '=';
+        out += i + 2 < in.size() ? kAlphabet[n & 63] : '=';
+    }
+    return out;
+}
+
+vector<uint8_t> RandomBytes(mt19937& rng, size_t size) {
+    vector<uint8_t> v(size);
+    for (auto& b : v) b = static_cast<uint8_t>(rng());
+    return v;
+}
+
+void CheckRoundTrips(const string& impl, mt19937& rng) {
+    for (size_t len = 0; len <= kMaxLength; ++len) {
+        const vector<uint8_t> data = RandomBytes(rng, len);
+        const string expected = ReferenceEncode(data);
+        const string encoded = Base64Encode(data.data(), data.size());
+        if (!Check(encoded == expected, impl + ": encode of " + to_string(len) + " bytes")) continue;
+        vector<uint8_t> decoded;
+        Check(Base64Decode(string_view(encoded), decoded) && decoded == data, impl + ": decode of " + to_string(len) + " bytes");
+        // Unpadded and wide input decode the same
+        string unpadded = encoded;
+        while (!unpadded.empty() && unpadded.back() == '=') unpadded.pop_back();
+        Check(Base64Decode(string_view(unpadded), decoded) && decoded == data, impl + ": unpadded decode of " + to_string(len) + " bytes");
+        const wstring wide(encoded.begin(), encoded.end());
+        Check(Base64Decode(wstring_view(wide), decoded) && decoded == data, impl + ": wide decode of " + to_string(len) + " bytes");
+    }
+
+    // Whitespace anywhere is skipped, including inside SIMD-sized blocks
+    const vector<uint8_t> data = RandomBytes(rng, 600);
+    const string encoded = Base64Encode(data.data(), data.size());
+    for (size_t pos = 0; pos <= encoded.size(); pos += 7) {
+        string spaced = encoded;
+        spaced.insert(pos, pos % 2 ? "\r\n" : " \t");
+        vector<uint8_t> decoded;
+        Check(Base64Decode(string_view(spaced), decoded) && decoded == data, impl + ": whitespace at " + to_string(pos));
+    }
+}
+
+void CheckStreaming(const string& impl, mt19937& rng) {
+    for (int round = 0; round < 300; ++round) {
+        const vector<uint8_t> data = RandomBytes(rng, rng() % 3000);
+        const string expected = ReferenceEncode(data);
+        const size_t maxChunk = 1 + rng() % (round % 3 == 0 ? 4 : 100);
+
+        Base64StreamEncoder enc;
+        string encoded;
+        for (size_t pos = 0; pos < data.size();) {
+            const size_t n = min(data.size() - pos, static_cast<size_t>(rng() % (maxChunk + 1)));
+            enc.Update(data.data() + pos, n, encoded);
+            pos += n;
+        }
+        enc.Finish(encoded);
+        Check(encoded == expected, impl + ": streaming encode of " + to_string(data.size()) + " bytes, chunks up to " + to_string(maxChunk));
+
+        Base64StreamDecoder dec;
+        vector<uint8_t> decoded;
+        bool ok = true;
+        for (size_t pos = 0; pos < expected.size() && ok;) {
+            const size_t n = min(expected.size() - pos, static_cast<size_t>(rng() % (maxChunk + 1)));
+            ok = dec.Update(expected.data() + pos, n, decoded);
+            pos += n;
+        }
+        ok = ok && dec.Finish(decoded);
+        Check(ok && decoded == data, impl + ": streaming decode of " + to_string(data.size()) + " bytes, chunks up to " + to_string(maxChunk));
+    }
+}
+
+void CheckInvalid(const string& impl, mt19937& rng) {
+    const vector<uint8_t> data = RandomBytes(rng, 900);
+    const string encoded = Base64Encode(data.data(), data.size());
+    vector<uint8_t> decoded;
+    for (const char bad : {'*', '-', '_', '\0', '\x80', '\xff'}) {
+        for (size_t pos = 0; pos < encoded.size(); ++pos) {
+            string s = encoded;
+            s[pos] = bad;
+            if (!Check(!Base64Decode(string_view(s), decoded), impl + ": invalid byte " + to_string(static_cast<unsigned char>(bad)) + " at " + to_string(pos) + " accepted")) break;
+        }
+    }
+    Check(!Base64Decode(string_view("QUJD=QUJD"), decoded), impl + ": data after padding accepted");
+    Check(!Base64Decode(string_view(encoded + "=A"), decoded), impl + ": data after final padding accepted");
+    Check(!Base64Decode(string_view("QUJDR"), decoded), impl + ": dangling sextet accepted");
+    const wstring wide = L"QUJDéQUJD";
+    Check(!Base64Decode(wstring_view(wide), decoded), impl + ": non-ASCII wide input accepted");
+
+    // An invalid character stays fatal for the rest of the stream
+    Base64StreamDecoder dec;
+    Check(!dec.Update("QU*J", 4, decoded), impl + ": streaming decoder accepted an invalid byte");
+    Check(!dec.Update("QUJD", 4, decoded) && !dec.Finish(decoded), impl + ": streaming decoder recovered after an invalid byte");
+}
+
+}  // namespace
+
+int main() {
+    int tested = 0;
+    for (const char* impl : {"scalar", "ssse3", "avx2"}) {
+        if (!Base64SetImplementation(impl)) {
+            printf("base64_test: %s not available on this CPU, skipped\n", impl);
+            continue;
+        }
+        Check(Base64Implementation() == string(impl), string(impl) + ": path forced");
+        mt19937 rng(12345);
+        CheckRoundTrips(impl, rng);
+        CheckStreaming(impl, rng);
+        CheckInvalid(impl, rng);
+        ++tested;
+    }
+    Base64SetImplementation(nullptr);
+    Check(tested > 0, "at least the scalar path tested");
+
+    if (CheckFailures() != 0) {
+        fprintf(stderr, "base64_test: %d checks failed\n", CheckFailures());
+        return 1;
+    }
+    printf("base64_test: %d implementations, ok\n", tested);
+    return 0;
+}
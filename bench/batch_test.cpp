@@ -0,0 +1,152 @@
+/**
+ * @file batch_test.cpp
+ * @brief Checks the directory batch runner and its journal against mock_server
+ *
+ * Builds without Win32 (see build.sh); run from the repository root. Runs a
+ * Text->Text filter over a temporary directory tree and checks that every
+ * text file gets its reply at the mirrored path and a binary file is left
+ * out, that a second run resumes everything from the journal without a
+ * request, that a run cancelled part-way is finished by the next one without
+ * redoing recorded items, and that the per-provider limit bounds the requests
+ * in flight. Exits non-zero if any check fails.
+ */
+
+#include "mock_process.h"
+
+#include "../src/batch_runner.h"
+#include "../src/filter_config.h"
+#include "../src/filter_engine.h"
+#include "../src/utf8.h"
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr int kFiles = 12;
+constexpr int kLatencyMs = 100;
+const string kPrompt = "Repeat the text.";
+
+string InputText(int i) { return "batch item " + to_string(i); }
+
+fs::path InputPath(int i) { return fs::path(i % 2 ? "odd" : "even") / ("item" + to_string(i) + ".txt"); }
+
+string ReadAll(const fs::path& p) {
+    ifstream in(p, ios::binary);
+    stringstream ss;
+    ss << in.rdbuf();
+    return ss.str();
+}
+
+void WriteAll(const fs::path& p, const string& bytes) {
+    fs::create_directories(p.parent_path());
+    ofstream(p, ios::binary) << bytes;
+}
+
+// Files whose reply echoes the filter prompt and their text, by the mock's "[model] prompt" rule
+int MatchingOutputs(const fs::path& outputDir) {
+    int n = 0;
+    for (int i = 0; i < kFiles; ++i) {
+        fs::path out = outputDir / InputPath(i);
+        out.replace_extension(".txt");
+        n += ReadAll(out) == "[gpt-x] " + kPrompt + "\n\n" + InputText(i);
+    }
+    return n;
+}
+
+long long Requests(const MockProcess& mock) {
+    long long conn = 0, req = 0;
+    mock.Stats(conn, req);
+    return req;
+}
+
+}  // namespace
+
+int main() {
+    MockProcess mock({"--latency", to_string(kLatencyMs)});
+    if (!Check(mock.Ready(), "mock_server started (run from the repository root after bench/build.sh)")) return 1;
+
+    FilterEngine engine;
+    vector<ApiProvider> providers;
+    vector<wstring> errors;
+    if (!Check(LoadApiProviders("apidef", providers, errors), "apidef loaded")) return 1;
+    engine.SetProviders(move(providers));
+    engine.SetCacheEnabled(false);
+
+    ModelConfig m;
+    m.name = L"mock";
+    m.serverUrl = L"http://" + mock.Host() + L"/openai/v1";
+    m.modelName = L"gpt-x";
+    m.apiKey = L"test";
+    m.providerId = L"OpenAI";
+    FilterDefinition f{};
+    f.title = L"Echo";
+    f.input = IOType::Text;
+    f.output = IOType::Text;
+    f.prompt = Utf8ToWide(kPrompt);
+    f.cache = false;
+
+    const fs::path dir = fs::temp_directory_path() / ("cbfilter_batch_test_" + to_string(getpid()));
+    fs::remove_all(dir);
+    const fs::path input = dir / "in";
+    for (int i = 0; i < kFiles; ++i) WriteAll(input / InputPath(i), InputText(i));
+    WriteAll(input / "binary.dat", string("\x89PNG\0\0garbage", 13));
+
+    // Full run: every text file answered at its mirrored path, the binary file left out
+    BatchOptions opt;
+    opt.inputDir = input;
+    opt.outputDir = dir / "out";
+    opt.workers = 8;
+    opt.perProvider = 2;
+    BatchStats stats;
+    wstring err;
+    const long long req0 = Requests(mock);
+    Check(RunBatch(engine, f, m, {}, opt, stats, err), "batch ran: " + WideToUtf8(err));
+    Check(stats.total == kFiles + 1 && stats.completed == kFiles && stats.ignored == 1 && stats.failed == 0 && stats.resumed == 0,
+          "full run counts (completed " + to_string(stats.completed) + ", ignored " + to_string(stats.ignored) + ", failed " + to_string(stats.failed) + ")");
+    Check(MatchingOutputs(opt.outputDir) == kFiles, "every output holds its reply");
+    Check(stats.bytesIn > 0 && stats.bytesOut > stats.bytesIn && stats.tokens > 0, "throughput totals counted");
+    const long long req1 = Requests(mock);
+    Check(req1 - req0 == kFiles + 1, "one request per text file (" + to_string(req1 - req0 - 1) + ")");
+
+    // Two requests at a time, each taking kLatencyMs: the batch takes at least half the serial time
+    const double minSeconds = kFiles / 2 * kLatencyMs / 1000.0 * 0.9;
+    Check(stats.seconds >= minSeconds, "per-provider limit bounds requests in flight (" + to_string(stats.seconds) + "s)");
+
+    // Same journal again: everything resumed, nothing sent
+    Check(RunBatch(engine, f, m, {}, opt, stats, err), "resumed batch ran: " + WideToUtf8(err));
+    Check(stats.resumed == kFiles && stats.completed == 0 && stats.failed == 0, "second run resumes every item (" + to_string(stats.resumed) + ")");
+    Check(Requests(mock) - req1 == 1, "second run sends no filter request");
+
+    // Cancelled after a few items, then finished by the next run without redoing what was recorded
+    opt.outputDir = dir / "out2";
+    CancelToken cancel;
+    size_t firstRun = 0;
+    const long long req2 = Requests(mock);
+    Check(RunBatch(engine, f, m, {}, opt, stats, err, [&](const BatchItemResult& r, const BatchStats& progress) {
+        if (r.ok && progress.completed == 3) cancel.Cancel();
+    }, &cancel), "cancelled batch ran: " + WideToUtf8(err));
+    firstRun = stats.completed;
+    Check(firstRun >= 3 && firstRun < kFiles, "cancelled run stopped part-way (" + to_string(firstRun) + " done)");
+    const long long req3 = Requests(mock);
+    Check(RunBatch(engine, f, m, {}, opt, stats, err), "resuming batch ran: " + WideToUtf8(err));
+    Check(stats.resumed == firstRun && stats.completed == kFiles - firstRun && stats.failed == 0,
+          "next run resumes the recorded items and does the rest (" + to_string(stats.resumed) + " + " + to_string(stats.completed) + ")");
+    Check(Requests(mock) - req3 == static_cast<long long>(kFiles - firstRun) + 1, "recorded items not sent again");
+    Check(req3 - req2 <= static_cast<long long>(firstRun + opt.perProvider) + 1, "cancelled run stopped sending");
+    Check(MatchingOutputs(opt.outputDir) == kFiles, "every output holds its reply after resuming");
+
+    fs::remove_all(dir);
+    if (CheckFailures() != 0) return 1;
+    printf("batch_test: ok\n");
+    return 0;
+}
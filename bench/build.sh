@@ -0,0 +1,39 @@
+#!/bin/sh
+# Build the microbenchmarks, the hedging, rate-limit, clipboard prefetch and typed output simulations, the mock provider server and the self-checking tests (Linux/macOS, no Win32 required)
+set -e
+cd "$(dirname "$0")"
+${CXX:-g++} -std=c++20 -O2 -Wall -Wextra -o hotpath_bench \
+    hotpath_bench.cpp ../src/api_payload.cpp ../src/json_path.cpp ../src/base64.cpp ../src/template_render.cpp ../src/utf8.cpp
+${CXX:-g++} -std=c++20 -O2 -Wall -Wextra -pthread -o hedge_sim \
+    hedge_sim.cpp ../src/hedge.cpp ../src/cancel_token.cpp
+${CXX:-g++} -std=c++20 -O2 -Wall -Wextra -pthread -o ratelimit_sim \
+    ratelimit_sim.cpp ../src/rate_limit.cpp ../src/cancel_token.cpp ../src/trace.cpp
+${CXX:-g++} -std=c++20 -O2 -Wall -Wextra -pthread -o prefetch_sim \
+    prefetch_sim.cpp ../src/clipboard_prefetch.cpp
+${CXX:-g++} -std=c++20 -O2 -Wall -Wextra -pthread -o prefetch_test \
+    prefetch_test.cpp ../src/clipboard_prefetch.cpp
+${CXX:-g++} -std=c++20 -O2 -Wall -Wextra -pthread -o typing_sim \
+    typing_sim.cpp ../src/typed_output.cpp
+${CXX:-g++} -std=c++20 -O2 -Wall -Wextra -pthread -o typing_test \
+    typing_test.cpp ../src/typed_output.cpp ../src/hedge.cpp ../src/cancel_token.cpp
+${CXX:-g++} -std=c++20 -O2 -Wall -Wextra -o strings_bench \
+    strings_bench.cpp ../src/string_table.cpp ../src/utf8.cpp
+${CXX:-g++} -std=c++20 -O2 -Wall -Wextra -pthread -o mock_server \
+    mock_server.cpp ../src/filter_config.cpp ../src/json_value.cpp ../src/json_path.cpp ../src/template_render.cpp \
+    ../src/image_scale.cpp ../src/base64.cpp ../src/utf8.cpp ../src/usage_stats.cpp
+${CXX:-g++} -std=c++20 -O2 -Wall -Wextra -pthread -o http_reuse_test \
+    http_reuse_test.cpp ../src/http_curl.cpp ../src/json_value.cpp ../src/cancel_token.cpp ../src/trace.cpp ../src/utf8.cpp -lcurl
+${CXX:-g++} -std=c++20 -O2 -Wall -Wextra -pthread -o sse_stream_test \
+    sse_stream_test.cpp ../src/http_curl.cpp ../src/sse_parser.cpp ../src/json_path.cpp ../src/json_value.cpp ../src/cancel_token.cpp \
+    ../src/trace.cpp ../src/utf8.cpp -lcurl
+${CXX:-g++} -std=c++20 -O2 -Wall -Wextra -pthread -o batch_test \
+    batch_test.cpp ../src/batch_runner.cpp ../src/filter_engine.cpp ../src/filter_config.cpp ../src/api_payload.cpp ../src/json_value.cpp \
+    ../src/json_path.cpp ../src/template_render.cpp ../src/http_curl.cpp ../src/sse_parser.cpp ../src/image_scale.cpp ../src/base64.cpp \
+    ../src/response_cache.cpp ../src/hedge.cpp ../src/rate_limit.cpp ../src/cancel_token.cpp ../src/trace.cpp ../src/text_chunker.cpp \
+    ../src/job_queue.cpp ../src/usage_stats.cpp ../src/utf8.cpp -lcurl
+${CXX:-g++} -std=c++20 -O2 -Wall -Wextra -o base64_test \
+    base64_test.cpp ../src/base64.cpp
+${CXX:-g++} -std=c++20 -O2 -Wall -Wextra -o cache_test \
+    cache_test.cpp ../src/response_cache.cpp ../src/utf8.cpp
+${CXX:-g++} -std=c++20 -O2 -Wall -Wextra -pthread -o ratelimit_test \
+    ratelimit_test.cpp ../src/rate_limit.cpp ../src/cancel_token.cpp ../src/trace.cpp
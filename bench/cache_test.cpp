@@ -0,0 +1,166 @@
+/**
+ * @file cache_test.cpp
+ * @brief Checks that the response cache survives damaged records and compaction
+ *
+ * Builds without Win32 (see build.sh). Fills a cache file in a temporary
+ * directory, damages records on disk the ways a crash or a bad sector would
+ * (a flipped payload byte, a wiped header, a wrong size field) and checks
+ * that reopening serves every intact record and none of the damaged ones,
+ * that a record moved by compaction is checked again before it is served,
+ * and that compaction keeps the live records readable across a reopen.
+ * Exits non-zero if any check fails.
+ */
+
+#include "check.h"
+
+#include "../src/response_cache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+constexpr uint64_t kFileHeaderBytes = 64;
+constexpr uint64_t kRecordHeaderBytes = 32;
+
+CacheKey Key(int i) {
+    return CacheKeyBuilder().Add(string_view("cache_test")).Add(to_string(i)).Finish();
+}
+
+string Payload(int i, size_t size) {
+    string s;
+    while (s.size() < size) s += "entry " + to_string(i) + ";";
+    s.resize(size);
+    return s;
+}
+
+uint64_t RecordBytes(size_t size) { return kRecordHeaderBytes + ((size + 7) & ~uint64_t{7}); }
+
+bool Hit(int i, const string& expected) {
+    CachedKind kind{};
+    string payload;
+    return ResponseCache::Instance().Get(Key(i), kind, payload) && kind == CachedKind::Text && payload == expected;
+}
+
+bool Miss(int i) {
+    CachedKind kind{};
+    string payload;
+    return !ResponseCache::Instance().Get(Key(i), kind, payload);
+}
+
+void Overwrite(const filesystem::path& file, uint64_t offset, const void* data, size_t size) {
+    int fd = open(file.c_str(), O_WRONLY);
+    Check(fd >= 0 && pwrite(fd, data, size, static_cast<off_t>(offset)) == static_cast<ssize_t>(size), "damage " + file.string());
+    if (fd >= 0) close(fd);
+}
+
+// Key of the record at offset, read from the file on disk
+CacheKey KeyAt(const filesystem::path& file, uint64_t offset) {
+    char header[kRecordHeaderBytes] = {};
+    int fd = open(file.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        if (pread(fd, header, sizeof(header), static_cast<off_t>(offset)) != static_cast<ssize_t>(sizeof(header))) memset(header, 0, sizeof(header));
+        close(fd);
+    }
+    CacheKey k;
+    memcpy(&k.hi, header + 8, sizeof(k.hi));
+    memcpy(&k.lo, header + 16, sizeof(k.lo));
+    return k;
+}
+
+}  // namespace
+
+int main() {
+    const filesystem::path dir = filesystem::temp_directory_path() / ("cbfilter_cache_test_" + to_string(getpid()));
+    filesystem::create_directories(dir);
+    const filesystem::path file = dir / "cache.bin";
+    ResponseCache& cache = ResponseCache::Instance();
+
+    // Records of assorted sizes, appended in order from the file header on
+    constexpr int kCount = 50;
+    vector<string> payloads;
+    vector<uint64_t> offsets;
+    uint64_t offset = kFileHeaderBytes;
+    Check(cache.Open(file.wstring(), 64ull << 20), "open new cache");
+    for (int i = 0; i < kCount; ++i) {
+        payloads.push_back(Payload(i, 1 + static_cast<size_t>(i) * 97));
+        offsets.push_back(offset);
+        offset += RecordBytes(payloads.back().size());
+        cache.Put(Key(i), CachedKind::Text, payloads.back());
+    }
+    cache.Close();
+
+    Check(cache.Open(file.wstring(), 64ull << 20), "reopen cache");
+    int hits = 0;
+    for (int i = 0; i < kCount; ++i) hits += Hit(i, payloads[i]);
+    Check(hits == kCount, "all records served after reopen (" + to_string(hits) + ")");
+    cache.Close();
+
+    // A flipped payload byte, a wiped header and a size field pointing into the next record
+    const char flipped = '\x7f';
+    Overwrite(file, offsets[10] + kRecordHeaderBytes + payloads[10].size() / 2, &flipped, 1);
+    const char zeros[kRecordHeaderBytes] = {};
+    Overwrite(file, offsets[20], zeros, sizeof(zeros));
+    const uint32_t wrongSize = static_cast<uint32_t>(payloads[30].size() + 40);
+    Overwrite(file, offsets[30] + 4, &wrongSize, sizeof(wrongSize));
+
+    Check(cache.Open(file.wstring(), 64ull << 20), "reopen damaged cache");
+    for (int i : {10, 20, 30}) Check(Miss(i), "damaged record " + to_string(i) + " not served");
+    hits = 0;
+    for (int i = 0; i < kCount; ++i) {
+        if (i != 10 && i != 20 && i != 30) hits += Hit(i, payloads[i]);
+    }
+    Check(hits == kCount - 3, "records after the damaged ones still served (" + to_string(hits) + " of " + to_string(kCount - 3) + ")");
+
+    cache.Close();
+
+    // A record moved by compaction is checked again on its first read: a dead record, then
+    // the record under test, then replacements of one key until compaction moves it to the front
+    filesystem::remove(file);
+    constexpr size_t kMovedBytes = 8 << 10;
+    Check(cache.Open(file.wstring(), 64ull << 20), "open cache for compaction");
+    cache.Put(Key(2000), CachedKind::Text, Payload(2000, kMovedBytes));
+    const string moved = Payload(2001, kMovedBytes);
+    cache.Put(Key(2001), CachedKind::Text, moved);
+    for (int i = 0; i < 200; ++i) cache.Put(Key(2000), CachedKind::Text, Payload(2000 + i, kMovedBytes));
+    Check(KeyAt(file, kFileHeaderBytes) == Key(2001), "compaction moved the record to the front");
+    Overwrite(file, kFileHeaderBytes + kRecordHeaderBytes + kMovedBytes / 2, &flipped, 1);
+    Check(Miss(2001), "record damaged after compaction moved it not served");
+    Check(Hit(2000, Payload(2199, kMovedBytes)), "record written after compaction still served");
+    cache.Close();
+
+    // Evictions past half the file trigger compaction into a new file
+    filesystem::remove(file);
+    constexpr int kMany = 600;
+    constexpr size_t kManyBytes = 8 << 10;
+    Check(cache.Open(file.wstring(), 256 << 10), "open small cache");
+    for (int i = 0; i < kMany; ++i) cache.Put(Key(1000 + i), CachedKind::Text, Payload(1000 + i, kManyBytes));
+    const size_t entries = cache.Stats().entries;
+    Check(entries > 0 && entries < static_cast<size_t>(kMany), "small cache evicted (" + to_string(entries) + " entries)");
+    Check(!filesystem::exists(file.string() + ".tmp"), "no compaction file left behind");
+    cache.Close();
+    Check(filesystem::file_size(file) < (1u << 20), "compaction shrank the file (" + to_string(filesystem::file_size(file)) + " bytes)");
+
+    Check(cache.Open(file.wstring(), 256 << 10), "reopen compacted cache");
+    Check(cache.Stats().entries == entries, "compacted cache reopened with every entry");
+    hits = 0;
+    for (int i = kMany - static_cast<int>(entries); i < kMany; ++i) hits += Hit(1000 + i, Payload(1000 + i, kManyBytes));
+    Check(static_cast<size_t>(hits) == entries, "most recent records served after compaction (" + to_string(hits) + ")");
+    cache.Close();
+
+    filesystem::remove_all(dir);
+    if (CheckFailures() != 0) {
+        fprintf(stderr, "cache_test: %d checks failed\n", CheckFailures());
+        return 1;
+    }
+    printf("cache_test: ok\n");
+    return 0;
+}
@@ -0,0 +1,29 @@
+/**
+ * @file check.h
+ * @brief Failure reporting shared by the self-checking tests
+ *
+ * Each test calls Check for every expectation and exits non-zero if
+ * CheckFailures() is not 0 at the end. Only the first failures are printed,
+ * so a check inside a loop does not flood the output.
+ */
+
+#pragma once
+
+#include <cstdio>
+#include <string>
+
+/**
+ * @brief Failure counter shared by the checks of one test executable
+ */
+inline int& CheckFailures() {
+    static int failures = 0;
+    return failures;
+}
+
+/**
+ * @brief Report a failed check (the test exits non-zero if any failed)
+ */
+inline bool Check(bool ok, const std::string& what) {
+    if (!ok && ++CheckFailures() <= 20) fprintf(stderr, "FAIL: %s\n", what.c_str());
+    return ok;
+}
@@ -0,0 +1,285 @@
+/**
+ * @file hotpath_bench.cpp
+ * @brief Microbenchmarks for the request/response hot path
+ *
+ * Builds without Win32 (see build.sh). Every case reports throughput over its
+ * input size and the number of heap allocations per call, counted by the
+ * replaced global operator new. Compare a run against baseline.txt to spot
+ * regressions:
+ *
+ *     ./build.sh && ./hotpath_bench > current.txt && diff baseline.txt current.txt
+ *
+ * Pass a substring as the first argument to run only the matching cases.
+ */
+
+#include "../src/api_payload.h"
+#include "../src/base64.h"
+#include "../src/json_path.h"
+#include "../src/template_render.h"
+#include "../src/utf8.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <new>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+atomic<uint64_t> g_allocations{0};
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+// GCC cannot see that the replaced new and delete below are a matching pair
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void* operator new(size_t size) {
+    g_allocations.fetch_add(1, memory_order_relaxed);
+    if (void* p = malloc(size ? size : 1)) return p;
+    throw bad_alloc();
+}
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+namespace {
+constexpr double kMinSeconds = 0.3;  // Run each case at least this long
+constexpr int kMinIterations = 3;
+
+// Keeps results alive so the optimizer cannot drop the calls
+volatile size_t g_sink;
+
+struct Size {
+    const char* label;
+    size_t bytes;
+};
+
+constexpr Size kTextSizes[] = {{"1KB", 1 << 10}, {"64KB", 64 << 10}, {"1MB", 1 << 20}};
+constexpr Size kImageSizes[] = {{"64KB", 64 << 10}, {"1MB", 1 << 20}, {"20MB", 20 << 20}};
+
+/**
+ * @brief Time fn until kMinSeconds have passed and print one result line
+ * @param filter Only run when name contains this substring (nullptr runs all)
+ * @param name Case name
+ * @param size Size label
+ * @param bytes Bytes processed per call (throughput base)
+ * @param fn Returns a value derived from the result
+ */
+void Run(const char* filter, const char* name, const char* size, size_t bytes, const function<size_t()>& fn) {
+    if (filter && !strstr(name, filter)) return;
+    g_sink = fn();  // Warm-up
+    uint64_t allocsBefore = g_allocations.load();
+    int iterations = 0;
+    auto start = chrono::steady_clock::now();
+    double elapsed = 0;
+    do {
+        g_sink = fn();
+        ++iterations;
+        elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    } while (elapsed < kMinSeconds || iterations < kMinIterations);
+    double allocs = static_cast<double>(g_allocations.load() - allocsBefore) / iterations;
+    double mbps = static_cast<double>(bytes) * iterations / elapsed / (1024.0 * 1024.0);
+    printf("%-30s %-6s %12.1f MB/s %12.0f ns/call %8.1f allocs/call\n", name, size, mbps, elapsed * 1e9 / iterations, allocs);
+    fflush(stdout);
+}
+
+/**
+ * @brief UTF-8 prose with the characters JsonEscape has to rewrite and some multibyte text
+ */
+string MakeText(size_t bytes) {
+    static const string kSentence = WideToUtf8(L"The quick brown fox said \"hello\" to the lazy dog.\n\tNext line \\ backslash, café 日本語. ");
+    string s;
+    s.reserve(bytes + kSentence.size());
+    while (s.size() < bytes) s += kSentence;
+    return s;
+}
+
+/**
+ * @brief Base64 of pseudo-random bytes, as an image payload would look
+ */
+string MakeImageBase64(size_t bytes) {
+    vector<uint8_t> raw(bytes);
+    uint32_t x = 2463534242u;
+    for (auto& b : raw) { x ^= x << 13; x ^= x >> 17; x ^= x << 5; b = static_cast<uint8_t>(x); }
+    return Base64Encode(raw.data(), raw.size());
+}
+
+const wchar_t kChatPayload[] =
+    L"{\"model\":\"<<model>>\",\"messages\":[{\"role\":\"developer\",\"content\":\"<<system_prompt>>\"},"
+    L"{\"role\":\"user\",\"content\":\"<<prompt>>\"}]}";
+
+const wchar_t kImagePayload[] =
+    L"{\"model\":\"<<model>>\",\"messages\":[{\"role\":\"developer\",\"content\":\"<<system_prompt>>\"},"
+    L"{\"role\":\"user\",\"content\":[{\"type\":\"text\",\"text\":\"<<prompt>>\"},"
+    L"{\"type\":\"image_url\",\"image_url\":{\"url\":\"<<image_url>>\"}}]}]}";
+
+/**
+ * @brief Placeholder substitution as the request path did it before compiled templates
+ *
+ * One full ReplaceAll pass over the wide template per placeholder, escaping
+ * every value character by character, then the conversion to UTF-8 for the
+ * request body. Kept as the baseline Render is measured against.
+ */
+namespace legacy {
+wstring ReplaceAll(wstring s, const wstring& from, const wstring& to) {
+    size_t pos = 0;
+    while ((pos = s.find(from, pos)) != wstring::npos) {
+        s.replace(pos, from.length(), to);
+        pos += to.length();
+    }
+    return s;
+}
+
+wstring JsonEscape(const wstring& s) {
+    wstring out;
+    for (wchar_t c : s) {
+        switch (c) {
+        case L'\\': out += L"\\\\"; break;
+        case L'"': out += L"\\\""; break;
+        case L'\n': out += L"\\n"; break;
+        case L'\r': out += L"\\r"; break;
+        case L'\t': out += L"\\t"; break;
+        default: out += c; break;
+        }
+    }
+    return out;
+}
+
+string ReplacePlaceholders(const wstring& src, const wstring& model, const wstring& apiKey, const wstring& systemPrompt, const wstring& prompt, const wstring& imageB64, const wstring& imageDataUrl) {
+    wstring out = src;
+    out = ReplaceAll(out, L"<<model>>", JsonEscape(model));
+    out = ReplaceAll(out, L"<<system_prompt>>", JsonEscape(systemPrompt));
+    out = ReplaceAll(out, L"<<prompt>>", JsonEscape(prompt));
+    out = ReplaceAll(out, L"<<input_text>>", JsonEscape(prompt));
+    out = ReplaceAll(out, L"<<api_key>>", JsonEscape(apiKey));
+    out = ReplaceAll(out, L"<<image_url>>", JsonEscape(imageDataUrl));
+    out = ReplaceAll(out, L"<<image>>", JsonEscape(imageB64));
+    return WideToUtf8(out);
+}
+} // namespace legacy
+
+string ChatResponse(const string& escapedContent) {
+    return "{\"id\":\"chatcmpl-1\",\"object\":\"chat.completion\",\"choices\":[{\"index\":0,\"message\":"
+           "{\"role\":\"assistant\",\"content\":\"" + escapedContent + "\"},\"finish_reason\":\"stop\"}],"
+           "\"usage\":{\"prompt_tokens\":10,\"completion_tokens\":20}}";
+}
+} // namespace
+
+int main(int argc, char** argv) {
+    const char* filter = argc > 1 ? argv[1] : nullptr;
+    printf("# base64 implementation: %s\n", Base64Implementation());
+
+    const CompiledTemplate chatTpl = CompiledTemplate::Compile(kChatPayload);
+    const CompiledTemplate imageTpl = CompiledTemplate::Compile(kImagePayload);
+    const string model = "gpt-4o-mini", system = "You are a helpful assistant.";
+
+    for (const Size& sz : kTextSizes) {
+        const string text = MakeText(sz.bytes);
+        const wstring wide = Utf8ToWide(text);
+        Run(filter, "WideToUtf8", sz.label, text.size(), [&] { return WideToUtf8(wide).size(); });
+        Run(filter, "Utf8ToWide", sz.label, text.size(), [&] { return Utf8ToWide(text).size(); });
+        Run(filter, "JsonEscape", sz.label, text.size(), [&] { return JsonEscape(text).size(); });
+        Run(filter, "Render/text", sz.label, text.size(), [&] {
+            PlaceholderValues v;
+            v[Placeholder::Model] = model;
+            v[Placeholder::SystemPrompt] = system;
+            v[Placeholder::Prompt] = text;
+            return chatTpl.Render(v, true).size();
+        });
+        const string response = ChatResponse(JsonEscape(text));
+        Run(filter, "ExtractContent", sz.label, response.size(), [&] { return ExtractContent(response).size(); });
+        Run(filter, "ExtractByPath/text", sz.label, response.size(), [&] { return ExtractByPath(response, L"choices[0].message.content").size(); });
+    }
+
+    for (const Size& sz : kImageSizes) {
+        const string b64 = MakeImageBase64(sz.bytes);
+        const string dataUrl = "data:image/png;base64," + b64;
+        vector<uint8_t> raw;
+        Base64Decode(string_view(b64), raw);
+
+        Run(filter, "Base64Encode", sz.label, raw.size(), [&] { return Base64Encode(raw.data(), raw.size()).size(); });
+        Run(filter, "Base64Decode", sz.label, raw.size(), [&] {
+            vector<uint8_t> out;
+            Base64Decode(string_view(b64), out);
+            return out.size();
+        });
+        Run(filter, "Render/image", sz.label, dataUrl.size(), [&] {
+            PlaceholderValues v;
+            v[Placeholder::Model] = model;
+            v[Placeholder::SystemPrompt] = system;
+            v[Placeholder::Prompt] = "Describe this image.";
+            v[Placeholder::ImageUrl] = dataUrl;
+            return imageTpl.Render(v, true).size();
+        });
+        Run(filter, "BuildMultipartBody", sz.label, raw.size(), [&] {
+            return BuildMultipartBody("----cbfilterBoundary", model, "Make it brighter", b64, "image/png").size();
+        });
+
+        const string b64Response = "{\"created\":1,\"data\":[{\"b64_json\":\"" + b64 + "\"}]}";
+        Run(filter, "ExtractB64Image", sz.label, b64Response.size(), [&] { return ExtractB64Image(b64Response).size(); });
+        const string chatImage = "{\"choices\":[{\"message\":{\"role\":\"assistant\",\"content\":\"\",\"images\":[{\"type\":\"image_url\","
+                                 "\"image_url\":{\"url\":\"" + dataUrl + "\"}}]}}]}";
+        Run(filter, "ExtractImageFromChatResponse", sz.label, chatImage.size(), [&] { return ExtractImageFromChatResponse(chatImage).size(); });
+        const string gemini = "{\"candidates\":[{\"content\":{\"role\":\"model\",\"parts\":[{\"text\":\"Here you go\"},"
+                              "{\"inlineData\":{\"mimeType\":\"image/png\",\"data\":\"" + b64 + "\"}}]},\"finishReason\":\"STOP\"}]}";
+        const JsonPath geminiPath = JsonPath::Compile(L"candidates[0].content.parts[1].inlineData.data");
+        Run(filter, "ExtractByPath/image", sz.label, gemini.size(), [&] { return ExtractByPath(gemini, L"candidates[0].content.parts[1].inlineData.data").size(); });
+        Run(filter, "JsonPath/image", sz.label, gemini.size(), [&] {
+            string out;
+            geminiPath.Extract(gemini, out);
+            return out.size();
+        });
+        Run(filter, "JsonPath/skip", sz.label, gemini.size(), [&] {
+            // The image is skipped on the way to a member that follows it
+            static const JsonPath finish = JsonPath::Compile(L"candidates[0].finishReason");
+            string out;
+            finish.Extract(gemini, out);
+            return out.size();
+        });
+        Run(filter, "JsonPath/many", sz.label, b64Response.size(), [&] {
+            // The result and the usage counts of an image response in one pass
+            static const JsonPath result = JsonPath::Compile(L"data[0].b64_json"), input = JsonPath::Compile(L"usage.input_tokens"),
+                                  output = JsonPath::Compile(L"usage.output_tokens"), cached = JsonPath::Compile(L"usage.input_tokens_details.cached_tokens");
+            vector<string> outs;
+            JsonPath::ExtractMany(b64Response, {&result, &input, &output, &cached}, outs);
+            return outs[0].size();
+        });
+    }
+
+    {
+        // The old and the compiled path on the same 10 MB image request
+        const string dataUrl = "data:image/png;base64," + MakeImageBase64(10 << 20);
+        const wstring wideUrl = Utf8ToWide(dataUrl);
+        const wstring wideModel = Utf8ToWide(model), wideSystem = Utf8ToWide(system), widePrompt = L"Describe this image.";
+        PlaceholderValues v;
+        v[Placeholder::Model] = model;
+        v[Placeholder::SystemPrompt] = system;
+        v[Placeholder::Prompt] = "Describe this image.";
+        v[Placeholder::ImageUrl] = dataUrl;
+        if (legacy::ReplacePlaceholders(kImagePayload, wideModel, L"", wideSystem, widePrompt, L"", wideUrl) != imageTpl.Render(v, true)) {
+            fprintf(stderr, "ReplacePlaceholders and Render disagree\n");
+            return 1;
+        }
+        Run(filter, "ReplacePlaceholders/legacy", "10MB", dataUrl.size(), [&] {
+            return legacy::ReplacePlaceholders(kImagePayload, wideModel, L"", wideSystem, widePrompt, L"", wideUrl).size();
+        });
+        Run(filter, "Render/template", "10MB", dataUrl.size(), [&] { return imageTpl.Render(v, true).size(); });
+    }
+
+    const wstring server = L"https://generativelanguage.googleapis.com/v1beta";
+    const wstring endpoint = L"/models/gemini-2.0-flash:generateContent?key=XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX";
+    Run(filter, "PrepareEndpoint", "url", (server.size() + endpoint.size()) * sizeof(wchar_t), [&] {
+        wstring host, path;
+        bool https = true;
+        PrepareEndpoint(server, endpoint, host, path, https);
+        return host.size() + path.size();
+    });
+    return 0;
+}
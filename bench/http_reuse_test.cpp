@@ -0,0 +1,80 @@
+/**
+ * @file http_reuse_test.cpp
+ * @brief Checks keep-alive connection reuse of the portable HTTP client against mock_server
+ *
+ * Builds without Win32 (see build.sh); run from the repository root. Sends
+ * requests in sequence on one thread and in parallel on several, and asks
+ * the server how many connections it accepted: one per thread, however many
+ * requests each sends. Exits non-zero if any check fails.
+ */
+
+#include "mock_process.h"
+
+#include "../src/http_request.h"
+#include "../src/json_value.h"
+#include "../src/utf8.h"
+
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+constexpr int kRequests = 20;
+constexpr int kThreads = 4;
+
+// A Text-Text request of the OpenAI template
+bool Complete(const MockProcess& mock, const string& prompt) {
+    const string body = "{\"model\":\"gpt-x\",\"messages\":[{\"role\":\"developer\",\"content\":\"\"},{\"role\":\"user\",\"content\":\"" + prompt + "\"}]}";
+    wstring err;
+    const string raw = HttpRequestWithHeaders(mock.Host(), L"/openai/v1/chat/completions", false, L"Content-Type: application/json\r\n", body, L"POST", &err);
+    JsonValue v;
+    if (!err.empty() || !JsonValue::Parse(raw, v)) {
+        fprintf(stderr, "request failed: %s\n", WideToUtf8(err).c_str());
+        return false;
+    }
+    return v.HasKey("choices");
+}
+
+}  // namespace
+
+int main() {
+    MockProcess mock;
+    if (!Check(mock.Ready(), "mock_server started (run from the repository root after bench/build.sh)")) return 1;
+
+    long long conn0 = 0, req0 = 0;
+    mock.Stats(conn0, req0);
+    Check(conn0 >= 1 && req0 == 1, "stats query answered");
+
+    int ok = 0;
+    for (int i = 0; i < kRequests; ++i) ok += Complete(mock, "sequential " + to_string(i));
+    Check(ok == kRequests, "sequential requests succeeded");
+
+    long long conn1 = 0, req1 = 0;
+    mock.Stats(conn1, req1);
+    Check(req1 == req0 + kRequests + 1, "server saw every sequential request");
+    Check(conn1 == conn0, "sequential requests reused the connection (" + to_string(conn1 - conn0) + " new)");
+
+    // Each worker thread has a connection of its own, kept across its requests
+    vector<int> okPerThread(kThreads);
+    vector<thread> workers;
+    for (int t = 0; t < kThreads; ++t) {
+        workers.emplace_back([&, t] {
+            for (int i = 0; i < kRequests; ++i) okPerThread[t] += Complete(mock, "thread " + to_string(t) + " " + to_string(i));
+        });
+    }
+    for (thread& w : workers) w.join();
+    for (int t = 0; t < kThreads; ++t) Check(okPerThread[t] == kRequests, "requests of thread " + to_string(t) + " succeeded");
+
+    long long conn2 = 0, req2 = 0;
+    mock.Stats(conn2, req2);
+    Check(req2 == req1 + kThreads * kRequests + 1, "server saw every parallel request");
+    Check(conn2 - conn1 == kThreads, "parallel requests opened one connection per thread (" + to_string(conn2 - conn1) + " new)");
+
+    if (CheckFailures() != 0) return 1;
+    printf("http_reuse_test: %d requests over %lld connections, ok\n", static_cast<int>(req2), conn2);
+    return 0;
+}
@@ -0,0 +1,124 @@
+/**
+ * @file mock_process.h
+ * @brief Runs bench/mock_server as a child process for the self-checking tests
+ *
+ * The server is started from the directory of the test executable on a free
+ * port, with the apidef directory of the working directory (run the tests
+ * from the repository root), and stopped when the MockProcess goes away.
+ */
+
+#pragma once
+
+#include "check.h"
+
+#include "../src/http_request.h"
+#include "../src/json_value.h"
+
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <csignal>
+#include <netinet/in.h>
+#include <spawn.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char** environ;
+
+/**
+ * @class MockProcess
+ * @brief bench/mock_server running on a local port
+ */
+class MockProcess {
+public:
+    explicit MockProcess(std::vector<std::string> args = {}) {
+        port_ = FreePort();
+        if (port_ <= 0) return;
+        const std::string server = (std::filesystem::read_symlink("/proc/self/exe").parent_path() / "mock_server").string();
+        args.insert(args.begin(), {server, "-p", std::to_string(port_), "--latency", "0", "--chunk-ms", "0"});
+        std::vector<char*> argv;
+        for (std::string& a : args) argv.push_back(a.data());
+        argv.push_back(nullptr);
+        if (posix_spawn(&pid_, server.c_str(), nullptr, nullptr, argv.data(), environ) != 0) {
+            pid_ = 0;
+            return;
+        }
+        // Up once it accepts connections; gone if it could not load apidef or bind
+        for (int i = 0; i < 500 && !ready_; ++i) {
+            int status = 0;
+            if (waitpid(pid_, &status, WNOHANG) == pid_) { pid_ = 0; return; }
+            ready_ = CanConnect();
+            if (!ready_) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+    }
+
+    ~MockProcess() {
+        if (pid_ <= 0) return;
+        kill(pid_, SIGTERM);
+        int status = 0;
+        waitpid(pid_, &status, 0);
+    }
+
+    MockProcess(const MockProcess&) = delete;
+    MockProcess& operator=(const MockProcess&) = delete;
+
+    bool Ready() const { return ready_; }
+
+    /**
+     * @brief Host part of the server's URLs ("127.0.0.1:PORT")
+     */
+    std::wstring Host() const { return L"127.0.0.1:" + std::to_wstring(port_); }
+
+    /**
+     * @brief Connections the server accepted and requests it served (-1 if unavailable)
+     *
+     * The query is itself a request, sent over the calling thread's connection.
+     */
+    void Stats(long long& connections, long long& requests) const {
+        connections = requests = -1;
+        std::wstring err;
+        const std::string body = HttpRequestWithHeaders(Host(), L"/_mock/stats", false, L"", "", L"GET", &err);
+        JsonValue v;
+        if (!JsonValue::Parse(body, v)) return;
+        connections = static_cast<long long>(v.GetNamedNumber("connections", -1));
+        requests = static_cast<long long>(v.GetNamedNumber("requests", -1));
+    }
+
+private:
+    static int FreePort() {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0) return -1;
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t len = sizeof(addr);
+        int port = -1;
+        if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0 && getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &len) == 0) {
+            port = ntohs(addr.sin_port);
+        }
+        close(fd);
+        return port;
+    }
+
+    bool CanConnect() const {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0) return false;
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(static_cast<uint16_t>(port_));
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        const bool ok = connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0;
+        close(fd);
+        return ok;
+    }
+
+    int port_{};
+    pid_t pid_{};
+    bool ready_{};
+};
@@ -0,0 +1,922 @@
+/**
+ * @file mock_server.cpp
+ * @brief Stand-in API provider for offline load, latency and failure tests
+ *
+ * Builds without Win32 (see build.sh). Serves every provider of the apidef
+ * directory over plain HTTP on one port, below a path prefix named after the
+ * provider, so a model's serverUrl becomes e.g.
+ *
+ *     http://127.0.0.1:18080/openai/v1
+ *     http://127.0.0.1:18080/gemini/v1beta
+ *     http://127.0.0.1:18080/openrouter/api/v1
+ *
+ * A request is matched to the template it was rendered from by its endpoint
+ * and the shape of its JSON body (every key of the template's payload must
+ * be present and literal values must agree), then answered in the shape of
+ * that template's result path, or its stream result path as SSE events. Any
+ * provider an apidef file describes is therefore mocked with no code here.
+ *
+ * The reply echoes the prompt (or is --words long) so that tests can check
+ * it; image results are uncompressed PNGs of --image-size, which makes
+ * large payloads easy to produce. The time to first byte is drawn from a
+ * latency distribution, optionally per model, and 429s, 500s and bodies cut
+ * off mid-way are injected at the given rates:
+ *
+ *     bench/mock_server --latency lognormal:400:0.5 --latency mock-slow=fixed:3000 --429-rate 0.1 -v
+ *
+ * Pass --seed to vary the random draws (the same seed and request order
+ * reproduce a run). GET /_mock/stats returns the connections accepted and
+ * requests served so far, for tests of connection reuse.
+ *
+ * Replies report token usage where the template's usage paths say (a
+ * quarter of the bytes per token; a prompt sent before is reported as
+ * cached), streams in a last frame of their own.
+ *
+ * --sse (or an X-Mock-SSE request header) frames streams the ways real
+ * servers do and naive parsers trip over: events cut into tiny chunks
+ * mid-line, data split over several "data:" lines, CRLF line ends, and a
+ * last event without its terminating blank line.
+ */
+
+#include "../src/base64.h"
+#include "../src/filter_config.h"
+#include "../src/image_scale.h"
+#include "../src/json_value.h"
+#include "../src/utf8.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <regex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+constexpr size_t kMaxHeaderBytes = 64 << 10;
+constexpr size_t kMaxBodyBytes = size_t(512) << 20;
+
+/**
+ * @struct LatencyModel
+ * @brief Distribution of the time to first byte in milliseconds
+ */
+struct LatencyModel {
+    enum class Kind { Fixed, Uniform, Normal, LogNormal };
+    Kind kind{Kind::Fixed};
+    double a{};   // fixed: ms; uniform: min; normal: mean; lognormal: median
+    double b{};   // uniform: max; normal: standard deviation; lognormal: sigma
+
+    double Draw(mt19937& rng) const {
+        switch (kind) {
+        case Kind::Uniform: return uniform_real_distribution<double>(a, b)(rng);
+        case Kind::Normal: return (std::max)(0.0, normal_distribution<double>(a, b)(rng));
+        case Kind::LogNormal: return lognormal_distribution<double>(log((std::max)(a, 1e-3)), b)(rng);
+        default: return a;
+        }
+    }
+};
+
+/**
+ * @brief Parse "MS", "fixed:MS", "uniform:MIN:MAX", "normal:MEAN:SD" or "lognormal:MEDIAN:SIGMA"
+ */
+bool ParseLatency(const string& spec, LatencyModel& out) {
+    vector<double> nums;
+    string kind = spec;
+    if (size_t colon = spec.find(':'); colon != string::npos) {
+        kind = spec.substr(0, colon);
+        for (size_t pos = colon + 1; pos <= spec.size();) {
+            size_t next = spec.find(':', pos);
+            if (next == string::npos) next = spec.size();
+            char* end = nullptr;
+            const string num = spec.substr(pos, next - pos);
+            nums.push_back(strtod(num.c_str(), &end));
+            if (num.empty() || *end) return false;
+            pos = next + 1;
+        }
+    } else {
+        char* end = nullptr;
+        out = LatencyModel{LatencyModel::Kind::Fixed, strtod(spec.c_str(), &end), 0};
+        return !spec.empty() && !*end && out.a >= 0;
+    }
+    if (kind == "fixed" && nums.size() == 1) out = {LatencyModel::Kind::Fixed, nums[0], 0};
+    else if (kind == "uniform" && nums.size() == 2 && nums[0] <= nums[1]) out = {LatencyModel::Kind::Uniform, nums[0], nums[1]};
+    else if (kind == "normal" && nums.size() == 2) out = {LatencyModel::Kind::Normal, nums[0], nums[1]};
+    else if (kind == "lognormal" && nums.size() == 2) out = {LatencyModel::Kind::LogNormal, nums[0], nums[1]};
+    else return false;
+    return out.a >= 0 && out.b >= 0;
+}
+
+/**
+ * @struct SseFraming
+ * @brief How streamed events are framed on the wire
+ */
+struct SseFraming {
+    bool split{};      // Send every event in 5-byte chunks, cutting lines and "data:" fields
+    bool multiline{};  // Spread the data of an event over two "data:" lines
+    bool crlf{};       // End lines with CRLF instead of LF
+    bool noFinal{};    // Leave out the blank line after the last event
+};
+
+/**
+ * @brief Parse a comma-separated list of split, multiline, crlf and nofinal
+ */
+bool ParseSseFraming(const string& list, SseFraming& out) {
+    out = {};
+    for (size_t pos = 0; pos < list.size();) {
+        size_t comma = list.find(',', pos);
+        if (comma == string::npos) comma = list.size();
+        const string mode = list.substr(pos, comma - pos);
+        if (mode == "split") out.split = true;
+        else if (mode == "multiline") out.multiline = true;
+        else if (mode == "crlf") out.crlf = true;
+        else if (mode == "nofinal") out.noFinal = true;
+        else if (!mode.empty()) return false;
+        pos = comma + 1;
+    }
+    return true;
+}
+
+/**
+ * @struct MockOptions
+ * @brief Command line settings
+ */
+struct MockOptions {
+    string bind{"127.0.0.1"};
+    int port{18080};
+    string apidef{"apidef"};
+    LatencyModel latency{LatencyModel::Kind::Fixed, 50, 0};
+    map<string, LatencyModel> modelLatency;  // Overrides by model name
+    double stallRate{};       // Probability of adding stallMs to the time to first byte
+    double stallMs{};
+    int chunkMs{30};          // Delay between SSE events
+    SseFraming sse;
+    size_t words{};           // Reply length in words (0 = echo the prompt)
+    double rate429{};
+    double rate500{};
+    double truncateRate{};
+    int retryAfter{1};        // Retry-After of injected 429s, seconds
+    int imageWidth{256};
+    int imageHeight{256};
+    vector<string> models{"mock-fast", "mock-slow"};
+    unsigned seed{1};
+    bool verbose{};
+};
+
+void PrintUsage(FILE* out) {
+    fputs(
+        "usage: mock_server [options]\n"
+        "\n"
+        "  -p, --port N              Port (default 18080)\n"
+        "      --bind ADDR           Address to listen on (default 127.0.0.1)\n"
+        "  -a, --apidef DIR          API definitions to mock (default apidef)\n"
+        "      --latency [MODEL=]SPEC  Time to first byte: MS, fixed:MS, uniform:MIN:MAX,\n"
+        "                            normal:MEAN:SD or lognormal:MEDIAN:SIGMA (default 50)\n"
+        "      --stall P:MS          Add MS to a fraction P of requests\n"
+        "      --chunk-ms N          Delay between streamed events (default 30)\n"
+        "      --sse MODE,...        Frame streams with split (tiny chunks), multiline (two\n"
+        "                            data: lines per event), crlf and/or nofinal (no blank\n"
+        "                            line after the last event); X-Mock-SSE overrides it\n"
+        "      --words N             Reply with N words instead of echoing the prompt\n"
+        "      --429-rate P          Answer a fraction P with 429 and Retry-After\n"
+        "      --retry-after S       Retry-After of injected 429s (default 1)\n"
+        "      --500-rate P          Answer a fraction P with 500\n"
+        "      --truncate-rate P     Cut off a fraction P of bodies and streams half-way\n"
+        "      --image-size WxH      Size of generated images (default 256x256)\n"
+        "      --models A,B,...      Names returned by the models endpoint\n"
+        "      --seed N              Random seed (default 1)\n"
+        "  -v, --verbose             Log every request\n", out);
+}
+
+bool ParseRate(const char* v, double& out) {
+    char* end = nullptr;
+    out = strtod(v, &end);
+    return *v && !*end && out >= 0 && out <= 1;
+}
+
+bool ParseArgs(int argc, char** argv, MockOptions& opt) {
+    for (int i = 1; i < argc; ++i) {
+        const string a = argv[i];
+        auto value = [&]() -> const char* {
+            if (i + 1 >= argc) { fprintf(stderr, "mock_server: %s needs a value\n", a.c_str()); return nullptr; }
+            return argv[++i];
+        };
+        const char* v = nullptr;
+        auto bad = [&] { fprintf(stderr, "mock_server: invalid %s %s\n", a.c_str(), v ? v : ""); return false; };
+        if (a == "-h" || a == "--help") { PrintUsage(stdout); exit(0); }
+        if (a == "-v" || a == "--verbose") { opt.verbose = true; continue; }
+        if (!(v = value())) return false;
+        if (a == "-p" || a == "--port") { opt.port = atoi(v); if (opt.port <= 0 || opt.port > 65535) return bad(); }
+        else if (a == "--bind") opt.bind = v;
+        else if (a == "-a" || a == "--apidef") opt.apidef = v;
+        else if (a == "--latency") {
+            string spec = v;
+            LatencyModel model;
+            size_t eq = spec.find('=');
+            if (!ParseLatency(eq == string::npos ? spec : spec.substr(eq + 1), model)) return bad();
+            if (eq == string::npos) opt.latency = model;
+            else opt.modelLatency[spec.substr(0, eq)] = model;
+        }
+        else if (a == "--stall") {
+            if (sscanf(v, "%lf:%lf", &opt.stallRate, &opt.stallMs) != 2 || opt.stallRate < 0 || opt.stallRate > 1 || opt.stallMs < 0) return bad();
+        }
+        else if (a == "--chunk-ms") opt.chunkMs = (std::max)(0, atoi(v));
+        else if (a == "--sse") { if (!ParseSseFraming(v, opt.sse)) return bad(); }
+        else if (a == "--words") opt.words = static_cast<size_t>(strtoul(v, nullptr, 10));
+        else if (a == "--429-rate") { if (!ParseRate(v, opt.rate429)) return bad(); }
+        else if (a == "--500-rate") { if (!ParseRate(v, opt.rate500)) return bad(); }
+        else if (a == "--truncate-rate") { if (!ParseRate(v, opt.truncateRate)) return bad(); }
+        else if (a == "--retry-after") opt.retryAfter = (std::max)(0, atoi(v));
+        else if (a == "--image-size") {
+            if (sscanf(v, "%dx%d", &opt.imageWidth, &opt.imageHeight) != 2 || opt.imageWidth <= 0 || opt.imageHeight <= 0 || opt.imageWidth > 16384 || opt.imageHeight > 16384) return bad();
+        }
+        else if (a == "--models") {
+            opt.models.clear();
+            for (string list = v; !list.empty();) {
+                size_t comma = list.find(',');
+                if (comma) opt.models.push_back(list.substr(0, comma));
+                list = comma == string::npos ? string() : list.substr(comma + 1);
+            }
+        }
+        else if (a == "--seed") opt.seed = static_cast<unsigned>(strtoul(v, nullptr, 10));
+        else { fprintf(stderr, "mock_server: unknown option %s\n", a.c_str()); return false; }
+    }
+    return true;
+}
+
+uint32_t Crc32(const uint8_t* data, size_t size, uint32_t crc = 0) {
+    static const auto table = [] {
+        array<uint32_t, 256> t{};
+        for (uint32_t n = 0; n < 256; ++n) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            t[n] = c;
+        }
+        return t;
+    }();
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i) crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+void PutBigEndian(string& out, uint32_t v) {
+    for (int shift = 24; shift >= 0; shift -= 8) out += static_cast<char>((v >> shift) & 0xFF);
+}
+
+void AppendChunk(string& png, const char* type, const string& data) {
+    PutBigEndian(png, static_cast<uint32_t>(data.size()));
+    const string typed = string(type, 4) + data;
+    png += typed;
+    PutBigEndian(png, Crc32(reinterpret_cast<const uint8_t*>(typed.data()), typed.size()));
+}
+
+/**
+ * @brief An RGB gradient as a PNG with stored (uncompressed) deflate blocks
+ *
+ * Stored blocks keep the file about width * height * 3 bytes, so the size
+ * of a test payload follows directly from the image size.
+ */
+string MakePng(int width, int height, uint8_t salt) {
+    string raw;
+    raw.reserve(static_cast<size_t>(height) * (1 + static_cast<size_t>(width) * 3));
+    for (int y = 0; y < height; ++y) {
+        raw += '\0';  // Filter: none
+        for (int x = 0; x < width; ++x) {
+            raw += static_cast<char>(x * 255 / (std::max)(1, width - 1));
+            raw += static_cast<char>(y * 255 / (std::max)(1, height - 1));
+            raw += static_cast<char>(salt);
+        }
+    }
+    string z = "\x78\x01";
+    for (size_t pos = 0; pos < raw.size() || pos == 0;) {
+        const size_t len = (std::min)(raw.size() - pos, size_t(65535));
+        const bool last = pos + len == raw.size();
+        z += static_cast<char>(last ? 1 : 0);
+        z += static_cast<char>(len & 0xFF);
+        z += static_cast<char>(len >> 8);
+        z += static_cast<char>(~len & 0xFF);
+        z += static_cast<char>((~len >> 8) & 0xFF);
+        z.append(raw, pos, len);
+        pos += len;
+        if (last) break;
+    }
+    uint32_t s1 = 1, s2 = 0;
+    for (unsigned char c : raw) { s1 = (s1 + c) % 65521; s2 = (s2 + s1) % 65521; }
+    PutBigEndian(z, (s2 << 16) | s1);
+    string ihdr;
+    PutBigEndian(ihdr, static_cast<uint32_t>(width));
+    PutBigEndian(ihdr, static_cast<uint32_t>(height));
+    ihdr += string("\x08\x02\x00\x00\x00", 5);  // 8-bit RGB
+    string png = "\x89PNG\r\n\x1a\n";
+    AppendChunk(png, "IHDR", ihdr);
+    AppendChunk(png, "IDAT", z);
+    AppendChunk(png, "IEND", "");
+    return png;
+}
+
+/**
+ * @brief Collect the leaves of a JSON document keyed by path ("a.b[0].c")
+ *
+ * Empty objects and arrays count as leaves so that their presence is checked.
+ */
+void CollectLeaves(const JsonValue& v, const string& path, map<string, const JsonValue*>& out) {
+    if (v.IsObject() && !v.Members().empty()) {
+        for (const auto& [key, child] : v.Members()) CollectLeaves(child, path.empty() ? key : path + "." + key, out);
+    } else if (v.IsArray() && !v.Items().empty()) {
+        for (size_t i = 0; i < v.Items().size(); ++i) CollectLeaves(v.Items()[i], path + "[" + to_string(i) + "]", out);
+    } else {
+        out[path] = &v;
+    }
+}
+
+/**
+ * @brief Wrap a value in the objects and arrays a result path names
+ *
+ * "choices[0].message.content" with "hi" gives {"choices":[{"message":{"content":"hi"}}]}.
+ */
+JsonValue BuildAtPath(const string& path, JsonValue leaf) {
+    vector<string> steps;  // Keys, or "[n]" for array indices
+    for (size_t pos = 0; pos < path.size();) {
+        if (path[pos] == '.') { ++pos; continue; }
+        if (path[pos] == '[') {
+            size_t close = path.find(']', pos);
+            if (close == string::npos) break;
+            steps.push_back(path.substr(pos, close - pos + 1));
+            pos = close + 1;
+            continue;
+        }
+        size_t end = path.find_first_of(".[", pos);
+        if (end == string::npos) end = path.size();
+        steps.push_back(path.substr(pos, end - pos));
+        pos = end;
+    }
+    for (auto it = steps.rbegin(); it != steps.rend(); ++it) {
+        JsonValue outer;
+        if (it->front() == '[') {
+            outer = JsonValue::Array();
+            for (long i = atol(it->c_str() + 1); i > 0; --i) outer.Append(JsonValue::Object());
+            outer.Append(move(leaf));
+        } else {
+            outer = JsonValue::Object();
+            outer.Set(*it, move(leaf));
+        }
+        leaf = move(outer);
+    }
+    return leaf;
+}
+
+/**
+ * @brief Merge the members of one JSON object into another, recursively
+ */
+void MergeInto(JsonValue& into, const JsonValue& from) {
+    if (!into.IsObject() || !from.IsObject()) { into = from; return; }
+    for (const auto& [key, value] : from.Members()) {
+        const JsonValue* old = into.Find(key);
+        if (!old) { into.Set(key, value); continue; }
+        JsonValue merged = *old;
+        MergeInto(merged, value);
+        into.Set(key, move(merged));
+    }
+}
+
+/**
+ * @brief Value of a multipart/form-data field (raw bytes), or empty
+ */
+string MultipartField(const string& body, const string& name) {
+    const string marker = "name=\"" + name + "\"";
+    size_t p = body.find(marker);
+    if (p == string::npos) return {};
+    p = body.find("\r\n\r\n", p);
+    if (p == string::npos) return {};
+    p += 4;
+    size_t end = body.find("\r\n--", p);
+    return body.substr(p, end == string::npos ? string::npos : end - p);
+}
+
+/**
+ * @struct Route
+ * @brief One way a provider can be called: a template, its streaming variant, or the models listing
+ */
+struct Route {
+    const ApiProvider* provider{};
+    const TemplateDefinition* tpl{};   // nullptr for the models listing
+    bool stream{};
+    bool doneMarker{};                 // Send "data: [DONE]" (streaming selected by a payload flag, OpenAI style)
+    regex endpoint;                    // Matches the end of the request target
+    vector<string> endpointVars;       // Placeholder names captured by endpoint, in order
+    map<string, const JsonValue*> leaves;  // Leaves of the payload template (point into payload)
+    JsonValue payload;
+    string resultPath;
+};
+
+/**
+ * @brief Compile an endpoint template ("/models/<<model>>:generateContent") into a suffix regex
+ */
+regex EndpointRegex(const string& pattern, vector<string>& vars) {
+    string re;
+    for (size_t pos = 0; pos < pattern.size();) {
+        if (pattern.compare(pos, 2, "<<") == 0) {
+            size_t close = pattern.find(">>", pos);
+            if (close != string::npos) {
+                vars.push_back(pattern.substr(pos + 2, close - pos - 2));
+                re += "(.+?)";
+                pos = close + 2;
+                continue;
+            }
+        }
+        if (strchr("\\^$.|?*+()[]{}", pattern[pos])) re += '\\';
+        re += pattern[pos++];
+    }
+    return regex(re + "$");
+}
+
+/**
+ * @struct HttpRequest
+ * @brief One parsed request
+ */
+struct HttpRequest {
+    string method;
+    string target;
+    map<string, string> headers;   // Lower-case names
+    string body;
+    bool keepAlive{true};
+};
+
+bool SendAll(int fd, string_view data) {
+    while (!data.empty()) {
+        ssize_t n = send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+        if (n <= 0) return false;
+        data.remove_prefix(static_cast<size_t>(n));
+    }
+    return true;
+}
+
+/**
+ * @brief Read one request; buffer carries bytes of the next one across keep-alive requests
+ * @return false when the connection is closed or the request is malformed
+ */
+bool ReadRequest(int fd, string& buffer, HttpRequest& req) {
+    char chunk[64 << 10];
+    size_t headerEnd;
+    while ((headerEnd = buffer.find("\r\n\r\n")) == string::npos) {
+        if (buffer.size() > kMaxHeaderBytes) return false;
+        ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+        if (n <= 0) return false;
+        buffer.append(chunk, static_cast<size_t>(n));
+    }
+    const string head = buffer.substr(0, headerEnd);
+    buffer.erase(0, headerEnd + 4);
+    req = HttpRequest{};
+    size_t lineEnd = head.find("\r\n");
+    const string requestLine = head.substr(0, lineEnd);
+    size_t sp1 = requestLine.find(' '), sp2 = requestLine.rfind(' ');
+    if (sp1 == string::npos || sp2 <= sp1) return false;
+    req.method = requestLine.substr(0, sp1);
+    req.target = requestLine.substr(sp1 + 1, sp2 - sp1 - 1);
+    for (size_t pos = lineEnd == string::npos ? head.size() : lineEnd + 2; pos < head.size();) {
+        size_t end = head.find("\r\n", pos);
+        if (end == string::npos) end = head.size();
+        const string line = head.substr(pos, end - pos);
+        pos = end + 2;
+        size_t colon = line.find(':');
+        if (colon == string::npos) continue;
+        string name = line.substr(0, colon);
+        transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return static_cast<char>(tolower(c)); });
+        size_t v = line.find_first_not_of(' ', colon + 1);
+        req.headers[name] = v == string::npos ? string() : line.substr(v);
+    }
+    if (auto it = req.headers.find("connection"); it != req.headers.end() && strcasecmp(it->second.c_str(), "close") == 0) req.keepAlive = false;
+    if (req.headers.count("transfer-encoding")) return false;  // Clients send Content-Length
+    size_t length = 0;
+    if (auto it = req.headers.find("content-length"); it != req.headers.end()) length = strtoull(it->second.c_str(), nullptr, 10);
+    if (length > kMaxBodyBytes) return false;
+    while (buffer.size() < length) {
+        ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+        if (n <= 0) return false;
+        buffer.append(chunk, static_cast<size_t>(n));
+    }
+    req.body = buffer.substr(0, length);
+    buffer.erase(0, length);
+    return true;
+}
+
+const char* StatusText(int status) {
+    switch (status) {
+    case 200: return "OK";
+    case 400: return "Bad Request";
+    case 404: return "Not Found";
+    case 429: return "Too Many Requests";
+    case 500: return "Internal Server Error";
+    default: return "Error";
+    }
+}
+
+string ErrorJson(int status, const string& message) {
+    JsonValue error = JsonValue::Object();
+    error.Set("code", JsonValue::Number(status));
+    error.Set("message", JsonValue::String(message));
+    JsonValue root = JsonValue::Object();
+    root.Set("error", move(error));
+    return root.Stringify();
+}
+
+/**
+ * @class MockServer
+ * @brief Listens, matches requests to apidef routes and answers them
+ */
+class MockServer {
+public:
+    MockServer(const MockOptions& opt, vector<ApiProvider> providers) : opt_(opt), providers_(move(providers)), rng_(opt.seed) {
+        for (const ApiProvider& p : providers_) {
+            if (!p.modelsEndpoint.empty()) AddRoute(p, nullptr, false, WideToUtf8(p.modelsEndpoint), {}, WideToUtf8(p.modelsResultPath));
+            for (const TemplateDefinition& t : p.templates) {
+                AddRoute(p, &t, false, WideToUtf8(t.endpoint), WideToUtf8(t.payload), WideToUtf8(t.resultPath));
+                if (t.stream) AddRoute(p, &t, true, WideToUtf8(t.streamEndpoint), WideToUtf8(t.streamPayload), WideToUtf8(t.streamResultPath));
+            }
+        }
+    }
+
+    bool Listen() {
+        listener_ = socket(AF_INET, SOCK_STREAM, 0);
+        if (listener_ < 0) { perror("mock_server: socket"); return false; }
+        int one = 1;
+        setsockopt(listener_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(static_cast<uint16_t>(opt_.port));
+        if (inet_pton(AF_INET, opt_.bind.c_str(), &addr.sin_addr) != 1) { fprintf(stderr, "mock_server: invalid address %s\n", opt_.bind.c_str()); return false; }
+        if (bind(listener_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) { perror("mock_server: bind"); return false; }
+        if (listen(listener_, 128) != 0) { perror("mock_server: listen"); return false; }
+        return true;
+    }
+
+    void Serve() {
+        for (const ApiProvider& p : providers_) {
+            fprintf(stderr, "mock_server: http://%s:%d/%s%s\n", opt_.bind.c_str(), opt_.port, Lower(WideToUtf8(p.id)).c_str(), PathOf(WideToUtf8(p.defaultEndpoint)).c_str());
+        }
+        for (;;) {
+            int fd = accept(listener_, nullptr, nullptr);
+            if (fd < 0) continue;
+            ++connections_;
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            thread([this, fd] { ServeConnection(fd); close(fd); }).detach();
+        }
+    }
+
+private:
+    static string Lower(string s) {
+        transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return static_cast<char>(tolower(c)); });
+        return s;
+    }
+
+    /**
+     * @brief Path part of an absolute URL ("https://host/v1" -> "/v1")
+     */
+    static string PathOf(const string& url) {
+        size_t scheme = url.find("://");
+        size_t slash = url.find('/', scheme == string::npos ? 0 : scheme + 3);
+        return slash == string::npos ? string() : url.substr(slash);
+    }
+
+    void AddRoute(const ApiProvider& p, const TemplateDefinition* t, bool stream, const string& endpoint, const string& payload, const string& resultPath) {
+        auto r = make_unique<Route>();
+        r->provider = &p;
+        r->tpl = t;
+        r->stream = stream;
+        r->doneMarker = stream && t && t->streamPayload != t->payload;
+        r->endpoint = EndpointRegex(endpoint.empty() ? "/v1/chat/completions" : endpoint, r->endpointVars);
+        r->resultPath = resultPath;
+        if (!payload.empty() && JsonValue::Parse(payload, r->payload)) CollectLeaves(r->payload, "", r->leaves);
+        routes_.push_back(move(r));
+    }
+
+    /**
+     * @brief Score how well a JSON body fits a route's payload template
+     * @return Number of template leaves found, or -1 if one is missing or a literal differs
+     */
+    static int Fit(const Route& r, const map<string, const JsonValue*>& body) {
+        int score = 0;
+        for (const auto& [path, tplValue] : r.leaves) {
+            auto it = body.find(path);
+            if (it == body.end()) return -1;
+            const bool placeholder = tplValue->IsString() && tplValue->GetUtf8().find("<<") != string::npos;
+            if (!placeholder && tplValue->Stringify() != it->second->Stringify()) return -1;
+            ++score;
+        }
+        return score;
+    }
+
+    /**
+     * @brief Value a request carries for a placeholder, taken from where the template put it
+     */
+    static string PlaceholderValue(const Route& r, const map<string, const JsonValue*>& body, const string& name) {
+        for (const auto& [path, tplValue] : r.leaves) {
+            if (!tplValue->IsString() || tplValue->GetUtf8().find("<<" + name + ">>") == string::npos) continue;
+            if (auto it = body.find(path); it != body.end() && it->second->IsString()) return it->second->GetUtf8();
+        }
+        return {};
+    }
+
+    double Random() {
+        lock_guard<mutex> lock(rngMutex_);
+        return uniform_real_distribution<double>(0, 1)(rng_);
+    }
+
+    double DrawLatency(const string& model) {
+        auto it = opt_.modelLatency.find(model);
+        const LatencyModel& lm = it == opt_.modelLatency.end() ? opt_.latency : it->second;
+        lock_guard<mutex> lock(rngMutex_);
+        double ms = lm.Draw(rng_);
+        if (opt_.stallRate > 0 && uniform_real_distribution<double>(0, 1)(rng_) < opt_.stallRate) ms += opt_.stallMs;
+        return ms;
+    }
+
+    string ReplyText(const string& model, const string& prompt, const string& image, uint64_t seq) {
+        string text;
+        if (opt_.words) {
+            static const char* kWords[] = { "lorem", "ipsum", "dolor", "sit", "amet", "consectetur", "adipiscing", "elit", "sed", "do", "eiusmod", "tempor" };
+            for (size_t i = 0; i < opt_.words; ++i) {
+                if (i) text += ' ';
+                text += kWords[(seq * 7 + i * 5 + i / 3) % size(kWords)];
+            }
+            return text;
+        }
+        text = "[" + model + "] ";
+        if (!image.empty()) {
+            ImageFormat fmt;
+            const bool known = SniffImageFormat(reinterpret_cast<const uint8_t*>(image.data()), image.size(), fmt);
+            text += (known ? WideToUtf8(ImageFormatMime(fmt)) : string("unknown")) + " image, " + to_string(image.size()) + " bytes: ";
+        }
+        return text + prompt;
+    }
+
+    /**
+     * @brief Response body for a matched route (the result value wrapped in its result path)
+     */
+    JsonValue ResultDocument(const Route& r, JsonValue value, const string& model, const JsonValue& usage = {}) {
+        const string path = r.resultPath.empty() ? "choices[0].message.content" : r.resultPath;
+        JsonValue doc = BuildAtPath(path, move(value));
+        if (doc.IsObject() && !doc.HasKey("model")) doc.Set("model", JsonValue::String(model));
+        if (!usage.IsNull()) MergeInto(doc, usage);
+        return doc;
+    }
+
+    /**
+     * @brief Usage block of a reply at the template's usage paths (null if it declares none)
+     */
+    JsonValue UsageDocument(const Route& r, const string& model, const string& prompt, uint64_t promptTokens, uint64_t completionTokens) {
+        const UsagePaths& u = r.tpl->usage;
+        JsonValue doc;
+        if (u.empty()) return doc;
+        bool seen;
+        {
+            lock_guard<mutex> lock(promptsMutex_);
+            seen = !prompts_.insert(hash<string>{}(model + '\n' + prompt)).second;
+        }
+        auto add = [&](const wstring& path, uint64_t n) {
+            if (!path.empty()) MergeInto(doc, BuildAtPath(WideToUtf8(path), JsonValue::Number(static_cast<double>(n))));
+        };
+        add(u.prompt, promptTokens);
+        add(u.completion, completionTokens);
+        add(u.cached, seen ? promptTokens : 0);
+        return doc;
+    }
+
+    bool SendResponse(int fd, int status, const string& body, const string& extraHeaders, bool keepAlive, bool truncate) {
+        string head = "HTTP/1.1 " + to_string(status) + " " + StatusText(status) + "\r\n";
+        head += "Content-Type: application/json\r\nContent-Length: " + to_string(body.size()) + "\r\n" + extraHeaders;
+        head += keepAlive ? "\r\n" : "Connection: close\r\n\r\n";
+        if (!SendAll(fd, head)) return false;
+        if (truncate) {
+            SendAll(fd, string_view(body).substr(0, body.size() / 2));
+            return false;
+        }
+        return SendAll(fd, body) && keepAlive;
+    }
+
+    bool SendStream(int fd, const Route& r, const string& text, const string& model, const JsonValue& usage, bool truncate, const SseFraming& sse) {
+        if (!SendAll(fd, "HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\nCache-Control: no-cache\r\nTransfer-Encoding: chunked\r\n\r\n")) return false;
+        vector<string> deltas;
+        for (size_t pos = 0; pos < text.size();) {
+            size_t end = text.find(' ', pos);
+            end = end == string::npos ? text.size() : end + 1;
+            deltas.push_back(text.substr(pos, end - pos));
+            pos = end;
+        }
+        const char* nl = sse.crlf ? "\r\n" : "\n";
+        auto sendChunk = [&](string_view bytes) {
+            char len[16];
+            snprintf(len, sizeof(len), "%zx\r\n", bytes.size());
+            return SendAll(fd, string(len) + string(bytes) + "\r\n");
+        };
+        auto sendEvent = [&](const string& data, bool last) {
+            string event;
+            // A newline after the opening brace leaves the JSON intact once the lines are joined
+            if (sse.multiline && data.size() > 1 && data[0] == '{') event = "data: {" + string(nl) + "data: " + data.substr(1) + nl;
+            else event = "data: " + data + nl;
+            if (!(last && sse.noFinal)) event += nl;
+            if (!sse.split) return sendChunk(event);
+            for (size_t pos = 0; pos < event.size(); pos += 5) {
+                if (!sendChunk(string_view(event).substr(pos, 5))) return false;
+            }
+            return true;
+        };
+        const size_t count = truncate ? deltas.size() / 2 : deltas.size();
+        const bool trailer = !usage.IsNull() || r.doneMarker;
+        for (size_t i = 0; i < count; ++i) {
+            if (i && opt_.chunkMs) this_thread::sleep_for(chrono::milliseconds(opt_.chunkMs));
+            if (!sendEvent(ResultDocument(r, JsonValue::String(deltas[i]), model).Stringify(), !trailer && i + 1 == count)) return false;
+        }
+        if (truncate) return false;  // Closed without the terminating chunk
+        if (!usage.IsNull() && !sendEvent(usage.Stringify(), !r.doneMarker)) return false;
+        if (r.doneMarker && !sendEvent("[DONE]", true)) return false;
+        return SendAll(fd, "0\r\n\r\n");
+    }
+
+    void ServeConnection(int fd) {
+        string buffer;
+        HttpRequest req;
+        while (ReadRequest(fd, buffer, req)) {
+            if (!Handle(fd, req)) break;
+        }
+    }
+
+    /**
+     * @return true to keep the connection open
+     */
+    bool Handle(int fd, const HttpRequest& req) {
+        using Clock = chrono::steady_clock;
+        const Clock::time_point start = Clock::now();
+        const uint64_t seq = ++requests_;
+        string target = req.target;
+        if (size_t scheme = target.find("://"); scheme != string::npos) target = PathOf(target);
+        size_t slash = target.find('/', 1);
+        const string prefix = Lower(target.substr(1, slash == string::npos ? string::npos : slash - 1));
+        const string rest = slash == string::npos ? string() : target.substr(slash);
+        auto log = [&](int status, const char* what) {
+            if (!opt_.verbose) return;
+            fprintf(stderr, "%6llu %s %s -> %d %s (%.0f ms)\n", static_cast<unsigned long long>(seq), req.method.c_str(),
+                    target.substr(0, 96).c_str(), status, what, chrono::duration<double, milli>(Clock::now() - start).count());
+        };
+
+        if (req.method == "GET" && target == "/_mock/stats") {
+            JsonValue stats = JsonValue::Object();
+            stats.Set("connections", JsonValue::Number(static_cast<double>(connections_.load())));
+            stats.Set("requests", JsonValue::Number(static_cast<double>(seq)));
+            log(200, "stats");
+            return SendResponse(fd, 200, stats.Stringify(), "", req.keepAlive, false);
+        }
+
+        JsonValue body;
+        map<string, const JsonValue*> leaves;
+        const bool jsonBody = !req.body.empty() && JsonValue::Parse(req.body, body);
+        if (jsonBody) CollectLeaves(body, "", leaves);
+        const Route* best = nullptr;
+        int bestScore = -1;
+        smatch bestMatch;
+        for (const auto& r : routes_) {
+            if (Lower(WideToUtf8(r->provider->id)) != prefix) continue;
+            smatch m;
+            if (!regex_search(rest, m, r->endpoint)) continue;
+            if (!r->tpl) {
+                if (req.method != "GET" && !ModelsArePosted(*r->provider)) continue;
+                best = r.get();
+                bestMatch = m;
+                break;
+            }
+            if (req.method != "POST") continue;
+            // Bodies that are not JSON (multipart uploads) are matched by endpoint alone
+            const int score = jsonBody ? Fit(*r, leaves) : 0;
+            if (score > bestScore) { best = r.get(); bestScore = score; bestMatch = m; }
+        }
+        if (!best) {
+            log(404, "no route");
+            return SendResponse(fd, 404, ErrorJson(404, "no apidef route for " + req.method + " " + target), "", req.keepAlive, false);
+        }
+
+        const Route& r = *best;
+        if (!r.tpl) {
+            JsonValue list = JsonValue::Array();
+            for (const string& name : opt_.models) {
+                JsonValue m = JsonValue::Object();
+                m.Set("id", JsonValue::String(name));
+                m.Set("name", JsonValue::String(name));
+                list.Append(move(m));
+            }
+            log(200, "models");
+            return SendResponse(fd, 200, BuildAtPath(r.resultPath.empty() ? "data" : r.resultPath, move(list)).Stringify(), "", req.keepAlive, false);
+        }
+
+        string model = PlaceholderValue(r, leaves, "model");
+        for (size_t i = 0; i < r.endpointVars.size() && i + 1 < bestMatch.size(); ++i) {
+            if (r.endpointVars[i] == "model") model = bestMatch[i + 1].str();
+        }
+        string prompt = PlaceholderValue(r, leaves, "prompt");
+        if (prompt.empty()) prompt = PlaceholderValue(r, leaves, "input_text");
+        string image = PlaceholderValue(r, leaves, "image");
+        if (image.empty()) {
+            image = PlaceholderValue(r, leaves, "image_url");
+            if (size_t comma = image.find(','); image.rfind("data:", 0) == 0 && comma != string::npos) image.erase(0, comma + 1);
+        }
+        if (!jsonBody) {
+            if (model.empty()) model = MultipartField(req.body, "model");
+            prompt = MultipartField(req.body, "prompt");
+            image = MultipartField(req.body, "image");
+        } else if (!image.empty()) {
+            vector<uint8_t> bytes;
+            image = Base64Decode(image, bytes) ? string(bytes.begin(), bytes.end()) : string();
+        }
+        const string tplName = WideToUtf8(r.provider->id + L" " + r.tpl->id) + (r.stream ? " stream" : "");
+
+        // Rejections come back at once, like a real limiter's
+        if (Random() < opt_.rate429) {
+            log(429, tplName.c_str());
+            const string headers = "Retry-After: " + to_string(opt_.retryAfter) + "\r\nx-ratelimit-remaining-requests: 0\r\n";
+            return SendResponse(fd, 429, ErrorJson(429, "rate limited (mock)"), headers, req.keepAlive, false);
+        }
+        this_thread::sleep_for(chrono::duration<double, milli>(DrawLatency(model)));
+        if (Random() < opt_.rate500) {
+            log(500, tplName.c_str());
+            return SendResponse(fd, 500, ErrorJson(500, "internal error (mock)"), "", req.keepAlive, false);
+        }
+        const bool truncate = Random() < opt_.truncateRate;
+        log(200, (tplName + (truncate ? " truncated" : "")).c_str());
+        // An input image counts 258 tokens and an output image 258 per 256x256 pixels started, roughly what providers bill
+        const uint64_t promptTokens = prompt.size() / 4 + 1 + (image.empty() ? 0 : 258);
+        if (r.tpl->output == IOType::Image) {
+            const string png = MakePng(opt_.imageWidth, opt_.imageHeight, static_cast<uint8_t>(seq));
+            const string b64 = Base64Encode(reinterpret_cast<const uint8_t*>(png.data()), png.size());
+            const bool url = r.resultPath.size() >= 3 && r.resultPath.compare(r.resultPath.size() - 3, 3, "url") == 0;
+            const string value = url ? "data:image/png;base64," + b64 : b64;
+            const uint64_t imageTokens = 258 * (static_cast<uint64_t>(opt_.imageWidth) * opt_.imageHeight / 65536 + 1);
+            const JsonValue usage = UsageDocument(r, model, prompt, promptTokens, imageTokens);
+            return SendResponse(fd, 200, ResultDocument(r, JsonValue::String(value), model, usage).Stringify(), "", req.keepAlive, truncate);
+        }
+        const string text = ReplyText(model, prompt, image, seq);
+        const JsonValue usage = UsageDocument(r, model, prompt, promptTokens, text.size() / 4 + 1);
+        if (r.stream) {
+            SseFraming sse = opt_.sse;
+            if (auto it = req.headers.find("x-mock-sse"); it != req.headers.end() && !ParseSseFraming(it->second, sse)) {
+                log(400, "invalid X-Mock-SSE");
+                return SendResponse(fd, 400, ErrorJson(400, "invalid X-Mock-SSE " + it->second), "", req.keepAlive, false);
+            }
+            return SendStream(fd, r, text, model, usage, truncate, sse) && req.keepAlive;
+        }
+        return SendResponse(fd, 200, ResultDocument(r, JsonValue::String(text), model, usage).Stringify(), "", req.keepAlive, truncate);
+    }
+
+    static bool ModelsArePosted(const ApiProvider& p) {
+        return strcasecmp(WideToUtf8(p.modelsMethod).c_str(), "post") == 0;
+    }
+
+    const MockOptions& opt_;
+    vector<ApiProvider> providers_;
+    vector<unique_ptr<Route>> routes_;
+    mutex rngMutex_;
+    mt19937 rng_;
+    atomic<uint64_t> requests_{0};
+    atomic<uint64_t> connections_{0};  // Connections accepted
+    mutex promptsMutex_;
+    unordered_set<size_t> prompts_;    // Prompts answered so far, by hash, for cached token counts
+    int listener_{-1};
+};
+} // namespace
+
+int main(int argc, char** argv) {
+    MockOptions opt;
+    if (!ParseArgs(argc, argv, opt)) {
+        PrintUsage(stderr);
+        return 2;
+    }
+    vector<ApiProvider> providers;
+    vector<wstring> errors;
+    const bool loaded = LoadApiProviders(opt.apidef, providers, errors);
+    for (const wstring& e : errors) fprintf(stderr, "mock_server: %s\n", WideToUtf8(e).c_str());
+    if (!loaded) {
+        fprintf(stderr, "mock_server: no API definitions in %s (see --apidef)\n", opt.apidef.c_str());
+        return 1;
+    }
+    MockServer server(opt, move(providers));
+    if (!server.Listen()) return 1;
+    server.Serve();
+}
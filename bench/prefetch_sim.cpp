@@ -0,0 +1,157 @@
+/**
+ * @file prefetch_sim.cpp
+ * @brief Hotkey-to-upload latency with and without background clipboard pre-processing
+ *
+ * Builds without Win32 (see build.sh). A fake clipboard stands in for the
+ * system one: copying an image bumps the sequence number, and encoding it
+ * takes kEncodeMs per upload profile. Each scenario copies an image, waits for
+ * the user to pick a filter (the think time) and then measures how long the
+ * filter run waits before its image is ready to upload:
+ *
+ *   - hotkey path   the old behaviour: copy and encode after the hotkey
+ *   - prefetched    ClipboardPrefetcher encodes on copy; the run takes the
+ *                   snapshot, waiting for an encode still in progress
+ *
+ * A burst of rapid copies then shows coalescing and the bounded memory of
+ * the snapshots, and copying the same image again shows encodings reused.
+ */
+
+#include "../src/clipboard_prefetch.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+namespace {
+constexpr int kEncodeMs = 120;           // Scale + PNG + base64 of one screenshot
+constexpr size_t kEncodedBytes = 3 << 20; // Base64 size of one encoding
+constexpr size_t kBudget = 16 << 20;      // Snapshot budget
+
+/**
+ * @class FakeImage
+ * @brief Image whose encoding costs kEncodeMs
+ */
+class FakeImage : public ClipboardImage {
+public:
+    FakeImage(uint64_t id, atomic<int>& encodes) : id_(id), encodes_(encodes) {}
+    uint64_t Hash() override { return ContentHash(&id_, sizeof(id_)); }
+    bool Encode(const ImageUploadOptions&, string& b64, string& mime) override {
+        this_thread::sleep_for(chrono::milliseconds(kEncodeMs));
+        b64.assign(kEncodedBytes, static_cast<char>('A' + id_ % 26));
+        mime = "image/png";
+        ++encodes_;
+        return true;
+    }
+
+private:
+    uint64_t id_;
+    atomic<int>& encodes_;
+};
+
+/**
+ * @class FakeClipboard
+ * @brief Clipboard holding one image id at a time
+ */
+class FakeClipboard : public ClipboardSource {
+public:
+    explicit FakeClipboard(atomic<int>& encodes) : encodes_(encodes) {}
+
+    void Copy(uint64_t imageId) {
+        lock_guard<mutex> lock(mutex_);
+        imageId_ = imageId;
+        ++sequence_;
+    }
+
+    uint32_t Sequence() override {
+        lock_guard<mutex> lock(mutex_);
+        return sequence_;
+    }
+    ClipboardType Detect() override { return ClipboardType::Bitmap; }
+    bool ReadText(wstring&) override { return false; }
+    unique_ptr<ClipboardImage> ReadImage() override {
+        lock_guard<mutex> lock(mutex_);
+        return make_unique<FakeImage>(imageId_, encodes_);
+    }
+
+private:
+    mutex mutex_;
+    uint32_t sequence_{1};
+    uint64_t imageId_{};
+    atomic<int>& encodes_;
+};
+
+double MsSince(chrono::steady_clock::time_point t) {
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - t).count();
+}
+
+void ThinkTimeScenarios() {
+    printf("%-12s %14s %14s\n", "think ms", "hotkey path", "prefetched");
+    const ImageUploadOptions profile;
+    for (int think : {0, 60, 150, 400}) {
+        atomic<int> encodes{0};
+        // Hotkey path: nothing happens until the filter runs
+        FakeClipboard plain(encodes);
+        plain.Copy(1);
+        this_thread::sleep_for(chrono::milliseconds(think));
+        auto start = chrono::steady_clock::now();
+        string b64, mime;
+        plain.ReadImage()->Encode(profile, b64, mime);
+        const double hotkeyMs = MsSince(start);
+
+        auto clipboard = make_unique<FakeClipboard>(encodes);
+        FakeClipboard* cb = clipboard.get();
+        ClipboardPrefetcher prefetcher(move(clipboard), kBudget);
+        prefetcher.SetProfiles({profile});
+        cb->Copy(2);
+        prefetcher.Notify();  // WM_CLIPBOARDUPDATE
+        this_thread::sleep_for(chrono::milliseconds(think));
+        start = chrono::steady_clock::now();
+        auto snap = prefetcher.Get(prefetcher.Sequence(), chrono::milliseconds(2000));
+        const bool ready = snap && snap->FindImage(profile);
+        printf("%-12d %11.1f ms %11.1f ms%s\n", think, hotkeyMs, MsSince(start), ready ? "" : " (miss)");
+    }
+}
+
+void BurstScenario() {
+    atomic<int> encodes{0};
+    auto clipboard = make_unique<FakeClipboard>(encodes);
+    FakeClipboard* cb = clipboard.get();
+    ClipboardPrefetcher prefetcher(move(clipboard), kBudget);
+    prefetcher.SetProfiles({ImageUploadOptions{}, ImageUploadOptions{1024, 0, ImageFormat::Jpeg, 80}});
+    size_t peakBytes = 0;
+    constexpr int kCopies = 40;
+    for (int i = 0; i < kCopies; ++i) {
+        cb->Copy(100 + i);
+        prefetcher.Notify();
+        this_thread::sleep_for(chrono::milliseconds(10));
+        if (auto snap = prefetcher.Get(prefetcher.Sequence())) peakBytes = max(peakBytes, snap->bytes);
+    }
+    auto snap = prefetcher.Get(prefetcher.Sequence(), chrono::milliseconds(2000));
+    if (snap) peakBytes = max(peakBytes, snap->bytes);
+    const int burstEncodes = encodes;
+    // The same image copied again reuses the previous encodings
+    cb->Copy(100 + kCopies - 1);
+    prefetcher.Notify();
+    prefetcher.Get(prefetcher.Sequence(), chrono::milliseconds(2000));
+    ClipboardPrefetchStats st = prefetcher.Stats();
+    printf("\n# burst of %d copies 10 ms apart, 2 profiles\n", kCopies);
+    printf("snapshots %llu  coalesced %llu  encodes %d (%d without coalescing)  reused %llu\n",
+           static_cast<unsigned long long>(st.snapshots), static_cast<unsigned long long>(st.coalesced), burstEncodes, kCopies * 2,
+           static_cast<unsigned long long>(st.reused));
+    printf("latest snapshot ready: %s  largest snapshot %.1f MB (budget %.0f MB)\n", snap ? "yes" : "no", peakBytes / 1048576.0,
+           kBudget / 1048576.0);
+}
+} // namespace
+
+int main() {
+    printf("# image ready for upload after the hotkey (encode %d ms per profile)\n", kEncodeMs);
+    ThinkTimeScenarios();
+    BurstScenario();
+    return 0;
+}
@@ -0,0 +1,236 @@
+/**
+ * @file prefetch_test.cpp
+ * @brief Checks the snapshots ClipboardPrefetcher builds in the background
+ *
+ * Builds without Win32 (see build.sh). A fake clipboard holds either text or
+ * an image id; encoding an image is instant unless the test holds it back to
+ * copy again mid-encode. Checks that text and image snapshots carry the right
+ * content for every upload profile, that a run asking for an older sequence
+ * gets nothing, that a burst of copies is coalesced into one rebuild, that
+ * copying the same image again reuses its encodings, that the byte budget
+ * drops what does not fit, and that Stop does not leave Get waiting. Exits
+ * non-zero if any check fails.
+ */
+
+#include "check.h"
+
+#include "../src/clipboard_prefetch.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+
+using namespace std;
+
+namespace {
+
+constexpr size_t kEncodedBytes = 1024;
+constexpr auto kWait = chrono::seconds(5);
+
+/**
+ * @brief What FakeImage encodes for an image id and profile
+ */
+string Encoding(uint64_t id, const ImageUploadOptions& opt) {
+    string b64 = to_string(id) + "@" + to_string(opt.maxLongEdge) + ";";
+    b64.resize(kEncodedBytes, '=');
+    return b64;
+}
+
+/**
+ * @class FakeImage
+ * @brief Image that counts its encodings and can be held mid-encode
+ */
+class FakeImage : public ClipboardImage {
+public:
+    FakeImage(uint64_t id, atomic<int>& encodes, atomic<bool>& hold, atomic<bool>& encoding)
+        : id_(id), encodes_(encodes), hold_(hold), encoding_(encoding) {}
+    uint64_t Hash() override { return ContentHash(&id_, sizeof(id_)); }
+    bool Encode(const ImageUploadOptions& opt, string& b64, string& mime) override {
+        encoding_ = true;
+        while (hold_) this_thread::sleep_for(chrono::milliseconds(1));
+        encoding_ = false;
+        b64 = Encoding(id_, opt);
+        mime = "image/png";
+        ++encodes_;
+        return true;
+    }
+
+private:
+    uint64_t id_;
+    atomic<int>& encodes_;
+    atomic<bool>& hold_;
+    atomic<bool>& encoding_;
+};
+
+/**
+ * @class FakeClipboard
+ * @brief Clipboard holding either text or one image id
+ */
+class FakeClipboard : public ClipboardSource {
+public:
+    atomic<int> encodes{0};
+    atomic<bool> hold{false};      // Encode waits while set
+    atomic<bool> encoding{false};  // An Encode call is in progress
+
+    uint32_t CopyText(const wstring& text) {
+        lock_guard<mutex> lock(mutex_);
+        text_ = text;
+        isImage_ = false;
+        return ++sequence_;
+    }
+    uint32_t CopyImage(uint64_t id) {
+        lock_guard<mutex> lock(mutex_);
+        imageId_ = id;
+        isImage_ = true;
+        return ++sequence_;
+    }
+
+    uint32_t Sequence() override {
+        lock_guard<mutex> lock(mutex_);
+        return sequence_;
+    }
+    ClipboardType Detect() override {
+        lock_guard<mutex> lock(mutex_);
+        return isImage_ ? ClipboardType::Bitmap : ClipboardType::Text;
+    }
+    bool ReadText(wstring& text) override {
+        lock_guard<mutex> lock(mutex_);
+        if (isImage_) return false;
+        text = text_;
+        return true;
+    }
+    unique_ptr<ClipboardImage> ReadImage() override {
+        lock_guard<mutex> lock(mutex_);
+        if (!isImage_) return nullptr;
+        return make_unique<FakeImage>(imageId_, encodes, hold, encoding);
+    }
+
+private:
+    mutex mutex_;
+    uint32_t sequence_{};
+    bool isImage_{};
+    wstring text_;
+    uint64_t imageId_{};
+};
+
+bool HasImage(const ClipboardSnapshot& snap, uint64_t id, const ImageUploadOptions& opt) {
+    const EncodedImage* e = snap.FindImage(opt);
+    return e && e->b64 == Encoding(id, opt) && e->mime == "image/png";
+}
+
+}  // namespace
+
+int main() {
+    ImageUploadOptions large;
+    ImageUploadOptions small;
+    small.maxLongEdge = 768;
+    small.format = ImageFormat::Jpeg;
+    ImageUploadOptions unused;
+    unused.maxLongEdge = 512;
+
+    {
+        auto source = make_unique<FakeClipboard>();
+        FakeClipboard& clip = *source;
+        ClipboardPrefetcher prefetcher(move(source), 16 << 20);
+        prefetcher.SetProfiles({large, small});
+
+        // Text: the snapshot holds the copied text and its hash
+        const wstring text = L"clipboard text é中";
+        const uint32_t textSeq = clip.CopyText(text);
+        prefetcher.Notify();
+        shared_ptr<const ClipboardSnapshot> snap = prefetcher.Get(textSeq, kWait);
+        if (Check(snap != nullptr, "text snapshot built")) {
+            Check(snap->sequence == textSeq && snap->type == ClipboardType::Text, "text snapshot sequence and type");
+            Check(snap->text == text && snap->bytes == text.size() * sizeof(wchar_t), "text snapshot content");
+            Check(snap->hash == ContentHash(text.data(), text.size() * sizeof(wchar_t)), "text snapshot hash");
+            Check(snap->images.empty(), "text snapshot has no images");
+        }
+
+        // Image: one encoding per profile, none for a profile not asked for
+        const uint32_t imageSeq = clip.CopyImage(1);
+        prefetcher.Notify();
+        snap = prefetcher.Get(imageSeq, kWait);
+        if (Check(snap != nullptr, "image snapshot built")) {
+            Check(snap->type == ClipboardType::Bitmap && snap->images.size() == 2, "image snapshot has both profiles");
+            Check(HasImage(*snap, 1, large) && HasImage(*snap, 1, small), "image snapshot encodings match their profiles");
+            Check(snap->FindImage(unused) == nullptr, "no encoding for a profile that was not prefetched");
+            Check(snap->bytes == 2 * kEncodedBytes, "image snapshot size");
+        }
+        Check(clip.encodes == 2, "image encoded once per profile (" + to_string(clip.encodes) + ")");
+
+        // A run for a sequence that was replaced gets nothing
+        const unsigned long long misses = prefetcher.Stats().misses;
+        Check(prefetcher.Get(textSeq, chrono::milliseconds(0)) == nullptr, "replaced sequence not served");
+        Check(prefetcher.Stats().misses == misses + 1, "replaced sequence counted as a miss");
+
+        // The same image again: encodings carried over, nothing encoded
+        const uint32_t againSeq = clip.CopyImage(1);
+        prefetcher.Notify();
+        snap = prefetcher.Get(againSeq, kWait);
+        Check(snap && HasImage(*snap, 1, large) && HasImage(*snap, 1, small), "re-copied image snapshot complete");
+        Check(clip.encodes == 2, "re-copied image not encoded again (" + to_string(clip.encodes) + ")");
+        Check(prefetcher.Stats().reused == 2, "both encodings reused (" + to_string(prefetcher.Stats().reused) + ")");
+
+        // A burst of copies while an encode is in progress: one rebuild for the last copy
+        const ClipboardPrefetchStats before = prefetcher.Stats();
+        const int encodesBefore = clip.encodes;
+        clip.hold = true;
+        clip.CopyImage(2);
+        prefetcher.Notify();
+        while (!clip.encoding) this_thread::sleep_for(chrono::milliseconds(1));
+        constexpr int kBurst = 8;
+        uint32_t lastSeq = 0;
+        for (int i = 0; i < kBurst; ++i) {
+            lastSeq = clip.CopyImage(3 + i);
+            prefetcher.Notify();
+        }
+        clip.hold = false;
+        snap = prefetcher.Get(lastSeq, kWait);
+        const uint64_t lastId = 3 + kBurst - 1;
+        Check(snap && HasImage(*snap, lastId, large) && HasImage(*snap, lastId, small), "burst ends with the last copy");
+        const ClipboardPrefetchStats after = prefetcher.Stats();
+        Check(after.coalesced - before.coalesced == kBurst - 1,
+              "burst notifications coalesced (" + to_string(after.coalesced - before.coalesced) + ")");
+        Check(after.snapshots - before.snapshots == 1, "abandoned encode not published as a snapshot");
+        Check(clip.encodes - encodesBefore <= 3, "encoding of replaced content abandoned (" + to_string(clip.encodes - encodesBefore) + " encodes)");
+        Check(after.overBudget == 0, "nothing over budget");
+    }
+
+    {
+        // Budget of one encoding: the second profile and long text are dropped
+        auto source = make_unique<FakeClipboard>();
+        FakeClipboard& clip = *source;
+        ClipboardPrefetcher prefetcher(move(source), kEncodedBytes + kEncodedBytes / 2);
+        prefetcher.SetProfiles({large, small});
+
+        const uint32_t imageSeq = clip.CopyImage(7);
+        prefetcher.Notify();
+        shared_ptr<const ClipboardSnapshot> snap = prefetcher.Get(imageSeq, kWait);
+        Check(snap && snap->images.size() == 1 && HasImage(*snap, 7, large), "only the first encoding fits the budget");
+        Check(snap && snap->bytes <= kEncodedBytes + kEncodedBytes / 2, "image snapshot within budget");
+        Check(prefetcher.Stats().overBudget == 1, "encoding over budget counted");
+
+        const wstring text(kEncodedBytes, L'x');
+        const uint32_t textSeq = clip.CopyText(text);
+        prefetcher.Notify();
+        snap = prefetcher.Get(textSeq, kWait);
+        Check(snap && snap->type == ClipboardType::Text && snap->text.empty() && snap->bytes == 0, "text over budget left out");
+        Check(snap && snap->hash == ContentHash(text.data(), text.size() * sizeof(wchar_t)), "text over budget still hashed");
+        Check(prefetcher.Stats().overBudget == 2, "text over budget counted");
+
+        // After Stop nothing is built and Get returns at once
+        prefetcher.Stop();
+        const uint32_t lateSeq = clip.CopyText(L"late");
+        prefetcher.Notify();
+        const auto start = chrono::steady_clock::now();
+        Check(prefetcher.Get(lateSeq, kWait) == nullptr, "nothing built after Stop");
+        Check(chrono::steady_clock::now() - start < chrono::seconds(1), "Get does not wait after Stop");
+    }
+
+    if (CheckFailures() != 0) return 1;
+    printf("prefetch_test: ok\n");
+    return 0;
+}
@@ -0,0 +1,132 @@
+/**
+ * @file ratelimit_sim.cpp
+ * @brief Burst load against a stand-in provider that answers 429 when its limit is hit
+ *
+ * Builds without Win32 (see build.sh). Like OpenAI's limiter, the stand-in
+ * server holds a token bucket per key and rejects requests that find it empty
+ * with 429 and Retry-After / retry-after-ms. Every response carries
+ * x-ratelimit-limit/remaining/reset-requests headers formatted as the real
+ * provider sends them. A burst of concurrent requests is pushed through
+ * SendWithRetry and RateLimiter (the code the filters use) with four policies,
+ * printing how many requests failed, how many attempts were wasted on 429s and
+ * the total time:
+ *
+ *   - no retry          the old behaviour: a 429 fails the request
+ *   - backoff only      jittered exponential retries, headers ignored
+ *   - headers + backoff retries plus pauses taken from the response headers
+ *   - client bucket     as above with a client-side token bucket at the server's rate
+ */
+
+#include "../src/rate_limit.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+namespace {
+constexpr double kLimit = 20;      // Server-side bucket capacity
+constexpr double kPerSecond = 100; // Server-side refill rate
+constexpr int kServeMs = 20;       // Time to answer an admitted request
+constexpr int kRejectMs = 2;       // Time to answer with 429
+constexpr size_t kRequests = 300;
+constexpr size_t kClients = 32;
+
+/**
+ * @class StandInServer
+ * @brief Token-bucket limiter answering like an OpenAI-compatible endpoint
+ */
+class StandInServer {
+public:
+    RateLimitedResponse Handle(bool withHeaders) {
+        int status;
+        long long resetMs, retryMs = 0;
+        int remaining;
+        {
+            lock_guard<mutex> lock(mutex_);
+            auto now = chrono::steady_clock::now();
+            tokens_ = min(kLimit, tokens_ + chrono::duration<double>(now - refilledAt_).count() * kPerSecond);
+            refilledAt_ = now;
+            status = tokens_ >= 1 ? 200 : 429;
+            if (status == 200) tokens_ -= 1; else ++rejected_;
+            if (status == 429) retryMs = llround(ceil((1 - tokens_) / kPerSecond * 1000));
+            remaining = static_cast<int>(tokens_);
+            resetMs = llround(ceil((kLimit - tokens_) / kPerSecond * 1000));
+        }
+        this_thread::sleep_for(chrono::milliseconds(status == 200 ? kServeMs : kRejectMs));
+        RateLimitedResponse r;
+        r.status = status;
+        r.rawHeaders = status == 200 ? "HTTP/1.1 200 OK\r\n" : "HTTP/1.1 429 Too Many Requests\r\n";
+        if (withHeaders) {
+            r.rawHeaders += "x-ratelimit-limit-requests: " + to_string(static_cast<int>(kLimit)) + "\r\n";
+            r.rawHeaders += "x-ratelimit-remaining-requests: " + to_string(remaining) + "\r\n";
+            r.rawHeaders += "x-ratelimit-reset-requests: " + to_string(resetMs) + "ms\r\n";
+            if (status == 429) {
+                r.rawHeaders += "retry-after: " + to_string((retryMs + 999) / 1000) + "\r\n";
+                r.rawHeaders += "retry-after-ms: " + to_string(retryMs) + "\r\n";
+            }
+        }
+        r.rawHeaders += "\r\n";
+        return r;
+    }
+
+    int Rejected() const { return rejected_; }
+
+private:
+    mutex mutex_;
+    double tokens_{kLimit};
+    chrono::steady_clock::time_point refilledAt_{chrono::steady_clock::now()};
+    atomic<int> rejected_{};
+};
+
+void RunScenario(const char* name, const RateLimitConfig& config, bool withHeaders) {
+    StandInServer server;
+    RateLimiter limiter;
+    limiter.Configure(config);
+    atomic<size_t> next{0}, failed{0};
+    const auto start = chrono::steady_clock::now();
+    vector<thread> clients;
+    for (size_t c = 0; c < kClients; ++c) {
+        clients.emplace_back([&] {
+            while (next.fetch_add(1) < kRequests) {
+                int status = SendWithRetry(limiter, nullptr, [&] { return server.Handle(withHeaders); });
+                if (status != 200) ++failed;
+            }
+        });
+    }
+    for (auto& t : clients) t.join();
+    const double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    printf("%-20s %8zu %8zu %10d %9.2f %10.1f\n", name, kRequests - failed.load(), failed.load(), server.Rejected(), seconds,
+           static_cast<double>(kRequests - failed.load()) / seconds);
+    fflush(stdout);
+}
+} // namespace
+
+int main() {
+    printf("# %zu requests from %zu clients; server allows %.0f requests/s, bursts of %.0f\n", kRequests, kClients, kPerSecond, kLimit);
+    printf("%-20s %8s %8s %10s %9s %10s\n", "policy", "ok", "failed", "429s", "seconds", "ok/s");
+
+    RateLimitConfig noRetry;
+    noRetry.maxRetries = 0;
+    RunScenario("no retry", noRetry, true);
+
+    RateLimitConfig retry;
+    retry.maxRetries = 6;
+    retry.baseDelayMs = 100;
+    retry.maxDelayMs = 5000;
+    RunScenario("backoff only", retry, false);
+    RunScenario("headers + backoff", retry, true);
+
+    RateLimitConfig bucket = retry;
+    bucket.requestsPerMinute = kPerSecond * 60;
+    bucket.burst = static_cast<unsigned>(kLimit / 2);
+    RunScenario("client bucket", bucket, true);
+    return 0;
+}
@@ -0,0 +1,125 @@
+/**
+ * @file ratelimit_test.cpp
+ * @brief Checks how rate limit headers with request and token windows drive the limiter
+ *
+ * Builds without Win32 (see build.sh). Parses header blocks shaped like the
+ * providers' (request and token windows side by side, unsuffixed windows,
+ * several request windows) and checks which window feeds the request bucket
+ * and when the provider is paused, then checks that the request slots bound
+ * the requests in flight and that a cancelled wait for a slot returns.
+ * Exits non-zero if any check fails.
+ */
+
+#include "check.h"
+
+#include "../src/rate_limit.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+RateLimitHeaders Parse(const string& headers) {
+    return ParseRateLimitHeaders("HTTP/1.1 200 OK\r\n" + headers + "\r\n", 1700000000000);
+}
+
+string Windows(long long reqLimit, long long reqLeft, const char* reqReset, long long tokLimit, long long tokLeft, const char* tokReset) {
+    return "x-ratelimit-limit-requests: " + to_string(reqLimit) + "\r\n" +
+           "x-ratelimit-remaining-requests: " + to_string(reqLeft) + "\r\n" +
+           "x-ratelimit-reset-requests: " + reqReset + "\r\n" +
+           "x-ratelimit-limit-tokens: " + to_string(tokLimit) + "\r\n" +
+           "x-ratelimit-remaining-tokens: " + to_string(tokLeft) + "\r\n" +
+           "x-ratelimit-reset-tokens: " + tokReset + "\r\n";
+}
+
+}  // namespace
+
+int main() {
+    using ms = chrono::milliseconds;
+
+    // Fewer tokens than requests left in raw numbers, but the request window is the one in use
+    RateLimitHeaders h = Parse(Windows(10000, 9000, "6s", 2000, 1500, "1s"));
+    Check(h.limit == 10000 && h.remaining == 9000 && h.resetMs == 6000, "request window reported, not the token window");
+    Check(h.exhaustedResetMs < 0, "nothing exhausted");
+
+    // An exhausted token window pauses until it resets, without touching the request bucket
+    h = Parse(Windows(10000, 9999, "6ms", 30000, 0, "2s"));
+    Check(h.remaining == 9999, "request window still reported next to an exhausted token window");
+    Check(h.exhaustedResetMs == 2000, "exhausted token window reported with its reset");
+    {
+        RateLimiter limiter;
+        const auto now = RateLimiter::Clock::now();
+        limiter.Observe(h, now);
+        Check(limiter.Reserve(now) >= ms(2000), "exhausted token window pauses until it resets");
+    }
+
+    // Among exhausted windows the pause lasts until the last one resets
+    h = Parse(Windows(50, 0, "3s", 30000, 0, "20s"));
+    Check(h.exhaustedResetMs == 20000, "pause covers the last exhausted window");
+
+    // Several request windows: the one with the smallest fraction left wins, not the smallest count
+    h = Parse("x-ratelimit-limit-requests: 1000\r\nx-ratelimit-remaining-requests: 100\r\nx-ratelimit-reset-requests: 60s\r\n"
+              "x-ratelimit-limit-requests-day: 100000\r\nx-ratelimit-remaining-requests-day: 500\r\nx-ratelimit-reset-requests-day: 3600s\r\n");
+    Check(h.limit == 100000 && h.remaining == 500, "daily window with 0.5% left chosen over a minute window with 10% left");
+    h = Parse("x-ratelimit-limit-requests: 1000\r\nx-ratelimit-remaining-requests: 20\r\nx-ratelimit-reset-requests: 60s\r\n"
+              "x-ratelimit-limit-requests-day: 100\r\nx-ratelimit-remaining-requests-day: 10\r\nx-ratelimit-reset-requests-day: 3600s\r\n");
+    Check(h.limit == 1000 && h.remaining == 20, "minute window with 2% left chosen over a daily window with 10% left");
+
+    // Unsuffixed windows (OpenRouter) count requests
+    h = Parse("x-ratelimit-limit: 20\r\nx-ratelimit-remaining: 0\r\nx-ratelimit-reset: 1700000005000\r\n");
+    Check(h.limit == 20 && h.remaining == 0 && h.resetMs == 5000, "unsuffixed window counts requests");
+    Check(h.exhaustedResetMs == 5000, "exhausted unsuffixed window pauses");
+
+    // Request slots: no more requests in flight than the provider's limit
+    RateLimiters::Instance().SetConcurrency(2, {{L"slots-wide", 3}});
+    {
+        RateLimiter& limiter = RateLimiters::Instance().For(L"slots-narrow");
+        limiter.Configure(RateLimitConfig{});
+        atomic<int> inFlight{0}, peak{0};
+        vector<thread> senders;
+        for (int i = 0; i < 8; ++i) {
+            senders.emplace_back([&] {
+                SendWithRetry(limiter, nullptr, [&] {
+                    const int now = ++inFlight;
+                    for (int seen = peak; now > seen && !peak.compare_exchange_weak(seen, now);) {}
+                    this_thread::sleep_for(ms(20));
+                    --inFlight;
+                    return RateLimitedResponse{200, ""};
+                });
+            });
+        }
+        for (thread& t : senders) t.join();
+        Check(peak == 2, "default limit bounds the requests in flight (peak " + to_string(peak) + ")");
+    }
+    Check(RateLimiters::Instance().For(L"slots-wide").AcquireSlot(nullptr), "overridden limit grants a slot");
+    {
+        RateLimiter& limiter = RateLimiters::Instance().For(L"slots-wide");
+        Check(limiter.AcquireSlot(nullptr) && limiter.AcquireSlot(nullptr), "overridden limit grants three slots");
+        CancelToken cancel;
+        thread canceller([&] {
+            this_thread::sleep_for(ms(50));
+            cancel.Cancel();
+        });
+        const auto start = RateLimiter::Clock::now();
+        Check(!limiter.AcquireSlot(&cancel), "wait for a fourth slot ends when cancelled");
+        Check(RateLimiter::Clock::now() - start >= ms(40), "fourth slot waited for a free one");
+        canceller.join();
+        limiter.ReleaseSlot();
+        Check(limiter.AcquireSlot(nullptr), "released slot taken again");
+        // Raising the limit applies to existing limiters
+        RateLimiters::Instance().SetConcurrency(2, {{L"slots-wide", 4}});
+        Check(limiter.AcquireSlot(nullptr), "raised limit grants another slot");
+        RateLimiters::Instance().SetConcurrency(0);
+        Check(limiter.AcquireSlot(nullptr), "limit 0 is unlimited");
+    }
+
+    if (CheckFailures() != 0) return 1;
+    printf("ratelimit_test: ok\n");
+    return 0;
+}
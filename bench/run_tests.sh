@@ -0,0 +1,10 @@
+#!/bin/sh
+# Build and run the self-checking tests from the repository root; exits non-zero if any fails
+set -e
+cd "$(dirname "$0")/.."
+bench/build.sh
+failed=0
+for t in base64_test batch_test cache_test http_reuse_test prefetch_test ratelimit_test sse_stream_test typing_test; do
+    if bench/$t > /dev/null; then echo "PASS $t"; else echo "FAIL $t"; failed=1; fi
+done
+exit $failed
@@ -0,0 +1,138 @@
+/**
+ * @file sse_stream_test.cpp
+ * @brief Checks streamed replies through the portable HTTP client and SseParser against mock_server
+ *
+ * Builds without Win32 (see build.sh); run from the repository root. Asks
+ * mock_server for streams framed every way its --sse modes allow (events cut
+ * into 5-byte chunks, data over several lines, CRLF, no blank line after
+ * the last event) and checks that the deltas extracted at the template's
+ * stream result path arrive in order and join to the full reply. The raw
+ * body is also fed to a fresh parser split at every byte offset. Exits
+ * non-zero if any check fails.
+ */
+
+#include "mock_process.h"
+
+#include "../src/http_request.h"
+#include "../src/json_path.h"
+#include "../src/sse_parser.h"
+#include "../src/utf8.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+const char kPrompt[] = "the quick brown fox jumps over the lazy dog";
+
+/**
+ * @struct StreamCase
+ * @brief One streaming template of apidef
+ */
+struct StreamCase {
+    const char* name;
+    const wchar_t* path;
+    string body;
+    const wchar_t* resultPath;
+    const char* lastEvent;  // Text the last event's data contains
+};
+
+/**
+ * @struct Parsed
+ * @brief What a parser made of a body
+ */
+struct Parsed {
+    vector<string> deltas;
+    string lastData;
+};
+
+Parsed ParseSplit(const string& raw, const JsonPath& path, const vector<size_t>& cuts) {
+    Parsed out;
+    SseParser parser([&](const string&, const string& data) {
+        out.lastData = data;
+        string delta;
+        if (path.Extract(data, delta) && !delta.empty()) out.deltas.push_back(delta);
+    });
+    size_t pos = 0;
+    for (size_t cut : cuts) {
+        parser.Feed(raw.data() + pos, cut - pos);
+        pos = cut;
+    }
+    parser.Feed(raw.data() + pos, raw.size() - pos);
+    parser.Finish();
+    return out;
+}
+
+string Join(const vector<string>& parts) {
+    string s;
+    for (const string& p : parts) s += p;
+    return s;
+}
+
+void RunCase(const MockProcess& mock, const StreamCase& c, const string& framing) {
+    const string label = string(c.name) + " [" + (framing.empty() ? "plain" : framing) + "]";
+    const JsonPath path = JsonPath::Compile(c.resultPath);
+    const string expected = "[gpt-x] " + string(kPrompt);
+
+    // Live: the parser sees the reads as the client delivers them
+    string raw;
+    Parsed live;
+    SseParser parser([&](const string&, const string& data) {
+        live.lastData = data;
+        string delta;
+        if (path.Extract(data, delta) && !delta.empty()) live.deltas.push_back(delta);
+    });
+    wstring err;
+    const wstring headers = L"Content-Type: application/json\r\nX-Mock-SSE: " + Utf8ToWide(framing) + L"\r\n";
+    const bool ok = HttpRequestStreaming(mock.Host(), c.path, false, headers, c.body, L"POST", [&](const char* data, size_t size) {
+        raw.append(data, size);
+        parser.Feed(data, size);
+    }, &err);
+    parser.Finish();
+    if (!Check(ok && err.empty(), label + ": request succeeded " + WideToUtf8(err))) return;
+    Check(live.deltas.size() > 1, label + ": reply arrived in several deltas (" + to_string(live.deltas.size()) + ")");
+    Check(Join(live.deltas) == expected, label + ": deltas join to the reply, got \"" + Join(live.deltas) + "\"");
+    Check(live.lastData.find(c.lastEvent) != string::npos, label + ": last event parsed, got \"" + live.lastData + "\"");
+
+    // Replayed: every way of cutting the body in two, and one byte at a time
+    bool allSplits = true;
+    for (size_t cut = 1; cut < raw.size() && allSplits; ++cut) {
+        const Parsed p = ParseSplit(raw, path, {cut});
+        allSplits = p.deltas == live.deltas && p.lastData == live.lastData;
+        if (!allSplits) Check(false, label + ": body cut at byte " + to_string(cut) + " parsed differently");
+    }
+    vector<size_t> everyByte;
+    for (size_t i = 1; i < raw.size(); ++i) everyByte.push_back(i);
+    const Parsed bytewise = ParseSplit(raw, path, everyByte);
+    Check(bytewise.deltas == live.deltas && bytewise.lastData == live.lastData, label + ": body fed a byte at a time parsed the same");
+}
+
+}  // namespace
+
+int main() {
+    MockProcess mock;
+    if (!Check(mock.Ready(), "mock_server started (run from the repository root after bench/build.sh)")) return 1;
+
+    const string prompt = kPrompt;
+    const vector<StreamCase> cases = {
+        {"OpenAI Text-Text", L"/openai/v1/chat/completions",
+         "{\"model\":\"gpt-x\",\"messages\":[{\"role\":\"developer\",\"content\":\"\"},{\"role\":\"user\",\"content\":\"" + prompt +
+             "\"}],\"stream\":true,\"stream_options\":{\"include_usage\":true}}",
+         L"choices[0].delta.content", "[DONE]"},
+        {"Gemini Text-Text", L"/gemini/v1beta/models/gpt-x:streamGenerateContent?alt=sse",
+         "{\"contents\":[{\"role\":\"user\",\"parts\":[{\"text\":\"" + prompt +
+             "\"}]}],\"systemInstruction\":\"\",\"generationConfig\":{\"maxOutputTokens\":10000}}",
+         L"candidates[0].content.parts[0].text", "usageMetadata"},
+    };
+    const vector<string> framings = {"", "split", "multiline", "crlf", "nofinal", "split,crlf,nofinal", "split,multiline,crlf,nofinal"};
+    for (const StreamCase& c : cases) {
+        for (const string& f : framings) RunCase(mock, c, f);
+    }
+
+    if (CheckFailures() != 0) return 1;
+    printf("sse_stream_test: %zu streams, ok\n", cases.size() * framings.size());
+    return 0;
+}
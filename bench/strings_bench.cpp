@@ -0,0 +1,156 @@
+/**
+ * @file strings_bench.cpp
+ * @brief Localized string lookups of dialog construction: per-call lang.ini scan vs StringTable
+ *
+ * Builds without Win32 (see build.sh); run from the repository root or pass
+ * the path of lang.ini. Each dialog case performs the GetString calls its
+ * window procedure makes in WM_CREATE (the keys are listed below), plus the
+ * progress window's 100 ms timer tick. "file scan" is the former GetString:
+ * open lang.ini and scan it line by line for every key. "table" is the
+ * StringTable that now backs GetString. The first section (ja) is the best
+ * case for the scan and the last one (ru) the worst.
+ */
+
+#include "../src/string_table.h"
+#include "../src/utf8.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <new>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+atomic<uint64_t> g_allocations{0};
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+// GCC cannot see that the replaced new and delete below are a matching pair
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void* operator new(size_t size) {
+    g_allocations.fetch_add(1, memory_order_relaxed);
+    if (void* p = malloc(size ? size : 1)) return p;
+    throw bad_alloc();
+}
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+namespace {
+constexpr double kMinSeconds = 0.3;
+volatile size_t g_sink;
+
+struct Dialog {
+    const char* name;
+    vector<const wchar_t*> keys;
+};
+
+const Dialog kDialogs[] = {
+    {"settings window", {L"filter_list", L"filter", L"input", L"output", L"model", L"copy", L"add", L"edit", L"delete", L"close", L"use_edit_button", L"hint", L"copy_suffix", L"new_filter"}},
+    {"filter edit dialog", {L"filter_name", L"input_type", L"text_type", L"image_type", L"output_type", L"language_model", L"add_language_model", L"model_settings", L"prompt", L"save", L"close", L"unsaved_changes", L"confirm", L"new_model"}},
+    {"model dialog", {L"name", L"server_url", L"model_name", L"provider", L"api_key", L"save", L"delete", L"close", L"unsaved_changes", L"confirm"}},
+    {"setup dialog", {L"language", L"hotkey", L"provider", L"server_url", L"api_key", L"check_connection", L"exit_app", L"connection_failed", L"connection_success"}},
+    {"progress timer tick", {L"elapsed_time"}},
+};
+
+/**
+ * @brief The former GetString: scan the file for one key
+ */
+wstring ScanFile(const char* path, const wstring& language, const wstring& key) {
+    FILE* fp = fopen(path, "r");
+    if (!fp) return key;
+    const string section = WideToUtf8(language), k = WideToUtf8(key);
+    wstring result = key;
+    bool inSection = false;
+    char line[2048];
+    while (fgets(line, sizeof(line), fp)) {
+        size_t len = strlen(line);
+        if (len > 0 && line[len - 1] == '\n') line[--len] = '\0';
+        if (len > 0 && line[len - 1] == '\r') line[--len] = '\0';
+        if (line[0] == '\0' || line[0] == ';') continue;
+        if (line[0] == '[') {
+            char* end = strchr(line + 1, ']');
+            if (end) inSection = string(line + 1, end) == section;
+            continue;
+        }
+        if (!inSection) continue;
+        char* eq = strchr(line, '=');
+        if (!eq) continue;
+        *eq = '\0';
+        if (k == line) {
+            result = Utf8ToWide(eq + 1);
+            break;
+        }
+    }
+    fclose(fp);
+    return result;
+}
+
+string ReadFile(const char* path) {
+    string content;
+    if (FILE* fp = fopen(path, "rb")) {
+        char buf[4096];
+        for (size_t n; (n = fread(buf, 1, sizeof(buf), fp)) > 0;) content.append(buf, n);
+        fclose(fp);
+    }
+    return content;
+}
+
+/**
+ * @brief Time fn until kMinSeconds have passed
+ * @return Nanoseconds and allocations per call
+ */
+pair<double, double> Measure(const function<size_t()>& fn) {
+    g_sink = fn();
+    uint64_t allocsBefore = g_allocations.load();
+    int iterations = 0;
+    auto start = chrono::steady_clock::now();
+    double elapsed = 0;
+    do {
+        g_sink = fn();
+        ++iterations;
+        elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    } while (elapsed < kMinSeconds);
+    return {elapsed * 1e9 / iterations, static_cast<double>(g_allocations.load() - allocsBefore) / iterations};
+}
+} // namespace
+
+int main(int argc, char** argv) {
+    const char* path = argc > 1 ? argv[1] : "lang.ini";
+    const string content = ReadFile(path);
+    if (content.empty()) {
+        fprintf(stderr, "cannot read %s (run from the repository root or pass its path)\n", path);
+        return 1;
+    }
+    printf("%-22s %-4s %14s %12s %14s %12s\n", "case", "lang", "file scan", "allocs", "table", "allocs");
+    for (const wchar_t* lang : {L"ja", L"ru"}) {
+        const wstring language = lang;
+        StringTable table;
+        auto load = Measure([&] { return table.Load(content, language); });
+        for (const Dialog& d : kDialogs) {
+            auto scan = Measure([&] {
+                size_t n = 0;
+                for (const wchar_t* k : d.keys) n += ScanFile(path, language, k).size();
+                return n;
+            });
+            auto lookup = Measure([&] {
+                size_t n = 0;
+                for (const wchar_t* k : d.keys) n += table.Get(k).size();
+                return n;
+            });
+            printf("%-22s %-4ls %11.1f us %12.1f %11.3f us %12.1f\n", d.name, lang, scan.first / 1000, scan.second, lookup.first / 1000,
+                   lookup.second);
+        }
+        printf("%-22s %-4ls %14s %12s %11.1f us %12.1f\n", "table load (once)", lang, "-", "-", load.first / 1000, load.second);
+    }
+    return 0;
+}
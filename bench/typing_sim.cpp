@@ -0,0 +1,168 @@
+/**
+ * @file typing_sim.cpp
+ * @brief Typed output against a slow target window, with and without batching
+ *
+ * Builds without Win32 (see build.sh). A fake target stands in for the
+ * application receiving the keystrokes: every input event costs it
+ * kEventMs (a repaint) plus kUnitUs per character, and events queue up while
+ * it is busy, as with SendInput. A model streams kTokens deltas at several
+ * rates after a time to first token of kFirstTokenMs, and each is delivered
+ * three ways:
+ *
+ *   - paste         the old behaviour: one paste after the last token
+ *   - per delta     one input event per delta as it arrives
+ *   - injector      KeystrokeInjector with the default TypingOptions
+ *
+ * For each, the table shows when the first text appears, how long after the
+ * last token the target has processed everything, the number of events and
+ * the longest queue of unprocessed events in the target.
+ */
+
+#include "../src/typed_output.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+using namespace std;
+
+namespace {
+constexpr int kTokens = 400;            // Deltas per result
+constexpr int kCharsPerToken = 4;
+constexpr int kFirstTokenMs = 300;      // Time to first token
+constexpr double kEventMs = 3.0;        // Target's cost per input event
+constexpr double kUnitUs = 20.0;        // Target's cost per character
+
+using Clock = chrono::steady_clock;
+
+double MsSince(Clock::time_point t) {
+    return chrono::duration<double, milli>(Clock::now() - t).count();
+}
+
+/**
+ * @class FakeTarget
+ * @brief Application window processing queued input events one at a time
+ */
+class FakeTarget {
+public:
+    explicit FakeTarget(Clock::time_point start) : start_(start), worker_([this] { Loop(); }) {}
+    ~FakeTarget() {
+        {
+            lock_guard<mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        cv_.notify_all();
+        worker_.join();
+    }
+
+    void Post(size_t units) {
+        lock_guard<mutex> lock(mutex_);
+        queue_.push_back(units);
+        ++events_;
+        maxQueue_ = max(maxQueue_, queue_.size());
+        cv_.notify_all();
+    }
+
+    /**
+     * @brief Wait until every posted event is processed
+     */
+    void Drain() {
+        unique_lock<mutex> lock(mutex_);
+        cv_.wait(lock, [&] { return queue_.empty() && !busy_; });
+    }
+
+    double firstMs{-1}, lastMs{};
+    size_t events_{}, maxQueue_{};
+
+private:
+    void Loop() {
+        unique_lock<mutex> lock(mutex_);
+        for (;;) {
+            cv_.wait(lock, [&] { return stopping_ || !queue_.empty(); });
+            if (queue_.empty()) return;
+            const size_t units = queue_.front();
+            queue_.pop_front();
+            busy_ = true;
+            lock.unlock();
+            this_thread::sleep_for(chrono::duration<double, milli>(kEventMs + units * kUnitUs / 1000.0));
+            lock.lock();
+            busy_ = false;
+            if (firstMs < 0) firstMs = MsSince(start_);
+            lastMs = MsSince(start_);
+            cv_.notify_all();
+        }
+    }
+
+    Clock::time_point start_;
+    mutex mutex_;
+    condition_variable cv_;
+    deque<size_t> queue_;
+    bool busy_{};
+    bool stopping_{};
+    thread worker_;
+};
+
+/**
+ * @class TargetSink
+ * @brief Sink posting each batch to the fake target as one event
+ */
+class TargetSink : public KeystrokeSink {
+public:
+    explicit TargetSink(FakeTarget& target) : target_(target) {}
+    bool Type(u16string_view units) override {
+        target_.Post(units.size());
+        return true;
+    }
+
+private:
+    FakeTarget& target_;
+};
+
+enum class Mode { Paste, PerDelta, Injector };
+
+/**
+ * @brief Stream one result at a token rate and deliver it in a mode
+ * @return Time from the last token until the target processed everything
+ */
+double Run(Mode mode, int tokensPerSecond, FakeTarget& target, Clock::time_point start) {
+    const wstring delta(kCharsPerToken, L'x');
+    unique_ptr<KeystrokeInjector> injector;
+    if (mode == Mode::Injector) injector = make_unique<KeystrokeInjector>(make_unique<TargetSink>(target), TypingOptions{});
+    auto due = start + chrono::milliseconds(kFirstTokenMs);
+    const auto step = chrono::duration_cast<Clock::duration>(chrono::duration<double>(1.0 / tokensPerSecond));
+    for (int i = 0; i < kTokens; ++i, due += step) {
+        this_thread::sleep_until(due);
+        if (mode == Mode::PerDelta) target.Post(delta.size());
+        else if (mode == Mode::Injector) injector->Push(delta);
+    }
+    const double endMs = MsSince(start);
+    if (mode == Mode::Paste) {
+        this_thread::sleep_for(chrono::milliseconds(80));  // Focus restore before Ctrl+V
+        target.Post(static_cast<size_t>(kTokens) * kCharsPerToken);
+    }
+    if (injector) injector->Finish();
+    target.Drain();
+    return target.lastMs - endMs;
+}
+} // namespace
+
+int main() {
+    printf("# %d tokens of %d chars, first token after %d ms; target costs %.1f ms per event + %.0f us per char\n",
+           kTokens, kCharsPerToken, kFirstTokenMs, kEventMs, kUnitUs);
+    printf("%-8s %-10s %10s %12s %8s %10s\n", "tok/s", "mode", "first ms", "tail ms", "events", "max queue");
+    for (int rate : {50, 200, 1000, 4000}) {
+        for (Mode mode : {Mode::Paste, Mode::PerDelta, Mode::Injector}) {
+            const auto start = Clock::now();
+            FakeTarget target(start);
+            const double tail = Run(mode, rate, target, start);
+            const char* name = mode == Mode::Paste ? "paste" : mode == Mode::PerDelta ? "per delta" : "injector";
+            printf("%-8d %-10s %10.0f %12.1f %8zu %10zu\n", rate, name, target.firstMs, tail, target.events_, target.maxQueue_);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,225 @@
+/**
+ * @file typing_test.cpp
+ * @brief Checks what KeystrokeInjector types and how it batches it
+ *
+ * Builds without Win32 (see build.sh). A fake sink records every batch and
+ * can be made slow or refuse a batch. Checks that the typed text is the
+ * pushed text without carriage returns, that batches respect maxBatch and
+ * never split a surrogate pair, that deltas pushed in a burst are coalesced,
+ * that charsPerSecond paces the batches, that a refused batch or Abort stops
+ * typing with only a prefix typed, and that of two hedged streams only the
+ * winner's is typed. Exits non-zero if any check fails.
+ */
+
+#include "check.h"
+
+#include "../src/hedge.h"
+#include "../src/typed_output.h"
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+using Clock = chrono::steady_clock;
+
+/**
+ * @struct SinkLog
+ * @brief What the fake sink received, shared with the test
+ */
+struct SinkLog {
+    mutex m;
+    vector<u16string> batches;
+    size_t refuseAt{SIZE_MAX};  // Index of the first batch to refuse
+    int delayMs{};              // Time each batch takes to type
+
+    u16string Joined() {
+        lock_guard<mutex> lock(m);
+        u16string s;
+        for (const u16string& b : batches) s += b;
+        return s;
+    }
+    vector<u16string> Batches() {
+        lock_guard<mutex> lock(m);
+        return batches;
+    }
+};
+
+/**
+ * @class FakeSink
+ * @brief Records batches into a SinkLog
+ */
+class FakeSink : public KeystrokeSink {
+public:
+    explicit FakeSink(shared_ptr<SinkLog> log) : log_(move(log)) {}
+    bool Type(u16string_view units) override {
+        if (log_->delayMs) this_thread::sleep_for(chrono::milliseconds(log_->delayMs));
+        lock_guard<mutex> lock(log_->m);
+        if (log_->batches.size() >= log_->refuseAt) return false;
+        log_->batches.emplace_back(units);
+        return true;
+    }
+
+private:
+    shared_ptr<SinkLog> log_;
+};
+
+unique_ptr<KeystrokeInjector> MakeInjector(const shared_ptr<SinkLog>& log, size_t maxBatch, unsigned intervalMs, unsigned charsPerSecond = 0) {
+    TypingOptions opt;
+    opt.maxBatch = maxBatch;
+    opt.intervalMs = intervalMs;
+    opt.charsPerSecond = charsPerSecond;
+    return make_unique<KeystrokeInjector>(make_unique<FakeSink>(log), opt);
+}
+
+bool IsHigh(char16_t c) { return c >= 0xD800 && c <= 0xDBFF; }
+bool IsLow(char16_t c) { return c >= 0xDC00 && c <= 0xDFFF; }
+
+}  // namespace
+
+int main() {
+    {
+        // Typed text is the pushed text, "\r\n" typed as one Enter
+        auto log = make_shared<SinkLog>();
+        auto injector = MakeInjector(log, 64, 0);
+        injector->Push(L"Hello, ");
+        injector->Push(L"world\r\n");
+        injector->Push(L"line two\ttab");
+        Check(injector->Finish(), "plain text finished");
+        Check(log->Joined() == u"Hello, world\nline two\ttab", "sink received the text without carriage returns");
+        Check(injector->Typed() == L"Hello, world\nline two\ttab", "Typed() reports what the sink received");
+        const TypingStats s = injector->Stats();
+        Check(s.pushed == 3 && s.units == 25 && !s.aborted, "plain text counters");
+        injector->Abort();
+        Check(!injector->Stats().aborted, "Abort after Finish is not an abort");
+    }
+
+    {
+        // A long delta is cut into batches of at most maxBatch units
+        auto log = make_shared<SinkLog>();
+        auto injector = MakeInjector(log, 8, 0);
+        const wstring text(100, L'x');
+        injector->Push(text);
+        Check(injector->Finish(), "long delta finished");
+        bool within = true;
+        for (const u16string& b : log->Batches()) within = within && !b.empty() && b.size() <= 8;
+        Check(within && log->Batches().size() == 13, "long delta cut into batches of maxBatch (" + to_string(log->Batches().size()) + ")");
+        Check(injector->Typed() == text, "long delta typed in full");
+    }
+
+    {
+        // Characters outside the BMP: batch boundaries never fall inside a surrogate pair
+        auto log = make_shared<SinkLog>();
+        auto injector = MakeInjector(log, 3, 0);
+        wstring text;
+        for (int i = 0; i < 20; ++i) text += (i % 3 == 0) ? wstring(1, static_cast<wchar_t>(0x1F600 + i)) : wstring(L"a");
+        injector->Push(text);
+        Check(injector->Finish(), "surrogate text finished");
+        bool whole = true;
+        for (const u16string& b : log->Batches()) whole = whole && !IsHigh(b.back()) && !IsLow(b.front());
+        Check(whole, "no batch splits a surrogate pair");
+        Check(injector->Typed() == text, "surrogate text typed in full");
+    }
+
+    {
+        // A high surrogate pushed on its own waits for its partner (wchar_t is UTF-32 here, so push the halves)
+        auto log = make_shared<SinkLog>();
+        auto injector = MakeInjector(log, 64, 0);
+        injector->Push(wstring(1, static_cast<wchar_t>(0xD83D)));
+        this_thread::sleep_for(chrono::milliseconds(50));
+        Check(log->Batches().empty(), "lone high surrogate held back");
+        injector->Push(wstring(1, static_cast<wchar_t>(0xDE00)));
+        Check(injector->Finish(), "split surrogate pair finished");
+        Check(log->Batches().size() == 1 && log->Joined() == u"\U0001F600", "surrogate pair typed in one batch");
+    }
+
+    {
+        // A burst of small deltas is coalesced into a few batches
+        auto log = make_shared<SinkLog>();
+        auto injector = MakeInjector(log, 64, 50);
+        wstring text;
+        for (int i = 0; i < 100; ++i) {
+            injector->Push(L"ab");
+            text += L"ab";
+        }
+        Check(injector->Finish(), "burst finished");
+        const TypingStats s = injector->Stats();
+        Check(s.pushed == 100 && s.batches <= 6, "burst of 100 deltas coalesced (" + to_string(s.batches) + " batches)");
+        Check(s.maxBacklog > 64, "backlog built up during the pause");
+        Check(injector->Typed() == text, "burst typed in full");
+    }
+
+    {
+        // charsPerSecond paces the batches: 50 units at 1000/s in batches of 10 take about 40 ms
+        auto log = make_shared<SinkLog>();
+        auto injector = MakeInjector(log, 10, 0, 1000);
+        const auto start = Clock::now();
+        injector->Push(wstring(50, L'y'));
+        Check(injector->Finish(), "paced text finished");
+        const double ms = chrono::duration<double, milli>(Clock::now() - start).count();
+        Check(log->Batches().size() == 5 && ms >= 38, "charsPerSecond paces the batches (" + to_string(ms) + " ms)");
+    }
+
+    {
+        // A refused batch stops typing: only the batches before it were typed, later pushes are dropped
+        auto log = make_shared<SinkLog>();
+        log->refuseAt = 1;
+        auto injector = MakeInjector(log, 4, 0);
+        injector->Push(L"0123456789");
+        this_thread::sleep_for(chrono::milliseconds(50));
+        injector->Push(L"more");
+        Check(!injector->Finish(), "refused batch reported by Finish");
+        Check(injector->Stats().aborted && injector->Typed() == L"0123", "only the accepted batch typed");
+    }
+
+    {
+        // Abort drops the backlog at once; what was typed is a prefix of what was pushed
+        auto log = make_shared<SinkLog>();
+        log->delayMs = 20;
+        auto injector = MakeInjector(log, 4, 0);
+        const wstring text(400, L'z');
+        injector->Push(text);
+        this_thread::sleep_for(chrono::milliseconds(50));
+        const auto start = Clock::now();
+        injector->Abort();
+        Check(Clock::now() - start < chrono::milliseconds(100), "Abort returns at once");
+        Check(!injector->Finish(), "aborted typing reported by Finish");
+        const wstring typed = injector->Typed();
+        Check(!typed.empty() && typed.size() < text.size() && text.compare(0, typed.size(), typed) == 0, "aborted typing left a prefix (" + to_string(typed.size()) + " units)");
+    }
+
+    {
+        // Two hedged streams: the primary streams first but stalls, the backup finishes first; only the backup is typed
+        auto log = make_shared<SinkLog>();
+        auto injector = MakeInjector(log, 64, 0);
+        HedgeStreams streams(2);
+        const wstring winnerText = L"backup answer, complete";
+        HedgeResult race = RunHedged(2, [](size_t) { return chrono::milliseconds(20); }, [&](HedgeAttempt& a) {
+            if (a.Index() == 0) {
+                while (!a.Token().IsCancelled()) {
+                    streams.Add(0, L"primary ");
+                    this_thread::sleep_for(chrono::milliseconds(5));
+                }
+                return false;
+            }
+            for (size_t i = 0; i < winnerText.size(); i += 5) streams.Add(1, winnerText.substr(i, 5));
+            return true;
+        });
+        Check(race.winner == 1 && race.launched == 2, "backup won the hedged race");
+        Check(log->Batches().empty(), "nothing typed before the race is decided");
+        streams.Forward(static_cast<size_t>(race.winner), [&](const wstring& delta) { injector->Push(delta); });
+        Check(injector->Finish(), "hedged stream finished");
+        Check(injector->Typed() == winnerText, "only the winner's stream typed");
+    }
+
+    if (CheckFailures() != 0) return 1;
+    printf("typing_test: ok\n");
+    return 0;
+}
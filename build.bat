@@ -20,6 +20,6 @@ rc /nologo /fo cbfilter.res cbfilter.rc
 
 rem Build with cl (C++20)
 cl /nologo /EHsc /std:c++20 /utf-8 /I. /DUNICODE /D_UNICODE /DWIN32_LEAN_AND_MEAN /W4 %DEBUG_FLAGS% /Fe:cbfilter.exe ^
-    src\main.cpp src\clipboard_processor.cpp cbfilter.res ^
-    user32.lib gdi32.lib comctl32.lib shell32.lib winhttp.lib windowsapp.lib gdiplus.lib crypt32.lib ole32.lib
+    src\main.cpp src\clipboard_processor.cpp src\filter_engine.cpp src\filter_config.cpp src\json_value.cpp src\http_client.cpp src\sse_parser.cpp src\template_render.cpp src\api_payload.cpp src\json_path.cpp src\utf8.cpp src\base64.cpp src\image_scale.cpp src\response_cache.cpp src\job_queue.cpp src\text_chunker.cpp src\trace.cpp src\cancel_token.cpp src\hedge.cpp src\rate_limit.cpp src\clipboard_prefetch.cpp src\string_table.cpp src\typed_output.cpp src\usage_stats.cpp cbfilter.res ^
+    user32.lib gdi32.lib comctl32.lib shell32.lib winhttp.lib windowsapp.lib gdiplus.lib crypt32.lib ole32.lib comdlg32.lib
 endlocal
@@ -0,0 +1,16 @@
+#!/bin/sh
+# Build the portable filter engine (build/libcbfilter.a) and cbfilter-cli (Linux/macOS, needs libcurl)
+set -e
+cd "$(dirname "$0")"
+CXX=${CXX:-g++}
+CXXFLAGS=${CXXFLAGS:--std=c++20 -O2 -Wall -Wextra}
+mkdir -p build
+objs=""
+for src in filter_engine filter_config json_value batch_runner http_curl api_payload json_path template_render utf8 base64 \
+        image_scale response_cache hedge rate_limit cancel_token trace text_chunker job_queue sse_parser usage_stats; do
+    $CXX $CXXFLAGS -pthread -c "src/$src.cpp" -o "build/$src.o"
+    objs="$objs build/$src.o"
+done
+rm -f build/libcbfilter.a
+ar rcs build/libcbfilter.a $objs
+$CXX $CXXFLAGS -pthread -o cbfilter-cli src/cbfilter_cli.cpp build/libcbfilter.a -lcurl
@@ -0,0 +1,193 @@
+/**
+ * @file api_payload.cpp
+ * @brief Implementation of request building and response extraction
+ */
+
+#include "api_payload.h"
+#include "base64.h"
+#include "json_path.h"
+
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+string ExtractContent(string_view json) {
+    size_t p = json.find("\"content\"");
+    if (p == string_view::npos) return "";
+    p = json.find('"', p + 9);
+    if (p == string_view::npos) return "";
+    ++p;
+    string out;
+    while (p < json.size() && json[p] != '"') {
+        if (json[p] == '\\' && p + 1 < json.size()) {
+            if (json[p + 1] == 'n') { out += '\n'; p += 2; continue; }
+            if (json[p + 1] == '"') { out += '"'; p += 2; continue; }
+        }
+        out += json[p]; ++p;
+    }
+    return out;
+}
+
+string ExtractB64Image(string_view json) {
+    size_t p = json.find("\"b64_json\"");
+    if (p == string_view::npos) return "";
+    p = json.find('"', p + 10);
+    if (p == string_view::npos) return "";
+    ++p;
+    string out;
+    while (p < json.size() && json[p] != '"') {
+        if (json[p] == '\\' && p + 1 < json.size()) {
+            if (json[p + 1] == '"') { out += '"'; p += 2; continue; }
+            if (json[p + 1] == '\\') { out += '\\'; p += 2; continue; }
+            if (json[p + 1] == '/') { out += '/'; p += 2; continue; }
+        }
+        out += json[p]; ++p;
+    }
+    return out;
+}
+
+string ExtractImageFromChatResponse(string_view json) {
+    // Look for "images" array in the response
+    size_t imagesPos = json.find("\"images\"");
+    if (imagesPos == string_view::npos) {
+        // Try alternative: "image_url" directly
+        imagesPos = json.find("\"image_url\"");
+        if (imagesPos == string_view::npos) return "";
+    }
+    
+    // Find image_url.url field (could be "image_url" or "imageUrl")
+    size_t urlPos = json.find("\"image_url\"", imagesPos);
+    if (urlPos == string_view::npos) {
+        urlPos = json.find("\"imageUrl\"", imagesPos);
+    }
+    if (urlPos == string_view::npos) return "";
+    
+    // Find url field (could be "url" or nested structure)
+    size_t urlFieldPos = json.find("\"url\"", urlPos);
+    if (urlFieldPos == string_view::npos) return "";
+    
+    // Find the value (data:image/png;base64,...)
+    // Skip to the colon and opening quote
+    size_t colonPos = json.find(':', urlFieldPos + 5);
+    if (colonPos == string_view::npos) return "";
+    
+    // Find the opening quote after colon
+    size_t valueStart = json.find('"', colonPos);
+    if (valueStart == string_view::npos) return "";
+    valueStart++;
+    
+    // Find the closing quote, but handle escaped quotes
+    size_t valueEnd = valueStart;
+    while (valueEnd < json.length()) {
+        if (json[valueEnd] == '"' && (valueEnd == valueStart || json[valueEnd - 1] != '\\')) {
+            break;
+        }
+        valueEnd++;
+    }
+    if (valueEnd >= json.length()) return "";
+    
+    string_view dataUrl = json.substr(valueStart, valueEnd - valueStart);
+    
+    // Unescape JSON string
+    string unescaped;
+    for (size_t i = 0; i < dataUrl.length(); ++i) {
+        if (dataUrl[i] == '\\' && i + 1 < dataUrl.length()) {
+            if (dataUrl[i + 1] == '\\') { unescaped += '\\'; i++; continue; }
+            if (dataUrl[i + 1] == '"') { unescaped += '"'; i++; continue; }
+            if (dataUrl[i + 1] == 'n') { unescaped += '\n'; i++; continue; }
+            if (dataUrl[i + 1] == 'r') { unescaped += '\r'; i++; continue; }
+            if (dataUrl[i + 1] == 't') { unescaped += '\t'; i++; continue; }
+        }
+        unescaped += dataUrl[i];
+    }
+    
+    // Extract base64 part (remove "data:image/png;base64," prefix)
+    size_t commaPos = unescaped.find(',');
+    if (commaPos != string::npos) {
+        return unescaped.substr(commaPos + 1);
+    }
+    
+    return unescaped; // Return as-is if no comma found
+}
+
+bool PrepareEndpoint(const wstring& serverUrl, const wstring& tplPath, wstring& host, wstring& path, bool& useHttps) {
+    host = serverUrl;
+    path = tplPath;
+    if (path.empty()) path = L"/v1/chat/completions";
+    // If template path is absolute URL, override host/path
+    if (path.rfind(L"http://", 0) == 0 || path.rfind(L"https://", 0) == 0) {
+        host = path;
+        path = L"";
+    }
+    if (host.rfind(L"https://", 0) == 0) { host = host.substr(8); useHttps = true; }
+    else if (host.rfind(L"http://", 0) == 0) { host = host.substr(7); useHttps = false; }
+    size_t slash = host.find(L'/');
+    if (slash != wstring::npos) {
+        path = host.substr(slash) + (path.empty() ? L"" : path);
+        host = host.substr(0, slash);
+    }
+    if (!path.empty() && path.front() != L'/') path = L"/" + path;
+    return !host.empty();
+}
+
+bool SplitHostPort(wstring_view hostPort, bool useHttps, wstring& host, unsigned short& port) {
+    port = useHttps ? 443 : 80;
+    wstring_view name = hostPort;
+    wstring_view portText;
+    if (!name.empty() && name.front() == L'[') {
+        size_t close = name.find(L']');
+        if (close == wstring_view::npos) return false;
+        if (close + 1 < name.size()) {
+            if (name[close + 1] != L':') return false;
+            portText = name.substr(close + 2);
+        }
+        name = name.substr(1, close - 1);
+    } else if (size_t colon = name.rfind(L':'); colon != wstring_view::npos && name.find(L':') == colon) {
+        portText = name.substr(colon + 1);
+        name = name.substr(0, colon);
+    }
+    host.assign(name);
+    if (portText.empty()) return !host.empty();
+    unsigned long value = 0;
+    for (wchar_t c : portText) {
+        if (c < L'0' || c > L'9') return false;
+        value = value * 10 + static_cast<unsigned long>(c - L'0');
+        if (value > 65535) return false;
+    }
+    if (value == 0) return false;
+    port = static_cast<unsigned short>(value);
+    return !host.empty();
+}
+
+string ExtractByPath(string_view json, wstring_view path) {
+    string out;
+    JsonPath::Compile(path).Extract(json, out);
+    return out;
+}
+
+string BuildMultipartBody(string_view boundary, string_view model, string_view prompt, string_view imageB64, string_view imageMime) {
+    vector<uint8_t> img;
+    if (!imageB64.empty() && !Base64Decode(imageB64, img)) img.clear();
+    string b = "";
+    const string bnd(boundary);
+    auto addText = [&](const string& name, string_view value) {
+        b += "--" + bnd + "\r\n";
+        b += "Content-Disposition: form-data; name=\"" + name + "\"\r\n\r\n";
+        b += value;
+        b += "\r\n";
+    };
+    addText("model", model);
+    addText("prompt", prompt);
+    if (!img.empty()) {
+        b += "--" + bnd + "\r\n";
+        string mime = imageMime.empty() ? "image/png" : string(imageMime);
+        string ext = mime.substr(mime.find('/') + 1);
+        b += "Content-Disposition: form-data; name=\"image\"; filename=\"image." + ext + "\"\r\n";
+        b += "Content-Type: " + mime + "\r\n\r\n";
+        b.insert(b.end(), img.begin(), img.end());
+        b += "\r\n";
+    }
+    b += "--" + bnd + "--\r\n";
+    return b;
+}
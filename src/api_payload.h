@@ -0,0 +1,76 @@
+/**
+ * @file api_payload.h
+ * @brief Request building and response extraction for apidef templates
+ *
+ * These helpers sit on the request/response hot path of every filter run and
+ * are kept free of Win32 so they can be benchmarked on any platform (see
+ * bench/). Request bodies and responses are UTF-8 byte buffers.
+ */
+
+#pragma once
+
+#include <string>
+#include <string_view>
+
+/**
+ * @brief Extract content field from OpenAI API JSON response
+ * @param json JSON response string
+ * @return Extracted content text, or empty string if not found
+ */
+std::string ExtractContent(std::string_view json);
+
+/**
+ * @brief Extract base64 image data from OpenAI image generation API response
+ * @param json JSON response string
+ * @return Base64-encoded image data, or empty string if not found
+ */
+std::string ExtractB64Image(std::string_view json);
+
+/**
+ * @brief Extract image URL from OpenRouter chat/completions response
+ * @param json JSON response string
+ * @return Base64-encoded image data (without data:image/png;base64, prefix), or empty string if not found
+ */
+std::string ExtractImageFromChatResponse(std::string_view json);
+
+/**
+ * @brief Extract value from JSON by path
+ * @param json JSON string (UTF-8)
+ * @param path Path to extract (e.g., "choices[0].message.content")
+ * @return Extracted value, or empty string if not found
+ *
+ * Compiles the path on every call; use JsonPath directly for paths that are reused.
+ */
+std::string ExtractByPath(std::string_view json, std::wstring_view path);
+
+/**
+ * @brief Prepare endpoint for HTTP request
+ * @param serverUrl Server URL
+ * @param tplPath Template path
+ * @param host Host name
+ * @param path Path
+ * @param useHttps Use HTTPS
+ * @return true if endpoint is valid, false otherwise
+ */
+bool PrepareEndpoint(const std::wstring& serverUrl, const std::wstring& tplPath, std::wstring& host, std::wstring& path, bool& useHttps);
+
+/**
+ * @brief Split the host returned by PrepareEndpoint into name and port
+ * @param hostPort Host with an optional ":port" ("[::1]:8080" for IPv6 literals)
+ * @param useHttps Selects the default port (443 or 80) when none is given
+ * @param host Host name or address without brackets
+ * @param port Port number
+ * @return false if the port is not a number in 1-65535
+ */
+bool SplitHostPort(std::wstring_view hostPort, bool useHttps, std::wstring& host, unsigned short& port);
+
+/**
+ * @brief Build multipart/form-data body for API request
+ * @param boundary Boundary string
+ * @param model Model name
+ * @param prompt Prompt text
+ * @param imageB64 Base64 encoded image data
+ * @param imageMime MIME type of the encoded image
+ * @return Multipart/form-data body string
+ */
+std::string BuildMultipartBody(std::string_view boundary, std::string_view model, std::string_view prompt, std::string_view imageB64, std::string_view imageMime);
@@ -0,0 +1,426 @@
+/**
+ * @file base64.cpp
+ * @brief Implementation of the base64 codec
+ *
+ * The SIMD kernels follow the well-known pshufb based approach: the encoder
+ * reshuffles 12 input bytes into four 32-bit lanes, extracts the sextets with
+ * two multiplies and maps them to ASCII through a 16-entry offset table; the
+ * decoder validates 16 characters with range compares and merges the sextets
+ * back with pmaddubsw/pmaddwd. Blocks containing anything else (padding,
+ * whitespace, garbage) are handed to the scalar path.
+ */
+
+#include "base64.h"
+
+#include <atomic>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define CBF_BASE64_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define CBF_TARGET(x)
+#else
+#define CBF_TARGET(x) __attribute__((target(x)))
+#endif
+#endif
+
+using namespace std;
+
+namespace {
+constexpr char kAlphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// Decode table values besides 0..63
+constexpr int8_t kInvalid = -1;
+constexpr int8_t kSpace = -2;
+constexpr int8_t kPad = -3;
+
+struct DecodeTable {
+    int8_t v[256];
+    constexpr DecodeTable() : v{} {
+        for (int i = 0; i < 256; ++i) v[i] = kInvalid;
+        for (int i = 0; i < 64; ++i) v[static_cast<unsigned char>(kAlphabet[i])] = static_cast<int8_t>(i);
+        v[static_cast<unsigned char>(' ')] = kSpace;
+        v[static_cast<unsigned char>('\t')] = kSpace;
+        v[static_cast<unsigned char>('\r')] = kSpace;
+        v[static_cast<unsigned char>('\n')] = kSpace;
+        v[static_cast<unsigned char>('=')] = kPad;
+    }
+};
+constexpr DecodeTable kDecode;
+
+/**
+ * @brief Encode whole 3-byte groups with the scalar path
+ * @return Number of input bytes consumed (multiple of 3)
+ */
+size_t EncodeScalar(const uint8_t* src, size_t size, char* out) {
+    size_t i = 0;
+    for (; i + 3 <= size; i += 3) {
+        uint32_t n = (uint32_t(src[i]) << 16) | (uint32_t(src[i + 1]) << 8) | src[i + 2];
+        *out++ = kAlphabet[(n >> 18) & 63];
+        *out++ = kAlphabet[(n >> 12) & 63];
+        *out++ = kAlphabet[(n >> 6) & 63];
+        *out++ = kAlphabet[n & 63];
+    }
+    return i;
+}
+
+/**
+ * @brief Encode the final 1 or 2 bytes with padding
+ */
+void EncodeTail(const uint8_t* src, size_t rem, char* out) {
+    if (rem == 0) return;
+    uint32_t n = uint32_t(src[0]) << 16;
+    if (rem == 2) n |= uint32_t(src[1]) << 8;
+    out[0] = kAlphabet[(n >> 18) & 63];
+    out[1] = kAlphabet[(n >> 12) & 63];
+    out[2] = rem == 2 ? kAlphabet[(n >> 6) & 63] : '=';
+    out[3] = '=';
+}
+
+#if CBF_BASE64_X86
+enum class SimdLevel { Scalar, Ssse3, Avx2 };
+
+SimdLevel DetectSimd() {
+#if defined(_MSC_VER)
+    int info[4]{};
+    __cpuid(info, 0);
+    const int maxLeaf = info[0];
+    __cpuid(info, 1);
+    const bool ssse3 = (info[2] & (1 << 9)) != 0;
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx2 = false;
+    if (maxLeaf >= 7 && osxsave && (_xgetbv(0) & 0x6) == 0x6) {
+        __cpuidex(info, 7, 0);
+        avx2 = (info[1] & (1 << 5)) != 0;
+    }
+    if (avx2) return SimdLevel::Avx2;
+    if (ssse3) return SimdLevel::Ssse3;
+    return SimdLevel::Scalar;
+#else
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return SimdLevel::Avx2;
+    if (__builtin_cpu_supports("ssse3")) return SimdLevel::Ssse3;
+    return SimdLevel::Scalar;
+#endif
+}
+
+SimdLevel DetectedSimd() {
+    static const SimdLevel level = DetectSimd();
+    return level;
+}
+
+atomic<int> g_forcedSimd{-1};  // SimdLevel chosen by Base64SetImplementation, -1 for the detected one
+
+SimdLevel Simd() {
+    const int forced = g_forcedSimd.load(memory_order_relaxed);
+    return forced < 0 ? DetectedSimd() : static_cast<SimdLevel>(forced);
+}
+
+CBF_TARGET("ssse3") inline __m128i EncodeLanes128(__m128i in) {
+    in = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+    const __m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+    const __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+    const __m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+    const __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+    const __m128i indices = _mm_or_si128(t1, t3);
+    __m128i shift = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+    const __m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+    shift = _mm_or_si128(shift, _mm_and_si128(less, _mm_set1_epi8(13)));
+    const __m128i lut = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                      '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+    return _mm_add_epi8(_mm_shuffle_epi8(lut, shift), indices);
+}
+
+CBF_TARGET("ssse3") size_t EncodeSsse3(const uint8_t* src, size_t size, char* out) {
+    size_t i = 0;
+    // Each step reads 16 bytes but consumes 12
+    for (; i + 16 <= size; i += 12, out += 16) {
+        __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out), EncodeLanes128(in));
+    }
+    return i;
+}
+
+CBF_TARGET("avx2") size_t EncodeAvx2(const uint8_t* src, size_t size, char* out) {
+    size_t i = 0;
+    const __m256i shuf = _mm256_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1,
+                                         10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1);
+    const __m256i lut = _mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                         '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0,
+                                         'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                         '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+    // Each step reads 12+16 bytes but consumes 24
+    for (; i + 28 <= size; i += 24, out += 32) {
+        __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + 12));
+        __m256i in = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+        in = _mm256_shuffle_epi8(in, shuf);
+        const __m256i t0 = _mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00));
+        const __m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+        const __m256i t2 = _mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0));
+        const __m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+        const __m256i indices = _mm256_or_si256(t1, t3);
+        __m256i shift = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+        const __m256i less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices);
+        shift = _mm256_or_si256(shift, _mm256_and_si256(less, _mm256_set1_epi8(13)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), _mm256_add_epi8(_mm256_shuffle_epi8(lut, shift), indices));
+    }
+    return i;
+}
+
+CBF_TARGET("ssse3") inline __m128i InRange128(__m128i in, char lo, char hi) {
+    return _mm_and_si128(_mm_cmpgt_epi8(in, _mm_set1_epi8(static_cast<char>(lo - 1))),
+                         _mm_cmplt_epi8(in, _mm_set1_epi8(static_cast<char>(hi + 1))));
+}
+
+CBF_TARGET("avx2") inline __m256i InRange256(__m256i in, char lo, char hi) {
+    return _mm256_and_si256(_mm256_cmpgt_epi8(in, _mm256_set1_epi8(static_cast<char>(lo - 1))),
+                            _mm256_cmpgt_epi8(_mm256_set1_epi8(static_cast<char>(hi + 1)), in));
+}
+
+CBF_TARGET("ssse3") inline bool DecodeLanes128(__m128i in, __m128i& packed) {
+    const __m128i upper = InRange128(in, 'A', 'Z');
+    const __m128i lower = InRange128(in, 'a', 'z');
+    const __m128i digit = InRange128(in, '0', '9');
+    const __m128i plus = _mm_cmpeq_epi8(in, _mm_set1_epi8('+'));
+    const __m128i slash = _mm_cmpeq_epi8(in, _mm_set1_epi8('/'));
+    const __m128i valid = _mm_or_si128(_mm_or_si128(upper, lower), _mm_or_si128(digit, _mm_or_si128(plus, slash)));
+    if (_mm_movemask_epi8(valid) != 0xFFFF) return false;
+    __m128i shift = _mm_and_si128(upper, _mm_set1_epi8(-65));
+    shift = _mm_or_si128(shift, _mm_and_si128(lower, _mm_set1_epi8(-71)));
+    shift = _mm_or_si128(shift, _mm_and_si128(digit, _mm_set1_epi8(4)));
+    shift = _mm_or_si128(shift, _mm_and_si128(plus, _mm_set1_epi8(19)));
+    shift = _mm_or_si128(shift, _mm_and_si128(slash, _mm_set1_epi8(16)));
+    const __m128i values = _mm_add_epi8(in, shift);
+    const __m128i ab = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+    const __m128i abcd = _mm_madd_epi16(ab, _mm_set1_epi32(0x00011000));
+    packed = _mm_shuffle_epi8(abcd, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+    return true;
+}
+
+/**
+ * @return Number of input characters consumed (multiple of 16)
+ */
+CBF_TARGET("ssse3") size_t DecodeSsse3(const char* src, size_t size, uint8_t* out) {
+    size_t i = 0;
+    alignas(16) uint8_t tmp[16];
+    for (; i + 16 <= size; i += 16, out += 12) {
+        __m128i packed;
+        if (!DecodeLanes128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)), packed)) break;
+        _mm_store_si128(reinterpret_cast<__m128i*>(tmp), packed);
+        memcpy(out, tmp, 12);
+    }
+    return i;
+}
+
+/**
+ * @return Number of input characters consumed (multiple of 32)
+ */
+CBF_TARGET("avx2") size_t DecodeAvx2(const char* src, size_t size, uint8_t* out) {
+    size_t i = 0;
+    alignas(32) uint8_t tmp[32];
+    for (; i + 32 <= size; i += 32, out += 24) {
+        const __m256i in = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        const __m256i upper = InRange256(in, 'A', 'Z');
+        const __m256i lower = InRange256(in, 'a', 'z');
+        const __m256i digit = InRange256(in, '0', '9');
+        const __m256i plus = _mm256_cmpeq_epi8(in, _mm256_set1_epi8('+'));
+        const __m256i slash = _mm256_cmpeq_epi8(in, _mm256_set1_epi8('/'));
+        const __m256i valid = _mm256_or_si256(_mm256_or_si256(upper, lower), _mm256_or_si256(digit, _mm256_or_si256(plus, slash)));
+        if (static_cast<uint32_t>(_mm256_movemask_epi8(valid)) != 0xFFFFFFFFu) break;
+        __m256i shift = _mm256_and_si256(upper, _mm256_set1_epi8(-65));
+        shift = _mm256_or_si256(shift, _mm256_and_si256(lower, _mm256_set1_epi8(-71)));
+        shift = _mm256_or_si256(shift, _mm256_and_si256(digit, _mm256_set1_epi8(4)));
+        shift = _mm256_or_si256(shift, _mm256_and_si256(plus, _mm256_set1_epi8(19)));
+        shift = _mm256_or_si256(shift, _mm256_and_si256(slash, _mm256_set1_epi8(16)));
+        const __m256i values = _mm256_add_epi8(in, shift);
+        const __m256i ab = _mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140));
+        const __m256i abcd = _mm256_madd_epi16(ab, _mm256_set1_epi32(0x00011000));
+        const __m256i lanes = _mm256_shuffle_epi8(abcd, _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                                                                          2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+        // Close the gap between the two 12-byte lane results
+        const __m256i packed = _mm256_permutevar8x32_epi32(lanes, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7));
+        _mm256_store_si256(reinterpret_cast<__m256i*>(tmp), packed);
+        memcpy(out, tmp, 24);
+    }
+    return i;
+}
+#endif
+
+/**
+ * @brief Encode whole 3-byte groups using the best available path
+ * @return Number of input bytes consumed (multiple of 3)
+ */
+size_t EncodeBlocks(const uint8_t* src, size_t size, char* out) {
+    size_t done = 0;
+#if CBF_BASE64_X86
+    SimdLevel level = Simd();
+    if (level == SimdLevel::Avx2) done = EncodeAvx2(src, size, out);
+    if (level >= SimdLevel::Ssse3) done += EncodeSsse3(src + done, size - done, out + done / 3 * 4);
+#endif
+    done += EncodeScalar(src + done, size - done, out + done / 3 * 4);
+    return done;
+}
+
+/**
+ * @brief Decode full 16/32-character blocks of plain alphabet with SIMD
+ * @return Number of input characters consumed (multiple of 4)
+ */
+size_t DecodeBlocks(const char* src, size_t size, uint8_t* out) {
+    size_t done = 0;
+#if CBF_BASE64_X86
+    SimdLevel level = Simd();
+    if (level == SimdLevel::Avx2) done = DecodeAvx2(src, size, out);
+    if (level >= SimdLevel::Ssse3) done += DecodeSsse3(src + done, size - done, out + done / 4 * 3);
+#else
+    (void)src; (void)size; (void)out;
+#endif
+    return done;
+}
+} // namespace
+
+const char* Base64Implementation() {
+#if CBF_BASE64_X86
+    switch (Simd()) {
+    case SimdLevel::Avx2: return "avx2";
+    case SimdLevel::Ssse3: return "ssse3";
+    default: break;
+    }
+#endif
+    return "scalar";
+}
+
+bool Base64SetImplementation(const char* name) {
+    const string_view n = name ? name : "";
+#if CBF_BASE64_X86
+    int level = -1;
+    if (n == "scalar") level = static_cast<int>(SimdLevel::Scalar);
+    else if (n == "ssse3") level = static_cast<int>(SimdLevel::Ssse3);
+    else if (n == "avx2") level = static_cast<int>(SimdLevel::Avx2);
+    else if (!n.empty()) return false;
+    if (level > static_cast<int>(DetectedSimd())) return false;
+    g_forcedSimd.store(level, memory_order_relaxed);
+    return true;
+#else
+    return n.empty() || n == "scalar";
+#endif
+}
+
+void Base64EncodeTo(const uint8_t* data, size_t size, char* out) {
+    size_t done = EncodeBlocks(data, size, out);
+    EncodeTail(data + done, size - done, out + done / 3 * 4);
+}
+
+void Base64EncodeAppend(const uint8_t* data, size_t size, string& out) {
+    size_t cur = out.size();
+    out.resize(cur + Base64EncodedLength(size));
+    Base64EncodeTo(data, size, out.data() + cur);
+}
+
+string Base64Encode(const uint8_t* data, size_t size) {
+    string out;
+    Base64EncodeAppend(data, size, out);
+    return out;
+}
+
+bool Base64Decode(string_view in, vector<uint8_t>& out) {
+    out.clear();
+    out.reserve(in.size() / 4 * 3 + 3);
+    Base64StreamDecoder dec;
+    return dec.Update(in.data(), in.size(), out) && dec.Finish(out);
+}
+
+bool Base64Decode(wstring_view in, vector<uint8_t>& out) {
+    out.clear();
+    out.reserve(in.size() / 4 * 3 + 3);
+    Base64StreamDecoder dec;
+    // Narrow in cache-sized chunks; non-ASCII code units become invalid bytes
+    char buf[16384];
+    for (size_t pos = 0; pos < in.size();) {
+        size_t n = in.size() - pos < sizeof(buf) ? in.size() - pos : sizeof(buf);
+        for (size_t i = 0; i < n; ++i) {
+            wchar_t c = in[pos + i];
+            buf[i] = c < 0x80 ? static_cast<char>(c) : '\x80';
+        }
+        if (!dec.Update(buf, n, out)) return false;
+        pos += n;
+    }
+    return dec.Finish(out);
+}
+
+void Base64StreamEncoder::Update(const uint8_t* data, size_t size, string& out) {
+    // Complete a group started by the previous chunk
+    while (carryLen_ > 0 && carryLen_ < 3 && size > 0) {
+        carry_[carryLen_++] = *data++;
+        --size;
+    }
+    if (carryLen_ == 3) {
+        size_t cur = out.size();
+        out.resize(cur + 4);
+        EncodeScalar(carry_, 3, out.data() + cur);
+        carryLen_ = 0;
+    }
+    size_t whole = size / 3 * 3;
+    if (whole > 0) {
+        size_t cur = out.size();
+        out.resize(cur + whole / 3 * 4);
+        EncodeBlocks(data, whole, out.data() + cur);
+    }
+    for (size_t i = whole; i < size; ++i) carry_[carryLen_++] = data[i];
+}
+
+void Base64StreamEncoder::Finish(string& out) {
+    if (carryLen_ == 0) return;
+    size_t cur = out.size();
+    out.resize(cur + 4);
+    EncodeTail(carry_, carryLen_, out.data() + cur);
+    carryLen_ = 0;
+}
+
+bool Base64StreamDecoder::Update(const char* data, size_t size, vector<uint8_t>& out) {
+    if (failed_) return false;
+    size_t i = 0;
+    while (i < size) {
+        // Fast path: group-aligned run of plain alphabet characters
+        if (count_ == 0 && !padded_ && size - i >= 16) {
+            uint8_t tmp[768];
+            size_t window = size - i < 1024 ? size - i : 1024;
+            size_t used = DecodeBlocks(data + i, window, tmp);
+            if (used > 0) {
+                out.insert(out.end(), tmp, tmp + used / 4 * 3);
+                i += used;
+                continue;
+            }
+        }
+        int8_t v = kDecode.v[static_cast<unsigned char>(data[i++])];
+        if (v == kSpace) continue;
+        if (v == kPad) { padded_ = true; continue; }
+        if (v == kInvalid || padded_) { failed_ = true; return false; }
+        acc_ = (acc_ << 6) | static_cast<uint32_t>(v);
+        if (++count_ == 4) {
+            out.push_back(static_cast<uint8_t>(acc_ >> 16));
+            out.push_back(static_cast<uint8_t>(acc_ >> 8));
+            out.push_back(static_cast<uint8_t>(acc_));
+            acc_ = 0;
+            count_ = 0;
+        }
+    }
+    return true;
+}
+
+bool Base64StreamDecoder::Finish(vector<uint8_t>& out) {
+    if (failed_) return false;
+    bool ok = true;
+    if (count_ == 1) ok = false;
+    else if (count_ == 2) out.push_back(static_cast<uint8_t>(acc_ >> 4));
+    else if (count_ == 3) {
+        out.push_back(static_cast<uint8_t>(acc_ >> 10));
+        out.push_back(static_cast<uint8_t>(acc_ >> 2));
+    }
+    acc_ = 0;
+    count_ = 0;
+    padded_ = false;
+    return ok;
+}
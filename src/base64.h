@@ -0,0 +1,114 @@
+/**
+ * @file base64.h
+ * @brief Portable base64 codec with SSSE3/AVX2 fast paths
+ *
+ * Encodes and decodes directly between byte buffers and ASCII (UTF-8)
+ * strings. On x86 the widest instruction set supported by the CPU is picked
+ * at runtime; other targets use the scalar implementation. The streaming
+ * classes let callers encode or decode in chunks, e.g. while a body is
+ * being uploaded or downloaded.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief Number of characters produced by encoding size bytes (with padding)
+ */
+constexpr size_t Base64EncodedLength(size_t size) { return (size + 2) / 3 * 4; }
+
+/**
+ * @brief Encode bytes into a caller-provided buffer
+ * @param data Input bytes
+ * @param size Number of input bytes
+ * @param out Output buffer of at least Base64EncodedLength(size) chars
+ */
+void Base64EncodeTo(const uint8_t* data, size_t size, char* out);
+
+/**
+ * @brief Append the base64 encoding of data to out
+ */
+void Base64EncodeAppend(const uint8_t* data, size_t size, std::string& out);
+
+/**
+ * @brief Encode bytes as a base64 string
+ */
+std::string Base64Encode(const uint8_t* data, size_t size);
+
+/**
+ * @brief Decode base64 text (whitespace is ignored, padding optional)
+ * @param in Base64 text
+ * @param out Decoded bytes (replaced)
+ * @return false if the input contains invalid characters
+ */
+bool Base64Decode(std::string_view in, std::vector<uint8_t>& out);
+
+/**
+ * @brief Decode base64 text held in a wide string
+ */
+bool Base64Decode(std::wstring_view in, std::vector<uint8_t>& out);
+
+/**
+ * @brief Name of the code path selected at runtime ("avx2", "ssse3" or "scalar")
+ */
+const char* Base64Implementation();
+
+/**
+ * @brief Force a code path ("scalar", "ssse3" or "avx2"; nullptr or "" restores detection)
+ * @return false if the name is unknown or the CPU lacks the instruction set
+ *
+ * For tests and benchmarks that compare the paths; not meant to be changed
+ * while other threads are encoding or decoding.
+ */
+bool Base64SetImplementation(const char* name);
+
+/**
+ * @class Base64StreamEncoder
+ * @brief Incremental encoder; output for complete 3-byte groups is produced immediately
+ */
+class Base64StreamEncoder {
+public:
+    /**
+     * @brief Encode the next chunk of input and append the produced characters
+     */
+    void Update(const uint8_t* data, size_t size, std::string& out);
+
+    /**
+     * @brief Encode the remaining bytes with padding
+     */
+    void Finish(std::string& out);
+
+private:
+    uint8_t carry_[3]{};
+    size_t carryLen_{};
+};
+
+/**
+ * @class Base64StreamDecoder
+ * @brief Incremental decoder accepting arbitrary chunk boundaries
+ */
+class Base64StreamDecoder {
+public:
+    /**
+     * @brief Decode the next chunk and append the produced bytes
+     * @return false once an invalid character has been seen
+     */
+    bool Update(const char* data, size_t size, std::vector<uint8_t>& out);
+
+    /**
+     * @brief Flush a trailing partial group
+     * @return false if the input ended in an impossible state
+     */
+    bool Finish(std::vector<uint8_t>& out);
+
+private:
+    uint32_t acc_{};
+    int count_{};
+    bool padded_{};
+    bool failed_{};
+};
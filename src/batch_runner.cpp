@@ -0,0 +1,357 @@
+/**
+ * @file batch_runner.cpp
+ * @brief Implementation of the directory batch runner and its journal
+ */
+
+#include "batch_runner.h"
+#include "base64.h"
+#include "image_scale.h"
+#include "job_queue.h"
+#include "text_chunker.h"
+#include "utf8.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+namespace {
+constexpr char kJournalMagic[] = "cbfilter-batch";
+constexpr char kJournalVersion[] = "1";
+constexpr char kDefaultJournalName[] = ".cbfilter-batch.journal";
+
+/**
+ * @brief Escape a journal field so it holds no tab or line break
+ */
+string EscapeField(string_view s) {
+    string out;
+    out.reserve(s.size());
+    for (char c : s) {
+        switch (c) {
+        case '\\': out += "\\\\"; break;
+        case '\t': out += "\\t"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        default: out += c; break;
+        }
+    }
+    return out;
+}
+
+string UnescapeField(string_view s) {
+    string out;
+    out.reserve(s.size());
+    for (size_t i = 0; i < s.size(); ++i) {
+        if (s[i] != '\\' || i + 1 == s.size()) { out += s[i]; continue; }
+        switch (s[++i]) {
+        case 't': out += '\t'; break;
+        case 'n': out += '\n'; break;
+        case 'r': out += '\r'; break;
+        default: out += s[i]; break;
+        }
+    }
+    return out;
+}
+
+vector<string_view> SplitTabs(string_view line) {
+    vector<string_view> fields;
+    for (size_t pos = 0;;) {
+        size_t tab = line.find('\t', pos);
+        fields.push_back(line.substr(pos, tab == string_view::npos ? string_view::npos : tab - pos));
+        if (tab == string_view::npos) break;
+        pos = tab + 1;
+    }
+    return fields;
+}
+
+string PathUtf8(const fs::path& p) {
+    const u8string u = p.generic_u8string();
+    return string(reinterpret_cast<const char*>(u.data()), u.size());
+}
+
+wstring PathText(const fs::path& p) {
+    return Utf8ToWide(PathUtf8(p));
+}
+
+/**
+ * @brief true if p is base or lies below it (both absolute and normalized)
+ */
+bool IsWithin(const fs::path& p, const fs::path& base) {
+    auto b = base.begin(), e = base.end();
+    auto i = p.begin();
+    for (; b != e; ++b, ++i) {
+        if (b->empty() && next(b) == e) break;  // Trailing separator
+        if (i == p.end() || *i != *b) return false;
+    }
+    return true;
+}
+
+FILE* OpenAppend(const fs::path& path) {
+#ifdef _WIN32
+    return _wfopen(path.c_str(), L"ab");
+#else
+    return fopen(path.c_str(), "ab");
+#endif
+}
+
+/**
+ * @brief Write a file under a temporary name and move it into place
+ *
+ * A crash leaves at most a .part file, never a truncated output that a
+ * later run would mistake for a result.
+ */
+bool WriteFileAtomically(const fs::path& path, string_view data) {
+    error_code ec;
+    fs::create_directories(path.parent_path(), ec);
+    fs::path tmp = path;
+    tmp += ".part";
+    {
+        ofstream out(tmp, ios::binary | ios::trunc);
+        if (!out) return false;
+        out.write(data.data(), static_cast<streamsize>(data.size()));
+        out.close();
+        if (!out) { fs::remove(tmp, ec); return false; }
+    }
+    fs::rename(tmp, path, ec);
+    if (ec) { fs::remove(tmp, ec); return false; }
+    return true;
+}
+
+const char* ImageExtension(ImageFormat fmt) {
+    switch (fmt) {
+    case ImageFormat::Jpeg: return ".jpg";
+    case ImageFormat::Webp: return ".webp";
+    default: return ".png";
+    }
+}
+
+/**
+ * @struct BatchItem
+ * @brief One input file and the output path it maps to (without extension)
+ */
+struct BatchItem {
+    fs::path relative;
+    fs::path outputStem;
+};
+} // namespace
+
+BatchJournal::~BatchJournal() {
+    Close();
+}
+
+bool BatchJournal::Open(const fs::path& path, const wstring& filter, const wstring& model, wstring& err) {
+    lock_guard<mutex> lock(mutex_);
+    done_.clear();
+    const string filterField = EscapeField(WideToUtf8(filter));
+    const string modelField = EscapeField(WideToUtf8(model));
+    string existing;
+    error_code ec;
+    if (fs::exists(path, ec) && !ReadFileBytes(path, existing)) {
+        err = L"cannot read journal " + PathText(path);
+        return false;
+    }
+    bool hasHeader = false;
+    size_t pos = 0;
+    // Only newline-terminated lines count: the last one may have been torn by a crash
+    for (size_t end; (end = existing.find('\n', pos)) != string::npos; pos = end + 1) {
+        string_view line(existing.data() + pos, end - pos);
+        if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+        vector<string_view> fields = SplitTabs(line);
+        if (!hasHeader) {
+            if (fields.size() < 4 || fields[0] != kJournalMagic) { err = PathText(path) + L" is not a batch journal"; return false; }
+            if (fields[2] != filterField || fields[3] != modelField) {
+                err = L"journal " + PathText(path) + L" belongs to filter \"" + Utf8ToWide(UnescapeField(fields[2])) + L"\" with model \"" + Utf8ToWide(UnescapeField(fields[3])) + L"\"";
+                return false;
+            }
+            hasHeader = true;
+        } else if (fields.size() >= 4 && fields[0] == "done") {
+            done_.insert(UnescapeField(fields[3]));
+        }
+    }
+    file_ = OpenAppend(path);
+    if (!file_) { err = L"cannot open journal " + PathText(path); return false; }
+    if (pos < existing.size() && fputc('\n', file_) == EOF) { err = L"cannot write journal " + PathText(path); return false; }
+    if (!hasHeader && !AppendLine(string(kJournalMagic) + '\t' + kJournalVersion + '\t' + filterField + '\t' + modelField)) {
+        err = L"cannot write journal " + PathText(path);
+        return false;
+    }
+    return true;
+}
+
+bool BatchJournal::IsDone(const string& key) const {
+    lock_guard<mutex> lock(mutex_);
+    return done_.count(key) != 0;
+}
+
+size_t BatchJournal::DoneCount() const {
+    lock_guard<mutex> lock(mutex_);
+    return done_.size();
+}
+
+bool BatchJournal::RecordDone(const string& key, uint64_t bytesIn, uint64_t bytesOut) {
+    lock_guard<mutex> lock(mutex_);
+    if (!file_) return false;
+    done_.insert(key);
+    return AppendLine("done\t" + to_string(bytesIn) + '\t' + to_string(bytesOut) + '\t' + EscapeField(key));
+}
+
+void BatchJournal::Close() {
+    lock_guard<mutex> lock(mutex_);
+    if (file_) fclose(file_);
+    file_ = nullptr;
+}
+
+bool BatchJournal::AppendLine(const string& line) {
+    // One write per line: concurrent appends never interleave inside a record
+    const string record = line + '\n';
+    if (fwrite(record.data(), 1, record.size(), file_) != record.size()) return false;
+    return fflush(file_) == 0;
+}
+
+bool RunBatch(const FilterEngine& engine, const FilterDefinition& f, const ModelConfig& m, const vector<ModelConfig>& hedgeModels, const BatchOptions& opt, BatchStats& stats, wstring& err, const BatchItemHandler& onItem, CancelToken* cancel) {
+    using Clock = chrono::steady_clock;
+    const Clock::time_point started = Clock::now();
+    stats = BatchStats{};
+    error_code ec;
+    if (!fs::is_directory(opt.inputDir, ec)) { err = L"not a directory: " + PathText(opt.inputDir); return false; }
+    fs::create_directories(opt.outputDir, ec);
+    if (!fs::is_directory(opt.outputDir, ec)) { err = L"cannot create " + PathText(opt.outputDir); return false; }
+    const fs::path inputAbs = fs::weakly_canonical(fs::absolute(opt.inputDir), ec);
+    const fs::path outputAbs = fs::weakly_canonical(fs::absolute(opt.outputDir), ec);
+    if (inputAbs == outputAbs) { err = L"input and output directories must differ"; return false; }
+    const fs::path journalPath = opt.journal.empty() ? opt.outputDir / kDefaultJournalName : opt.journal;
+    const fs::path journalAbs = fs::weakly_canonical(fs::absolute(journalPath), ec);
+
+    BatchJournal journal;
+    if (!journal.Open(journalPath, f.title, m.name, err)) return false;
+
+    // Sorted so that runs, resumes and output name collisions are deterministic
+    vector<fs::path> files;
+    for (fs::recursive_directory_iterator it(opt.inputDir, fs::directory_options::skip_permission_denied, ec), end; !ec && it != end; it.increment(ec)) {
+        const fs::path abs = fs::weakly_canonical(fs::absolute(it->path()), ec);
+        if (it->is_directory(ec)) {
+            // An output directory inside the input tree is not input
+            if (IsWithin(abs, outputAbs)) it.disable_recursion_pending();
+            continue;
+        }
+        if (!it->is_regular_file(ec) || abs == journalAbs) continue;
+        files.push_back(fs::relative(it->path(), opt.inputDir, ec));
+    }
+    if (ec) { err = L"cannot list " + PathText(opt.inputDir) + L": " + Utf8ToWide(ec.message()); return false; }
+    sort(files.begin(), files.end());
+    stats.total = files.size();
+
+    // "a.png" and "a.jpg" would both become "a.txt": colliding names keep their extension
+    map<fs::path, size_t> stemUses;
+    for (const fs::path& rel : files) ++stemUses[fs::path(rel).replace_extension()];
+    vector<BatchItem> items;
+    for (const fs::path& rel : files) {
+        if (journal.IsDone(PathUtf8(rel))) { ++stats.resumed; continue; }
+        fs::path stem = fs::path(rel).replace_extension();
+        items.push_back({ rel, stemUses[stem] > 1 ? rel : stem });
+    }
+
+    mutex statsMutex;
+    condition_variable finished;
+    size_t remaining = items.size();
+    auto report = [&](BatchItemResult& r, uint64_t bytesIn, uint64_t bytesOut, uint64_t tokens) {
+        lock_guard<mutex> lock(statsMutex);
+        if (r.ok) {
+            ++stats.completed;
+            stats.bytesIn += bytesIn;
+            stats.bytesOut += bytesOut;
+            stats.tokens += tokens;
+        } else {
+            ++stats.failed;
+        }
+        if (onItem) onItem(r, stats);
+    };
+    auto runItem = [&](const BatchItem& item) {
+        if (cancel && cancel->IsCancelled()) return;
+        BatchItemResult r;
+        r.input = item.relative;
+        string bytes;
+        if (!ReadFileBytes(opt.inputDir / item.relative, bytes)) {
+            r.error = L"cannot read input";
+            report(r, 0, 0, 0);
+            return;
+        }
+        wstring text;
+        string imageB64, imageMime;
+        FilterPayload payload;
+        if (f.input == IOType::Text) {
+            if (bytes.find('\0') != string::npos) { lock_guard<mutex> lock(statsMutex); ++stats.ignored; return; }
+            text = Utf8ToWide(bytes);
+            payload.text = text;
+        } else {
+            ImageFormat fmt;
+            if (!SniffImageFormat(reinterpret_cast<const uint8_t*>(bytes.data()), bytes.size(), fmt)) { lock_guard<mutex> lock(statsMutex); ++stats.ignored; return; }
+            imageB64 = Base64Encode(reinterpret_cast<const uint8_t*>(bytes.data()), bytes.size());
+            imageMime = WideToUtf8(ImageFormatMime(fmt));
+            payload.imageB64 = imageB64;
+            payload.imageMime = imageMime;
+        }
+        FilterOutput out;
+        const Clock::time_point t0 = Clock::now();
+        bool ok = engine.RunFilter(f, m, hedgeModels, payload, out, nullptr, cancel);
+        r.seconds = chrono::duration<double>(Clock::now() - t0).count();
+        // Interrupted items are neither failures nor done: the next run redoes them
+        if (cancel && cancel->IsCancelled()) return;
+        if (!ok) {
+            r.error = L"filter failed";
+            report(r, 0, 0, 0);
+            return;
+        }
+        string result;
+        fs::path outRel = item.outputStem;
+        uint64_t tokens = EstimateTokens(text);
+        if (f.output == IOType::Text) {
+            result = WideToUtf8(out.text);
+            outRel += ".txt";
+            tokens += EstimateTokens(out.text);
+        } else {
+            vector<uint8_t> image;
+            ImageFormat fmt = ImageFormat::Png;
+            if (!Base64Decode(out.imageB64, image) || !SniffImageFormat(image.data(), image.size(), fmt)) {
+                r.error = L"invalid image in response";
+                report(r, 0, 0, 0);
+                return;
+            }
+            result.assign(reinterpret_cast<const char*>(image.data()), image.size());
+            outRel += ImageExtension(fmt);
+        }
+        if (!WriteFileAtomically(opt.outputDir / outRel, result)) {
+            r.error = L"cannot write " + PathText(outRel);
+            report(r, 0, 0, 0);
+            return;
+        }
+        if (!journal.RecordDone(PathUtf8(item.relative), bytes.size(), result.size())) {
+            r.error = L"cannot write journal";
+            report(r, 0, 0, 0);
+            return;
+        }
+        r.ok = true;
+        r.output = outRel;
+        report(r, bytes.size(), result.size(), tokens);
+    };
+
+    {
+        JobQueue queue((std::max<size_t>)(1, opt.workers), (std::max<size_t>)(1, opt.perProvider));
+        for (const auto& [id, limit] : opt.providerLimits) queue.SetGroupLimit(id, limit);
+        for (const BatchItem& item : items) {
+            queue.Submit(m.providerId, [&, &item = item] {
+                runItem(item);
+                lock_guard<mutex> lock(statsMutex);
+                if (--remaining == 0) finished.notify_all();
+            });
+        }
+        // Once cancelled, queued items return without work, so this still ends promptly
+        unique_lock<mutex> lock(statsMutex);
+        finished.wait(lock, [&] { return remaining == 0; });
+    }
+    stats.seconds = chrono::duration<double>(Clock::now() - started).count();
+    return true;
+}
@@ -0,0 +1,142 @@
+/**
+ * @file batch_runner.h
+ * @brief Runs one filter over every file of a directory tree
+ *
+ * Files are submitted to a JobQueue grouped by API provider, so the worker
+ * count bounds the total concurrency and the per-provider limits (plus the
+ * provider's RateLimiter inside the engine) bound each API. Each result is
+ * written next to its relative path in the output directory as soon as it
+ * arrives, then recorded in an append-only journal; a later run with the
+ * same journal skips everything already recorded, so an interrupted batch
+ * resumes where it stopped.
+ */
+
+#pragma once
+
+#include "cancel_token.h"
+#include "filter_config.h"
+#include "filter_engine.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+/**
+ * @class BatchJournal
+ * @brief Append-only record of completed batch items
+ *
+ * Line-oriented UTF-8 text: a header naming the filter and model, then one
+ * "done" line per item. Every line is flushed as it is written, so a crash
+ * loses at most the line being written; a torn last line is ignored on the
+ * next open.
+ */
+class BatchJournal {
+public:
+    BatchJournal() = default;
+    ~BatchJournal();
+
+    /**
+     * @brief Open or create a journal and load the items it records
+     * @param path Journal file
+     * @param filter Filter title the batch runs
+     * @param model Model name the batch uses
+     * @param err Reason on failure
+     * @return false if the file cannot be opened or belongs to another filter/model
+     */
+    bool Open(const std::filesystem::path& path, const std::wstring& filter, const std::wstring& model, std::wstring& err);
+
+    /**
+     * @brief true if the item (relative path, '/'-separated) is recorded as done
+     */
+    bool IsDone(const std::string& key) const;
+
+    /**
+     * @brief Number of items recorded as done
+     */
+    size_t DoneCount() const;
+
+    /**
+     * @brief Append a completed item
+     * @return false if the line could not be written
+     */
+    bool RecordDone(const std::string& key, uint64_t bytesIn, uint64_t bytesOut);
+
+    void Close();
+
+    BatchJournal(const BatchJournal&) = delete;
+    BatchJournal& operator=(const BatchJournal&) = delete;
+
+private:
+    bool AppendLine(const std::string& line);
+
+    mutable std::mutex mutex_;
+    FILE* file_{};
+    std::set<std::string> done_;
+};
+
+/**
+ * @struct BatchOptions
+ * @brief Directories and concurrency of a batch run
+ */
+struct BatchOptions {
+    std::filesystem::path inputDir;    // Walked recursively
+    std::filesystem::path outputDir;   // Created if missing; mirrors inputDir's layout
+    std::filesystem::path journal;     // Default: .cbfilter-batch.journal in outputDir
+    size_t workers{4};                 // Items processed at once
+    size_t perProvider{2};             // Concurrent items per API provider
+    std::map<std::wstring, size_t> providerLimits;  // Per-provider overrides of perProvider
+};
+
+/**
+ * @struct BatchItemResult
+ * @brief Outcome of one file, reported as it completes
+ */
+struct BatchItemResult {
+    std::filesystem::path input;    // Relative to inputDir
+    std::filesystem::path output;   // Relative to outputDir (empty unless ok)
+    bool ok{};
+    std::wstring error;             // Reason when !ok
+    double seconds{};               // Wall time of the filter run
+};
+
+/**
+ * @struct BatchStats
+ * @brief Totals of a batch run (items skipped as done are not counted in the throughput)
+ */
+struct BatchStats {
+    size_t total{};        // Files found under inputDir
+    size_t completed{};    // Processed in this run
+    size_t resumed{};      // Skipped because the journal records them
+    size_t failed{};
+    size_t ignored{};      // Files the filter cannot take (not an image, binary for a text filter)
+    uint64_t bytesIn{};
+    uint64_t bytesOut{};
+    uint64_t tokens{};     // Estimated text tokens in and out (see EstimateTokens)
+    double seconds{};
+};
+
+/**
+ * @brief Receives each item's outcome and the totals so far (called from worker threads, serialized)
+ */
+using BatchItemHandler = std::function<void(const BatchItemResult& item, const BatchStats& progress)>;
+
+/**
+ * @brief Run a filter over a directory tree
+ * @param engine Engine with providers loaded
+ * @param f Filter to run
+ * @param m Model used by the filter
+ * @param hedgeModels Backup models raced against m (optional)
+ * @param opt Directories and concurrency
+ * @param stats Totals of the run
+ * @param err Reason when the batch could not start
+ * @param onItem Receives each completed item (optional)
+ * @param cancel Stops submitting and aborts items in flight (optional)
+ * @return false if the batch could not start (bad directories, journal); item failures are counted in stats
+ */
+bool RunBatch(const FilterEngine& engine, const FilterDefinition& f, const ModelConfig& m, const std::vector<ModelConfig>& hedgeModels, const BatchOptions& opt, BatchStats& stats, std::wstring& err, const BatchItemHandler& onItem = nullptr, CancelToken* cancel = nullptr);
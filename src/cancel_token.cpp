@@ -0,0 +1,56 @@
+/**
+ * @file cancel_token.cpp
+ * @brief Implementation of cooperative cancellation
+ */
+
+#include "cancel_token.h"
+
+#include <thread>
+
+using namespace std;
+
+void CancelToken::Cancel() {
+    lock_guard<mutex> lock(mutex_);
+    if (cancelled_.exchange(true, memory_order_acq_rel)) return;
+    for (auto& kv : callbacks_) kv.second();
+    callbacks_.clear();
+    cv_.notify_all();
+}
+
+bool CancelToken::WaitFor(chrono::milliseconds duration) {
+    unique_lock<mutex> lock(mutex_);
+    return !cv_.wait_for(lock, duration, [this] { return IsCancelled(); });
+}
+
+uint64_t CancelToken::Add(Callback fn) {
+    lock_guard<mutex> lock(mutex_);
+    if (IsCancelled()) {
+        fn();
+        return 0;
+    }
+    uint64_t id = nextId_++;
+    callbacks_.emplace(id, move(fn));
+    return id;
+}
+
+void CancelToken::Remove(uint64_t id) {
+    lock_guard<mutex> lock(mutex_);
+    callbacks_.erase(id);
+}
+
+CancelRegistration::CancelRegistration(CancelToken* token, CancelToken::Callback fn) : token_(token) {
+    if (token_) id_ = token_->Add(move(fn));
+}
+
+void CancelRegistration::Reset() {
+    if (token_ && id_) token_->Remove(id_);
+    token_ = nullptr;
+    id_ = 0;
+}
+
+bool SleepUnlessCancelled(CancelToken* token, chrono::milliseconds duration) {
+    if (duration.count() <= 0) return !token || !token->IsCancelled();
+    if (token) return token->WaitFor(duration);
+    this_thread::sleep_for(duration);
+    return true;
+}
@@ -0,0 +1,100 @@
+/**
+ * @file cancel_token.h
+ * @brief Cooperative cancellation with callbacks that abort blocking calls
+ *
+ * Code that waits on something it cannot poll (a blocking WinHTTP call, a
+ * condition variable) registers a callback that interrupts the wait, e.g. by
+ * closing the request handle. Cancel() runs the registered callbacks once on
+ * the cancelling thread.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+
+/**
+ * @class CancelToken
+ * @brief Cancellation flag shared by a requester and the code doing the work
+ */
+class CancelToken {
+public:
+    using Callback = std::function<void()>;
+
+    CancelToken() = default;
+    CancelToken(const CancelToken&) = delete;
+    CancelToken& operator=(const CancelToken&) = delete;
+
+    bool IsCancelled() const { return cancelled_.load(std::memory_order_acquire); }
+
+    /**
+     * @brief Set the flag and run every registered callback (later calls do nothing)
+     */
+    void Cancel();
+
+    /**
+     * @brief Sleep for a duration unless the token is cancelled first
+     * @return false if the token was cancelled
+     */
+    bool WaitFor(std::chrono::milliseconds duration);
+
+private:
+    friend class CancelRegistration;
+
+    /**
+     * @brief Register a callback; runs it at once if the token is already cancelled
+     * @return Registration id (0 if the callback already ran)
+     */
+    uint64_t Add(Callback fn);
+
+    /**
+     * @brief Remove a callback; once this returns the callback is not running and will not run
+     */
+    void Remove(uint64_t id);
+
+    // Held while callbacks run so that Remove waits for a callback in progress
+    std::mutex mutex_;
+    std::condition_variable cv_;  // Wakes WaitFor on Cancel
+    std::atomic<bool> cancelled_{};
+    std::map<uint64_t, Callback> callbacks_;
+    uint64_t nextId_{1};
+};
+
+/**
+ * @brief Sleep that ends early when a token is cancelled
+ * @param token Token to watch (nullptr sleeps the full duration)
+ * @return false if the token was cancelled
+ */
+bool SleepUnlessCancelled(CancelToken* token, std::chrono::milliseconds duration);
+
+/**
+ * @class CancelRegistration
+ * @brief Keeps a callback registered with a token for the lifetime of the object
+ *
+ * Callbacks run under the token's lock and must not touch the token themselves.
+ */
+class CancelRegistration {
+public:
+    /**
+     * @param token Token to watch (nullptr registers nothing)
+     * @param fn Called when the token is cancelled
+     */
+    CancelRegistration(CancelToken* token, CancelToken::Callback fn);
+    ~CancelRegistration() { Reset(); }
+    CancelRegistration(const CancelRegistration&) = delete;
+    CancelRegistration& operator=(const CancelRegistration&) = delete;
+
+    /**
+     * @brief Unregister early (later calls do nothing)
+     */
+    void Reset();
+
+private:
+    CancelToken* token_;
+    uint64_t id_{};
+};
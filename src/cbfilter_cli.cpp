@@ -0,0 +1,572 @@
+/**
+ * @file cbfilter_cli.cpp
+ * @brief Headless command line front end: runs one configured filter on a file or stdin
+ *
+ * Reads the same config.json and apidef files as the tray application and
+ * drives FilterEngine directly, so filters can be scripted, batched or
+ * chained in shell pipelines. Images are uploaded as read (PNG, JPEG or
+ * WebP) without the downscaling the Windows build applies. Given a
+ * directory as input, every file below it is run through the filter in
+ * parallel (see batch_runner.h). A fan-out filter runs all its branches at
+ * once; images come back as one numbered file per branch. A pipeline filter
+ * runs its stages in memory and writes only the last stage's output.
+ * With --stats, every request is added to a usage file and the totals per
+ * filter and model are printed when the run ends.
+ */
+
+#include "base64.h"
+#include "batch_runner.h"
+#include "cancel_token.h"
+#include "filter_config.h"
+#include "filter_engine.h"
+#include "rate_limit.h"
+#include "response_cache.h"
+#include "trace.h"
+#include "usage_stats.h"
+#include "utf8.h"
+
+#include <algorithm>
+#include <atomic>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cwctype>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <pthread.h>
+#include <unistd.h>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+namespace {
+constexpr int kExitOk = 0;
+constexpr int kExitFailed = 1;
+constexpr int kExitUsage = 2;
+constexpr int kExitCancelled = 130;
+constexpr size_t kStatsRecords = 10000;  // Records kept in a --stats file
+
+/**
+ * @struct CliOptions
+ * @brief Parsed command line
+ */
+struct CliOptions {
+    wstring filter;        // Filter title or index
+    wstring model;         // Model name or index overriding the filter's model
+    fs::path input;        // Input file (stdin if empty)
+    fs::path output;       // Output file (stdout if empty)
+    fs::path config;       // config.json
+    fs::path apidef;       // apidef directory
+    fs::path trace;        // Chrome trace output (none if empty)
+    fs::path journal;      // Batch journal (default: in the output directory)
+    fs::path stats;        // Usage statistics file (none if empty)
+    size_t jobs{};         // Batch items at once (0 = config.json "jobs" setting)
+    size_t perProvider{};  // Batch items at once per provider (0 = config.json)
+    bool stream{};         // Write text as it streams in
+    bool noCache{};        // Bypass the response cache
+    bool list{};           // List filters and models, then exit
+    bool verbose{};        // Engine diagnostics on stderr
+};
+
+void PrintUsage(FILE* out) {
+    fputs(
+        "usage: cbfilter-cli -f FILTER [options]\n"
+        "       cbfilter-cli -f FILTER -i INPUT_DIR -o OUTPUT_DIR [-j N]\n"
+        "       cbfilter-cli --list\n"
+        "\n"
+        "  -f, --filter NAME|INDEX  Filter to run (title or 0-based index)\n"
+        "  -i, --input FILE         Input file (default: stdin)\n"
+        "  -o, --output FILE        Output file (default: stdout)\n"
+        "  -m, --model NAME|INDEX   Use this model instead of the filter's\n"
+        "  -c, --config FILE        config.json (default: $XDG_CONFIG_HOME/cbfilter/config.json)\n"
+        "  -a, --apidef DIR         API definitions (default: apidef next to the executable)\n"
+        "      --stream             Write text output as it streams in\n"
+        "      --no-cache           Do not use the response cache\n"
+        "      --trace FILE         Write a Chrome trace of the run\n"
+        "      --stats FILE         Add token usage and latency to FILE and print the totals\n"
+        "      --list               List filters and models\n"
+        "\n"
+        "Batch mode (INPUT is a directory; results mirror its layout under OUTPUT):\n"
+        "  -j, --jobs N             Files processed at once (default: config.json jobs.workers)\n"
+        "      --per-provider N     Files processed at once per API provider\n"
+        "      --journal FILE       Progress journal (default: OUTPUT/.cbfilter-batch.journal)\n"
+        "  -v, --verbose            Log requests to stderr\n"
+        "\n"
+        "API keys are taken from <PROVIDER>_API_KEY (e.g. OPENAI_API_KEY) or config.json.\n", out);
+}
+
+fs::path DefaultConfigDirectory() {
+    if (const char* xdg = getenv("XDG_CONFIG_HOME"); xdg && *xdg) return fs::path(xdg) / "cbfilter";
+    if (const char* home = getenv("HOME"); home && *home) return fs::path(home) / ".config" / "cbfilter";
+    return fs::current_path();
+}
+
+fs::path DefaultApidefDirectory(const char* argv0) {
+    error_code ec;
+    fs::path exe = fs::read_symlink("/proc/self/exe", ec);
+    if (ec) exe = fs::absolute(argv0, ec);
+    if (!ec && fs::is_directory(exe.parent_path() / "apidef")) return exe.parent_path() / "apidef";
+    return fs::path("apidef");
+}
+
+/**
+ * @brief Parse a positive count option value
+ */
+bool ParseCount(const char* v, size_t& out) {
+    char* end = nullptr;
+    unsigned long n = strtoul(v, &end, 10);
+    if (!*v || *end || n == 0 || n > 256) { fprintf(stderr, "cbfilter-cli: invalid count %s\n", v); return false; }
+    out = n;
+    return true;
+}
+
+/**
+ * @brief Parse the command line
+ * @return false (after printing the reason) on a usage error
+ */
+bool ParseArgs(int argc, char** argv, CliOptions& opt) {
+    for (int i = 1; i < argc; ++i) {
+        const string a = argv[i];
+        auto value = [&](const char* name) -> const char* {
+            if (i + 1 >= argc) { fprintf(stderr, "cbfilter-cli: %s needs a value\n", name); return nullptr; }
+            return argv[++i];
+        };
+        const char* v = nullptr;
+        if (a == "-f" || a == "--filter") { if (!(v = value("--filter"))) return false; opt.filter = Utf8ToWide(v); }
+        else if (a == "-m" || a == "--model") { if (!(v = value("--model"))) return false; opt.model = Utf8ToWide(v); }
+        else if (a == "-i" || a == "--input") { if (!(v = value("--input"))) return false; opt.input = v; }
+        else if (a == "-o" || a == "--output") { if (!(v = value("--output"))) return false; opt.output = v; }
+        else if (a == "-c" || a == "--config") { if (!(v = value("--config"))) return false; opt.config = v; }
+        else if (a == "-a" || a == "--apidef") { if (!(v = value("--apidef"))) return false; opt.apidef = v; }
+        else if (a == "--trace") { if (!(v = value("--trace"))) return false; opt.trace = v; }
+        else if (a == "--stats") { if (!(v = value("--stats"))) return false; opt.stats = v; }
+        else if (a == "--journal") { if (!(v = value("--journal"))) return false; opt.journal = v; }
+        else if (a == "-j" || a == "--jobs") { if (!(v = value("--jobs")) || !ParseCount(v, opt.jobs)) return false; }
+        else if (a == "--per-provider") { if (!(v = value("--per-provider")) || !ParseCount(v, opt.perProvider)) return false; }
+        else if (a == "--stream") opt.stream = true;
+        else if (a == "--no-cache") opt.noCache = true;
+        else if (a == "--list") opt.list = true;
+        else if (a == "-v" || a == "--verbose") opt.verbose = true;
+        else if (a == "-h" || a == "--help") { PrintUsage(stdout); exit(kExitOk); }
+        else { fprintf(stderr, "cbfilter-cli: unknown option %s\n", a.c_str()); return false; }
+    }
+    if (!opt.list && opt.filter.empty()) { fputs("cbfilter-cli: --filter is required\n", stderr); return false; }
+    if (opt.config.empty()) opt.config = DefaultConfigDirectory() / "config.json";
+    if (opt.apidef.empty()) opt.apidef = DefaultApidefDirectory(argv[0]);
+    return true;
+}
+
+/**
+ * @brief Environment variable holding a provider's API key ("OpenRouter" -> "OPENROUTER_API_KEY")
+ */
+string ApiKeyVariable(const wstring& providerId) {
+    string name;
+    for (char c : WideToUtf8(providerId)) name += isalnum(static_cast<unsigned char>(c)) ? static_cast<char>(toupper(static_cast<unsigned char>(c))) : '_';
+    return name + "_API_KEY";
+}
+
+/**
+ * @brief Find an entry by 0-based index or exact name
+ * @return Index, or npos if nothing matches
+ */
+template <typename T, typename Name>
+size_t FindByNameOrIndex(const vector<T>& items, const wstring& key, Name name) {
+    for (size_t i = 0; i < items.size(); ++i) if (name(items[i]) == key) return i;
+    if (!key.empty() && all_of(key.begin(), key.end(), [](wchar_t c) { return iswdigit(c); })) {
+        size_t idx = stoul(key);
+        if (idx < items.size()) return idx;
+    }
+    return string::npos;
+}
+
+bool ReadInput(const fs::path& path, string& out) {
+    if (!path.empty()) return ReadFileBytes(path, out);
+    out.assign(istreambuf_iterator<char>(cin), istreambuf_iterator<char>());
+    return !cin.bad();
+}
+
+/**
+ * @class OutputSink
+ * @brief The output file or stdout, written incrementally
+ */
+class OutputSink {
+public:
+    bool Open(const fs::path& path) {
+        if (path.empty()) return true;
+        file_.open(path, ios::binary | ios::trunc);
+        return file_.is_open();
+    }
+
+    bool Write(string_view data) {
+        ostream& os = file_.is_open() ? static_cast<ostream&>(file_) : cout;
+        os.write(data.data(), static_cast<streamsize>(data.size()));
+        os.flush();
+        return os.good();
+    }
+
+private:
+    ofstream file_;
+};
+
+/**
+ * @class SignalCanceller
+ * @brief Cancels a token on SIGINT/SIGTERM from a dedicated thread (Cancel is not async-signal-safe)
+ */
+class SignalCanceller {
+public:
+    explicit SignalCanceller(CancelToken& token) {
+        sigemptyset(&signals_);
+        sigaddset(&signals_, SIGINT);
+        sigaddset(&signals_, SIGTERM);
+        // Blocked before any worker thread starts, so every thread inherits the mask
+        pthread_sigmask(SIG_BLOCK, &signals_, nullptr);
+        thread_ = thread([this, &token] {
+            int sig = 0;
+            if (sigwait(&signals_, &sig) == 0 && !stopping_) {
+                fputs("cbfilter-cli: cancelling\n", stderr);
+                token.Cancel();
+            }
+        });
+    }
+
+    ~SignalCanceller() {
+        stopping_ = true;
+        pthread_kill(thread_.native_handle(), SIGTERM);
+        thread_.join();
+    }
+
+    SignalCanceller(const SignalCanceller&) = delete;
+    SignalCanceller& operator=(const SignalCanceller&) = delete;
+
+private:
+    sigset_t signals_{};
+    atomic<bool> stopping_{};
+    thread thread_;
+};
+
+void ListConfig(const vector<FilterDefinition>& filters, const vector<ModelConfig>& models) {
+    puts("filters:");
+    for (size_t i = 0; i < filters.size(); ++i) {
+        const FilterDefinition& f = filters[i];
+        const wstring model = f.modelIndex < models.size() ? models[f.modelIndex].name : L"?";
+        printf("  %zu: %s (%ls -> %ls, %s)\n", i, WideToUtf8(f.title).c_str(), IOTypeToConfig(f.input), IOTypeToConfig(f.output), IsFanOut(f) ? "fan-out" : IsPipeline(f) ? "pipeline" : WideToUtf8(model).c_str());
+    }
+    puts("models:");
+    for (size_t i = 0; i < models.size(); ++i) {
+        const ModelConfig& m = models[i];
+        printf("  %zu: %s (%s %s @ %s)\n", i, WideToUtf8(m.name).c_str(), WideToUtf8(m.providerId).c_str(), WideToUtf8(m.modelName).c_str(), WideToUtf8(m.serverUrl).c_str());
+    }
+}
+
+/**
+ * @brief Print usage totals per filter and model to stderr
+ */
+void PrintUsageStats(const vector<UsageAggregate>& rows) {
+    fprintf(stderr, "%-20s %-16s %6s %5s %5s %8s %8s %8s %8s %10s %10s %10s %10s\n", "filter", "model", "req", "fail", "hits",
+            "p50 ms", "p95 ms", "ttfb ms", "tok/s", "prompt", "output", "cached", "cost $");
+    for (const UsageAggregate& a : rows) {
+        fprintf(stderr, "%-20s %-16s %6zu %5zu %5zu %8.0f %8.0f %8.0f %8.1f %10llu %10llu %10llu %10.4f\n",
+                WideToUtf8(a.filter).c_str(), WideToUtf8(a.model).c_str(), a.requests, a.failures, a.cacheHits,
+                a.p50Ms, a.p95Ms, a.p50FirstByteMs, a.tokensPerSecond, static_cast<unsigned long long>(a.promptTokens),
+                static_cast<unsigned long long>(a.completionTokens), static_cast<unsigned long long>(a.cachedTokens), a.cost);
+    }
+}
+
+/**
+ * @brief Output file of one fan-out image branch ("out.png" -> "out-2.png")
+ */
+fs::path FanOutImagePath(const fs::path& output, size_t index) {
+    return output.parent_path() / (output.stem().string() + "-" + to_string(index + 1) + output.extension().string());
+}
+
+/**
+ * @brief Run every branch of a fan-out filter on one input
+ * @return Exit code
+ *
+ * Text is written as one block per branch under a heading, in branch order
+ * (in the order branches finish with --stream); images are written as
+ * numbered files next to the output path.
+ */
+int RunFanOutMode(const CliOptions& opt, const FilterEngine& engine, const FilterDefinition& f, const vector<FilterRun>& runs, const FilterPayload& payload) {
+    if (f.output == IOType::Image && opt.output.empty()) { fputs("cbfilter-cli: a fan-out image filter needs -o (one file is written per branch)\n", stderr); return kExitUsage; }
+    OutputSink sink;
+    if (f.output == IOType::Text && !sink.Open(opt.output)) { fprintf(stderr, "cbfilter-cli: cannot write %s\n", opt.output.string().c_str()); return kExitFailed; }
+    CancelToken cancel;
+    SignalCanceller signals(cancel);
+    unique_ptr<TraceSession> trace;
+    if (!opt.trace.empty()) trace = make_unique<TraceSession>(WideToUtf8(f.title));
+
+    const wstring failedText = L"(failed)";
+    bool streamed = false;
+    FanOutResultHandler onResult = [&](size_t i, const vector<FanOutResult>& results) {
+        fprintf(stderr, "cbfilter-cli: %s %s\n", WideToUtf8(runs[i].label).c_str(), results[i].ok ? "done" : "failed");
+        if (!opt.stream || f.output != IOType::Text) return;
+        wstring block = (streamed ? L"\n\n=== " : L"=== ") + runs[i].label + L" ===\n";
+        block += results[i].ok ? results[i].output.text : failedText;
+        sink.Write(WideToUtf8(block));
+        streamed = true;
+    };
+    vector<FanOutResult> results;
+    bool ok;
+    {
+        TraceAttach attach(trace.get());
+        ok = engine.RunFanOut(runs, payload, results, onResult, &cancel);
+    }
+    if (trace && !trace->WriteChromeJson(opt.trace)) fprintf(stderr, "cbfilter-cli: cannot write %s\n", opt.trace.string().c_str());
+    if (cancel.IsCancelled()) return kExitCancelled;
+    if (!ok) { fprintf(stderr, "cbfilter-cli: every branch of %s failed%s\n", WideToUtf8(f.title).c_str(), opt.verbose ? "" : " (use -v for details)"); return kExitFailed; }
+
+    if (f.output == IOType::Text) {
+        if (!opt.stream && !sink.Write(WideToUtf8(CombineFanOutText(runs, results, failedText)))) { fputs("cbfilter-cli: write failed\n", stderr); return kExitFailed; }
+    } else {
+        for (size_t i = 0; i < results.size(); ++i) {
+            if (!results[i].ok) continue;
+            vector<uint8_t> bytes;
+            const fs::path path = FanOutImagePath(opt.output, i);
+            if (!Base64Decode(results[i].output.imageB64, bytes)) { fprintf(stderr, "cbfilter-cli: invalid image from %s\n", WideToUtf8(runs[i].label).c_str()); continue; }
+            OutputSink file;
+            if (!file.Open(path) || !file.Write(string_view(reinterpret_cast<const char*>(bytes.data()), bytes.size()))) { fprintf(stderr, "cbfilter-cli: cannot write %s\n", path.string().c_str()); return kExitFailed; }
+            fprintf(stderr, "cbfilter-cli: %s -> %s\n", WideToUtf8(runs[i].label).c_str(), path.string().c_str());
+        }
+    }
+    // Partial success still produced output, but scripts should notice the failed branches
+    return all_of(results.begin(), results.end(), [](const FanOutResult& r) { return r.ok; }) ? kExitOk : kExitFailed;
+}
+
+/**
+ * @brief Concurrency limits from config.json's "jobs" section and the command line
+ * @return Options with workers, perProvider and providerLimits set
+ */
+BatchOptions JobLimits(const CliOptions& opt, const JsonValue& root) {
+    BatchOptions batch;
+    // The same limits as the tray application's job queue unless overridden
+    if (const JsonValue* jobs = root.Find("jobs"); jobs && jobs->IsObject()) {
+        batch.workers = static_cast<size_t>(clamp(jobs->GetNamedNumber("workers", static_cast<double>(batch.workers)), 1.0, 32.0));
+        batch.perProvider = static_cast<size_t>(clamp(jobs->GetNamedNumber("perProvider", static_cast<double>(batch.perProvider)), 1.0, 32.0));
+        for (const auto& [id, limit] : (*jobs)["providers"].Members()) {
+            if (limit.IsNumber()) batch.providerLimits[Utf8ToWide(id)] = static_cast<size_t>(clamp(limit.GetNumber(), 1.0, 32.0));
+        }
+    }
+    if (opt.jobs) batch.workers = opt.jobs;
+    if (opt.perProvider) {
+        batch.perProvider = opt.perProvider;
+        batch.providerLimits.clear();
+    }
+    return batch;
+}
+
+/**
+ * @brief Run a filter over a directory, printing each item and the throughput to stderr
+ * @param batch Concurrency limits (see JobLimits)
+ */
+int RunBatchMode(const CliOptions& opt, BatchOptions batch, const FilterEngine& engine, const FilterDefinition& f, const ModelConfig& m, const vector<ModelConfig>& hedgeModels) {
+    if (opt.output.empty()) { fputs("cbfilter-cli: a directory input needs -o OUTPUT_DIR\n", stderr); return kExitUsage; }
+    if (opt.stream || !opt.trace.empty()) { fputs("cbfilter-cli: --stream and --trace are not supported with a directory input\n", stderr); return kExitUsage; }
+    batch.inputDir = opt.input;
+    batch.outputDir = opt.output;
+    batch.journal = opt.journal;
+
+    CancelToken cancel;
+    SignalCanceller signals(cancel);
+    BatchStats stats;
+    wstring err;
+    auto onItem = [&](const BatchItemResult& r, const BatchStats& progress) {
+        const size_t processed = progress.resumed + progress.completed + progress.failed + progress.ignored;
+        if (r.ok) {
+            if (opt.verbose) fprintf(stderr, "[%zu/%zu] %s -> %s (%.1fs)\n", processed, progress.total, r.input.string().c_str(), r.output.string().c_str(), r.seconds);
+        } else {
+            fprintf(stderr, "[%zu/%zu] %s: %s\n", processed, progress.total, r.input.string().c_str(), WideToUtf8(r.error).c_str());
+        }
+    };
+    if (!RunBatch(engine, f, m, hedgeModels, batch, stats, err, onItem, &cancel)) {
+        fprintf(stderr, "cbfilter-cli: %s\n", WideToUtf8(err).c_str());
+        return kExitFailed;
+    }
+    const double secs = (std::max)(stats.seconds, 1e-3);
+    fprintf(stderr, "cbfilter-cli: %zu done, %zu already done, %zu failed, %zu not applicable of %zu files in %.1fs\n",
+            stats.completed, stats.resumed, stats.failed, stats.ignored, stats.total, stats.seconds);
+    fprintf(stderr, "cbfilter-cli: %.2f items/s, %.2f MB/s in, %.2f MB/s out, %.0f tokens/s (estimated)\n",
+            stats.completed / secs, stats.bytesIn / secs / 1e6, stats.bytesOut / secs / 1e6, stats.tokens / secs);
+    if (cancel.IsCancelled() || stats.failed) fputs("cbfilter-cli: run the same command again to resume\n", stderr);
+    if (cancel.IsCancelled()) return kExitCancelled;
+    return stats.failed ? kExitFailed : kExitOk;
+}
+
+int Run(const CliOptions& opt, UsageStats& usage) {
+    FilterEngine engine;
+    if (opt.verbose) engine.SetLogHandler([](const wstring& msg) { fprintf(stderr, "%s\n", WideToUtf8(msg).c_str()); });
+    if (!opt.stats.empty()) engine.SetUsageHandler([&usage](const UsageRecord& r) { usage.Record(r); });
+
+    vector<ApiProvider> providers;
+    vector<wstring> errors;
+    bool loaded = LoadApiProviders(opt.apidef, providers, errors);
+    for (const wstring& e : errors) fprintf(stderr, "cbfilter-cli: %s\n", WideToUtf8(e).c_str());
+    if (!loaded) { fprintf(stderr, "cbfilter-cli: no API definitions in %s\n", opt.apidef.string().c_str()); return kExitFailed; }
+    engine.SetProviders(move(providers));
+
+    string configText;
+    if (!ReadFileBytes(opt.config, configText)) { fprintf(stderr, "cbfilter-cli: cannot read %s\n", opt.config.string().c_str()); return kExitFailed; }
+    JsonValue root;
+    string parseErr;
+    if (!JsonValue::Parse(configText, root, &parseErr)) { fprintf(stderr, "cbfilter-cli: %s: %s\n", opt.config.string().c_str(), parseErr.c_str()); return kExitFailed; }
+    vector<ModelConfig> models;
+    vector<FilterDefinition> filters;
+    ParseModels(root, models, [](const wstring& stored) {
+        // DPAPI keys can only be decrypted by the Windows account that stored them
+        return stored.rfind(L"dpapi:", 0) == 0 ? wstring() : stored;
+    });
+    ParseFilters(root, filters);
+    ValidateFilterModels(filters, models.size());
+    ValidatePipelines(filters);
+    ValidateFanOuts(filters);
+    EnsureModelProviders(models, engine.Providers());
+    // Chunks, fan-out branches and pipeline stages share each provider's request slots
+    const BatchOptions limits = JobLimits(opt, root);
+    RateLimiters::Instance().SetConcurrency(limits.perProvider, limits.providerLimits);
+    for (ModelConfig& m : models) {
+        if (const char* key = getenv(ApiKeyVariable(m.providerId).c_str()); key && *key) m.apiKey = Utf8ToWide(key);
+    }
+    if (opt.list) { ListConfig(filters, models); return kExitOk; }
+
+    const size_t fi = FindByNameOrIndex(filters, opt.filter, [](const FilterDefinition& f) { return f.title; });
+    if (fi == string::npos) { fprintf(stderr, "cbfilter-cli: no filter %s (see --list)\n", WideToUtf8(opt.filter).c_str()); return kExitUsage; }
+    const FilterDefinition& f = filters[fi];
+    auto warnMissingKey = [](const ModelConfig& m) {
+        if (m.apiKey.empty()) fprintf(stderr, "cbfilter-cli: warning: no API key for %s (set %s)\n", WideToUtf8(m.name).c_str(), ApiKeyVariable(m.providerId).c_str());
+    };
+    vector<FilterRun> fanOut, pipeline;
+    if (IsFanOut(f) || IsPipeline(f)) {
+        if (!opt.model.empty()) { fprintf(stderr, "cbfilter-cli: --model cannot be used with a %s filter\n", IsFanOut(f) ? "fan-out" : "pipeline"); return kExitUsage; }
+        if (IsFanOut(f)) fanOut = ExpandFanOut(f, filters, models);
+        else pipeline = ExpandPipeline(f, filters, models);
+        for (const FilterRun& run : IsFanOut(f) ? fanOut : pipeline) warnMissingKey(run.model);
+    }
+    size_t mi = f.modelIndex;
+    vector<ModelConfig> hedgeModels;
+    if (!opt.model.empty()) {
+        mi = FindByNameOrIndex(models, opt.model, [](const ModelConfig& m) { return m.name; });
+        if (mi == string::npos) { fprintf(stderr, "cbfilter-cli: no model %s (see --list)\n", WideToUtf8(opt.model).c_str()); return kExitUsage; }
+    } else {
+        for (size_t idx : f.hedgeModels) hedgeModels.push_back(models[idx]);
+    }
+    if (mi >= models.size()) { fputs("cbfilter-cli: no models configured\n", stderr); return kExitFailed; }
+    const ModelConfig& m = models[mi];
+    if (fanOut.empty() && pipeline.empty()) warnMissingKey(m);
+
+    error_code ec;
+    const bool batchMode = !opt.input.empty() && fs::is_directory(opt.input, ec);
+    if (batchMode && (!fanOut.empty() || !pipeline.empty())) { fputs("cbfilter-cli: fan-out and pipeline filters cannot run in batch mode\n", stderr); return kExitUsage; }
+    string inputBytes;
+    if (!batchMode && !ReadInput(opt.input, inputBytes)) { fputs("cbfilter-cli: cannot read input\n", stderr); return kExitFailed; }
+    wstring text;
+    string imageB64, imageMime;
+    FilterPayload payload;
+    if (batchMode) {
+        // Each file is read by the batch runner
+    } else if (f.input == IOType::Text) {
+        text = Utf8ToWide(inputBytes);
+        payload.text = text;
+    } else {
+        ImageFormat fmt;
+        if (!SniffImageFormat(reinterpret_cast<const uint8_t*>(inputBytes.data()), inputBytes.size(), fmt)) { fputs("cbfilter-cli: input is not a PNG, JPEG or WebP image\n", stderr); return kExitFailed; }
+        imageB64 = Base64Encode(reinterpret_cast<const uint8_t*>(inputBytes.data()), inputBytes.size());
+        imageMime = WideToUtf8(ImageFormatMime(fmt));
+        payload.imageB64 = imageB64;
+        payload.imageMime = imageMime;
+    }
+
+    bool cacheEnabled = !opt.noCache;
+    unsigned long long cacheMegabytes = 64;
+    if (const JsonValue* cache = root.Find("cache"); cache && cache->IsObject()) {
+        cacheEnabled = cacheEnabled && cache->GetNamedBoolean("enabled", true);
+        cacheMegabytes = static_cast<unsigned long long>((std::max)(1.0, cache->GetNamedNumber("maxMegabytes", 64.0)));
+    }
+    if (cacheEnabled) {
+        error_code ec;
+        fs::create_directories(opt.config.parent_path().empty() ? fs::path(".") : opt.config.parent_path(), ec);
+        const fs::path cachePath = (opt.config.parent_path().empty() ? fs::path(".") : opt.config.parent_path()) / "cache.bin";
+        // Another process holding the cache is not fatal: run uncached
+        if (!ResponseCache::Instance().Open(cachePath.wstring(), cacheMegabytes << 20)) cacheEnabled = false;
+    }
+    engine.SetCacheEnabled(cacheEnabled);
+
+    if (batchMode) {
+        int rc = RunBatchMode(opt, limits, engine, f, m, hedgeModels);
+        if (cacheEnabled) ResponseCache::Instance().Close();
+        return rc;
+    }
+    if (!fanOut.empty()) {
+        int rc = RunFanOutMode(opt, engine, f, fanOut, payload);
+        if (cacheEnabled) ResponseCache::Instance().Close();
+        return rc;
+    }
+
+    OutputSink sink;
+    if (!sink.Open(opt.output)) { fprintf(stderr, "cbfilter-cli: cannot write %s\n", opt.output.string().c_str()); return kExitFailed; }
+    CancelToken cancel;
+    SignalCanceller signals(cancel);
+    unique_ptr<TraceSession> trace;
+    if (!opt.trace.empty()) trace = make_unique<TraceSession>(WideToUtf8(f.title));
+
+    wstring streamed;
+    PartialTextHandler onPartial;
+    if (opt.stream && f.output == IOType::Text) {
+        onPartial = [&](const wstring& delta) {
+            streamed += delta;
+            sink.Write(WideToUtf8(delta));
+        };
+    }
+    FilterOutput out;
+    bool ok;
+    {
+        TraceAttach attach(trace.get());
+        ok = pipeline.empty() ? engine.RunFilter(f, m, hedgeModels, payload, out, onPartial, &cancel)
+                              : engine.RunPipeline(pipeline, payload, out, onPartial, &cancel);
+    }
+    if (cacheEnabled) ResponseCache::Instance().Close();
+    if (trace && !trace->WriteChromeJson(opt.trace)) fprintf(stderr, "cbfilter-cli: cannot write %s\n", opt.trace.string().c_str());
+    if (cancel.IsCancelled()) return kExitCancelled;
+    if (!ok) { fprintf(stderr, "cbfilter-cli: filter %s failed%s\n", WideToUtf8(f.title).c_str(), opt.verbose ? "" : " (use -v for details)"); return kExitFailed; }
+
+    bool written;
+    if (f.output == IOType::Text) {
+        // A hedged backup may win after another attempt streamed; only a matching prefix can be completed
+        if (out.text.compare(0, streamed.size(), streamed) == 0) {
+            written = sink.Write(WideToUtf8(wstring_view(out.text).substr(streamed.size())));
+        } else {
+            fputs("\ncbfilter-cli: warning: streamed text differs from the final result\n", stderr);
+            written = sink.Write(WideToUtf8(out.text));
+        }
+    } else {
+        vector<uint8_t> bytes;
+        if (!Base64Decode(out.imageB64, bytes)) { fputs("cbfilter-cli: invalid image in response\n", stderr); return kExitFailed; }
+        written = sink.Write(string_view(reinterpret_cast<const char*>(bytes.data()), bytes.size()));
+    }
+    if (!written) { fputs("cbfilter-cli: write failed\n", stderr); return kExitFailed; }
+    return kExitOk;
+}
+} // namespace
+
+int main(int argc, char** argv) {
+    CliOptions opt;
+    if (!ParseArgs(argc, argv, opt)) {
+        PrintUsage(stderr);
+        return kExitUsage;
+    }
+    UsageStats usage;
+    if (!opt.stats.empty() && !usage.Open(opt.stats, kStatsRecords)) {
+        fprintf(stderr, "cbfilter-cli: cannot write %s\n", opt.stats.string().c_str());
+    }
+    const int rc = Run(opt, usage);
+    if (!opt.stats.empty() && !opt.list) PrintUsageStats(usage.Aggregate(UsageGroup::FilterModel));
+    return rc;
+}
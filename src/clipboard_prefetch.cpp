@@ -0,0 +1,163 @@
+/**
+ * @file clipboard_prefetch.cpp
+ * @brief Implementation of background clipboard pre-processing
+ */
+
+#include "clipboard_prefetch.h"
+
+using namespace std;
+
+uint64_t ContentHash(const void* data, size_t size) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    const auto* p = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i) {
+        h ^= p[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+bool SameUploadOptions(const ImageUploadOptions& a, const ImageUploadOptions& b) {
+    return a.maxLongEdge == b.maxLongEdge && a.maxMegapixels == b.maxMegapixels && a.format == b.format &&
+           (a.format == ImageFormat::Png || a.quality == b.quality);
+}
+
+const EncodedImage* ClipboardSnapshot::FindImage(const ImageUploadOptions& opt) const {
+    for (const EncodedImage& e : images) {
+        if (SameUploadOptions(e.options, opt)) return &e;
+    }
+    return nullptr;
+}
+
+ClipboardPrefetcher::ClipboardPrefetcher(unique_ptr<ClipboardSource> source, size_t maxBytes)
+    : source_(move(source)), maxBytes_(maxBytes) {
+    worker_ = thread([this] { WorkerLoop(); });
+}
+
+ClipboardPrefetcher::~ClipboardPrefetcher() {
+    Stop();
+}
+
+void ClipboardPrefetcher::SetProfiles(vector<ImageUploadOptions> profiles) {
+    lock_guard<mutex> lock(mutex_);
+    profiles_ = move(profiles);
+}
+
+void ClipboardPrefetcher::Notify() {
+    lock_guard<mutex> lock(mutex_);
+    if (stopping_) return;
+    if (pending_) ++stats_.coalesced;
+    pending_ = true;
+    cv_.notify_all();
+}
+
+shared_ptr<const ClipboardSnapshot> ClipboardPrefetcher::Get(uint32_t seq, chrono::milliseconds wait) {
+    unique_lock<mutex> lock(mutex_);
+    cv_.wait_for(lock, wait, [&] { return (current_ && current_->sequence == seq) || (!busy_ && !pending_) || stopping_; });
+    if (current_ && current_->sequence == seq) {
+        ++stats_.hits;
+        return current_;
+    }
+    ++stats_.misses;
+    return nullptr;
+}
+
+ClipboardPrefetchStats ClipboardPrefetcher::Stats() const {
+    lock_guard<mutex> lock(mutex_);
+    return stats_;
+}
+
+void ClipboardPrefetcher::Stop() {
+    {
+        lock_guard<mutex> lock(mutex_);
+        stopping_ = true;
+        pending_ = false;
+    }
+    cv_.notify_all();
+    if (worker_.joinable()) worker_.join();
+}
+
+void ClipboardPrefetcher::WorkerLoop() {
+    for (;;) {
+        shared_ptr<const ClipboardSnapshot> prev;
+        vector<ImageUploadOptions> profiles;
+        {
+            unique_lock<mutex> lock(mutex_);
+            cv_.wait(lock, [&] { return pending_ || stopping_; });
+            if (stopping_) return;
+            pending_ = false;
+            busy_ = true;
+            prev = current_;
+            profiles = profiles_;
+        }
+        shared_ptr<const ClipboardSnapshot> snap;
+        try {
+            snap = Build(prev, profiles);
+        } catch (...) {
+            snap = nullptr;  // Leave the slow path to the filter run
+        }
+        {
+            lock_guard<mutex> lock(mutex_);
+            // Replacing the old snapshot frees it unless a filter job still holds it
+            if (snap) {
+                current_ = move(snap);
+                ++stats_.snapshots;
+            }
+            busy_ = false;
+        }
+        cv_.notify_all();
+    }
+}
+
+shared_ptr<const ClipboardSnapshot> ClipboardPrefetcher::Build(const shared_ptr<const ClipboardSnapshot>& prev,
+                                                                const vector<ImageUploadOptions>& profiles) {
+    auto snap = make_shared<ClipboardSnapshot>();
+    snap->sequence = source_->Sequence();
+    snap->type = source_->Detect();
+    size_t reused = 0, overBudget = 0;
+    if (snap->type == ClipboardType::Text) {
+        wstring text;
+        if (!source_->ReadText(text)) return nullptr;
+        snap->hash = ContentHash(text.data(), text.size() * sizeof(wchar_t));
+        if (text.size() * sizeof(wchar_t) <= maxBytes_) {
+            snap->bytes = text.size() * sizeof(wchar_t);
+            snap->text = move(text);
+        } else {
+            ++overBudget;
+        }
+    } else if (snap->type == ClipboardType::Bitmap) {
+        unique_ptr<ClipboardImage> image = source_->ReadImage();
+        if (!image) return nullptr;
+        snap->hash = image->Hash();
+        const bool sameImage = prev && prev->type == ClipboardType::Bitmap && prev->hash == snap->hash;
+        for (const ImageUploadOptions& opt : profiles) {
+            if (snap->FindImage(opt)) continue;
+            // Stop encoding content that has already been replaced
+            if (source_->Sequence() != snap->sequence) return nullptr;
+            EncodedImage e;
+            e.options = opt;
+            if (const EncodedImage* old = sameImage ? prev->FindImage(opt) : nullptr) {
+                e.b64 = old->b64;
+                e.mime = old->mime;
+                e.encodeMs = old->encodeMs;
+                ++reused;
+            } else {
+                const auto start = chrono::steady_clock::now();
+                if (!image->Encode(opt, e.b64, e.mime)) continue;
+                e.encodeMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+            }
+            if (snap->bytes + e.b64.size() > maxBytes_) {
+                ++overBudget;
+                continue;
+            }
+            snap->bytes += e.b64.size();
+            snap->images.push_back(move(e));
+        }
+    }
+    // The clipboard changed while it was being read: the next Notify rebuilds it
+    if (source_->Sequence() != snap->sequence) return nullptr;
+    lock_guard<mutex> lock(mutex_);
+    stats_.reused += reused;
+    stats_.overBudget += overBudget;
+    return snap;
+}
@@ -0,0 +1,198 @@
+/**
+ * @file clipboard_prefetch.h
+ * @brief Background pre-processing of new clipboard content
+ *
+ * With the clipboard listener enabled, every clipboard change is snapshotted
+ * on a background thread: the content type is detected, text is copied and
+ * images are encoded once per upload profile the filters use. The filter menu
+ * then opens with the type already known and a filter run starts uploading
+ * without reading, scaling or encoding the clipboard on the hotkey path.
+ *
+ * Only the newest snapshot is kept; changes arriving while one is processed
+ * are coalesced, and content beyond the byte budget is left to the slow path.
+ * The clipboard is reached through ClipboardSource, so the core runs against
+ * a fake clipboard off Windows.
+ */
+
+#pragma once
+
+#include "image_scale.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @enum ClipboardType
+ * @brief Type of content currently in the clipboard
+ */
+enum class ClipboardType { None, Text, Bitmap };
+
+/**
+ * @brief 64-bit FNV-1a hash of clipboard content
+ */
+uint64_t ContentHash(const void* data, size_t size);
+
+/**
+ * @brief true if two upload profiles produce the same encoding
+ */
+bool SameUploadOptions(const ImageUploadOptions& a, const ImageUploadOptions& b);
+
+/**
+ * @class ClipboardImage
+ * @brief Image read from the clipboard, encodable for several profiles
+ */
+class ClipboardImage {
+public:
+    virtual ~ClipboardImage() = default;
+
+    /**
+     * @brief Hash of the pixels, used to reuse encodings when the same image is copied again
+     */
+    virtual uint64_t Hash() = 0;
+
+    /**
+     * @brief Scale and encode the image for upload
+     * @return false if encoding failed
+     */
+    virtual bool Encode(const ImageUploadOptions& opt, std::string& b64, std::string& mime) = 0;
+};
+
+/**
+ * @class ClipboardSource
+ * @brief Access to the clipboard (the Win32 clipboard, or a fake in tests and benchmarks)
+ *
+ * Called from the prefetch thread; Sequence() may also be called from others.
+ */
+class ClipboardSource {
+public:
+    virtual ~ClipboardSource() = default;
+
+    /**
+     * @brief Number that changes whenever the clipboard content changes
+     */
+    virtual uint32_t Sequence() = 0;
+
+    virtual ClipboardType Detect() = 0;
+
+    /**
+     * @return false if the clipboard holds no text
+     */
+    virtual bool ReadText(std::wstring& out) = 0;
+
+    /**
+     * @return Image, or nullptr if the clipboard holds none
+     */
+    virtual std::unique_ptr<ClipboardImage> ReadImage() = 0;
+};
+
+/**
+ * @struct EncodedImage
+ * @brief Clipboard image encoded for one upload profile
+ */
+struct EncodedImage {
+    ImageUploadOptions options;
+    std::string b64;
+    std::string mime;
+    double encodeMs{};  // Time the encoding took, i.e. what a filter run using it saves
+};
+
+/**
+ * @struct ClipboardSnapshot
+ * @brief Pre-processed clipboard content as of one sequence number (immutable once published)
+ */
+struct ClipboardSnapshot {
+    uint32_t sequence{};
+    ClipboardType type{ClipboardType::None};
+    uint64_t hash{};                   // FNV-1a of the text, or the image's pixel hash
+    std::wstring text;                 // Text content (empty if over the budget)
+    std::vector<EncodedImage> images;  // One per profile that fit in the budget
+    size_t bytes{};                    // Memory held by text and images
+
+    /**
+     * @brief Encoding for a profile, or nullptr if it was not prefetched
+     */
+    const EncodedImage* FindImage(const ImageUploadOptions& opt) const;
+};
+
+/**
+ * @struct ClipboardPrefetchStats
+ * @brief Prefetch counters
+ */
+struct ClipboardPrefetchStats {
+    uint64_t snapshots{};   // Snapshots built
+    uint64_t coalesced{};   // Changes folded into a pending rebuild
+    uint64_t reused{};      // Encodings reused because the same image was copied again
+    uint64_t overBudget{};  // Texts or encodings dropped for the byte budget
+    uint64_t hits{};        // Get() calls answered with a snapshot
+    uint64_t misses{};      // Get() calls that found the snapshot stale or missing
+};
+
+/**
+ * @class ClipboardPrefetcher
+ * @brief Snapshots the clipboard on a background thread whenever it changes
+ */
+class ClipboardPrefetcher {
+public:
+    /**
+     * @param source Clipboard to read
+     * @param maxBytes Budget for the text and encoded images of one snapshot
+     */
+    ClipboardPrefetcher(std::unique_ptr<ClipboardSource> source, size_t maxBytes);
+    ~ClipboardPrefetcher();
+
+    ClipboardPrefetcher(const ClipboardPrefetcher&) = delete;
+    ClipboardPrefetcher& operator=(const ClipboardPrefetcher&) = delete;
+
+    /**
+     * @brief Set the upload profiles images are encoded for (applies to the next snapshot)
+     */
+    void SetProfiles(std::vector<ImageUploadOptions> profiles);
+
+    /**
+     * @brief Report a clipboard change (WM_CLIPBOARDUPDATE); returns at once
+     */
+    void Notify();
+
+    /**
+     * @brief Current clipboard sequence number
+     */
+    uint32_t Sequence() { return source_->Sequence(); }
+
+    /**
+     * @brief Snapshot of the clipboard content with a given sequence number
+     * @param sequence Sequence number observed when the content was wanted
+     * @param wait How long to wait for a snapshot that is still being built
+     * @return Snapshot, or nullptr if the newest one is for other content
+     */
+    std::shared_ptr<const ClipboardSnapshot> Get(uint32_t sequence, std::chrono::milliseconds wait = std::chrono::milliseconds(0));
+
+    ClipboardPrefetchStats Stats() const;
+
+    /**
+     * @brief Finish the snapshot in progress, drop the pending one and join the thread
+     */
+    void Stop();
+
+private:
+    void WorkerLoop();
+    std::shared_ptr<const ClipboardSnapshot> Build(const std::shared_ptr<const ClipboardSnapshot>& prev,
+                                                   const std::vector<ImageUploadOptions>& profiles);
+
+    std::unique_ptr<ClipboardSource> source_;
+    const size_t maxBytes_;
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    std::shared_ptr<const ClipboardSnapshot> current_;
+    std::vector<ImageUploadOptions> profiles_;
+    ClipboardPrefetchStats stats_;
+    bool pending_{};
+    bool busy_{};
+    bool stopping_{};
+    std::thread worker_;
+};
@@ -8,15 +8,11 @@
 
 #pragma once
 
+#include "clipboard_prefetch.h"
+
 #include <string>
 #include <windows.h>
 
-/**
- * @enum ClipboardType
- * @brief Type of content currently in the clipboard
- */
-enum class ClipboardType { None, Text, Bitmap };
-
 /**
  * @brief Detect the type of content in the clipboard
  * @return ClipboardType indicating text, bitmap, or none
@@ -0,0 +1,361 @@
+/**
+ * @file filter_config.cpp
+ * @brief Implementation of the config.json and apidef JSON schema
+ */
+
+#include "filter_config.h"
+#include "utf8.h"
+
+#include <algorithm>
+#include <cwctype>
+#include <fstream>
+
+using namespace std;
+
+namespace {
+/**
+ * @brief UTF-8 path text as a wide string (file names are UTF-8 off Windows)
+ */
+wstring PathText(const filesystem::path& p) {
+    const u8string u = p.u8string();
+    return Utf8ToWide(string_view(reinterpret_cast<const char*>(u.data()), u.size()));
+}
+
+vector<pair<wstring, wstring>> ParseHeaders(const JsonValue& obj) {
+    vector<pair<wstring, wstring>> headers;
+    for (const auto& [key, value] : obj.Members()) headers.push_back({ Utf8ToWide(key), value.GetString() });
+    return headers;
+}
+
+TemplateDefinition ParseTemplate(const ApiProvider& provider, const string& key, const JsonValue& obj) {
+    TemplateDefinition t{};
+    t.id = Utf8ToWide(key);
+    t.providerId = provider.id;
+    size_t sep = t.id.find(L'-');
+    t.input = ParseIOType(sep == wstring::npos ? t.id : t.id.substr(0, sep));
+    t.output = ParseIOType(sep == wstring::npos ? t.id : t.id.substr(sep + 1));
+    t.endpoint = obj.GetNamedString("endpoint", L"/");
+    t.resultPath = obj.GetNamedString("result", L"");
+    t.headers = ParseHeaders(obj["headers"]);
+    if (const JsonValue* payload = obj.Find("payload")) t.payload = Utf8ToWide(payload->Stringify());
+    const JsonValue& stream = obj["stream"];
+    if (stream.IsObject()) {
+        t.stream = true;
+        t.streamEndpoint = stream.GetNamedString("endpoint", t.endpoint);
+        t.streamResultPath = stream.GetNamedString("result", t.resultPath);
+        JsonValue merged = obj["payload"].IsObject() ? obj["payload"] : JsonValue::Object();
+        for (const auto& [k, v] : stream["payload"].Members()) merged.Set(k, v);
+        t.streamPayload = Utf8ToWide(merged.Stringify());
+    }
+    t.endpointTpl = CompiledTemplate::Compile(t.endpoint);
+    t.payloadTpl = CompiledTemplate::Compile(t.payload);
+    t.streamEndpointTpl = CompiledTemplate::Compile(t.streamEndpoint);
+    t.streamPayloadTpl = CompiledTemplate::Compile(t.streamPayload);
+    t.headerTpls = CompileHeaders(t.headers);
+    t.resultJsonPath = JsonPath::Compile(t.resultPath);
+    t.streamResultJsonPath = JsonPath::Compile(t.streamResultPath);
+    const JsonValue& usage = obj["usage"];
+    if (usage.IsObject()) {
+        t.usage.prompt = usage.GetNamedString("prompt", L"");
+        t.usage.completion = usage.GetNamedString("completion", L"");
+        t.usage.cached = usage.GetNamedString("cached", L"");
+        t.usage.reasoning = usage.GetNamedString("reasoning", L"");
+        t.usage.Compile();
+    }
+    return t;
+}
+} // namespace
+
+IOType ParseIOType(wstring_view s) {
+    wstring lower(s);
+    for (auto& c : lower) c = static_cast<wchar_t>(towlower(c));
+    return (lower == L"image") ? IOType::Image : IOType::Text;
+}
+
+const wchar_t* IOTypeToConfig(IOType t) {
+    return t == IOType::Image ? L"image" : L"text";
+}
+
+wstring NormalizeProviderId(const wstring& raw) {
+    if (raw.empty()) return raw;
+    size_t pos = raw.find(L'-');
+    if (pos != wstring::npos) return raw.substr(0, pos);
+    return raw;
+}
+
+vector<pair<wstring, CompiledTemplate>> CompileHeaders(const vector<pair<wstring, wstring>>& headers) {
+    vector<pair<wstring, CompiledTemplate>> out;
+    out.reserve(headers.size());
+    for (const auto& kv : headers) out.push_back({ kv.first, CompiledTemplate::Compile(kv.second) });
+    return out;
+}
+
+bool ParseApiProvider(const wstring& id, string_view json, ApiProvider& out, wstring* err) {
+    JsonValue root;
+    string parseErr;
+    if (!JsonValue::Parse(json, root, &parseErr) || !root.IsObject()) {
+        if (err) *err = parseErr.empty() ? L"not a JSON object" : Utf8ToWide(parseErr);
+        return false;
+    }
+    ApiProvider provider{};
+    provider.id = id;
+    provider.defaultEndpoint = root.GetNamedString("default-endpoint", L"");
+    for (const auto& [key, value] : root.Members()) {
+        if (!value.IsObject()) continue;
+        if (key == "models") {
+            provider.modelsEndpoint = value.GetNamedString("endpoint", L"");
+            provider.modelsMethod = value.GetNamedString("method", L"GET");
+            provider.modelsResultPath = value.GetNamedString("result", L"data");
+            provider.modelsHeaders = ParseHeaders(value["headers"]);
+            if (const JsonValue* payload = value.Find("payload")) provider.modelsPayload = Utf8ToWide(payload->Stringify());
+            continue;
+        }
+        if (key == "rate-limit") {
+            RateLimitConfig& rl = provider.rateLimit;
+            rl.requestsPerMinute = (std::max)(0.0, value.GetNamedNumber("requestsPerMinute", rl.requestsPerMinute));
+            rl.burst = static_cast<unsigned>(clamp(value.GetNamedNumber("burst", rl.burst), 1.0, 1000.0));
+            rl.maxRetries = static_cast<int>(clamp(value.GetNamedNumber("maxRetries", rl.maxRetries), 0.0, 10.0));
+            rl.baseDelayMs = static_cast<unsigned>(clamp(value.GetNamedNumber("baseDelayMs", rl.baseDelayMs), 10.0, 60000.0));
+            rl.maxDelayMs = static_cast<unsigned>(clamp(value.GetNamedNumber("maxDelayMs", rl.maxDelayMs), 100.0, 600000.0));
+            continue;
+        }
+        if (!key.empty()) provider.templates.push_back(ParseTemplate(provider, key, value));
+    }
+    provider.modelsEndpointTpl = CompiledTemplate::Compile(provider.modelsEndpoint);
+    provider.modelsPayloadTpl = CompiledTemplate::Compile(provider.modelsPayload);
+    provider.modelsHeaderTpls = CompileHeaders(provider.modelsHeaders);
+    if (provider.id.empty() || provider.templates.empty()) {
+        if (err) *err = L"no templates";
+        return false;
+    }
+    out = move(provider);
+    return true;
+}
+
+bool LoadApiProviders(const filesystem::path& dir, vector<ApiProvider>& out, vector<wstring>& errors) {
+    vector<filesystem::path> files;
+    error_code ec;
+    for (filesystem::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+        if (it->is_regular_file(ec) && it->path().extension() == ".json") files.push_back(it->path());
+    }
+    if (files.empty()) {
+        errors.push_back(L"apidef directory missing or empty: " + PathText(dir));
+        return false;
+    }
+    sort(files.begin(), files.end());
+    vector<ApiProvider> providers;
+    for (const auto& file : files) {
+        string text;
+        if (!ReadFileBytes(file, text) || text.empty()) {
+            errors.push_back(L"apidef file missing or empty: " + PathText(file));
+            continue;
+        }
+        ApiProvider provider;
+        wstring err;
+        if (!ParseApiProvider(PathText(file.stem()), text, provider, &err)) {
+            errors.push_back(L"apidef parse failed for " + PathText(file) + L": " + err);
+            continue;
+        }
+        providers.push_back(move(provider));
+    }
+    if (providers.empty()) return false;
+    out = move(providers);
+    return true;
+}
+
+void ParseModels(const JsonValue& root, vector<ModelConfig>& target, const ApiKeyCodec& decodeKey) {
+    vector<ModelConfig> v;
+    for (const JsonValue& obj : root["models"].Items()) {
+        if (!obj.IsObject()) continue;
+        ModelConfig m{};
+        m.name = obj.GetNamedString("name", L"");
+        m.serverUrl = obj.GetNamedString("serverUrl", L"");
+        m.modelName = obj.GetNamedString("modelName", L"");
+        m.providerId = NormalizeProviderId(obj.GetNamedString("providerId", L""));
+        m.apiKey = obj.GetNamedString("apiKey", L"");
+        if (decodeKey) m.apiKey = decodeKey(m.apiKey);
+        const JsonValue& image = obj["image"];
+        if (image.IsObject()) {
+            m.image.maxLongEdge = (std::max)(0, static_cast<int>(image.GetNamedNumber("maxLongEdge", m.image.maxLongEdge)));
+            m.image.maxMegapixels = (std::max)(0.0, image.GetNamedNumber("maxMegapixels", m.image.maxMegapixels));
+            m.image.format = ParseImageFormat(image.GetNamedString("format", L"png"));
+            m.image.quality = clamp(static_cast<int>(image.GetNamedNumber("quality", m.image.quality)), 1, 100);
+        }
+        const JsonValue& prices = obj["prices"];
+        if (prices.IsObject()) {
+            m.prices.input = (std::max)(0.0, prices.GetNamedNumber("input", 0));
+            m.prices.output = (std::max)(0.0, prices.GetNamedNumber("output", 0));
+            m.prices.cached = (std::max)(0.0, prices.GetNamedNumber("cached", 0));
+        }
+        if (!m.name.empty()) v.push_back(move(m));
+    }
+    if (!v.empty()) target = move(v);
+}
+
+void ParseFilters(const JsonValue& root, vector<FilterDefinition>& target) {
+    vector<FilterDefinition> v;
+    for (const JsonValue& obj : root["filters"].Items()) {
+        if (!obj.IsObject()) continue;
+        FilterDefinition f{};
+        f.title = obj.GetNamedString("title", L"");
+        f.input = ParseIOType(obj.GetNamedString("input", L"text"));
+        f.output = ParseIOType(obj.GetNamedString("output", L"text"));
+        f.modelIndex = static_cast<size_t>((std::max)(0.0, obj.GetNamedNumber("modelIndex", 0)));
+        f.prompt = obj.GetNamedString("prompt", L"");
+        f.cache = obj.GetNamedBoolean("cache", true);
+        f.typeOutput = obj.GetNamedBoolean("typeOutput", false);
+        const JsonValue& chunking = obj["chunking"];
+        if (chunking.IsObject()) {
+            f.chunkTokens = static_cast<size_t>((std::max)(0.0, chunking.GetNamedNumber("maxTokens", 0)));
+            f.chunkParallel = static_cast<size_t>(clamp(chunking.GetNamedNumber("parallel", 4), 1.0, 16.0));
+            f.chunkRetries = static_cast<int>(clamp(chunking.GetNamedNumber("retries", 2), 0.0, 5.0));
+        }
+        const JsonValue& hedge = obj["hedge"];
+        if (hedge.IsObject()) {
+            for (const JsonValue& idx : hedge["models"].Items()) {
+                if (idx.IsNumber()) f.hedgeModels.push_back(static_cast<size_t>((std::max)(0.0, idx.GetNumber())));
+            }
+            f.hedge.delayMs = static_cast<unsigned>(clamp(hedge.GetNamedNumber("delayMs", 0), 0.0, 60000.0));
+            f.hedge.quantile = clamp(hedge.GetNamedNumber("quantile", f.hedge.quantile), 0.5, 0.99);
+        }
+        const JsonValue& fanout = obj["fanout"];
+        if (fanout.IsObject()) {
+            for (const JsonValue& idx : fanout["filters"].Items()) {
+                if (idx.IsNumber()) f.fanOutFilters.push_back(static_cast<size_t>((std::max)(0.0, idx.GetNumber())));
+            }
+            for (const JsonValue& idx : fanout["models"].Items()) {
+                if (idx.IsNumber()) f.fanOutModels.push_back(static_cast<size_t>((std::max)(0.0, idx.GetNumber())));
+            }
+        }
+        for (const JsonValue& idx : obj["pipeline"].Items()) {
+            if (idx.IsNumber()) f.pipeline.push_back(static_cast<size_t>((std::max)(0.0, idx.GetNumber())));
+        }
+        if (!f.title.empty()) v.push_back(move(f));
+    }
+    if (!v.empty()) target = move(v);
+}
+
+void ValidateFilterModels(vector<FilterDefinition>& filters, size_t modelCount) {
+    for (auto& f : filters) {
+        if (f.modelIndex >= modelCount) f.modelIndex = 0;
+        erase_if(f.hedgeModels, [&](size_t idx) { return idx >= modelCount || idx == f.modelIndex; });
+        erase_if(f.fanOutModels, [&](size_t idx) { return idx >= modelCount; });
+    }
+}
+
+void ValidateFanOuts(vector<FilterDefinition>& filters) {
+    // Decide nesting on the configured lists before any of them is trimmed
+    vector<char> composite(filters.size());
+    for (size_t i = 0; i < filters.size(); ++i) composite[i] = IsFanOut(filters[i]) || IsPipeline(filters[i]);
+    for (size_t i = 0; i < filters.size(); ++i) {
+        FilterDefinition& f = filters[i];
+        erase_if(f.fanOutFilters, [&](size_t idx) {
+            return idx >= filters.size() || idx == i || composite[idx] ||
+                filters[idx].input != f.input || filters[idx].output != f.output;
+        });
+    }
+}
+
+void ValidatePipelines(vector<FilterDefinition>& filters) {
+    vector<char> composite(filters.size());
+    for (size_t i = 0; i < filters.size(); ++i) composite[i] = IsFanOut(filters[i]) || IsPipeline(filters[i]);
+    for (size_t i = 0; i < filters.size(); ++i) {
+        FilterDefinition& f = filters[i];
+        if (!IsPipeline(f)) continue;
+        erase_if(f.pipeline, [&](size_t idx) { return idx >= filters.size() || idx == i || composite[idx]; });
+        for (size_t k = 1; k < f.pipeline.size(); ++k) {
+            if (filters[f.pipeline[k - 1]].output != filters[f.pipeline[k]].input) { f.pipeline.clear(); break; }
+        }
+        if (!IsPipeline(f)) continue;
+        f.input = filters[f.pipeline.front()].input;
+        f.output = filters[f.pipeline.back()].output;
+        f.fanOutFilters.clear();
+        f.fanOutModels.clear();
+    }
+}
+
+void EnsureModelProviders(vector<ModelConfig>& models, const vector<ApiProvider>& providers) {
+    if (providers.empty()) return;
+    for (auto& m : models) if (m.providerId.empty()) m.providerId = providers.front().id;
+}
+
+JsonValue ModelsToJson(const vector<ModelConfig>& models, const ApiKeyCodec& encodeKey) {
+    JsonValue arr = JsonValue::Array();
+    for (const auto& m : models) {
+        JsonValue obj = JsonValue::Object();
+        obj.Set("name", JsonValue::String(m.name));
+        obj.Set("serverUrl", JsonValue::String(m.serverUrl));
+        obj.Set("modelName", JsonValue::String(m.modelName));
+        obj.Set("providerId", JsonValue::String(m.providerId));
+        obj.Set("apiKey", JsonValue::String(encodeKey ? encodeKey(m.apiKey) : m.apiKey));
+        JsonValue image = JsonValue::Object();
+        image.Set("maxLongEdge", JsonValue::Number(m.image.maxLongEdge));
+        image.Set("maxMegapixels", JsonValue::Number(m.image.maxMegapixels));
+        image.Set("format", JsonValue::String(wstring_view(ImageFormatToConfig(m.image.format))));
+        image.Set("quality", JsonValue::Number(m.image.quality));
+        obj.Set("image", move(image));
+        if (!m.prices.empty()) {
+            JsonValue prices = JsonValue::Object();
+            prices.Set("input", JsonValue::Number(m.prices.input));
+            prices.Set("output", JsonValue::Number(m.prices.output));
+            prices.Set("cached", JsonValue::Number(m.prices.cached));
+            obj.Set("prices", move(prices));
+        }
+        arr.Append(move(obj));
+    }
+    return arr;
+}
+
+JsonValue FiltersToJson(const vector<FilterDefinition>& filters) {
+    JsonValue arr = JsonValue::Array();
+    for (const auto& f : filters) {
+        JsonValue obj = JsonValue::Object();
+        obj.Set("title", JsonValue::String(f.title));
+        obj.Set("input", JsonValue::String(wstring_view(IOTypeToConfig(f.input))));
+        obj.Set("output", JsonValue::String(wstring_view(IOTypeToConfig(f.output))));
+        obj.Set("modelIndex", JsonValue::Number(static_cast<double>(f.modelIndex)));
+        obj.Set("prompt", JsonValue::String(f.prompt));
+        obj.Set("cache", JsonValue::Boolean(f.cache));
+        if (f.typeOutput) obj.Set("typeOutput", JsonValue::Boolean(true));
+        if (f.chunkTokens > 0) {
+            JsonValue chunking = JsonValue::Object();
+            chunking.Set("maxTokens", JsonValue::Number(static_cast<double>(f.chunkTokens)));
+            chunking.Set("parallel", JsonValue::Number(static_cast<double>(f.chunkParallel)));
+            chunking.Set("retries", JsonValue::Number(f.chunkRetries));
+            obj.Set("chunking", move(chunking));
+        }
+        if (!f.hedgeModels.empty()) {
+            JsonValue hedge = JsonValue::Object();
+            JsonValue hedgeModels = JsonValue::Array();
+            for (size_t idx : f.hedgeModels) hedgeModels.Append(JsonValue::Number(static_cast<double>(idx)));
+            hedge.Set("models", move(hedgeModels));
+            hedge.Set("delayMs", JsonValue::Number(f.hedge.delayMs));
+            hedge.Set("quantile", JsonValue::Number(f.hedge.quantile));
+            obj.Set("hedge", move(hedge));
+        }
+        if (IsFanOut(f)) {
+            JsonValue fanout = JsonValue::Object();
+            JsonValue fanOutFilters = JsonValue::Array();
+            for (size_t idx : f.fanOutFilters) fanOutFilters.Append(JsonValue::Number(static_cast<double>(idx)));
+            JsonValue fanOutModels = JsonValue::Array();
+            for (size_t idx : f.fanOutModels) fanOutModels.Append(JsonValue::Number(static_cast<double>(idx)));
+            fanout.Set("filters", move(fanOutFilters));
+            fanout.Set("models", move(fanOutModels));
+            obj.Set("fanout", move(fanout));
+        }
+        if (IsPipeline(f)) {
+            JsonValue pipeline = JsonValue::Array();
+            for (size_t idx : f.pipeline) pipeline.Append(JsonValue::Number(static_cast<double>(idx)));
+            obj.Set("pipeline", move(pipeline));
+        }
+        arr.Append(move(obj));
+    }
+    return arr;
+}
+
+bool ReadFileBytes(const filesystem::path& path, string& out) {
+    ifstream in(path, ios::binary);
+    if (!in) return false;
+    out.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+    return true;
+}
@@ -0,0 +1,233 @@
+/**
+ * @file filter_config.h
+ * @brief Models, filters and API templates, and their config.json / apidef JSON form
+ *
+ * These definitions are shared by the tray application and the headless
+ * command line tool, so both read the same config.json and apidef files.
+ * Nothing here depends on Win32; API keys are passed through a codec so the
+ * host decides how they are stored (DPAPI on Windows).
+ */
+
+#pragma once
+
+#include "hedge.h"
+#include "image_scale.h"
+#include "json_path.h"
+#include "json_value.h"
+#include "rate_limit.h"
+#include "template_render.h"
+#include "usage_stats.h"
+
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/**
+ * @enum IOType
+ * @brief Input/output type for filter operations
+ */
+enum class IOType { Text, Image };
+
+/**
+ * @struct ModelConfig
+ * @brief Configuration for an AI model endpoint
+ */
+struct ModelConfig {
+    std::wstring name;        // Display name for the model
+    std::wstring serverUrl;   // API server URL (e.g., https://api.openai.com/v1)
+    std::wstring modelName;   // Model identifier (e.g., gpt-4o-mini)
+    std::wstring apiKey;      // API authentication key
+    std::wstring providerId;  // API provider id
+    ImageUploadOptions image; // Downscale/re-encode limits for uploaded images
+    TokenPrices prices;       // Token prices for cost accounting (unset = no cost recorded)
+};
+
+/**
+ * @struct FilterDefinition
+ * @brief Definition of a clipboard transformation filter
+ */
+struct FilterDefinition {
+    std::wstring title;           // Display name for the filter
+    IOType input;                 // Input type (Text or Image)
+    IOType output;                // Output type (Text or Image)
+    size_t modelIndex;            // Index into the model list
+    std::wstring prompt;          // Prompt text to send to the AI model
+    bool cache{true};             // Reuse cached results for identical requests
+    size_t chunkTokens{};         // Split long Text->Text input into chunks of this many tokens (0 = off)
+    size_t chunkParallel{4};      // Chunk requests in flight at once
+    int chunkRetries{2};          // Extra attempts for a failed chunk
+    std::vector<size_t> hedgeModels; // Backup models raced against a slow primary, in order (indices into the model list)
+    HedgePolicy hedge;            // When to fire the next backup
+    std::vector<size_t> fanOutFilters; // Other filters run on the same input at once (indices into the filter list)
+    std::vector<size_t> fanOutModels;  // Models that each run this filter's prompt at once (indices into the model list)
+    std::vector<size_t> pipeline;      // Filters run in sequence, each on the previous one's output (indices into the filter list)
+    bool typeOutput{};            // Type streamed Text output into the target window instead of pasting it at the end
+};
+
+/**
+ * @brief true if the filter fans its input out to several filters or models
+ */
+inline bool IsFanOut(const FilterDefinition& f) { return !f.fanOutFilters.empty() || !f.fanOutModels.empty(); }
+
+/**
+ * @brief true if the filter chains other filters
+ */
+inline bool IsPipeline(const FilterDefinition& f) { return !f.pipeline.empty(); }
+
+/**
+ * @struct TemplateDefinition
+ * @brief API request template definition loaded from apidef/<provider>.json
+ */
+struct TemplateDefinition {
+    std::wstring id;
+    std::wstring providerId;
+    IOType input;
+    IOType output;
+    std::wstring endpoint;
+    std::wstring resultPath;
+    std::vector<std::pair<std::wstring, std::wstring>> headers; // key/value with placeholders
+    std::wstring payload;         // JSON text with placeholders
+    bool stream{};                // true if the template declares an SSE streaming variant
+    std::wstring streamEndpoint;  // Endpoint used when streaming
+    std::wstring streamPayload;   // Payload used when streaming (base payload merged with stream overrides)
+    std::wstring streamResultPath; // Path of the text delta inside each SSE data frame
+    UsagePaths usage;             // Where responses (and stream frames) report token counts
+    // Pre-compiled forms of the fields above (filled by ParseApiProvider)
+    CompiledTemplate endpointTpl;
+    CompiledTemplate payloadTpl;
+    CompiledTemplate streamEndpointTpl;
+    CompiledTemplate streamPayloadTpl;
+    std::vector<std::pair<std::wstring, CompiledTemplate>> headerTpls;
+    JsonPath resultJsonPath;
+    JsonPath streamResultJsonPath;
+};
+
+/**
+ * @struct ApiProvider
+ * @brief One apidef file: its templates, model listing request and rate limits
+ */
+struct ApiProvider {
+    std::wstring id;
+    std::wstring defaultEndpoint;
+    std::vector<TemplateDefinition> templates;
+    std::wstring modelsEndpoint;
+    std::wstring modelsMethod;
+    std::vector<std::pair<std::wstring, std::wstring>> modelsHeaders;
+    std::wstring modelsPayload;
+    std::wstring modelsResultPath;
+    RateLimitConfig rateLimit;    // Client-side limit and retry settings ("rate-limit")
+    // Pre-compiled forms of the models request (filled by ParseApiProvider)
+    CompiledTemplate modelsEndpointTpl;
+    CompiledTemplate modelsPayloadTpl;
+    std::vector<std::pair<std::wstring, CompiledTemplate>> modelsHeaderTpls;
+};
+
+/**
+ * @brief Converts a stored API key to plain text or back (identity when empty)
+ */
+using ApiKeyCodec = std::function<std::wstring(const std::wstring&)>;
+
+/**
+ * @brief Parse an input/output type name ("text" or "image", any case)
+ */
+IOType ParseIOType(std::wstring_view s);
+
+/**
+ * @brief Config name of an input/output type
+ */
+const wchar_t* IOTypeToConfig(IOType t);
+
+/**
+ * @brief Strip a variant suffix from a provider id ("OpenAI-compatible" -> "OpenAI")
+ */
+std::wstring NormalizeProviderId(const std::wstring& raw);
+
+/**
+ * @brief Compile header key/value pairs into templates
+ */
+std::vector<std::pair<std::wstring, CompiledTemplate>> CompileHeaders(const std::vector<std::pair<std::wstring, std::wstring>>& headers);
+
+/**
+ * @brief Parse one apidef file
+ * @param id Provider id (the file name without extension)
+ * @param json File content (UTF-8)
+ * @param out Provider with compiled templates
+ * @param err Reason on failure (optional)
+ * @return false if the file is not valid JSON or defines no template
+ */
+bool ParseApiProvider(const std::wstring& id, std::string_view json, ApiProvider& out, std::wstring* err = nullptr);
+
+/**
+ * @brief Load every *.json file of an apidef directory
+ * @param dir Directory
+ * @param out Providers in file name order
+ * @param errors Receives one message per file that could not be used
+ * @return false if no provider was loaded
+ */
+bool LoadApiProviders(const std::filesystem::path& dir, std::vector<ApiProvider>& out, std::vector<std::wstring>& errors);
+
+/**
+ * @brief Read the "models" array of config.json
+ * @param root Config document
+ * @param target Replaced only if the array holds at least one named model
+ * @param decodeKey Turns the stored apiKey into plain text (optional)
+ */
+void ParseModels(const JsonValue& root, std::vector<ModelConfig>& target, const ApiKeyCodec& decodeKey = nullptr);
+
+/**
+ * @brief Read the "filters" array of config.json
+ * @param root Config document
+ * @param target Replaced only if the array holds at least one titled filter
+ */
+void ParseFilters(const JsonValue& root, std::vector<FilterDefinition>& target);
+
+/**
+ * @brief Point filters with out-of-range model indices at model 0 and drop invalid hedge backups
+ */
+void ValidateFilterModels(std::vector<FilterDefinition>& filters, size_t modelCount);
+
+/**
+ * @brief Drop fan-out references a filter cannot run
+ *
+ * Removes out-of-range indices, references to the filter itself or to
+ * another fan-out or pipeline filter (they do not nest) and filters whose
+ * input or output type differs from the referencing filter's.
+ */
+void ValidateFanOuts(std::vector<FilterDefinition>& filters);
+
+/**
+ * @brief Check pipeline stages and derive the pipeline's input and output types
+ *
+ * Out-of-range stages and stages that are the filter itself or another
+ * pipeline or fan-out filter are removed. A pipeline whose remaining stages
+ * do not chain (one stage's output type is not the next one's input type)
+ * is cleared. A valid pipeline takes its input type from the first stage
+ * and its output type from the last, and does not fan out. Call before
+ * ValidateFanOuts.
+ */
+void ValidatePipelines(std::vector<FilterDefinition>& filters);
+
+/**
+ * @brief Assign the first provider to models that have none
+ */
+void EnsureModelProviders(std::vector<ModelConfig>& models, const std::vector<ApiProvider>& providers);
+
+/**
+ * @brief Config form of the model list
+ * @param encodeKey Turns the plain API key into its stored form (optional)
+ */
+JsonValue ModelsToJson(const std::vector<ModelConfig>& models, const ApiKeyCodec& encodeKey = nullptr);
+
+/**
+ * @brief Config form of the filter list
+ */
+JsonValue FiltersToJson(const std::vector<FilterDefinition>& filters);
+
+/**
+ * @brief Read a whole file as bytes
+ * @return false if the file could not be opened
+ */
+bool ReadFileBytes(const std::filesystem::path& path, std::string& out);
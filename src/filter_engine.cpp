@@ -0,0 +1,800 @@
+/**
+ * @file filter_engine.cpp
+ * @brief Implementation of the filter engine
+ */
+
+#include "filter_engine.h"
+#include "api_payload.h"
+#include "base64.h"
+#include "hedge.h"
+#include "job_queue.h"
+#include "rate_limit.h"
+#include "response_cache.h"
+#include "sse_parser.h"
+#include "trace.h"
+#include "utf8.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cwctype>
+#include <exception>
+#include <memory>
+#include <mutex>
+
+using namespace std;
+
+namespace {
+bool ContainsNoCase(const wstring& hay, const wstring& needle) {
+    auto toLow = [](wstring s) { for (auto& c : s) c = static_cast<wchar_t>(towlower(c)); return s; };
+    return toLow(hay).find(toLow(needle)) != wstring::npos;
+}
+
+wstring ReplaceAll(wstring s, const wstring& from, const wstring& to) {
+    size_t pos = 0;
+    while ((pos = s.find(from, pos)) != wstring::npos) {
+        s.replace(pos, from.length(), to);
+        pos += to.length();
+    }
+    return s;
+}
+
+/**
+ * @brief Drop a "data:image/...;base64," prefix
+ */
+void StripDataUrl(string& b64) {
+    if (b64.find("data:image") == string::npos) return;
+    size_t c = b64.find(',');
+    if (c != string::npos) b64.erase(0, c + 1);
+}
+
+/**
+ * @brief Check that base64 data decodes to a PNG, JPEG or WebP image
+ */
+bool IsEncodedImage(string_view b64) {
+    vector<uint8_t> bytes;
+    ImageFormat fmt;
+    return Base64Decode(b64, bytes) && SniffImageFormat(bytes.data(), bytes.size(), fmt);
+}
+
+/**
+ * @brief MIME type of base64 image data, from its leading bytes (PNG if unrecognized)
+ */
+string EncodedImageMime(string_view b64) {
+    vector<uint8_t> head;
+    ImageFormat fmt = ImageFormat::Png;
+    // 64 characters decode to 48 bytes, enough for every signature SniffImageFormat knows
+    if (!Base64Decode(b64.size() > 64 ? b64.substr(0, 64) : b64, head) || !SniffImageFormat(head.data(), head.size(), fmt)) fmt = ImageFormat::Png;
+    return WideToUtf8(ImageFormatMime(fmt));
+}
+
+/**
+ * @brief Run one chunk request with the filter's retries and exponential backoff
+ * @param retries Extra attempts after the first (FilterDefinition::chunkRetries)
+ * @param cancel Ends the backoff early (optional)
+ * @param failed Set once another chunk of the same text failed: no further attempts
+ * @param attempt Sends the request once
+ * @param onRetry Called before each retry with its number (optional)
+ * @return true once an attempt succeeded
+ */
+bool RetryChunk(int retries, CancelToken* cancel, const atomic<bool>& failed, const function<bool()>& attempt, const function<void(int)>& onRetry = nullptr) {
+    for (int i = 0; i <= retries && !failed; ++i) {
+        if (i > 0) {
+            if (onRetry) onRetry(i);
+            if (!SleepUnlessCancelled(cancel, chrono::milliseconds(500u << (i - 1)))) return false;
+        }
+        if (attempt()) return true;
+        if (cancel && cancel->IsCancelled()) return false;
+    }
+    return false;
+}
+
+/**
+ * @class ChunkRelay
+ * @brief Runs a chunked Text->Text pipeline stage on text that is still streaming in
+ *
+ * Feed receives the previous stage's text; each chunk it completes is
+ * queued at once and run on up to chunkParallel threads with the stage's
+ * retries. Outputs are passed on in order, so relays can be chained. The
+ * chunk requests watch a token of the relay's own, so Fail() aborts them
+ * without cancelling the rest of the job.
+ */
+class ChunkRelay {
+public:
+    ChunkRelay(const FilterEngine& engine, const FilterRun& stage, PartialTextHandler onOutput, CancelToken* cancel, TraceSession* trace)
+        : engine_(engine), stage_(stage), onOutput_(move(onOutput)), trace_(trace),
+          link_(cancel, [this] { cancel_.Cancel(); }),
+          chunker_(stage.filter.chunkTokens), queue_(stage.filter.chunkParallel, stage.filter.chunkParallel) {
+        // Chunks are already within budget
+        stage_.filter.chunkTokens = 0;
+    }
+
+    ~ChunkRelay() { Wait(); }
+
+    /**
+     * @brief Add streamed text of the previous stage (calls must not overlap)
+     */
+    void Feed(const wstring& text) { Submit(chunker_.Append(text)); }
+
+    /**
+     * @brief Run the rest of the text and wait for every chunk
+     * @param result Joined output of the stage
+     * @return false if a chunk failed after its retries
+     */
+    bool Finish(wstring& result) {
+        Submit(chunker_.Finish());
+        Wait();
+        if (failed_ || cancel_.IsCancelled()) return false;
+        result = JoinChunks(chunks_, outputs_);
+        return true;
+    }
+
+    /**
+     * @brief Give up on the stage: abort the chunk requests in flight and skip the queued ones
+     *
+     * Safe to call from any thread; chunks that were not sent yet are never sent.
+     */
+    void Fail() {
+        failed_ = true;
+        cancel_.Cancel();
+    }
+
+    ChunkRelay(const ChunkRelay&) = delete;
+    ChunkRelay& operator=(const ChunkRelay&) = delete;
+
+private:
+    void Submit(vector<TextChunk> chunks) {
+        for (TextChunk& c : chunks) {
+            size_t index;
+            wstring text = c.text;
+            {
+                lock_guard<mutex> lock(mutex_);
+                index = chunks_.size();
+                chunks_.push_back(move(c));
+                outputs_.emplace_back();
+                done_.push_back(0);
+                ++pending_;
+            }
+            queue_.Submit(L"", [this, index, text = move(text)] { Run(index, text); });
+        }
+    }
+
+    void Run(size_t index, const wstring& text) {
+        TraceAttach attach(trace_);
+        TraceScope span("relay_chunk");
+        span.Arg("index", static_cast<long long>(index));
+        wstring output;
+        bool ok = !failed_ && Process(text, output);
+        lock_guard<mutex> lock(mutex_);
+        if (ok) {
+            outputs_[index] = move(output);
+            done_[index] = 1;
+        } else {
+            Fail();
+        }
+        // Pass on the contiguous finished prefix so the next stage reads in order
+        for (; !failed_ && emitted_ < chunks_.size() && done_[emitted_]; ++emitted_) {
+            if (onOutput_) onOutput_(outputs_[emitted_] + chunks_[emitted_].separator);
+        }
+        if (--pending_ == 0) idle_.notify_all();
+    }
+
+    bool Process(const wstring& text, wstring& output) {
+        // Whitespace between paragraphs can end up alone at the end of the stream
+        if (all_of(text.begin(), text.end(), [](wchar_t c) { return iswspace(c); })) { output = text; return true; }
+        FilterPayload payload;
+        payload.text = text;
+        return RetryChunk(stage_.filter.chunkRetries, &cancel_, failed_, [&] {
+            FilterOutput r;
+            if (!engine_.RunFilter(stage_.filter, stage_.model, stage_.hedgeModels, payload, r, nullptr, &cancel_)) return false;
+            output = move(r.text);
+            return true;
+        });
+    }
+
+    void Wait() {
+        unique_lock<mutex> lock(mutex_);
+        idle_.wait(lock, [this] { return pending_ == 0; });
+    }
+
+    const FilterEngine& engine_;
+    FilterRun stage_;
+    PartialTextHandler onOutput_;
+    TraceSession* trace_;
+    CancelToken cancel_;            // Watched by the chunk requests; cancelled by Fail or the job's token
+    CancelRegistration link_;       // Forwards the job's cancellation to cancel_
+    StreamingChunker chunker_;      // Used by Feed and Finish only
+    mutex mutex_;                   // Guards the members below
+    condition_variable idle_;
+    vector<TextChunk> chunks_;
+    vector<wstring> outputs_;
+    vector<char> done_;
+    size_t emitted_{};
+    size_t pending_{};
+    atomic<bool> failed_{};
+    JobQueue queue_;                // Last, so its workers stop before the rest is destroyed
+};
+
+/**
+ * @brief true if stage next can start on the streamed output of stage prev
+ *
+ * Only chunked Text->Text stages qualify: their filter already declares that
+ * the text may be processed piece by piece. A hedged stage may switch to
+ * another attempt's text half-way, so it does not stream into the next one.
+ */
+bool CanStreamInto(const FilterRun& prev, const FilterRun& next) {
+    return prev.filter.output == IOType::Text && prev.hedgeModels.empty() &&
+        next.filter.input == IOType::Text && next.filter.output == IOType::Text && next.filter.chunkTokens > 0;
+}
+} // namespace
+
+PlaceholderValues MakePlaceholderValues(string_view model, string_view apiKey, string_view systemPrompt, string_view prompt, string_view imageB64, string_view imageDataUrl, string_view imageMime) {
+    PlaceholderValues v;
+    v[Placeholder::Model] = model;
+    v[Placeholder::SystemPrompt] = systemPrompt;
+    v[Placeholder::Prompt] = prompt;
+    v[Placeholder::InputText] = prompt;
+    v[Placeholder::ApiKey] = apiKey;
+    v[Placeholder::ImageUrl] = imageDataUrl;
+    v[Placeholder::Image] = imageB64;
+    v[Placeholder::ImageMime] = imageMime;
+    return v;
+}
+
+wstring BuildHeaderString(const vector<pair<wstring, CompiledTemplate>>& headers, const PlaceholderValues& v) {
+    wstring header;
+    for (const auto& kv : headers) {
+        header += kv.first + L": " + Utf8ToWide(kv.second.Render(v, false)) + L"\r\n";
+    }
+    return header;
+}
+
+wstring ModelLatencyKey(const ModelConfig& m) {
+    return m.serverUrl + L"|" + m.modelName;
+}
+
+const TemplateDefinition* FindTemplateByIO(const ApiProvider& provider, IOType input, IOType output) {
+    for (const auto& t : provider.templates) if (t.input == input && t.output == output) return &t;
+    return nullptr;
+}
+
+void FilterEngine::SetProviders(vector<ApiProvider> providers) {
+    for (const ApiProvider& p : providers) RateLimiters::Instance().For(p.id).Configure(p.rateLimit);
+    providers_ = move(providers);
+}
+
+const ApiProvider* FilterEngine::FindProvider(const wstring& id) const {
+    for (const auto& p : providers_) if (p.id == id) return &p;
+    return nullptr;
+}
+
+const TemplateDefinition* FilterEngine::ResolveTemplate(const ModelConfig& m, IOType input, IOType output) const {
+    const ApiProvider* provider = FindProvider(m.providerId);
+    if (!provider && !providers_.empty()) provider = &providers_.front();
+    if (const TemplateDefinition* tpl = provider ? FindTemplateByIO(*provider, input, output) : nullptr) return tpl;
+    for (const auto& p : providers_) {
+        if (const auto* t = FindTemplateByIO(p, input, output)) return t;
+    }
+    return nullptr;
+}
+
+void FilterEngine::Log(const wstring& msg) const {
+    if (log_) log_(msg);
+}
+
+/**
+ * @brief Complete a usage record with the request's identity and cost and pass it to the usage handler
+ */
+void FilterEngine::RecordUsage(UsageRecord r, const TemplateDefinition& tpl, const ModelConfig& m, const Request& req) const {
+    if (log_ && r.usage.reported) {
+        Log(L"usage: prompt=" + to_wstring(r.usage.prompt) + L" completion=" + to_wstring(r.usage.completion)
+            + L" cached=" + to_wstring(r.usage.cached) + L" latency=" + to_wstring(static_cast<long long>(r.latencyMs)) + L" ms");
+    }
+    if (!usage_) return;
+    r.time = chrono::duration_cast<chrono::seconds>(chrono::system_clock::now().time_since_epoch()).count();
+    r.filter = req.filter;
+    r.model = m.name;
+    r.provider = tpl.providerId;
+    r.cost = UsageCost(r.usage, m.prices);
+    usage_(r);
+}
+
+/**
+ * @brief POST a request through the provider's rate limiter, retrying 429/503 responses
+ * @param providerId Provider whose limiter applies
+ * @param host Host name
+ * @param path Path
+ * @param useHttps Use HTTPS
+ * @param headers Headers
+ * @param body Body
+ * @param onData Receives the body of the response that is kept (rejected attempts are dropped)
+ * @param err Error message of the last attempt
+ * @param cancel Aborts the request or the wait before it (optional)
+ * @return true if the last attempt received a whole response
+ */
+bool FilterEngine::SendRateLimited(const wstring& providerId, const wstring& host, const wstring& path, bool useHttps, const wstring& headers, const string& body, const HttpDataHandler& onData, wstring& err, CancelToken* cancel) const {
+    bool ok = false;
+    SendWithRetry(RateLimiters::Instance().For(providerId), cancel, [&] {
+        HttpResponseInfo info;
+        err.clear();
+        ok = HttpRequestStreaming(host, path, useHttps, headers, body, L"POST", [&](const char* data, size_t size) {
+            if (!IsRetryableStatus(info.status)) onData(data, size);
+        }, &err, cancel, &info);
+        return RateLimitedResponse{info.status, move(info.rawHeaders)};
+    }, [&](int status, chrono::milliseconds delay) {
+        Log(L"HTTP " + to_wstring(status) + L" from " + providerId + L", retry in " + to_wstring(delay.count()) + L" ms");
+    });
+    return ok;
+}
+
+/**
+ * @brief Call a template API
+ * @param tpl Template definition
+ * @param m Model configuration
+ * @param req Prompts and image input
+ * @param onDelta Receives streamed text deltas; when set and the template supports streaming, the SSE variant is used
+ * @param ctl Cancellation and first-byte hooks (optional)
+ * @return API call result (empty if cancelled)
+ *
+ * The body is rendered, sent and parsed as UTF-8; only the extracted result is converted.
+ * The time to first byte is recorded in LatencyRegistry for adaptive hedging.
+ */
+FilterOutput FilterEngine::CallTemplate(const TemplateDefinition& tpl, const ModelConfig& m, const Request& req, const PartialTextHandler& onDelta, const RequestControl* ctl) const {
+    FilterOutput result;
+    const bool streaming = tpl.stream && tpl.output == IOType::Text && onDelta;
+    TraceScope renderSpan("render_template");
+    const string model = WideToUtf8(m.modelName), apiKey = WideToUtf8(m.apiKey);
+    const string imageDataUrl = req.imageB64.empty() ? "" : ("data:" + string(req.imageMime) + ";base64," + string(req.imageB64));
+    const PlaceholderValues values = MakePlaceholderValues(model, apiKey, req.systemPrompt, req.promptText, req.imageB64, imageDataUrl, req.imageMime);
+    wstring endpoint = Utf8ToWide((streaming ? tpl.streamEndpointTpl : tpl.endpointTpl).Render(values, false));
+    wstring host, path; bool useHttps = true;
+    if (!PrepareEndpoint(m.serverUrl, endpoint, host, path, useHttps)) {
+        Log(L"PrepareEndpoint failed");
+        return result;
+    }
+    wstring headers = BuildHeaderString(tpl.headerTpls, values);
+    string body;
+    wstring adjHeaders = headers;
+    if (ContainsNoCase(headers, L"multipart/form-data")) {
+        const string boundary = "----cbfilterboundary";
+        adjHeaders = ReplaceAll(headers, L"multipart/form-data", L"multipart/form-data; boundary=" + Utf8ToWide(boundary));
+        body = BuildMultipartBody(boundary, model, req.promptText, req.imageB64, req.imageMime);
+    } else {
+        body = (streaming ? tpl.streamPayloadTpl : tpl.payloadTpl).Render(values, true);
+    }
+    renderSpan.Arg("bytes", static_cast<long long>(body.size()));
+    renderSpan.End();
+    if (log_) {
+        Log(L"request host: " + host);
+        Log(L"request path: " + path);
+        Log(L"body: " + Utf8ToWide(body));
+    }
+    wstring err;
+    CancelToken* cancel = ctl ? ctl->cancel : nullptr;
+    const auto sent = chrono::steady_clock::now();
+    auto msSinceSent = [&] { return chrono::duration<double, milli>(chrono::steady_clock::now() - sent).count(); };
+    bool gotFirstByte = false;
+    double firstByteMs = 0;
+    auto recordLatency = [&] {
+        firstByteMs = msSinceSent();
+        LatencyRegistry::Instance().Record(ModelLatencyKey(m), firstByteMs);
+    };
+    auto onFirstByte = [&] {
+        if (gotFirstByte) return;
+        gotFirstByte = true;
+        recordLatency();
+        if (ctl && ctl->onFirstByte) ctl->onFirstByte();
+    };
+    auto recordUsage = [&](bool ok) {
+        UsageRecord r;
+        r.ok = ok;
+        r.streamed = streaming;
+        r.latencyMs = msSinceSent();
+        r.firstByteMs = firstByteMs;
+        r.usage = result.usage;
+        RecordUsage(move(r), tpl, m, req);
+    };
+    // Returns true if the request was cancelled; the result is then discarded
+    auto cancelled = [&] {
+        if (!cancel || !cancel->IsCancelled()) return false;
+        // A request cancelled while waiting still counts, as a lower bound, so the tail stays visible
+        if (!gotFirstByte) recordLatency();
+        Log(L"template request cancelled");
+        return true;
+    };
+    if (streaming) {
+        // Usage arrives in the last frame (OpenAI) or accumulates in every frame (Gemini): read it once, from the last
+        string lastFrame;
+        SseParser parser([&](const string&, const string& data) {
+            if (data == "[DONE]") return;
+            lastFrame.assign(data);
+            string deltaUtf8;
+            if (!tpl.streamResultJsonPath.Extract(data, deltaUtf8) || deltaUtf8.empty()) return;
+            wstring delta = Utf8ToWide(deltaUtf8);
+            result.text += delta;
+            onDelta(delta);
+        });
+        const bool complete = SendRateLimited(tpl.providerId, host, path, useHttps, adjHeaders, body, [&](const char* data, size_t size) { onFirstByte(); parser.Feed(data, size); }, err, cancel);
+        if (cancelled()) return FilterOutput{};
+        // A stream cut off mid-way must not pass for a short answer (or be cached as one)
+        if (!complete) {
+            Log(L"template stream incomplete: " + err);
+            if (!lastFrame.empty()) tpl.usage.Extract(lastFrame, result.usage);
+            recordUsage(false);
+            return FilterOutput{};
+        }
+        parser.Finish();
+        if (!lastFrame.empty()) tpl.usage.Extract(lastFrame, result.usage);
+        if (!err.empty()) Log(L"template stream error: " + err);
+        if (result.text.empty()) Log(L"template stream produced no text");
+        recordUsage(!result.text.empty());
+        return result;
+    }
+    string resp;
+    const bool complete = SendRateLimited(tpl.providerId, host, path, useHttps, adjHeaders, body, [&](const char* data, size_t size) { onFirstByte(); resp.append(data, size); }, err, cancel);
+    if (cancelled()) return result;
+    if (!complete) {
+        Log(L"template request incomplete: " + err);
+        recordUsage(false);
+        return result;
+    }
+    if (!err.empty()) Log(L"template request error: " + err);
+    if (resp.empty()) { recordUsage(false); return result; }
+    TraceScope extractSpan("extract_result");
+    extractSpan.Arg("bytes", static_cast<long long>(resp.size()));
+    // The result and the usage counts come out of one pass, so a large image response is scanned once
+    string extracted;
+    tpl.usage.Extract(resp, result.usage, tpl.resultJsonPath, extracted);
+    if (tpl.output == IOType::Text) {
+        string text = move(extracted);
+        if (text.empty()) text = ExtractContent(resp);
+        if (text.empty()) Log(L"template response empty content. resp=" + Utf8ToWide(resp.substr(0, 512)));
+        result.text = Utf8ToWide(text);
+    } else {
+        string b64 = move(extracted);
+        StripDataUrl(b64);
+        if (b64.empty()) b64 = ExtractB64Image(resp);
+        if (b64.empty()) b64 = ExtractContent(resp);
+        StripDataUrl(b64);
+        // A truncated or non-image answer must not reach the host or the cache
+        if (!b64.empty() && IsEncodedImage(b64)) result.imageB64 = move(b64);
+        else Log(L"template response produced no image");
+    }
+    extractSpan.End();
+    recordUsage(!result.text.empty() || !result.imageB64.empty());
+    return result;
+}
+
+/**
+ * @brief Send one request through a template, consulting the response cache first
+ * @param tpl Template definition
+ * @param m Model configuration
+ * @param useCache Look up and store the result in the response cache
+ * @param req Prompts and image input
+ * @param out Output parameter for the resulting text or image
+ * @param onPartial Receives streamed text deltas (optional)
+ * @param ctl Cancellation and first-byte hooks (optional)
+ * @return true if the template produced a result
+ */
+bool FilterEngine::ExecuteTemplate(const TemplateDefinition& tpl, const ModelConfig& m, bool useCache, const Request& req, FilterOutput& out, const PartialTextHandler& onPartial, const RequestControl* ctl) const {
+    CacheKey cacheKey;
+    if (useCache) {
+        TraceScope span("cache_lookup");
+        cacheKey = CacheKeyBuilder().Add(tpl.providerId).Add(tpl.id).Add(m.serverUrl).Add(m.modelName)
+            .Add(req.systemPrompt).Add(req.promptText).Add(req.imageB64).Finish();
+        CachedKind kind{};
+        string payload;
+        bool hit = ResponseCache::Instance().Get(cacheKey, kind, payload) && !payload.empty();
+        span.Arg("hit", hit ? 1 : 0);
+        if (hit) {
+            char rate[16];
+            snprintf(rate, sizeof(rate), "%.1f", ResponseCache::Instance().Stats().HitRate() * 100.0);
+            Log(L"cache hit (hit rate " + Utf8ToWide(rate) + L"%)");
+            if (kind == CachedKind::Text) out.text = Utf8ToWide(payload);
+            else out.imageB64 = move(payload);
+            UsageRecord r;
+            r.ok = true;
+            r.cacheHit = true;
+            RecordUsage(move(r), tpl, m, req);
+            return true;
+        }
+    }
+    out = CallTemplate(tpl, m, req, onPartial, ctl);
+    if (ctl && ctl->cancel && ctl->cancel->IsCancelled()) return false;
+    if (tpl.output == IOType::Text) {
+        if (out.text.empty()) { Log(L"fail: template returned empty text"); return false; }
+        if (useCache) ResponseCache::Instance().Put(cacheKey, CachedKind::Text, WideToUtf8(out.text));
+        return true;
+    }
+    if (out.imageB64.empty()) { Log(L"fail: template returned no image"); return false; }
+    if (useCache) ResponseCache::Instance().Put(cacheKey, CachedKind::Image, out.imageB64);
+    return true;
+}
+
+/**
+ * @brief Send one request to the primary model and race backups against it while it is slow
+ * @param f Filter definition (hedge policy)
+ * @param tpl Template of the primary model
+ * @param primary Primary model
+ * @param backups Backup models, in the order they are tried
+ * @param useCache Use the response cache
+ * @param req Prompts and image input, shared by every attempt
+ * @param out Output parameter for the winning result
+ * @param onPartial Receives the winner's streamed deltas once the race is decided (optional)
+ * @param cancel Aborts every attempt (optional)
+ * @return true if any attempt produced a result
+ */
+bool FilterEngine::ExecuteHedged(const FilterDefinition& f, const TemplateDefinition& tpl, const ModelConfig& primary, const vector<ModelConfig>& backups, bool useCache, const Request& req, FilterOutput& out, const PartialTextHandler& onPartial, CancelToken* cancel) const {
+    vector<const ModelConfig*> models{&primary};
+    vector<const TemplateDefinition*> tpls{&tpl};
+    for (const ModelConfig& b : backups) {
+        const TemplateDefinition* t = ResolveTemplate(b, tpl.input, tpl.output);
+        if (!t) { Log(L"hedge: no template for " + b.name); continue; }
+        models.push_back(&b);
+        tpls.push_back(t);
+    }
+    TraceScope span("hedge");
+    TraceSession* trace = CurrentTrace();
+    vector<FilterOutput> results(models.size());
+    HedgeStreams streams(models.size());  // Deltas of each attempt, held until the winner is known
+    HedgeResult race = RunHedged(models.size(),
+        [&](size_t i) { return HedgeDelay(f.hedge, ModelLatencyKey(*models[i])); },
+        [&](HedgeAttempt& a) {
+            TraceAttach attach(trace);
+            TraceScope attemptSpan("hedge_attempt");
+            const size_t i = a.Index();
+            attemptSpan.Arg("index", static_cast<long long>(i));
+            // Cancelling the job cancels this attempt; once cancelled, remaining backups fail at once
+            CancelRegistration forward(cancel, [&a] { a.Token().Cancel(); });
+            if (a.Token().IsCancelled()) return false;
+            if (i > 0) Log(L"hedge: firing backup " + models[i]->name);
+            RequestControl ctl{&a.Token(), [&a] { a.FirstByte(); }};
+            PartialTextHandler onDelta;
+            if (onPartial) onDelta = [&streams, i](const wstring& delta) { streams.Add(i, delta); };
+            bool ok = ExecuteTemplate(*tpls[i], *models[i], useCache, req, results[i], onDelta, &ctl);
+            attemptSpan.Arg("ok", ok ? 1 : 0);
+            return ok;
+        });
+    span.Arg("launched", static_cast<long long>(race.launched));
+    span.Arg("winner", race.winner);
+    if (cancel && cancel->IsCancelled()) return false;
+    if (race.winner < 0) { Log(L"fail: every hedged attempt failed"); return false; }
+    Log(L"hedge: launched=" + to_wstring(race.launched) + L" winner=" + models[race.winner]->name);
+    if (onPartial) streams.Forward(static_cast<size_t>(race.winner), onPartial);
+    out = move(results[race.winner]);
+    return true;
+}
+
+/**
+ * @brief Process a long text as concurrent chunk requests and stitch the outputs back in order
+ * @param tpl Text->Text template
+ * @param m Model configuration
+ * @param f Filter definition (prompt and chunking settings)
+ * @param useCache Use the response cache per chunk
+ * @param systemPrompt System prompt (UTF-8)
+ * @param chunks Input split by SplitTextIntoChunks
+ * @param result Output parameter for the joined text
+ * @param onPartial Receives the finished prefix of the output as chunks complete (optional)
+ * @param cancel Aborts the chunk requests and retries (optional)
+ * @return false if a chunk still failed after its retries or the job was cancelled
+ *
+ * Each chunk is retried with exponential backoff; with the cache enabled,
+ * chunks that succeeded are not requested again when the filter is rerun.
+ */
+bool FilterEngine::RunChunkedText(const TemplateDefinition& tpl, const ModelConfig& m, const FilterDefinition& f, bool useCache, const string& systemPrompt, const vector<TextChunk>& chunks, wstring& result, const PartialTextHandler& onPartial, CancelToken* cancel) const {
+    Log(L"RunChunkedText: chunks=" + to_wstring(chunks.size()) + L" parallel=" + to_wstring(f.chunkParallel));
+    vector<wstring> outputs(chunks.size());
+    vector<char> done(chunks.size());
+    atomic<bool> failed{};
+    mutex doneMutex;
+    size_t emitted = 0;
+    TraceSession* trace = CurrentTrace();
+    ParallelFor(chunks.size(), f.chunkParallel, [&](size_t i) {
+        TraceAttach attach(trace);
+        TraceScope span("chunk");
+        span.Arg("index", static_cast<long long>(i));
+        if (failed) return;
+        FilterOutput r;
+        RequestControl ctl{cancel, nullptr};
+        const Request req{systemPrompt, WideToUtf8(f.prompt + L"\n\n" + chunks[i].text), {}, {}, f.title};
+        const bool ok = RetryChunk(f.chunkRetries, cancel, failed, [&] {
+            r = FilterOutput{};
+            try {
+                return ExecuteTemplate(tpl, m, useCache, req, r, nullptr, &ctl);
+            } catch (...) {
+                return false;  // Helper threads must not let exceptions escape
+            }
+        }, [&](int attempt) { Log(L"chunk " + to_wstring(i) + L" failed, retry " + to_wstring(attempt)); });
+        if (!ok || (cancel && cancel->IsCancelled())) { failed = true; return; }
+        lock_guard<mutex> lock(doneMutex);
+        outputs[i] = move(r.text);
+        done[i] = 1;
+        // Report the contiguous finished prefix so the preview reads in order
+        for (; emitted < chunks.size() && done[emitted]; ++emitted) {
+            if (onPartial) onPartial(outputs[emitted] + chunks[emitted].separator);
+        }
+    });
+    if (cancel && cancel->IsCancelled()) return false;
+    if (failed) { Log(L"fail: chunk failed after retries"); return false; }
+    result = JoinChunks(chunks, outputs);
+    return true;
+}
+
+bool FilterEngine::RunFilter(const FilterDefinition& f, const ModelConfig& m, const vector<ModelConfig>& hedgeModels, const FilterPayload& in, FilterOutput& out, const PartialTextHandler& onPartial, CancelToken* cancel) const {
+    Log(L"RunFilter: " + f.title + L" input=" + IOTypeToConfig(f.input) + L" output=" + IOTypeToConfig(f.output));
+    TraceScope span("RunFilter");
+    const TemplateDefinition* tpl = ResolveTemplate(m, f.input, f.output);
+    if (!tpl) { Log(L"fail: no matching template"); return false; }
+    try {
+        if (tpl->input == IOType::Text && in.text.empty()) { Log(L"fail: no text input"); return false; }
+        if (tpl->input == IOType::Image && in.imageB64.empty()) { Log(L"fail: no image input"); return false; }
+        if (cancel && cancel->IsCancelled()) return false;
+        Request req;
+        req.filter = f.title;
+        req.systemPrompt = string("Follow the instructions strictly and convert the input ") + (f.input == IOType::Text ? "text" : "image")
+            + " to the output " + (f.output == IOType::Text ? "text" : "image") + ". No additional text or comments are allowed.";
+        const bool useCache = cacheEnabled_ && f.cache;
+        const wstring textInput = tpl->input == IOType::Text ? wstring(in.text) : wstring();
+        if (tpl->input == IOType::Text && tpl->output == IOType::Text && f.chunkTokens > 0) {
+            vector<TextChunk> chunks = SplitTextIntoChunks(textInput, f.chunkTokens);
+            if (chunks.size() > 1) return RunChunkedText(*tpl, m, f, useCache, req.systemPrompt, chunks, out.text, onPartial, cancel);
+        }
+        req.promptText = WideToUtf8(f.prompt + L"\n\n" + textInput);
+        if (tpl->input == IOType::Image) {
+            req.imageB64 = in.imageB64;
+            req.imageMime = in.imageMime;
+        }
+        if (!hedgeModels.empty()) return ExecuteHedged(f, *tpl, m, hedgeModels, useCache, req, out, onPartial, cancel);
+        RequestControl ctl{cancel, nullptr};
+        return ExecuteTemplate(*tpl, m, useCache, req, out, onPartial, &ctl);
+    } catch (const exception& ex) {
+        Log(L"exception in RunFilter: " + Utf8ToWide(ex.what()));
+    } catch (...) {
+        Log(L"unknown exception in RunFilter");
+    }
+    return false; // fallback
+}
+
+vector<FilterRun> ExpandFanOut(const FilterDefinition& f, const vector<FilterDefinition>& filters, const vector<ModelConfig>& models) {
+    vector<FilterRun> runs;
+    if (models.empty()) return runs;
+    for (size_t fi : f.fanOutFilters) {
+        if (fi >= filters.size()) continue;
+        FilterRun run;
+        run.label = filters[fi].title;
+        run.filter = filters[fi];
+        run.model = models[run.filter.modelIndex < models.size() ? run.filter.modelIndex : 0];
+        for (size_t idx : run.filter.hedgeModels) {
+            if (idx < models.size()) run.hedgeModels.push_back(models[idx]);
+        }
+        runs.push_back(move(run));
+    }
+    for (size_t mi : f.fanOutModels) {
+        if (mi >= models.size()) continue;
+        FilterRun run;
+        run.label = models[mi].name;
+        run.filter = f;
+        run.filter.fanOutFilters.clear();
+        run.filter.fanOutModels.clear();
+        run.model = models[mi];
+        runs.push_back(move(run));
+    }
+    return runs;
+}
+
+wstring CombineFanOutText(const vector<FilterRun>& runs, const vector<FanOutResult>& results, const wstring& failedText) {
+    wstring text;
+    for (size_t i = 0; i < runs.size() && i < results.size(); ++i) {
+        if (!results[i].done) continue;
+        if (!text.empty()) text += L"\n\n";
+        text += L"=== " + runs[i].label + L" ===\n";
+        text += results[i].ok ? results[i].output.text : failedText;
+    }
+    return text;
+}
+
+bool FilterEngine::RunFanOut(const vector<FilterRun>& runs, const FilterPayload& in, vector<FanOutResult>& results, const FanOutResultHandler& onResult, CancelToken* cancel) const {
+    Log(L"RunFanOut: branches=" + to_wstring(runs.size()));
+    TraceScope span("RunFanOut");
+    results.assign(runs.size(), FanOutResult{});
+    mutex resultMutex;
+    size_t succeeded = 0;
+    TraceSession* trace = CurrentTrace();
+    ParallelFor(runs.size(), runs.size(), [&](size_t i) {
+        TraceAttach attach(trace);
+        TraceScope branchSpan("fanout_branch");
+        branchSpan.Arg("index", static_cast<long long>(i));
+        FanOutResult r;
+        r.ok = RunFilter(runs[i].filter, runs[i].model, runs[i].hedgeModels, in, r.output, nullptr, cancel);
+        r.done = true;
+        if (!r.ok) Log(L"fan-out branch failed: " + runs[i].label);
+        lock_guard<mutex> lock(resultMutex);
+        if (r.ok) ++succeeded;
+        results[i] = move(r);
+        if (onResult) onResult(i, results);
+    });
+    if (cancel && cancel->IsCancelled()) return false;
+    if (succeeded == 0) { Log(L"fail: every fan-out branch failed"); return false; }
+    return true;
+}
+
+vector<FilterRun> ExpandPipeline(const FilterDefinition& f, const vector<FilterDefinition>& filters, const vector<ModelConfig>& models) {
+    vector<FilterRun> stages;
+    if (models.empty()) return stages;
+    for (size_t fi : f.pipeline) {
+        if (fi >= filters.size()) continue;
+        FilterRun stage;
+        stage.label = filters[fi].title;
+        stage.filter = filters[fi];
+        stage.model = models[stage.filter.modelIndex < models.size() ? stage.filter.modelIndex : 0];
+        for (size_t idx : stage.filter.hedgeModels) {
+            if (idx < models.size()) stage.hedgeModels.push_back(models[idx]);
+        }
+        stages.push_back(move(stage));
+    }
+    return stages;
+}
+
+bool FilterEngine::RunPipeline(const vector<FilterRun>& stages, const FilterPayload& in, FilterOutput& out, const PartialTextHandler& onPartial, CancelToken* cancel) const {
+    Log(L"RunPipeline: stages=" + to_wstring(stages.size()));
+    TraceScope span("RunPipeline");
+    if (stages.empty()) { Log(L"fail: pipeline has no stages"); return false; }
+    TraceSession* trace = CurrentTrace();
+    // Input of the current stage, owned here because the payload only views it
+    FilterOutput current;
+    current.text = in.text;
+    current.imageB64 = in.imageB64;
+    string imageMime(in.imageMime);
+    size_t i = 0;
+    while (i < stages.size()) {
+        if (cancel && cancel->IsCancelled()) return false;
+        // Stages that can start on this one's stream run alongside it, each fed by a relay
+        size_t end = i + 1;
+        while (end < stages.size() && CanStreamInto(stages[end - 1], stages[end])) ++end;
+        const PartialTextHandler& finalPartial = end == stages.size() ? onPartial : PartialTextHandler();
+        vector<unique_ptr<ChunkRelay>> relays(end - i - 1);
+        for (size_t k = relays.size(); k-- > 0;) {
+            PartialTextHandler downstream = finalPartial;
+            if (k + 1 < relays.size()) downstream = [next = relays[k + 1].get()](const wstring& t) { next->Feed(t); };
+            relays[k] = make_unique<ChunkRelay>(*this, stages[i + 1 + k], move(downstream), cancel, trace);
+        }
+        FilterPayload payload;
+        if (stages[i].filter.input == IOType::Text) {
+            payload.text = current.text;
+        } else {
+            payload.imageB64 = current.imageB64;
+            payload.imageMime = imageMime;
+        }
+        wstring fed;
+        PartialTextHandler onStage = finalPartial;
+        if (!relays.empty()) onStage = [&](const wstring& delta) { fed += delta; relays.front()->Feed(delta); };
+        Log(L"pipeline stage " + to_wstring(i + 1) + L"/" + to_wstring(stages.size()) + L": " + stages[i].label +
+            (relays.empty() ? L"" : L" (streaming into " + to_wstring(relays.size()) + L" stage(s))"));
+        FilterOutput result;
+        bool ok = RunFilter(stages[i].filter, stages[i].model, stages[i].hedgeModels, payload, result, onStage, cancel);
+        if (ok && !relays.empty()) {
+            // A cached or non-streaming result arrives whole; otherwise the stream already holds a prefix of it
+            if (result.text.compare(0, fed.size(), fed) == 0) relays.front()->Feed(result.text.substr(fed.size()));
+            else { Log(L"fail: stage output differs from its stream"); ok = false; }
+        }
+        // Each relay has received all of its input once the one before it has finished
+        for (size_t k = 0; ok && k < relays.size(); ++k) {
+            wstring text;
+            ok = relays[k]->Finish(text);
+            if (!ok) Log(L"fail: pipeline stage " + stages[i + 1 + k].label);
+            result.text = move(text);
+        }
+        if (!ok) {
+            if (relays.empty()) Log(L"fail: pipeline stage " + stages[i].label);
+            // Relays still holding chunks would otherwise send them while being destroyed
+            for (const unique_ptr<ChunkRelay>& relay : relays) relay->Fail();
+            return false;
+        }
+        current = move(result);
+        if (stages[end - 1].filter.output == IOType::Image) imageMime = EncodedImageMime(current.imageB64);
+        i = end;
+    }
+    out = move(current);
+    return true;
+}
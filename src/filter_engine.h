@@ -0,0 +1,270 @@
+/**
+ * @file filter_engine.h
+ * @brief Runs filters against the API providers, independent of the clipboard and UI
+ *
+ * The engine renders a template, sends it through the provider's rate
+ * limiter, parses the (optionally streamed) response and consults the
+ * response cache; hedging across models and chunked long texts are handled
+ * here too. Images cross the boundary as base64 so that the host owns
+ * decoding: GDI+ bitmaps in the tray application, raw files in the CLI.
+ */
+
+#pragma once
+
+#include "cancel_token.h"
+#include "filter_config.h"
+#include "http_request.h"
+#include "text_chunker.h"
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @struct FilterPayload
+ * @brief Input of one filter run (views must outlive the run)
+ */
+struct FilterPayload {
+    std::wstring_view text;       // Text input (Text filters)
+    std::string_view imageB64;    // Encoded image, base64 (Image filters)
+    std::string_view imageMime;   // MIME type of the encoded image
+};
+
+/**
+ * @struct FilterOutput
+ * @brief Result of one filter run
+ */
+struct FilterOutput {
+    std::wstring text;      // Text output (Text filters)
+    std::string imageB64;   // Encoded image as returned by the API, base64 (Image filters)
+    TokenUsage usage;       // Tokens the request reported (not set for cache hits and combined runs)
+};
+
+/**
+ * @brief Receives text as it streams in
+ */
+using PartialTextHandler = std::function<void(const std::wstring&)>;
+
+/**
+ * @struct FilterRun
+ * @brief A filter bound to its models: one fan-out branch or pipeline stage
+ */
+struct FilterRun {
+    std::wstring label;                    // Branch heading in combined output, stage name in logs
+    FilterDefinition filter;
+    ModelConfig model;
+    std::vector<ModelConfig> hedgeModels;  // Backups of a referenced filter
+};
+
+/**
+ * @struct FanOutResult
+ * @brief Outcome of one fan-out branch
+ */
+struct FanOutResult {
+    bool done{};    // The branch finished (successfully or not)
+    bool ok{};
+    FilterOutput output;
+};
+
+/**
+ * @brief Receives the results each time a branch finishes (called from worker threads, serialized)
+ */
+using FanOutResultHandler = std::function<void(size_t index, const std::vector<FanOutResult>& results)>;
+
+/**
+ * @brief List the branches of a fan-out filter
+ * @param f Fan-out filter (validated with ValidateFanOuts)
+ * @param filters Filter list f belongs to
+ * @param models Model list
+ * @return Referenced filters on their own models (and backups), then f's prompt on each referenced model
+ */
+std::vector<FilterRun> ExpandFanOut(const FilterDefinition& f, const std::vector<FilterDefinition>& filters, const std::vector<ModelConfig>& models);
+
+/**
+ * @brief List the stages of a pipeline filter
+ * @param f Pipeline filter (validated with ValidatePipelines)
+ * @param filters Filter list f belongs to
+ * @param models Model list
+ * @return Each stage's filter on its own model (and backups), in order
+ */
+std::vector<FilterRun> ExpandPipeline(const FilterDefinition& f, const std::vector<FilterDefinition>& filters, const std::vector<ModelConfig>& models);
+
+/**
+ * @brief Join the text of finished branches in branch order, each under a "=== label ===" heading
+ * @param runs Branches
+ * @param results Results so far (branches not done are left out)
+ * @param failedText Shown under the heading of a failed branch
+ */
+std::wstring CombineFanOutText(const std::vector<FilterRun>& runs, const std::vector<FanOutResult>& results, const std::wstring& failedText);
+
+/**
+ * @brief Collect placeholder values for rendering a compiled template (all UTF-8)
+ * @param model Model name
+ * @param apiKey API key
+ * @param systemPrompt System prompt
+ * @param prompt Prompt text (also used for <<input_text>>)
+ * @param imageB64 Base64 encoded image data
+ * @param imageDataUrl Image data URL
+ * @param imageMime MIME type of the encoded image
+ * @return Values referencing the arguments (must outlive rendering)
+ */
+PlaceholderValues MakePlaceholderValues(std::string_view model, std::string_view apiKey, std::string_view systemPrompt, std::string_view prompt, std::string_view imageB64, std::string_view imageDataUrl, std::string_view imageMime);
+
+/**
+ * @brief Build header string from compiled header templates
+ * @param headers Header names and value templates
+ * @param v Placeholder values
+ * @return Header string
+ */
+std::wstring BuildHeaderString(const std::vector<std::pair<std::wstring, CompiledTemplate>>& headers, const PlaceholderValues& v);
+
+/**
+ * @brief Key of a model's time-to-first-byte histogram in LatencyRegistry
+ */
+std::wstring ModelLatencyKey(const ModelConfig& m);
+
+/**
+ * @brief Find a template by input and output type
+ * @param provider API provider
+ * @param input Input type
+ * @param output Output type
+ * @return Template definition, or nullptr if not found
+ */
+const TemplateDefinition* FindTemplateByIO(const ApiProvider& provider, IOType input, IOType output);
+
+/**
+ * @class FilterEngine
+ * @brief Executes filter definitions against the loaded API providers
+ *
+ * Providers are set once at startup; RunFilter is then safe to call from
+ * several threads at once.
+ */
+class FilterEngine {
+public:
+    /**
+     * @brief Replace the providers and apply their rate-limit settings
+     */
+    void SetProviders(std::vector<ApiProvider> providers);
+
+    /**
+     * @brief Providers in apidef file order
+     */
+    const std::vector<ApiProvider>& Providers() const { return providers_; }
+
+    /**
+     * @brief Find a provider by id
+     * @return Provider, or nullptr if not found
+     */
+    const ApiProvider* FindProvider(const std::wstring& id) const;
+
+    /**
+     * @brief Find the template a model uses for a filter's input and output types
+     * @return Template, or nullptr if no provider offers one
+     */
+    const TemplateDefinition* ResolveTemplate(const ModelConfig& m, IOType input, IOType output) const;
+
+    /**
+     * @brief Turn the response cache on or off for later runs
+     */
+    void SetCacheEnabled(bool enabled) { cacheEnabled_ = enabled; }
+
+    /**
+     * @brief Receive diagnostic messages (none are produced without a handler)
+     */
+    void SetLogHandler(std::function<void(const std::wstring&)> handler) { log_ = std::move(handler); }
+
+    /**
+     * @brief Receive a record of every request sent and every response cache hit (called from worker threads)
+     *
+     * Cancelled requests, such as the losers of a hedged race, are not recorded.
+     */
+    void SetUsageHandler(std::function<void(const UsageRecord&)> handler) { usage_ = std::move(handler); }
+
+    /**
+     * @brief Execute a filter transformation
+     * @param f Filter definition to execute
+     * @param m Model configuration used by the filter
+     * @param hedgeModels Backup models raced against m when it is slow (single requests only)
+     * @param in Text or encoded image input
+     * @param out Output parameter for the resulting text or encoded image
+     * @param onPartial Receives partial text as it streams in (Text output only, optional)
+     * @param cancel Aborts the filter, including a request in flight (optional)
+     * @return true on success, false on failure or cancellation
+     *
+     * This function handles four transformation types:
+     * - Text -> Text: Text completion/translation
+     * - Text -> Image: Image generation from text
+     * - Image -> Text: Vision API (image description/analysis)
+     * - Image -> Image: Image-to-image transformation
+     */
+    bool RunFilter(const FilterDefinition& f, const ModelConfig& m, const std::vector<ModelConfig>& hedgeModels, const FilterPayload& in, FilterOutput& out, const PartialTextHandler& onPartial = nullptr, CancelToken* cancel = nullptr) const;
+
+    /**
+     * @brief Run the branches of a fan-out filter on one input, all at once
+     * @param runs Branches (see ExpandFanOut)
+     * @param in Input shared by every branch
+     * @param results One result per branch, in branch order
+     * @param onResult Receives the results as each branch finishes (optional)
+     * @param cancel Aborts every branch (optional)
+     * @return true if at least one branch succeeded and the run was not cancelled
+     *
+     * Every branch gets its own thread, so the run takes about as long as
+     * the slowest branch; each request still waits for its provider's rate
+     * limiter and request slots (see RateLimiters::SetConcurrency).
+     */
+    bool RunFanOut(const std::vector<FilterRun>& runs, const FilterPayload& in, std::vector<FanOutResult>& results, const FanOutResultHandler& onResult = nullptr, CancelToken* cancel = nullptr) const;
+
+    /**
+     * @brief Run the stages of a pipeline filter, each on the previous one's output
+     * @param stages Stages (see ExpandPipeline)
+     * @param in Input of the first stage
+     * @param out Output of the last stage
+     * @param onPartial Receives the last stage's text as it streams in (optional)
+     * @param cancel Aborts the stage in flight (optional)
+     * @return true if every stage succeeded
+     *
+     * Intermediate results stay in memory: text is handed on as is and
+     * images as the base64 the API returned, without re-encoding. A
+     * Text->Text stage with chunking enabled does not wait for the stage
+     * before it: it starts on each chunk as soon as the streamed text has
+     * completed it (see StreamingChunker).
+     */
+    bool RunPipeline(const std::vector<FilterRun>& stages, const FilterPayload& in, FilterOutput& out, const PartialTextHandler& onPartial = nullptr, CancelToken* cancel = nullptr) const;
+
+private:
+    /**
+     * @struct RequestControl
+     * @brief Per-request hooks used by hedged execution
+     */
+    struct RequestControl {
+        CancelToken* cancel{};               // Aborts the HTTP request when cancelled
+        std::function<void()> onFirstByte;   // Called once when the response starts arriving
+    };
+
+    /**
+     * @struct Request
+     * @brief Rendered prompt and input shared by every attempt of a run (UTF-8)
+     */
+    struct Request {
+        std::string systemPrompt;
+        std::string promptText;   // Prompt including the text input
+        std::string_view imageB64;
+        std::string_view imageMime;
+        std::wstring filter;      // Filter title, for usage records
+    };
+
+    void Log(const std::wstring& msg) const;
+    void RecordUsage(UsageRecord r, const TemplateDefinition& tpl, const ModelConfig& m, const Request& req) const;
+    bool SendRateLimited(const std::wstring& providerId, const std::wstring& host, const std::wstring& path, bool useHttps, const std::wstring& headers, const std::string& body, const HttpDataHandler& onData, std::wstring& err, CancelToken* cancel) const;
+    FilterOutput CallTemplate(const TemplateDefinition& tpl, const ModelConfig& m, const Request& req, const PartialTextHandler& onDelta, const RequestControl* ctl) const;
+    bool ExecuteTemplate(const TemplateDefinition& tpl, const ModelConfig& m, bool useCache, const Request& req, FilterOutput& out, const PartialTextHandler& onPartial, const RequestControl* ctl) const;
+    bool ExecuteHedged(const FilterDefinition& f, const TemplateDefinition& tpl, const ModelConfig& primary, const std::vector<ModelConfig>& backups, bool useCache, const Request& req, FilterOutput& out, const PartialTextHandler& onPartial, CancelToken* cancel) const;
+    bool RunChunkedText(const TemplateDefinition& tpl, const ModelConfig& m, const FilterDefinition& f, bool useCache, const std::string& systemPrompt, const std::vector<TextChunk>& chunks, std::wstring& result, const PartialTextHandler& onPartial, CancelToken* cancel) const;
+
+    std::vector<ApiProvider> providers_;
+    std::atomic<bool> cacheEnabled_{true};
+    std::function<void(const std::wstring&)> log_;
+    std::function<void(const UsageRecord&)> usage_;
+};
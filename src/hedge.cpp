@@ -0,0 +1,165 @@
+/**
+ * @file hedge.cpp
+ * @brief Implementation of latency histograms and the hedged request race
+ */
+
+#include "hedge.h"
+
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+size_t LatencyHistogram::BucketOf(double ms) {
+    if (!(ms > kFirstMs)) return 0;
+    size_t b = static_cast<size_t>(ceil(log(ms / kFirstMs) / log(kGrowth)));
+    return (std::min)(b, kBuckets - 1);
+}
+
+double LatencyHistogram::UpperBound(size_t bucket) {
+    return kFirstMs * pow(kGrowth, static_cast<double>(bucket));
+}
+
+void LatencyHistogram::Record(double ms) {
+    ++buckets_[BucketOf(ms)];
+    if (++count_ < kDecayAt) return;
+    count_ = 0;
+    for (auto& b : buckets_) {
+        b /= 2;
+        count_ += b;
+    }
+}
+
+double LatencyHistogram::Quantile(double q) const {
+    if (count_ == 0) return 0;
+    // Rank of the sample the quantile falls on, counted from 1
+    uint64_t rank = (std::max)(uint64_t{1}, static_cast<uint64_t>(ceil(clamp(q, 0.0, 1.0) * static_cast<double>(count_))));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < kBuckets; ++i) {
+        seen += buckets_[i];
+        if (seen >= rank) return UpperBound(i);
+    }
+    return UpperBound(kBuckets - 1);
+}
+
+LatencyRegistry& LatencyRegistry::Instance() {
+    static LatencyRegistry registry;
+    return registry;
+}
+
+void LatencyRegistry::Record(const wstring& key, double ms) {
+    lock_guard<mutex> lock(mutex_);
+    histograms_[key].Record(ms);
+}
+
+bool LatencyRegistry::Quantile(const wstring& key, double q, uint64_t minSamples, double& ms) const {
+    lock_guard<mutex> lock(mutex_);
+    auto it = histograms_.find(key);
+    if (it == histograms_.end() || it->second.Count() < minSamples) return false;
+    ms = it->second.Quantile(q);
+    return true;
+}
+
+chrono::milliseconds HedgeDelay(const HedgePolicy& policy, const wstring& modelKey) {
+    if (policy.delayMs > 0) return chrono::milliseconds(policy.delayMs);
+    double ms = 0;
+    if (!LatencyRegistry::Instance().Quantile(modelKey, policy.quantile, HedgePolicy::kMinSamples, ms)) {
+        return chrono::milliseconds(HedgePolicy::kFallbackMs);
+    }
+    ms = clamp(ms, static_cast<double>(HedgePolicy::kMinAdaptiveMs), static_cast<double>(HedgePolicy::kMaxAdaptiveMs));
+    return chrono::milliseconds(static_cast<long long>(ms));
+}
+
+/**
+ * @struct HedgeRaceState
+ * @brief State shared by RunHedged and its attempt threads (guarded by mutex)
+ */
+struct HedgeRaceState {
+    mutex stateMutex;
+    condition_variable cv;
+    bool firstByte{};   // Some attempt started receiving its response
+    int winner{-1};
+    size_t finished{};  // Attempts that have returned
+    vector<unique_ptr<HedgeAttempt>> attempts;
+
+    HedgeAttempt* Add(size_t index) {
+        attempts.emplace_back(new HedgeAttempt(this, index));
+        return attempts.back().get();
+    }
+};
+
+void HedgeAttempt::FirstByte() {
+    lock_guard<mutex> lock(race_->stateMutex);
+    race_->firstByte = true;
+    race_->cv.notify_all();
+}
+
+HedgeResult RunHedged(size_t count, const function<chrono::milliseconds(size_t)>& delayFor, const function<bool(HedgeAttempt&)>& attempt) {
+    HedgeResult result;
+    if (count == 0) return result;
+    HedgeRaceState race;
+    vector<thread> threads;
+    unique_lock<mutex> lock(race.stateMutex);
+    chrono::steady_clock::time_point deadline;
+    size_t next = 0;
+    // Called with the lock held
+    auto launch = [&]() {
+        HedgeAttempt* a = race.Add(next);
+        threads.emplace_back([&race, &attempt, a] {
+            bool ok = false;
+            try {
+                ok = attempt(*a);
+            } catch (...) {
+                ok = false;  // Attempt threads must not let exceptions escape
+            }
+            lock_guard<mutex> done(race.stateMutex);
+            ++race.finished;
+            if (ok && race.winner < 0) race.winner = static_cast<int>(a->Index());
+            race.cv.notify_all();
+        });
+        deadline = chrono::steady_clock::now() + delayFor(next);
+        ++next;
+    };
+    launch();
+    while (race.winner < 0) {
+        const bool running = race.finished < race.attempts.size();
+        if (!running && next >= count) break;  // Every candidate failed
+        const bool canHedge = next < count && !race.firstByte;
+        if (!running || (canHedge && chrono::steady_clock::now() >= deadline)) {
+            launch();
+            continue;
+        }
+        if (canHedge) race.cv.wait_until(lock, deadline);
+        else race.cv.wait(lock);
+    }
+    result.winner = race.winner;
+    result.launched = race.attempts.size();
+    vector<HedgeAttempt*> losers;
+    for (auto& a : race.attempts) {
+        if (static_cast<int>(a->Index()) != race.winner) losers.push_back(a.get());
+    }
+    lock.unlock();
+    // Cancel outside the lock: cancel callbacks may block briefly (e.g. closing a request handle)
+    for (HedgeAttempt* a : losers) a->Token().Cancel();
+    for (auto& t : threads) t.join();
+    return result;
+}
+
+void HedgeStreams::Add(size_t index, const wstring& delta) {
+    lock_guard<mutex> lock(mutex_);
+    if (index < deltas_.size()) deltas_[index].push_back(delta);
+}
+
+void HedgeStreams::Forward(size_t winner, const function<void(const wstring&)>& sink) {
+    vector<wstring> deltas;
+    {
+        lock_guard<mutex> lock(mutex_);
+        if (winner < deltas_.size()) deltas = move(deltas_[winner]);
+        deltas_.clear();
+    }
+    for (const wstring& d : deltas) sink(d);
+}
@@ -0,0 +1,192 @@
+/**
+ * @file hedge.h
+ * @brief Hedged requests: race backup models against a slow primary
+ *
+ * Provider latency has a long tail, so waiting on one request leaves the slow
+ * cases slow. RunHedged starts the primary and, if no attempt has started
+ * receiving a response within the hedge delay, fires the same request at the
+ * next candidate. The first attempt to succeed wins and the others are
+ * cancelled. The delay is either fixed or taken from a quantile (p90 by
+ * default) of the candidate's recent time to first byte, recorded per model
+ * in LatencyRegistry, so only the slowest ~10% of requests pay for a
+ * duplicate.
+ */
+
+#pragma once
+
+#include "cancel_token.h"
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * @class LatencyHistogram
+ * @brief Log-bucketed latency distribution that slowly forgets old samples
+ */
+class LatencyHistogram {
+public:
+    /**
+     * @brief Add one sample in milliseconds
+     */
+    void Record(double ms);
+
+    /**
+     * @brief Latency below which a fraction q of the samples fall (0 if empty)
+     */
+    double Quantile(double q) const;
+
+    /**
+     * @brief Current (decayed) sample count
+     */
+    uint64_t Count() const { return count_; }
+
+private:
+    // Bucket i holds samples up to kFirstMs * kGrowth^i; the last one is open-ended
+    static constexpr size_t kBuckets = 96;
+    static constexpr double kFirstMs = 10.0;
+    static constexpr double kGrowth = 1.1;
+    // Halve every bucket once this many samples are held so recent behaviour dominates
+    static constexpr uint64_t kDecayAt = 512;
+
+    static size_t BucketOf(double ms);
+    static double UpperBound(size_t bucket);
+
+    std::array<uint64_t, kBuckets> buckets_{};
+    uint64_t count_{};
+};
+
+/**
+ * @class LatencyRegistry
+ * @brief Process-wide time-to-first-byte histograms keyed by model
+ */
+class LatencyRegistry {
+public:
+    static LatencyRegistry& Instance();
+
+    void Record(const std::wstring& key, double ms);
+
+    /**
+     * @brief Quantile of a model's latency
+     * @param minSamples Fail unless at least this many samples were recorded
+     * @return false if the model has too few samples
+     */
+    bool Quantile(const std::wstring& key, double q, uint64_t minSamples, double& ms) const;
+
+    LatencyRegistry(const LatencyRegistry&) = delete;
+    LatencyRegistry& operator=(const LatencyRegistry&) = delete;
+
+private:
+    LatencyRegistry() = default;
+
+    mutable std::mutex mutex_;
+    std::map<std::wstring, LatencyHistogram> histograms_;
+};
+
+/**
+ * @struct HedgePolicy
+ * @brief When to fire a duplicate request at the next candidate
+ */
+struct HedgePolicy {
+    unsigned delayMs{};        // Fixed delay; 0 = adaptive from the latency quantile
+    double quantile{0.9};      // Quantile of time to first byte used by the adaptive delay
+
+    static constexpr uint64_t kMinSamples = 20;       // Samples needed before adapting
+    static constexpr unsigned kFallbackMs = 2000;     // Adaptive delay until then
+    static constexpr unsigned kMinAdaptiveMs = 50;
+    static constexpr unsigned kMaxAdaptiveMs = 30000;
+};
+
+/**
+ * @brief Delay before hedging a request that went to the given model
+ * @param policy Hedge policy of the filter
+ * @param modelKey LatencyRegistry key of the model the pending attempt went to
+ */
+std::chrono::milliseconds HedgeDelay(const HedgePolicy& policy, const std::wstring& modelKey);
+
+struct HedgeRaceState;
+
+/**
+ * @class HedgeAttempt
+ * @brief Handle given to one attempt of a hedged request
+ */
+class HedgeAttempt {
+public:
+    /**
+     * @brief Candidate index (0 = primary)
+     */
+    size_t Index() const { return index_; }
+
+    /**
+     * @brief Cancelled when another attempt wins
+     */
+    CancelToken& Token() { return cancel_; }
+
+    /**
+     * @brief Report that the response started arriving; no further backups are fired on delay
+     */
+    void FirstByte();
+
+private:
+    friend struct HedgeRaceState;
+    HedgeAttempt(HedgeRaceState* race, size_t index) : race_(race), index_(index) {}
+
+    HedgeRaceState* race_;
+    size_t index_;
+    CancelToken cancel_;
+};
+
+/**
+ * @struct HedgeResult
+ * @brief Outcome of RunHedged
+ */
+struct HedgeResult {
+    int winner{-1};     // Index of the attempt that succeeded first, or -1 if all failed
+    size_t launched{};  // Attempts started (1 = no backup was needed)
+};
+
+/**
+ * @brief Run a request with hedging across candidates
+ * @param count Number of candidates (primary plus backups)
+ * @param delayFor Delay after launching candidate i before candidate i + 1 is launched
+ * @param attempt Runs one attempt on its own thread; returns true on success
+ * @return Winner and number of attempts launched
+ *
+ * When every launched attempt has failed, the next candidate is launched at
+ * once. Returns once a winner is known and every other attempt has returned;
+ * attempts should watch their token so a loser stops promptly.
+ */
+HedgeResult RunHedged(size_t count, const std::function<std::chrono::milliseconds(size_t)>& delayFor,
+                      const std::function<bool(HedgeAttempt&)>& attempt);
+
+/**
+ * @class HedgeStreams
+ * @brief Holds back the streamed text of hedged attempts until the race has a winner
+ *
+ * Whichever attempt streams first may still lose the race, and text that has
+ * already been shown or typed cannot be taken back. Each attempt's deltas are
+ * kept apart and only the winner's are forwarded, once RunHedged returns.
+ */
+class HedgeStreams {
+public:
+    explicit HedgeStreams(size_t count) : deltas_(count) {}
+
+    /**
+     * @brief Keep a delta of attempt index (called from the attempt threads)
+     */
+    void Add(size_t index, const std::wstring& delta);
+
+    /**
+     * @brief Send the winner's deltas, in order, to sink and drop the rest
+     */
+    void Forward(size_t winner, const std::function<void(const std::wstring&)>& sink);
+
+private:
+    std::mutex mutex_;
+    std::vector<std::vector<std::wstring>> deltas_;
+};
@@ -0,0 +1,222 @@
+/**
+ * @file http_client.cpp
+ * @brief Implementation of the pooled WinHTTP session
+ */
+
+#include "http_client.h"
+#include "api_payload.h"
+#include "trace.h"
+#include "utf8.h"
+
+#include <atomic>
+
+using namespace std;
+
+HttpSession& HttpSession::Instance() {
+    static HttpSession session;
+    return session;
+}
+
+HttpSession::~HttpSession() {
+    Shutdown();
+}
+
+HINTERNET HttpSession::Acquire(const wstring& host, INTERNET_PORT port, bool secure, wstring* err, bool* reused) {
+    auto setErr = [&](const wstring& m) { if (err) *err = m; };
+    if (reused) *reused = false;
+    lock_guard<mutex> lock(mutex_);
+    if (!session_) {
+        session_ = WinHttpOpen(L"cbfilter/1.0", WINHTTP_ACCESS_TYPE_DEFAULT_PROXY, WINHTTP_NO_PROXY_NAME, WINHTTP_NO_PROXY_BYPASS, 0);
+        if (!session_) { setErr(L"WinHttpOpen failed: " + to_wstring(GetLastError())); return nullptr; }
+    }
+    auto it = idle_.find(Key{ host, port, secure });
+    if (it != idle_.end() && !it->second.empty()) {
+        HINTERNET hc = it->second.back();
+        it->second.pop_back();
+        --stats_.idle;
+        ++stats_.hits;
+        if (reused) *reused = true;
+        return hc;
+    }
+    HINTERNET hc = WinHttpConnect(session_, host.c_str(), port, 0);
+    if (!hc) { setErr(L"WinHttpConnect failed: " + to_wstring(GetLastError())); return nullptr; }
+    ++stats_.misses;
+    return hc;
+}
+
+void HttpSession::Release(const wstring& host, INTERNET_PORT port, bool secure, HINTERNET hc, bool reusable) {
+    if (!hc) return;
+    {
+        lock_guard<mutex> lock(mutex_);
+        auto& bucket = idle_[Key{ host, port, secure }];
+        if (reusable && session_ && bucket.size() < kMaxIdlePerKey) {
+            bucket.push_back(hc);
+            ++stats_.idle;
+            return;
+        }
+    }
+    WinHttpCloseHandle(hc);
+}
+
+bool HttpSession::WarmUp(const wstring& host, INTERNET_PORT port, bool secure, CancelToken* cancel) {
+    const Key key{ host, port, secure };
+    {
+        lock_guard<mutex> lock(mutex_);
+        WarmState& w = warm_[key];
+        if (w.inFlight || (w.handshakeMs > 0 && !w.claimed && chrono::steady_clock::now() - w.warmAt < kWarmLifetime)) return false;
+        w = WarmState{};
+        w.inFlight = true;
+    }
+    TraceScope span("http_warm_up");
+    const auto start = chrono::steady_clock::now();
+    bool ok = false;
+    double handshakeMs = 0;
+    {
+        PooledConnection conn(host, port, secure, nullptr);
+        HINTERNET hr = conn.handle ? WinHttpOpenRequest(conn.handle, L"HEAD", L"/", nullptr, WINHTTP_NO_REFERER, WINHTTP_DEFAULT_ACCEPT_TYPES, secure ? WINHTTP_FLAG_SECURE : 0) : nullptr;
+        if (hr) {
+            atomic<bool> closed{false};
+            CancelRegistration onCancel(cancel, [&] { closed = true; WinHttpCloseHandle(hr); });
+            // Any status will do: the point is the handshake, which WinHTTP keeps alive for the next request
+            ok = !closed && WinHttpSendRequest(hr, WINHTTP_NO_ADDITIONAL_HEADERS, 0, WINHTTP_NO_REQUEST_DATA, 0, 0, 0);
+            // Sending returns once DNS, TCP and TLS are done; the HEAD round trip after it is not a saving
+            handshakeMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+            ok = ok && !closed && WinHttpReceiveResponse(hr, nullptr);
+            onCancel.Reset();
+            ok = ok && !closed;
+            if (!closed) WinHttpCloseHandle(hr);
+        }
+        conn.reusable = ok;
+    }
+    span.Arg("ok", ok ? 1 : 0);
+    span.Arg("handshake_ms", static_cast<long long>(handshakeMs));
+    {
+        lock_guard<mutex> lock(mutex_);
+        WarmState& w = warm_[key];
+        w.inFlight = false;
+        w.handshakeMs = ok ? handshakeMs : 0;
+        w.warmAt = chrono::steady_clock::now();
+    }
+    warmCv_.notify_all();
+    return ok;
+}
+
+double HttpSession::ClaimWarm(const wstring& host, INTERNET_PORT port, bool secure, chrono::milliseconds wait, CancelToken* cancel) {
+    // Registered before taking the lock: the callback takes it to wake the wait below
+    CancelRegistration onCancel(cancel, [this] {
+        lock_guard<mutex> lock(mutex_);
+        warmCv_.notify_all();
+    });
+    unique_lock<mutex> lock(mutex_);
+    auto it = warm_.find(Key{ host, port, secure });
+    if (it == warm_.end()) return 0;
+    // A handshake nearly done is worth a short wait; a slow or hanging warm-up is not
+    warmCv_.wait_for(lock, wait, [&] { return !it->second.inFlight || (cancel && cancel->IsCancelled()); });
+    WarmState& w = it->second;
+    if (w.inFlight || w.claimed || w.handshakeMs <= 0 || chrono::steady_clock::now() - w.warmAt >= kWarmLifetime) return 0;
+    w.claimed = true;
+    return w.handshakeMs;
+}
+
+HttpPoolStats HttpSession::Stats() const {
+    lock_guard<mutex> lock(mutex_);
+    return stats_;
+}
+
+void HttpSession::Shutdown() {
+    lock_guard<mutex> lock(mutex_);
+    for (auto& kv : idle_) for (HINTERNET hc : kv.second) WinHttpCloseHandle(hc);
+    idle_.clear();
+    stats_.idle = 0;
+    if (session_) { WinHttpCloseHandle(session_); session_ = nullptr; }
+}
+
+bool HttpRequestStreaming(const wstring& host, const wstring& path, bool useHttps, const wstring& headers, const string& body, const wstring& method, const HttpDataHandler& onData, wstring* err, CancelToken* cancel, HttpResponseInfo* info) {
+    auto setErr = [&](const wstring& m) { if (err) *err = m; };
+    TraceScope span("http_request");
+    wstring hostName;
+    INTERNET_PORT port = 0;
+    if (!SplitHostPort(host, useHttps, hostName, port)) { setErr(L"invalid host: " + host); return false; }
+    if (double saved = HttpSession::Instance().ClaimWarm(hostName, port, useHttps, kWarmClaimWait, cancel); saved > 0) {
+        span.Arg("warm_saved_ms", static_cast<long long>(saved));
+    }
+    PooledConnection conn(hostName, port, useHttps, err);
+    if (!conn.handle) return false;
+    span.Arg("reused_connection", conn.reused ? 1 : 0);
+    DWORD flags = useHttps ? WINHTTP_FLAG_SECURE : 0;
+    HINTERNET hr = WinHttpOpenRequest(conn.handle, method.c_str(), path.c_str(), nullptr, WINHTTP_NO_REFERER, WINHTTP_DEFAULT_ACCEPT_TYPES, flags);
+    if (!hr) { setErr(L"WinHttpOpenRequest failed: " + to_wstring(GetLastError())); conn.reusable = false; return false; }
+    // Closing the request handle from the cancelling thread makes a blocking WinHTTP call return at once
+    atomic<bool> closed{false};
+    CancelRegistration onCancel(cancel, [&] { closed = true; WinHttpCloseHandle(hr); });
+    if (closed) {
+        // Cancelled before sending: the registration has already closed hr, and nothing went over the connection
+        setErr(L"request cancelled");
+        return false;
+    }
+    const bool hasBody = !body.empty();
+    BOOL ok;
+    {
+        // Includes TCP/TLS setup when the pooled handle has no live connection
+        TraceScope send("http_connect_send");
+        send.Arg("bytes", static_cast<long long>(body.size()));
+        ok = WinHttpSendRequest(hr, headers.c_str(), (DWORD)headers.size(), hasBody ? (LPVOID)body.data() : nullptr, hasBody ? (DWORD)body.size() : 0, hasBody ? (DWORD)body.size() : 0, 0);
+    }
+    if (!ok) { setErr(L"WinHttpSendRequest failed: " + to_wstring(GetLastError())); }
+    if (ok && !closed) {
+        TraceScope ttfb("http_time_to_first_byte");
+        ok = WinHttpReceiveResponse(hr, nullptr);
+    }
+    if (!ok) { setErr(L"WinHttpReceiveResponse failed: " + to_wstring(GetLastError())); }
+    if (ok && !closed) {
+        DWORD status = 0, len = sizeof(status);
+        if (WinHttpQueryHeaders(hr, WINHTTP_QUERY_STATUS_CODE | WINHTTP_QUERY_FLAG_NUMBER, WINHTTP_HEADER_NAME_BY_INDEX, &status, &len, WINHTTP_NO_HEADER_INDEX)) {
+            if (status >= 400) setErr(L"HTTP status " + to_wstring(status));
+            span.Arg("status", status);
+            if (info) info->status = static_cast<int>(status);
+        }
+        DWORD size = 0;
+        if (info && !WinHttpQueryHeaders(hr, WINHTTP_QUERY_RAW_HEADERS_CRLF, WINHTTP_HEADER_NAME_BY_INDEX, WINHTTP_NO_OUTPUT_BUFFER, &size, WINHTTP_NO_HEADER_INDEX)
+            && GetLastError() == ERROR_INSUFFICIENT_BUFFER) {
+            wstring raw(size / sizeof(wchar_t), L'\0');
+            if (WinHttpQueryHeaders(hr, WINHTTP_QUERY_RAW_HEADERS_CRLF, WINHTTP_HEADER_NAME_BY_INDEX, raw.data(), &size, WINHTTP_NO_HEADER_INDEX)) {
+                raw.resize(size / sizeof(wchar_t));
+                info->rawHeaders = WideToUtf8(raw);
+            }
+        }
+    }
+    if (ok) {
+        TraceScope download("http_download");
+        long long received = 0;
+        string buf;
+        for (;;) {
+            if (closed) { ok = FALSE; break; }
+            DWORD dwSize = 0;
+            if (!WinHttpQueryDataAvailable(hr, &dwSize)) { setErr(L"WinHttpQueryDataAvailable failed: " + to_wstring(GetLastError())); ok = FALSE; break; }
+            if (dwSize == 0) break;
+            if (buf.size() < dwSize) buf.resize(dwSize);
+            DWORD dwDownloaded = 0;
+            if (!WinHttpReadData(hr, buf.data(), dwSize, &dwDownloaded)) { setErr(L"WinHttpReadData failed: " + to_wstring(GetLastError())); ok = FALSE; break; }
+            if (dwDownloaded == 0) break;
+            received += dwDownloaded;
+            if (onData) onData(buf.data(), dwDownloaded);
+        }
+        download.Arg("bytes", received);
+    }
+    onCancel.Reset();
+    if (closed) {
+        setErr(L"request cancelled");
+        conn.reusable = false;
+        return false;
+    }
+    // A connection that failed mid-request is not trusted for keep-alive reuse
+    if (!ok) conn.reusable = false;
+    WinHttpCloseHandle(hr);
+    return ok != FALSE;
+}
+
+string HttpRequestWithHeaders(const wstring& host, const wstring& path, bool useHttps, const wstring& headers, const string& body, const wstring& method, wstring* err, CancelToken* cancel) {
+    string raw;
+    HttpRequestStreaming(host, path, useHttps, headers, body, method, [&](const char* data, size_t size) { raw.append(data, size); }, err, cancel);
+    return raw;
+}
@@ -0,0 +1,150 @@
+/**
+ * @file http_client.h
+ * @brief Persistent WinHTTP session and keep-alive connection pool
+ *
+ * Keeps one WinHTTP session open for the lifetime of the process and pools
+ * connection handles per (host, port, scheme), so repeated requests to the
+ * same API server reuse the TCP/TLS connection instead of handshaking again.
+ * WarmUp opens that connection ahead of time (DNS, TCP and TLS) while the
+ * user is still choosing a filter; the request that follows claims the
+ * handshake time it no longer spends. The request functions declared in
+ * http_request.h are implemented over this session.
+ */
+
+#pragma once
+
+#include "cancel_token.h"
+#include "http_request.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <vector>
+#include <windows.h>
+#include <winhttp.h>
+
+/**
+ * @struct HttpPoolStats
+ * @brief Connection pool counters
+ *
+ * These count reuse of WinHttpConnect handles, not of sockets: a pooled
+ * handle only names an endpoint, and WinHTTP decides by itself whether a
+ * request on it rides an open keep-alive socket (and TLS session) or
+ * connects again. A hit therefore says nothing about a saved handshake.
+ */
+struct HttpPoolStats {
+    unsigned long long hits{};    // Requests handed an idle pooled connection handle
+    unsigned long long misses{};  // Requests that had to open a new connection handle
+    size_t idle{};                // Connection handles currently parked in the pool
+};
+
+/**
+ * @class HttpSession
+ * @brief Process-wide WinHTTP session holding a pool of keep-alive connections
+ */
+class HttpSession {
+public:
+    /**
+     * @brief Get the process-wide session
+     */
+    static HttpSession& Instance();
+
+    /**
+     * @brief Check out a connection handle for the given endpoint
+     * @param host Host name
+     * @param port Port number
+     * @param secure true for HTTPS
+     * @param err Error message on failure
+     * @param reused Set to true if an idle pooled connection was handed out (optional)
+     * @return Connection handle, or nullptr on failure
+     */
+    HINTERNET Acquire(const std::wstring& host, INTERNET_PORT port, bool secure, std::wstring* err, bool* reused = nullptr);
+
+    /**
+     * @brief Return a connection handle to the pool
+     * @param reusable false if the connection saw a transport error and must be closed
+     */
+    void Release(const std::wstring& host, INTERNET_PORT port, bool secure, HINTERNET hc, bool reusable);
+
+    /**
+     * @brief Open and handshake a connection with a HEAD request, leaving it in WinHTTP's keep-alive pool
+     * @param cancel Aborts the warm-up (optional)
+     * @return false if the endpoint is already warm or warming, or the warm-up failed
+     */
+    bool WarmUp(const std::wstring& host, INTERNET_PORT port, bool secure, CancelToken* cancel = nullptr);
+
+    /**
+     * @brief Claim the warm connection of an endpoint for a request about to be sent
+     * @param wait How long to wait for a warm-up still in progress
+     * @param cancel Ends the wait early (optional)
+     * @return Handshake time the warm-up took off this request in ms (0 if none)
+     *
+     * Each warm-up is credited to one request only.
+     */
+    double ClaimWarm(const std::wstring& host, INTERNET_PORT port, bool secure, std::chrono::milliseconds wait, CancelToken* cancel = nullptr);
+
+    /**
+     * @brief Get pool hit/miss counters
+     */
+    HttpPoolStats Stats() const;
+
+    /**
+     * @brief Close every pooled connection and the session handle
+     */
+    void Shutdown();
+
+    HttpSession(const HttpSession&) = delete;
+    HttpSession& operator=(const HttpSession&) = delete;
+
+private:
+    HttpSession() = default;
+    ~HttpSession();
+
+    using Key = std::tuple<std::wstring, INTERNET_PORT, bool>;
+    static constexpr size_t kMaxIdlePerKey = 4;
+    static constexpr std::chrono::seconds kWarmLifetime{30};  // Trust a warmed keep-alive connection this long
+
+    /**
+     * @struct WarmState
+     * @brief Warm-up of one endpoint
+     */
+    struct WarmState {
+        bool inFlight{};
+        bool claimed{};
+        double handshakeMs{};                          // Time until the warm-up's request was sent (DNS, TCP, TLS)
+        std::chrono::steady_clock::time_point warmAt;  // When the connection became warm
+    };
+
+    mutable std::mutex mutex_;
+    std::condition_variable warmCv_;
+    HINTERNET session_{};
+    std::map<Key, std::vector<HINTERNET>> idle_;
+    std::map<Key, WarmState> warm_;
+    HttpPoolStats stats_{};
+};
+
+/**
+ * @brief How long a request waits for a warm-up of its endpoint still in progress (about one handshake)
+ */
+inline constexpr std::chrono::milliseconds kWarmClaimWait{150};
+
+/**
+ * @struct PooledConnection
+ * @brief RAII checkout of a pooled connection; returns it to the pool when destroyed
+ */
+struct PooledConnection {
+    PooledConnection(const std::wstring& host, INTERNET_PORT port, bool secure, std::wstring* err)
+        : host(host), port(port), secure(secure) { handle = HttpSession::Instance().Acquire(host, port, secure, err, &reused); }
+    ~PooledConnection() { if (handle) HttpSession::Instance().Release(host, port, secure, handle, reusable); }
+    PooledConnection(const PooledConnection&) = delete;
+    PooledConnection& operator=(const PooledConnection&) = delete;
+    std::wstring host;
+    INTERNET_PORT port{};
+    bool secure{};
+    bool reusable{true};
+    bool reused{};       // Handle came from the idle pool
+    HINTERNET handle{};
+};
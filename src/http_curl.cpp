@@ -0,0 +1,244 @@
+/**
+ * @file http_curl.cpp
+ * @brief libcurl implementation of the HTTP request functions (Linux/macOS)
+ *
+ * Each thread keeps one multi handle and one easy handle, so consecutive
+ * requests from a worker reuse its keep-alive connection; DNS results and
+ * TLS sessions are shared between threads. A request drives the multi loop
+ * itself, which lets a cancellation wake curl_multi_poll and abort at once
+ * rather than at curl's next progress callback.
+ */
+
+#include "http_request.h"
+#include "trace.h"
+#include "utf8.h"
+
+#include <curl/curl.h>
+
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <string_view>
+
+using namespace std;
+
+namespace {
+/**
+ * @class CurlShare
+ * @brief Global libcurl initialization and the DNS/TLS session cache shared by all threads
+ *
+ * Kept for the lifetime of the process: thread-local handles may still refer to it at exit.
+ */
+class CurlShare {
+public:
+    static CurlShare& Instance() {
+        static CurlShare* share = new CurlShare();
+        return *share;
+    }
+
+    CURLSH* Handle() const { return share_; }
+
+private:
+    CurlShare() {
+        curl_global_init(CURL_GLOBAL_DEFAULT);
+        share_ = curl_share_init();
+        if (!share_) return;
+        curl_share_setopt(share_, CURLSHOPT_LOCKFUNC, Lock);
+        curl_share_setopt(share_, CURLSHOPT_UNLOCKFUNC, Unlock);
+        curl_share_setopt(share_, CURLSHOPT_USERDATA, this);
+        curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+        curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    }
+
+    static void Lock(CURL*, curl_lock_data data, curl_lock_access, void* user) {
+        static_cast<CurlShare*>(user)->mutexes_[data].lock();
+    }
+    static void Unlock(CURL*, curl_lock_data data, void* user) {
+        static_cast<CurlShare*>(user)->mutexes_[data].unlock();
+    }
+
+    CURLSH* share_{};
+    mutex mutexes_[CURL_LOCK_DATA_LAST];
+};
+
+/**
+ * @struct ThreadHandles
+ * @brief Handles reused by every request of one thread (the multi handle owns the connection cache)
+ */
+struct ThreadHandles {
+    CURLM* multi{};
+    CURL* easy{};
+    ThreadHandles() : multi(curl_multi_init()), easy(curl_easy_init()) {}
+    ~ThreadHandles() {
+        if (easy) curl_easy_cleanup(easy);
+        if (multi) curl_multi_cleanup(multi);
+    }
+    ThreadHandles(const ThreadHandles&) = delete;
+    ThreadHandles& operator=(const ThreadHandles&) = delete;
+};
+
+ThreadHandles& Handles() {
+    CurlShare::Instance();  // curl_global_init must precede the first handle
+    thread_local ThreadHandles handles;
+    return handles;
+}
+
+/**
+ * @struct Transfer
+ * @brief State shared with the libcurl callbacks of one request
+ */
+struct Transfer {
+    CURL* easy{};
+    const HttpDataHandler* onData{};
+    HttpResponseInfo* info{};
+    const atomic<bool>* cancelled{};
+    string rawHeaders;
+    bool headersReported{};
+    long long received{};
+    exception_ptr error;  // Thrown by onData; rethrown once curl has returned
+};
+
+size_t OnHeader(char* data, size_t size, size_t count, void* user) {
+    auto* t = static_cast<Transfer*>(user);
+    const string_view line(data, size * count);
+    // A new status line starts the headers of the final response (after 100 Continue)
+    if (line.substr(0, 5) == "HTTP/") t->rawHeaders.clear();
+    t->rawHeaders.append(line);
+    return size * count;
+}
+
+void ReportHeaders(Transfer& t) {
+    if (t.headersReported) return;
+    t.headersReported = true;
+    if (!t.info) return;
+    long status = 0;
+    curl_easy_getinfo(t.easy, CURLINFO_RESPONSE_CODE, &status);
+    t.info->status = static_cast<int>(status);
+    t.info->rawHeaders = t.rawHeaders;
+}
+
+size_t OnBody(char* data, size_t size, size_t count, void* user) {
+    auto* t = static_cast<Transfer*>(user);
+    const size_t n = size * count;
+    if (*t->cancelled) return 0;  // Aborts the transfer with CURLE_WRITE_ERROR
+    ReportHeaders(*t);
+    t->received += static_cast<long long>(n);
+    if (*t->onData) {
+        // Exceptions must not unwind through libcurl's C frames
+        try {
+            (*t->onData)(data, n);
+        } catch (...) {
+            t->error = current_exception();
+            return 0;
+        }
+    }
+    return n;
+}
+
+/**
+ * @brief Turn the CRLF-separated header block into a curl list
+ */
+curl_slist* BuildHeaderList(const wstring& headers) {
+    const string all = WideToUtf8(headers);
+    curl_slist* list = nullptr;
+    for (size_t pos = 0; pos < all.size();) {
+        size_t end = all.find("\r\n", pos);
+        if (end == string::npos) end = all.size();
+        if (end > pos) list = curl_slist_append(list, all.substr(pos, end - pos).c_str());
+        pos = end + 2;
+    }
+    // Like WinHTTP, do not wait for 100 Continue before sending a large body
+    return curl_slist_append(list, "Expect:");
+}
+} // namespace
+
+bool HttpRequestStreaming(const wstring& host, const wstring& path, bool useHttps, const wstring& headers, const string& body, const wstring& method, const HttpDataHandler& onData, wstring* err, CancelToken* cancel, HttpResponseInfo* info) {
+    auto setErr = [&](const wstring& m) { if (err) *err = m; };
+    TraceScope span("http_request");
+    ThreadHandles& h = Handles();
+    if (!h.multi || !h.easy) { setErr(L"curl initialization failed"); return false; }
+    CURL* easy = h.easy;
+    curl_easy_reset(easy);
+    const string url = (useHttps ? "https://" : "http://") + WideToUtf8(host) + WideToUtf8(path);
+    const string verb = WideToUtf8(method);
+    curl_slist* headerList = BuildHeaderList(headers);
+    atomic<bool> cancelled{false};
+    Transfer t;
+    t.easy = easy;
+    t.onData = &onData;
+    t.info = info;
+    t.cancelled = &cancelled;
+    curl_easy_setopt(easy, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(easy, CURLOPT_HTTPHEADER, headerList);
+    curl_easy_setopt(easy, CURLOPT_USERAGENT, "cbfilter/1.0");
+    curl_easy_setopt(easy, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(easy, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(easy, CURLOPT_CONNECTTIMEOUT_MS, 60000L);
+    curl_easy_setopt(easy, CURLOPT_SHARE, CurlShare::Instance().Handle());
+    curl_easy_setopt(easy, CURLOPT_HEADERFUNCTION, OnHeader);
+    curl_easy_setopt(easy, CURLOPT_HEADERDATA, &t);
+    curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION, OnBody);
+    curl_easy_setopt(easy, CURLOPT_WRITEDATA, &t);
+    if (verb == "HEAD") {
+        curl_easy_setopt(easy, CURLOPT_NOBODY, 1L);
+    } else if (verb == "GET" && body.empty()) {
+        curl_easy_setopt(easy, CURLOPT_HTTPGET, 1L);
+    } else {
+        if (verb != "POST") curl_easy_setopt(easy, CURLOPT_CUSTOMREQUEST, verb.c_str());
+        curl_easy_setopt(easy, CURLOPT_POSTFIELDSIZE_LARGE, static_cast<curl_off_t>(body.size()));
+        curl_easy_setopt(easy, CURLOPT_POSTFIELDS, body.data());
+    }
+    span.Arg("bytes_sent", static_cast<long long>(body.size()));
+    if (curl_multi_add_handle(h.multi, easy) != CURLM_OK) {
+        curl_slist_free_all(headerList);
+        setErr(L"curl_multi_add_handle failed");
+        return false;
+    }
+    bool performed = true;
+    {
+        // Waking the poll from the cancelling thread makes the loop below return at once
+        CancelRegistration onCancel(cancel, [&] { cancelled = true; curl_multi_wakeup(h.multi); });
+        int running = 1;
+        while (running && !cancelled) {
+            if (curl_multi_perform(h.multi, &running) != CURLM_OK) { performed = false; break; }
+            if (running) curl_multi_poll(h.multi, nullptr, 0, 1000, nullptr);
+        }
+    }
+    CURLcode rc = CURLE_OK;
+    bool done = false;
+    int queued = 0;
+    while (CURLMsg* msg = curl_multi_info_read(h.multi, &queued)) {
+        if (msg->msg == CURLMSG_DONE && msg->easy_handle == easy) { rc = msg->data.result; done = true; }
+    }
+    // Removing an unfinished transfer closes its connection instead of returning it to the cache
+    curl_multi_remove_handle(h.multi, easy);
+    curl_slist_free_all(headerList);
+    if (t.error) rethrow_exception(t.error);
+    if (cancelled) {
+        setErr(L"request cancelled");
+        return false;
+    }
+    long status = 0;
+    curl_easy_getinfo(easy, CURLINFO_RESPONSE_CODE, &status);
+    long connects = 0;
+    curl_easy_getinfo(easy, CURLINFO_NUM_CONNECTS, &connects);
+    curl_off_t ttfbUs = 0;
+    curl_easy_getinfo(easy, CURLINFO_STARTTRANSFER_TIME_T, &ttfbUs);
+    span.Arg("status", status);
+    span.Arg("reused_connection", connects == 0 ? 1 : 0);
+    span.Arg("ttfb_ms", static_cast<long long>(ttfbUs / 1000));
+    if (status > 0) ReportHeaders(t);  // Responses without a body
+    if (!performed) { setErr(L"curl_multi_perform failed"); return false; }
+    if (!done || rc != CURLE_OK) {
+        setErr(L"curl: " + Utf8ToWide(curl_easy_strerror(done ? rc : CURLE_RECV_ERROR)));
+        return false;
+    }
+    if (status >= 400) setErr(L"HTTP status " + to_wstring(status));
+    return true;
+}
+
+string HttpRequestWithHeaders(const wstring& host, const wstring& path, bool useHttps, const wstring& headers, const string& body, const wstring& method, wstring* err, CancelToken* cancel) {
+    string raw;
+    HttpRequestStreaming(host, path, useHttps, headers, body, method, [&](const char* data, size_t size) { raw.append(data, size); }, err, cancel);
+    return raw;
+}
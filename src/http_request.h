@@ -0,0 +1,58 @@
+/**
+ * @file http_request.h
+ * @brief Platform-neutral HTTP request functions used by the filter engine
+ *
+ * Implemented over the pooled WinHTTP session on Windows (http_client.cpp)
+ * and over libcurl elsewhere (http_curl.cpp); a build links exactly one.
+ */
+
+#pragma once
+
+#include "cancel_token.h"
+
+#include <functional>
+#include <string>
+
+/**
+ * @struct HttpResponseInfo
+ * @brief Status and headers of a response
+ */
+struct HttpResponseInfo {
+    int status{};            // HTTP status (0 if no response was received)
+    std::string rawHeaders;  // Status line and headers, CRLF-separated
+};
+
+/**
+ * @brief Callback receiving response body bytes as they arrive
+ */
+using HttpDataHandler = std::function<void(const char* data, size_t size)>;
+
+/**
+ * @brief Make an HTTP request and deliver the response body incrementally
+ * @param host Host name
+ * @param path Path
+ * @param useHttps Use HTTPS
+ * @param headers Headers
+ * @param body Body
+ * @param method Method
+ * @param onData Called for every chunk read from the connection
+ * @param err Error message
+ * @param cancel Aborts the request when cancelled, even inside a blocking call (optional)
+ * @param info Receives the status and headers before the body is delivered (optional)
+ * @return true if the whole body was received
+ */
+bool HttpRequestStreaming(const std::wstring& host, const std::wstring& path, bool useHttps, const std::wstring& headers, const std::string& body, const std::wstring& method, const HttpDataHandler& onData, std::wstring* err, CancelToken* cancel = nullptr, HttpResponseInfo* info = nullptr);
+
+/**
+ * @brief Make an HTTP request with headers over the shared session
+ * @param host Host name
+ * @param path Path
+ * @param useHttps Use HTTPS
+ * @param headers Headers
+ * @param body Body
+ * @param method Method
+ * @param err Error message
+ * @param cancel Aborts the request when cancelled (optional)
+ * @return Response body as received (UTF-8 for the JSON APIs)
+ */
+std::string HttpRequestWithHeaders(const std::wstring& host, const std::wstring& path, bool useHttps, const std::wstring& headers, const std::string& body, const std::wstring& method, std::wstring* err, CancelToken* cancel = nullptr);
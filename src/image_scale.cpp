@@ -0,0 +1,148 @@
+/**
+ * @file image_scale.cpp
+ * @brief Implementation of the area-averaging downscaler
+ */
+
+#include "image_scale.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <cwctype>
+#include <vector>
+
+using namespace std;
+
+namespace {
+/**
+ * @struct Span
+ * @brief Source pixels covering one destination pixel along one axis
+ */
+struct Span {
+    int first{};                 // First source index
+    vector<float> weights;       // Coverage of each source index, summing to 1
+};
+
+/**
+ * @brief Compute coverage spans for mapping n source pixels onto m destination pixels
+ */
+vector<Span> BuildSpans(int n, int m) {
+    vector<Span> spans(m);
+    const double scale = static_cast<double>(n) / m;
+    for (int i = 0; i < m; ++i) {
+        double lo = i * scale, hi = (i + 1) * scale;
+        int first = static_cast<int>(floor(lo));
+        int last = min(n - 1, static_cast<int>(ceil(hi)) - 1);
+        Span& s = spans[i];
+        s.first = first;
+        for (int k = first; k <= last; ++k) {
+            double cover = min(hi, k + 1.0) - max(lo, static_cast<double>(k));
+            s.weights.push_back(static_cast<float>(cover / scale));
+        }
+    }
+    return spans;
+}
+} // namespace
+
+ImageFormat ParseImageFormat(const wstring& s) {
+    wstring lower = s;
+    for (auto& c : lower) c = static_cast<wchar_t>(towlower(c));
+    if (lower == L"jpeg" || lower == L"jpg") return ImageFormat::Jpeg;
+    if (lower == L"webp") return ImageFormat::Webp;
+    return ImageFormat::Png;
+}
+
+const wchar_t* ImageFormatToConfig(ImageFormat f) {
+    switch (f) {
+    case ImageFormat::Jpeg: return L"jpeg";
+    case ImageFormat::Webp: return L"webp";
+    default: return L"png";
+    }
+}
+
+const wchar_t* ImageFormatMime(ImageFormat f) {
+    switch (f) {
+    case ImageFormat::Jpeg: return L"image/jpeg";
+    case ImageFormat::Webp: return L"image/webp";
+    default: return L"image/png";
+    }
+}
+
+bool SniffImageFormat(const uint8_t* data, size_t size, ImageFormat& out) {
+    static const uint8_t png[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    if (size >= 8 && memcmp(data, png, 8) == 0) { out = ImageFormat::Png; return true; }
+    if (size >= 3 && data[0] == 0xFF && data[1] == 0xD8 && data[2] == 0xFF) { out = ImageFormat::Jpeg; return true; }
+    if (size >= 12 && memcmp(data, "RIFF", 4) == 0 && memcmp(data + 8, "WEBP", 4) == 0) { out = ImageFormat::Webp; return true; }
+    return false;
+}
+
+bool ComputeScaledSize(int w, int h, const ImageUploadOptions& opt, int& outW, int& outH) {
+    outW = w; outH = h;
+    if (w <= 0 || h <= 0) return false;
+    double factor = 1.0;
+    if (opt.maxLongEdge > 0) factor = min(factor, static_cast<double>(opt.maxLongEdge) / max(w, h));
+    if (opt.maxMegapixels > 0) factor = min(factor, sqrt(opt.maxMegapixels * 1e6 / (static_cast<double>(w) * h)));
+    if (factor >= 1.0) return false;
+    outW = max(1, static_cast<int>(w * factor));
+    outH = max(1, static_cast<int>(h * factor));
+    return outW < w || outH < h;
+}
+
+void ResampleAreaAverage(const uint8_t* src, int sw, int sh, int sstride, uint8_t* dst, int dw, int dh, int dstride) {
+    if (sw <= 0 || sh <= 0 || dw <= 0 || dh <= 0) return;
+    const vector<Span> xs = BuildSpans(sw, dw);
+    const vector<Span> ys = BuildSpans(sh, dh);
+    vector<float> row(static_cast<size_t>(dw) * 4);  // One source row reduced horizontally
+    vector<float> acc(static_cast<size_t>(dw) * 4);  // Weighted sum of reduced rows
+    for (int dy = 0; dy < dh; ++dy) {
+        fill(acc.begin(), acc.end(), 0.0f);
+        const Span& sy = ys[dy];
+        for (size_t k = 0; k < sy.weights.size(); ++k) {
+            const uint8_t* srow = src + static_cast<size_t>(sy.first + k) * sstride;
+            for (int dx = 0; dx < dw; ++dx) {
+                const Span& sx = xs[dx];
+                float c0 = 0, c1 = 0, c2 = 0, c3 = 0;
+                const uint8_t* p = srow + static_cast<size_t>(sx.first) * 4;
+                for (float wgt : sx.weights) {
+                    c0 += wgt * p[0]; c1 += wgt * p[1]; c2 += wgt * p[2]; c3 += wgt * p[3];
+                    p += 4;
+                }
+                float* r = &row[static_cast<size_t>(dx) * 4];
+                r[0] = c0; r[1] = c1; r[2] = c2; r[3] = c3;
+            }
+            const float wy = sy.weights[k];
+            for (size_t i = 0; i < acc.size(); ++i) acc[i] += wy * row[i];
+        }
+        uint8_t* drow = dst + static_cast<size_t>(dy) * dstride;
+        for (size_t i = 0; i < acc.size(); ++i) {
+            float v = acc[i] + 0.5f;
+            drow[i] = static_cast<uint8_t>(v < 0 ? 0 : (v > 255 ? 255 : v));
+        }
+    }
+}
+
+void LayoutImageGrid(const vector<pair<int, int>>& sizes, int gap, vector<GridCell>& cells, int& width, int& height) {
+    cells.assign(sizes.size(), GridCell{});
+    width = height = 0;
+    if (sizes.empty()) return;
+    const size_t cols = static_cast<size_t>(ceil(sqrt(static_cast<double>(sizes.size()))));
+    const size_t rows = (sizes.size() + cols - 1) / cols;
+    vector<int> colW(cols), rowH(rows);
+    for (size_t i = 0; i < sizes.size(); ++i) {
+        colW[i % cols] = (std::max)(colW[i % cols], sizes[i].first);
+        rowH[i / cols] = (std::max)(rowH[i / cols], sizes[i].second);
+    }
+    vector<int> colX(cols), rowY(rows);
+    for (size_t c = 1; c < cols; ++c) colX[c] = colX[c - 1] + colW[c - 1] + gap;
+    for (size_t r = 1; r < rows; ++r) rowY[r] = rowY[r - 1] + rowH[r - 1] + gap;
+    width = colX.back() + colW.back();
+    height = rowY.back() + rowH.back();
+    for (size_t i = 0; i < sizes.size(); ++i) {
+        const size_t c = i % cols, r = i / cols;
+        GridCell& cell = cells[i];
+        cell.w = sizes[i].first;
+        cell.h = sizes[i].second;
+        cell.x = colX[c] + (colW[c] - cell.w) / 2;
+        cell.y = rowY[r] + (rowH[r] - cell.h) / 2;
+    }
+}
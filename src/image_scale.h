@@ -0,0 +1,103 @@
+/**
+ * @file image_scale.h
+ * @brief Upload size limits and area-averaging downscaler for 32bpp images
+ *
+ * Vision models downscale large inputs server-side anyway, so clipboard
+ * images are shrunk to the model's limits before they are encoded and
+ * uploaded.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * @enum ImageFormat
+ * @brief Encoding used for uploaded images
+ */
+enum class ImageFormat { Png, Jpeg, Webp };
+
+/**
+ * @struct ImageUploadOptions
+ * @brief Per-model limits applied to images before upload
+ */
+struct ImageUploadOptions {
+    int maxLongEdge{2048};        // Longest side in pixels (0 = unlimited)
+    double maxMegapixels{0};      // Pixel budget in megapixels (0 = unlimited)
+    ImageFormat format{ImageFormat::Png};
+    int quality{85};              // Lossy encoder quality 1-100
+};
+
+/**
+ * @brief Parse a format name ("png", "jpeg"/"jpg", "webp"); unknown names map to PNG
+ */
+ImageFormat ParseImageFormat(const std::wstring& s);
+
+/**
+ * @brief Config name of a format
+ */
+const wchar_t* ImageFormatToConfig(ImageFormat f);
+
+/**
+ * @brief MIME type of a format
+ */
+const wchar_t* ImageFormatMime(ImageFormat f);
+
+/**
+ * @brief Detect an encoded image format from its leading bytes
+ * @param data Encoded image (PNG, JPEG or WebP)
+ * @param size Size in bytes
+ * @param out Detected format
+ * @return false if the bytes are not a supported image
+ */
+bool SniffImageFormat(const uint8_t* data, size_t size, ImageFormat& out);
+
+/**
+ * @brief Compute the output size that satisfies the limits, keeping aspect ratio
+ * @param w Source width
+ * @param h Source height
+ * @param opt Limits
+ * @param outW Output width (equals w when no scaling is needed)
+ * @param outH Output height (equals h when no scaling is needed)
+ * @return true if the image must be downscaled
+ */
+bool ComputeScaledSize(int w, int h, const ImageUploadOptions& opt, int& outW, int& outH);
+
+/**
+ * @brief Downscale a 32bpp image by exact area averaging
+ * @param src Source pixels (4 bytes per pixel, any channel order)
+ * @param sw Source width
+ * @param sh Source height
+ * @param sstride Source row stride in bytes
+ * @param dst Destination pixels
+ * @param dw Destination width (<= sw)
+ * @param dh Destination height (<= sh)
+ * @param dstride Destination row stride in bytes
+ */
+void ResampleAreaAverage(const uint8_t* src, int sw, int sh, int sstride, uint8_t* dst, int dw, int dh, int dstride);
+
+/**
+ * @struct GridCell
+ * @brief Placement of one image in a grid
+ */
+struct GridCell {
+    int x{}, y{};   // Top-left corner of the image
+    int w{}, h{};   // Image size (unchanged)
+};
+
+/**
+ * @brief Lay images out in a near-square grid, in order, row by row
+ * @param sizes Width and height of each image
+ * @param gap Pixels between rows and columns
+ * @param cells Placement of each image, centered in its cell
+ * @param width Total width of the grid
+ * @param height Total height of the grid
+ *
+ * The grid has ceil(sqrt(n)) columns; each column is as wide as its widest
+ * image and each row as tall as its tallest.
+ */
+void LayoutImageGrid(const std::vector<std::pair<int, int>>& sizes, int gap, std::vector<GridCell>& cells, int& width, int& height);
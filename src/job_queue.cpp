@@ -0,0 +1,118 @@
+/**
+ * @file job_queue.cpp
+ * @brief Implementation of the job queue and delivery ordering
+ */
+
+#include "job_queue.h"
+
+#include <algorithm>
+#include <atomic>
+
+using namespace std;
+
+JobQueue::JobQueue(size_t workers, size_t defaultGroupLimit)
+    : defaultLimit_((std::max)(defaultGroupLimit, size_t{1})) {
+    workers = (std::max)(workers, size_t{1});
+    workers_.reserve(workers);
+    for (size_t i = 0; i < workers; ++i) workers_.emplace_back([this] { WorkerLoop(); });
+}
+
+JobQueue::~JobQueue() {
+    Shutdown();
+}
+
+void JobQueue::SetGroupLimit(const wstring& group, size_t limit) {
+    lock_guard<mutex> lock(mutex_);
+    limits_[group] = (std::max)(limit, size_t{1});
+    cv_.notify_all();
+}
+
+size_t JobQueue::LimitFor(const wstring& group) const {
+    auto it = limits_.find(group);
+    return it != limits_.end() ? it->second : defaultLimit_;
+}
+
+uint64_t JobQueue::Submit(const wstring& group, Task task) {
+    lock_guard<mutex> lock(mutex_);
+    if (stopping_) return 0;
+    uint64_t seq = nextSeq_++;
+    queue_.push_back(Job{seq, group, move(task)});
+    cv_.notify_one();
+    return seq;
+}
+
+size_t JobQueue::Outstanding() const {
+    lock_guard<mutex> lock(mutex_);
+    return queue_.size() + active_;
+}
+
+bool JobQueue::TakeRunnable(Job& out) {
+    for (auto it = queue_.begin(); it != queue_.end(); ++it) {
+        if (running_[it->group] >= LimitFor(it->group)) continue;
+        out = move(*it);
+        queue_.erase(it);
+        return true;
+    }
+    return false;
+}
+
+void JobQueue::WorkerLoop() {
+    for (;;) {
+        Job job;
+        {
+            unique_lock<mutex> lock(mutex_);
+            cv_.wait(lock, [&] { return stopping_ || TakeRunnable(job); });
+            if (stopping_ && !job.task) return;
+            ++running_[job.group];
+            ++active_;
+        }
+        job.task();
+        {
+            lock_guard<mutex> lock(mutex_);
+            --running_[job.group];
+            --active_;
+        }
+        // A slot in this group opened up: jobs skipped for the limit may now run
+        cv_.notify_all();
+    }
+}
+
+void JobQueue::Shutdown() {
+    {
+        lock_guard<mutex> lock(mutex_);
+        if (stopping_ && workers_.empty()) return;
+        stopping_ = true;
+        queue_.clear();
+    }
+    cv_.notify_all();
+    for (auto& t : workers_) if (t.joinable()) t.join();
+    workers_.clear();
+}
+
+vector<uint64_t> DeliveryOrder::Complete(uint64_t seq) {
+    vector<uint64_t> ready;
+    if (!pending_.erase(seq)) return ready;
+    if (!ordered_) {
+        ready.push_back(seq);
+        return ready;
+    }
+    done_.insert(seq);
+    // Release every completed job that no longer has an earlier job outstanding
+    while (!done_.empty() && (pending_.empty() || *done_.begin() < *pending_.begin())) {
+        ready.push_back(*done_.begin());
+        done_.erase(done_.begin());
+    }
+    return ready;
+}
+
+void ParallelFor(size_t count, size_t parallelism, const function<void(size_t)>& fn) {
+    atomic<size_t> next{0};
+    auto worker = [&] {
+        for (size_t i = next++; i < count; i = next++) fn(i);
+    };
+    size_t threads = (std::min)((std::max)(parallelism, size_t{1}), count);
+    vector<thread> helpers;
+    for (size_t t = 1; t < threads; ++t) helpers.emplace_back(worker);
+    worker();
+    for (auto& t : helpers) t.join();
+}
@@ -0,0 +1,126 @@
+/**
+ * @file job_queue.h
+ * @brief Bounded worker pool with per-group concurrency limits
+ *
+ * Filter runs are submitted as jobs tagged with their API provider. A fixed
+ * set of worker threads picks the oldest job whose provider is below its
+ * concurrency limit, so a burst of slow image generations on one provider
+ * does not starve requests to another. DeliveryOrder decides when finished
+ * jobs may be handed back to the UI: in submission order or as they arrive.
+ * ParallelFor fans one job out over a few short-lived threads, e.g. for the
+ * chunks of a long text.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @class JobQueue
+ * @brief Fixed-size thread pool scheduling jobs under per-group limits
+ */
+class JobQueue {
+public:
+    using Task = std::function<void()>;
+
+    /**
+     * @param workers Number of worker threads (at least 1)
+     * @param defaultGroupLimit Concurrent jobs allowed per group unless overridden
+     */
+    JobQueue(size_t workers, size_t defaultGroupLimit);
+    ~JobQueue();
+
+    /**
+     * @brief Override the concurrency limit of one group
+     */
+    void SetGroupLimit(const std::wstring& group, size_t limit);
+
+    /**
+     * @brief Queue a task
+     * @param group Concurrency group (e.g., provider id)
+     * @param task Work to run on a worker thread
+     * @return Sequence number, increasing in submission order
+     */
+    uint64_t Submit(const std::wstring& group, Task task);
+
+    /**
+     * @brief Number of queued plus running jobs
+     */
+    size_t Outstanding() const;
+
+    /**
+     * @brief Stop accepting jobs, drop queued ones and join the workers
+     */
+    void Shutdown();
+
+    JobQueue(const JobQueue&) = delete;
+    JobQueue& operator=(const JobQueue&) = delete;
+
+private:
+    struct Job {
+        uint64_t seq{};
+        std::wstring group;
+        Task task;
+    };
+
+    void WorkerLoop();
+    size_t LimitFor(const std::wstring& group) const;
+    bool TakeRunnable(Job& out);
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<Job> queue_;
+    std::map<std::wstring, size_t> running_;
+    std::map<std::wstring, size_t> limits_;
+    std::vector<std::thread> workers_;
+    size_t defaultLimit_{};
+    size_t active_{};
+    uint64_t nextSeq_{1};
+    bool stopping_{};
+};
+
+/**
+ * @class DeliveryOrder
+ * @brief Releases completed sequence numbers either in order or immediately
+ *
+ * Not thread-safe; intended to be driven from the UI thread.
+ */
+class DeliveryOrder {
+public:
+    explicit DeliveryOrder(bool ordered = true) : ordered_(ordered) {}
+
+    void SetOrdered(bool ordered) { ordered_ = ordered; }
+
+    /**
+     * @brief Record a submitted sequence number
+     */
+    void Register(uint64_t seq) { pending_.insert(seq); }
+
+    /**
+     * @brief Mark a sequence number complete
+     * @return Sequence numbers that may now be delivered, in delivery order
+     */
+    std::vector<uint64_t> Complete(uint64_t seq);
+
+private:
+    bool ordered_;
+    std::set<uint64_t> pending_;  // Submitted, not yet complete
+    std::set<uint64_t> done_;     // Complete, held back behind an earlier job
+};
+
+/**
+ * @brief Run fn(i) for every i in [0, count) on up to parallelism threads
+ *
+ * The calling thread takes part in the work; indices are handed out in
+ * increasing order. Returns once every call has finished.
+ */
+void ParallelFor(size_t count, size_t parallelism, const std::function<void(size_t)>& fn);
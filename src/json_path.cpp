@@ -0,0 +1,399 @@
+/**
+ * @file json_path.cpp
+ * @brief Implementation of the single-pass JSON path extractor
+ */
+
+#include "json_path.h"
+#include "utf8.h"
+
+#include <cstdint>
+
+using namespace std;
+
+namespace {
+/**
+ * @class Scanner
+ * @brief Forward-only cursor over JSON text
+ */
+template <class Ch>
+class Scanner {
+public:
+    using View = basic_string_view<Ch>;
+    using Traits = char_traits<Ch>;
+
+    explicit Scanner(View json) : p_(json.data()), end_(json.data() + json.size()) {}
+
+    void SkipWs() {
+        while (p_ < end_ && (*p_ == ' ' || *p_ == '\t' || *p_ == '\n' || *p_ == '\r')) ++p_;
+    }
+
+    bool Consume(Ch c) {
+        SkipWs();
+        if (p_ >= end_ || *p_ != c) return false;
+        ++p_;
+        return true;
+    }
+
+    bool Peek(Ch c) {
+        SkipWs();
+        return p_ < end_ && *p_ == c;
+    }
+
+    const Ch* Pos() const { return p_; }
+
+    /**
+     * @brief Skip a string; on entry the cursor is at the opening quote
+     * @param body Receives the raw (still escaped) contents
+     */
+    bool SkipString(View* body = nullptr) {
+        const Ch* start = ++p_;
+        for (const Ch* from = start;;) {
+            const Ch* q = Traits::find(from, static_cast<size_t>(end_ - from), Ch('"'));
+            if (!q) return false;
+            // The quote is escaped if an odd number of backslashes precede it
+            size_t slashes = 0;
+            while (q - slashes > start && q[-1 - static_cast<ptrdiff_t>(slashes)] == '\\') ++slashes;
+            if (slashes % 2 == 0) {
+                if (body) *body = View(start, static_cast<size_t>(q - start));
+                p_ = q + 1;
+                return true;
+            }
+            from = q + 1;
+        }
+    }
+
+    /**
+     * @brief Skip any value, including nested objects and arrays
+     */
+    bool SkipValue() {
+        SkipWs();
+        if (p_ >= end_) return false;
+        if (*p_ == '"') return SkipString();
+        if (*p_ != '{' && *p_ != '[') {
+            // Scalar: runs up to the next structural character
+            const Ch* start = p_;
+            while (p_ < end_ && *p_ != ',' && *p_ != '}' && *p_ != ']' && *p_ != ' ' && *p_ != '\t' && *p_ != '\n' && *p_ != '\r') ++p_;
+            return p_ > start;
+        }
+        size_t depth = 0;
+        while (p_ < end_) {
+            Ch c = *p_;
+            if (c == '"') { if (!SkipString()) return false; continue; }
+            if (c == '{' || c == '[') ++depth;
+            else if (c == '}' || c == ']') {
+                if (depth == 0) return false;
+                if (--depth == 0) { ++p_; return true; }
+            }
+            ++p_;
+        }
+        return false;
+    }
+
+private:
+    const Ch* p_;
+    const Ch* end_;
+};
+
+/**
+ * @brief Append a code point in the output's encoding
+ */
+void AppendCodePoint(wstring& out, uint32_t cp) {
+    if constexpr (sizeof(wchar_t) == 2) {
+        if (cp >= 0x10000) {
+            cp -= 0x10000;
+            out += static_cast<wchar_t>(0xD800 + (cp >> 10));
+            out += static_cast<wchar_t>(0xDC00 + (cp & 0x3FF));
+            return;
+        }
+    }
+    out += static_cast<wchar_t>(cp);
+}
+
+void AppendCodePoint(string& out, uint32_t cp) {
+    if (cp < 0x80) {
+        out += static_cast<char>(cp);
+    } else if (cp < 0x800) {
+        out += static_cast<char>(0xC0 | (cp >> 6));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        out += static_cast<char>(0xE0 | (cp >> 12));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else {
+        out += static_cast<char>(0xF0 | (cp >> 18));
+        out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    }
+}
+
+template <class Ch>
+bool ReadHex4(const Ch*& p, const Ch* end, uint32_t& v) {
+    if (end - p < 4) return false;
+    v = 0;
+    for (int i = 0; i < 4; ++i, ++p) {
+        Ch c = *p;
+        v <<= 4;
+        if (c >= '0' && c <= '9') v |= static_cast<uint32_t>(c - '0');
+        else if (c >= 'a' && c <= 'f') v |= static_cast<uint32_t>(c - 'a' + 10);
+        else if (c >= 'A' && c <= 'F') v |= static_cast<uint32_t>(c - 'A' + 10);
+        else return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Append the unescaped contents of a JSON string body
+ */
+template <class Ch>
+void Unescape(basic_string_view<Ch> s, basic_string<Ch>& out) {
+    using Traits = char_traits<Ch>;
+    out.reserve(out.size() + s.size());
+    const Ch* p = s.data();
+    const Ch* end = p + s.size();
+    while (p < end) {
+        const Ch* bs = Traits::find(p, static_cast<size_t>(end - p), Ch('\\'));
+        if (!bs) { out.append(p, end); break; }
+        out.append(p, bs);
+        p = bs + 1;
+        if (p >= end) break;
+        Ch c = *p++;
+        switch (c) {
+        case 'n': out += Ch('\n'); break;
+        case 'r': out += Ch('\r'); break;
+        case 't': out += Ch('\t'); break;
+        case 'b': out += Ch('\b'); break;
+        case 'f': out += Ch('\f'); break;
+        case 'u': {
+            uint32_t cp = 0;
+            if (!ReadHex4(p, end, cp)) break;
+            // Combine a surrogate pair written as two escapes
+            if (cp >= 0xD800 && cp < 0xDC00 && end - p >= 6 && p[0] == '\\' && p[1] == 'u') {
+                const Ch* q = p + 2;
+                uint32_t lo = 0;
+                if (ReadHex4(q, end, lo) && lo >= 0xDC00 && lo < 0xE000) {
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+                    p = q;
+                }
+            }
+            AppendCodePoint(out, cp);
+            break;
+        }
+        default: out += c; break;  // \" \\ \/ and anything unknown
+        }
+    }
+}
+
+/**
+ * @brief Append a non-string value with whitespace outside strings removed
+ */
+template <class Ch>
+void AppendCompact(basic_string_view<Ch> s, basic_string<Ch>& out) {
+    out.reserve(out.size() + s.size());
+    bool inString = false;
+    for (size_t i = 0; i < s.size(); ++i) {
+        Ch c = s[i];
+        if (inString) {
+            out += c;
+            if (c == '\\' && i + 1 < s.size()) out += s[++i];
+            else if (c == '"') inString = false;
+        } else if (c == '"') {
+            inString = true;
+            out += c;
+        } else if (c != ' ' && c != '\t' && c != '\n' && c != '\r') {
+            out += c;
+        }
+    }
+}
+
+/**
+ * @brief Compare a raw member name with a path key, unescaping only when needed
+ */
+template <class Ch>
+bool KeyEquals(basic_string_view<Ch> raw, const basic_string<Ch>& key) {
+    if (raw.find(Ch('\\')) == basic_string_view<Ch>::npos) return raw == key;
+    basic_string<Ch> unescaped;
+    Unescape(raw, unescaped);
+    return unescaped == key;
+}
+
+/**
+ * @brief Write the raw text of a value the way Extract returns it
+ */
+void AppendValue(string_view raw, string& out) {
+    if (!raw.empty() && raw.front() == '"') {
+        Unescape(raw.substr(1, raw.size() - 2), out);
+        return;
+    }
+    if (raw == "null") return;
+    AppendCompact(raw, out);
+}
+} // namespace
+
+JsonPath JsonPath::Compile(wstring_view path) {
+    JsonPath jp;
+    size_t start = 0;
+    for (size_t i = 0; i <= path.size(); ++i) {
+        if (i < path.size() && path[i] != L'.') continue;
+        wstring_view seg = path.substr(start, i - start);
+        start = i + 1;
+        size_t lb = seg.find(L'[');
+        wstring_view key = seg.substr(0, lb);
+        if (!key.empty()) {
+            Step s;
+            s.key = wstring(key);
+            s.keyUtf8 = WideToUtf8(key);
+            jp.steps_.push_back(move(s));
+        }
+        while (lb != wstring_view::npos) {
+            size_t rb = seg.find(L']', lb);
+            if (rb == wstring_view::npos) break;
+            Step s;
+            s.index = 0;
+            for (size_t k = lb + 1; k < rb; ++k) {
+                if (seg[k] >= L'0' && seg[k] <= L'9') s.index = s.index * 10 + (seg[k] - L'0');
+            }
+            jp.steps_.push_back(move(s));
+            lb = seg.find(L'[', rb);
+        }
+    }
+    return jp;
+}
+
+template <class Ch>
+bool JsonPath::ExtractImpl(basic_string_view<Ch> json, basic_string<Ch>& out) const {
+    out.clear();
+    Scanner<Ch> sc(json);
+    for (const Step& step : steps_) {
+        if (step.index >= 0) {
+            if (!sc.Consume('[')) return false;
+            for (long i = 0; i < step.index; ++i) {
+                if (sc.Peek(']') || !sc.SkipValue() || !sc.Consume(',')) return false;
+            }
+            if (sc.Peek(']')) return false;
+            continue;
+        }
+        const basic_string<Ch>* key;
+        if constexpr (sizeof(Ch) == 1) key = &step.keyUtf8; else key = &step.key;
+        if (!sc.Consume('{')) return false;
+        for (;;) {
+            if (!sc.Peek('"')) return false;
+            basic_string_view<Ch> name;
+            if (!sc.SkipString(&name) || !sc.Consume(':')) return false;
+            if (KeyEquals(name, *key)) break;
+            if (!sc.SkipValue() || !sc.Consume(',')) return false;
+        }
+    }
+    if (sc.Peek('"')) {
+        basic_string_view<Ch> body;
+        if (!sc.SkipString(&body)) return false;
+        Unescape(body, out);
+        return true;
+    }
+    const Ch* start = sc.Pos();
+    if (!sc.SkipValue()) return false;
+    basic_string_view<Ch> raw(start, static_cast<size_t>(sc.Pos() - start));
+    if (raw.size() == 4 && raw[0] == 'n' && raw[1] == 'u' && raw[2] == 'l' && raw[3] == 'l') return true;
+    AppendCompact(raw, out);
+    return true;
+}
+
+/**
+ * @struct JsonPath::ManyWalk
+ * @brief State of one ExtractMany pass
+ */
+struct JsonPath::ManyWalk {
+    Scanner<char> sc;
+    const vector<const JsonPath*>& paths;
+    vector<string>& outs;
+    vector<char> found;
+    size_t left{};  // Paths not found yet; the walk stops at 0
+
+    /**
+     * @brief Walk the value at the cursor, following the active paths that are depth steps deep into it
+     * @return false if the document is malformed (or the walk can stop because every path is found)
+     */
+    bool Value(const vector<size_t>& active, size_t depth) {
+        vector<size_t> deeper;
+        bool ends = false;
+        for (size_t i : active) {
+            if (paths[i]->steps_.size() == depth) ends = true;
+            else deeper.push_back(i);
+        }
+        sc.SkipWs();
+        const char* start = sc.Pos();
+        if (deeper.empty()) {
+            if (!sc.SkipValue()) return false;
+        } else if (sc.Peek('{')) {
+            if (!Object(deeper, depth)) return false;
+        } else if (sc.Peek('[')) {
+            if (!Array(deeper, depth)) return false;
+        } else if (!sc.SkipValue()) {
+            return false;
+        }
+        if (ends) {
+            const string_view raw(start, static_cast<size_t>(sc.Pos() - start));
+            for (size_t i : active) {
+                if (paths[i]->steps_.size() != depth || found[i]) continue;
+                AppendValue(raw, outs[i]);
+                found[i] = 1;
+                --left;
+            }
+        }
+        return left > 0;
+    }
+
+    bool Object(const vector<size_t>& deeper, size_t depth) {
+        sc.Consume('{');
+        if (sc.Consume('}')) return true;
+        vector<size_t> next;
+        for (;;) {
+            if (!sc.Peek('"')) return false;
+            string_view name;
+            if (!sc.SkipString(&name) || !sc.Consume(':')) return false;
+            next.clear();
+            for (size_t i : deeper) {
+                const Step& step = paths[i]->steps_[depth];
+                if (!found[i] && step.index < 0 && KeyEquals(name, step.keyUtf8)) next.push_back(i);
+            }
+            if (next.empty() ? !sc.SkipValue() : !Value(next, depth + 1)) return false;
+            if (sc.Consume('}')) return true;
+            if (!sc.Consume(',')) return false;
+        }
+    }
+
+    bool Array(const vector<size_t>& deeper, size_t depth) {
+        sc.Consume('[');
+        if (sc.Consume(']')) return true;
+        vector<size_t> next;
+        for (long index = 0;; ++index) {
+            next.clear();
+            for (size_t i : deeper) {
+                if (!found[i] && paths[i]->steps_[depth].index == index) next.push_back(i);
+            }
+            if (next.empty() ? !sc.SkipValue() : !Value(next, depth + 1)) return false;
+            if (sc.Consume(']')) return true;
+            if (!sc.Consume(',')) return false;
+        }
+    }
+};
+
+size_t JsonPath::ExtractMany(string_view json, const vector<const JsonPath*>& paths, vector<string>& outs) {
+    outs.assign(paths.size(), string());
+    ManyWalk walk{Scanner<char>(json), paths, outs, vector<char>(paths.size()), 0};
+    vector<size_t> active;
+    for (size_t i = 0; i < paths.size(); ++i) {
+        if (paths[i] && !paths[i]->empty()) active.push_back(i);
+    }
+    walk.left = active.size();
+    if (!active.empty()) walk.Value(active, 0);
+    return active.size() - walk.left;
+}
+
+bool JsonPath::Extract(wstring_view json, wstring& out) const {
+    return ExtractImpl(json, out);
+}
+
+bool JsonPath::Extract(string_view json, string& out) const {
+    return ExtractImpl(json, out);
+}
@@ -0,0 +1,72 @@
+/**
+ * @file json_path.h
+ * @brief Single-pass extraction of one value from a JSON document
+ *
+ * Result paths from the apidef files (e.g. "choices[0].message.content") are
+ * compiled once into key/index steps. Extraction then walks the document
+ * SAX-style: subtrees that are not on the path are skipped without being
+ * materialized, strings are skipped with a character search, and only the
+ * target value is copied and unescaped. A 20 MB base64 image response is
+ * therefore scanned once instead of being parsed into a DOM.
+ */
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @class JsonPath
+ * @brief Pre-compiled result path
+ */
+class JsonPath {
+public:
+    JsonPath() = default;
+
+    /**
+     * @brief Compile a dotted path; each segment is a key optionally followed by [index] suffixes
+     */
+    static JsonPath Compile(std::wstring_view path);
+
+    bool empty() const { return steps_.empty(); }
+
+    /**
+     * @brief Extract the value at this path from a UTF-16/UTF-32 document
+     * @param json JSON text
+     * @param out Unescaped text for strings, compact JSON text for other values, empty for null
+     * @return false if the path does not exist or the document is malformed along the way
+     */
+    bool Extract(std::wstring_view json, std::wstring& out) const;
+
+    /**
+     * @brief Extract the value at this path from a UTF-8 document (out is UTF-8)
+     */
+    bool Extract(std::string_view json, std::string& out) const;
+
+    /**
+     * @brief Extract several paths from a UTF-8 document in one pass
+     * @param paths Paths to look up (empty paths are never found)
+     * @param outs Receives one value per path, as Extract would; empty for a path not found
+     * @return Number of paths found
+     *
+     * Paths that share a prefix walk it together, and the scan stops once
+     * every path is found, so a response is scanned once however many
+     * values are read from it.
+     */
+    static size_t ExtractMany(std::string_view json, const std::vector<const JsonPath*>& paths, std::vector<std::string>& outs);
+
+private:
+    struct Step {
+        std::wstring key;      // Object member name (used when index < 0)
+        std::string keyUtf8;   // Same name for UTF-8 documents
+        long index{-1};        // Array element index, or -1 for a member lookup
+    };
+
+    struct ManyWalk;
+
+    template <class Ch>
+    bool ExtractImpl(std::basic_string_view<Ch> json, std::basic_string<Ch>& out) const;
+
+    std::vector<Step> steps_;
+};
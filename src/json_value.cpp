@@ -0,0 +1,351 @@
+/**
+ * @file json_value.cpp
+ * @brief Implementation of the JSON document model
+ */
+
+#include "json_value.h"
+#include "utf8.h"
+
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+
+using namespace std;
+
+namespace {
+constexpr int kMaxDepth = 256;
+
+/**
+ * @class Parser
+ * @brief Recursive-descent parser over a UTF-8 buffer
+ */
+class Parser {
+public:
+    explicit Parser(string_view s) : s_(s) {}
+
+    bool ParseDocument(JsonValue& out, string* err) {
+        if (s_.substr(0, 3) == "\xEF\xBB\xBF") pos_ = 3;
+        bool ok = ParseValue(out, 0);
+        if (ok) {
+            SkipSpace();
+            if (pos_ != s_.size()) ok = Fail("trailing characters");
+        }
+        if (!ok && err) *err = "offset " + to_string(pos_) + ": " + error_;
+        return ok;
+    }
+
+private:
+    bool Fail(const char* reason) {
+        if (error_.empty()) error_ = reason;
+        return false;
+    }
+
+    void SkipSpace() {
+        while (pos_ < s_.size() && (s_[pos_] == ' ' || s_[pos_] == '\t' || s_[pos_] == '\n' || s_[pos_] == '\r')) ++pos_;
+    }
+
+    bool Consume(string_view word) {
+        if (s_.substr(pos_, word.size()) != word) return false;
+        pos_ += word.size();
+        return true;
+    }
+
+    bool ParseValue(JsonValue& out, int depth) {
+        if (depth > kMaxDepth) return Fail("nesting too deep");
+        SkipSpace();
+        if (pos_ >= s_.size()) return Fail("unexpected end");
+        switch (s_[pos_]) {
+        case '{': return ParseObject(out, depth);
+        case '[': return ParseArray(out, depth);
+        case '"': {
+            string text;
+            if (!ParseString(text)) return false;
+            out = JsonValue::String(string_view(text));
+            return true;
+        }
+        case 't': if (Consume("true")) { out = JsonValue::Boolean(true); return true; } break;
+        case 'f': if (Consume("false")) { out = JsonValue::Boolean(false); return true; } break;
+        case 'n': if (Consume("null")) { out = JsonValue(); return true; } break;
+        default: return ParseNumber(out);
+        }
+        return Fail("invalid literal");
+    }
+
+    bool ParseObject(JsonValue& out, int depth) {
+        ++pos_;
+        out = JsonValue::Object();
+        SkipSpace();
+        if (pos_ < s_.size() && s_[pos_] == '}') { ++pos_; return true; }
+        for (;;) {
+            SkipSpace();
+            if (pos_ >= s_.size() || s_[pos_] != '"') return Fail("expected member name");
+            string key;
+            if (!ParseString(key)) return false;
+            SkipSpace();
+            if (pos_ >= s_.size() || s_[pos_] != ':') return Fail("expected ':'");
+            ++pos_;
+            JsonValue value;
+            if (!ParseValue(value, depth + 1)) return false;
+            out.Set(key, move(value));
+            SkipSpace();
+            if (pos_ < s_.size() && s_[pos_] == ',') { ++pos_; continue; }
+            if (pos_ < s_.size() && s_[pos_] == '}') { ++pos_; return true; }
+            return Fail("expected ',' or '}'");
+        }
+    }
+
+    bool ParseArray(JsonValue& out, int depth) {
+        ++pos_;
+        out = JsonValue::Array();
+        SkipSpace();
+        if (pos_ < s_.size() && s_[pos_] == ']') { ++pos_; return true; }
+        for (;;) {
+            JsonValue value;
+            if (!ParseValue(value, depth + 1)) return false;
+            out.Append(move(value));
+            SkipSpace();
+            if (pos_ < s_.size() && s_[pos_] == ',') { ++pos_; continue; }
+            if (pos_ < s_.size() && s_[pos_] == ']') { ++pos_; return true; }
+            return Fail("expected ',' or ']'");
+        }
+    }
+
+    bool ParseHex4(uint32_t& cp) {
+        if (pos_ + 4 > s_.size()) return Fail("truncated \\u escape");
+        cp = 0;
+        for (int i = 0; i < 4; ++i) {
+            char c = s_[pos_++];
+            cp <<= 4;
+            if (c >= '0' && c <= '9') cp |= static_cast<uint32_t>(c - '0');
+            else if (c >= 'a' && c <= 'f') cp |= static_cast<uint32_t>(c - 'a' + 10);
+            else if (c >= 'A' && c <= 'F') cp |= static_cast<uint32_t>(c - 'A' + 10);
+            else return Fail("invalid \\u escape");
+        }
+        return true;
+    }
+
+    static void AppendUtf8(string& out, uint32_t cp) {
+        if (cp < 0x80) {
+            out += static_cast<char>(cp);
+        } else if (cp < 0x800) {
+            out += static_cast<char>(0xC0 | (cp >> 6));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+        } else if (cp < 0x10000) {
+            out += static_cast<char>(0xE0 | (cp >> 12));
+            out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+        } else {
+            out += static_cast<char>(0xF0 | (cp >> 18));
+            out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+            out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+        }
+    }
+
+    bool ParseString(string& out) {
+        ++pos_;  // Opening quote
+        for (;;) {
+            // Copy the run up to the next quote or escape in one go
+            size_t end = s_.find_first_of("\"\\", pos_);
+            if (end == string_view::npos) return Fail("unterminated string");
+            out.append(s_.data() + pos_, end - pos_);
+            pos_ = end + 1;
+            if (s_[end] == '"') return true;
+            if (pos_ >= s_.size()) return Fail("unterminated string");
+            char c = s_[pos_++];
+            switch (c) {
+            case '"': out += '"'; break;
+            case '\\': out += '\\'; break;
+            case '/': out += '/'; break;
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case 'n': out += '\n'; break;
+            case 'r': out += '\r'; break;
+            case 't': out += '\t'; break;
+            case 'u': {
+                uint32_t cp;
+                if (!ParseHex4(cp)) return false;
+                if (cp >= 0xD800 && cp < 0xDC00 && s_.substr(pos_, 2) == "\\u") {
+                    size_t save = pos_;
+                    pos_ += 2;
+                    uint32_t low;
+                    if (ParseHex4(low) && low >= 0xDC00 && low < 0xE000) cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                    else pos_ = save;
+                }
+                if (cp >= 0xD800 && cp < 0xE000) cp = 0xFFFD;  // Lone surrogate
+                AppendUtf8(out, cp);
+                break;
+            }
+            default: return Fail("invalid escape");
+            }
+        }
+    }
+
+    bool ParseNumber(JsonValue& out) {
+        size_t start = pos_;
+        if (pos_ < s_.size() && s_[pos_] == '-') ++pos_;
+        while (pos_ < s_.size() && ((s_[pos_] >= '0' && s_[pos_] <= '9') || s_[pos_] == '.' || s_[pos_] == 'e' || s_[pos_] == 'E' || s_[pos_] == '+' || s_[pos_] == '-')) ++pos_;
+        double value = 0;
+        auto res = from_chars(s_.data() + start, s_.data() + pos_, value);
+        if (pos_ == start || res.ec != errc() || res.ptr != s_.data() + pos_) { pos_ = start; return Fail("invalid value"); }
+        out = JsonValue::Number(value);
+        return true;
+    }
+
+    string_view s_;
+    size_t pos_{};
+    string error_;
+};
+
+void AppendQuoted(string& out, string_view s) {
+    out += '"';
+    for (char c : s) {
+        switch (c) {
+        case '"': out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20) {
+                char buf[8];
+                snprintf(buf, sizeof(buf), "\\u%04x", static_cast<unsigned>(static_cast<unsigned char>(c)));
+                out += buf;
+            } else {
+                out += c;
+            }
+        }
+    }
+    out += '"';
+}
+
+const JsonValue& NullValue() {
+    static const JsonValue null;
+    return null;
+}
+} // namespace
+
+JsonValue JsonValue::Boolean(bool b) {
+    JsonValue v;
+    v.type_ = JsonType::Boolean;
+    v.bool_ = b;
+    return v;
+}
+
+JsonValue JsonValue::Number(double n) {
+    JsonValue v;
+    v.type_ = JsonType::Number;
+    v.number_ = n;
+    return v;
+}
+
+JsonValue JsonValue::String(string_view utf8) {
+    JsonValue v;
+    v.type_ = JsonType::String;
+    v.string_ = utf8;
+    return v;
+}
+
+JsonValue JsonValue::String(wstring_view s) {
+    return String(string_view(WideToUtf8(s)));
+}
+
+JsonValue JsonValue::Array() {
+    JsonValue v;
+    v.type_ = JsonType::Array;
+    return v;
+}
+
+JsonValue JsonValue::Object() {
+    JsonValue v;
+    v.type_ = JsonType::Object;
+    return v;
+}
+
+bool JsonValue::Parse(string_view utf8, JsonValue& out, string* err) {
+    JsonValue v;
+    if (!Parser(utf8).ParseDocument(v, err)) return false;
+    out = move(v);
+    return true;
+}
+
+wstring JsonValue::GetString(wstring_view def) const {
+    return type_ == JsonType::String ? Utf8ToWide(string_) : wstring(def);
+}
+
+const JsonValue* JsonValue::Find(string_view key) const {
+    for (const auto& m : members_) if (m.first == key) return &m.second;
+    return nullptr;
+}
+
+const JsonValue& JsonValue::operator[](string_view key) const {
+    const JsonValue* v = Find(key);
+    return v ? *v : NullValue();
+}
+
+wstring JsonValue::GetNamedString(string_view key, wstring_view def) const {
+    return (*this)[key].GetString(def);
+}
+
+double JsonValue::GetNamedNumber(string_view key, double def) const {
+    return (*this)[key].GetNumber(def);
+}
+
+bool JsonValue::GetNamedBoolean(string_view key, bool def) const {
+    return (*this)[key].GetBoolean(def);
+}
+
+JsonValue& JsonValue::Set(string_view key, JsonValue value) {
+    if (type_ == JsonType::Null) type_ = JsonType::Object;
+    for (auto& m : members_) {
+        if (m.first == key) { m.second = move(value); return m.second; }
+    }
+    members_.emplace_back(string(key), move(value));
+    return members_.back().second;
+}
+
+JsonValue& JsonValue::Append(JsonValue value) {
+    if (type_ == JsonType::Null) type_ = JsonType::Array;
+    items_.push_back(move(value));
+    return items_.back();
+}
+
+string JsonValue::Stringify() const {
+    string out;
+    StringifyTo(out);
+    return out;
+}
+
+void JsonValue::StringifyTo(string& out) const {
+    switch (type_) {
+    case JsonType::Null: out += "null"; break;
+    case JsonType::Boolean: out += bool_ ? "true" : "false"; break;
+    case JsonType::Number: {
+        if (!isfinite(number_)) { out += "null"; break; }
+        char buf[32];
+        auto res = to_chars(buf, buf + sizeof(buf), number_);
+        out.append(buf, res.ptr);
+        break;
+    }
+    case JsonType::String: AppendQuoted(out, string_); break;
+    case JsonType::Array:
+        out += '[';
+        for (size_t i = 0; i < items_.size(); ++i) {
+            if (i) out += ',';
+            items_[i].StringifyTo(out);
+        }
+        out += ']';
+        break;
+    case JsonType::Object:
+        out += '{';
+        for (size_t i = 0; i < members_.size(); ++i) {
+            if (i) out += ',';
+            AppendQuoted(out, members_[i].first);
+            out += ':';
+            members_[i].second.StringifyTo(out);
+        }
+        out += '}';
+        break;
+    }
+}
@@ -0,0 +1,131 @@
+/**
+ * @file json_value.h
+ * @brief Small JSON document model for config.json and the apidef files
+ *
+ * Settings and API definitions are small documents that are read once and
+ * written rarely, so they are parsed into a tree of JsonValue nodes. Object
+ * members keep their document order. Strings are stored as UTF-8; the
+ * GetString accessors convert to wide strings for the config structs. The
+ * request hot path does not use this model (see json_path.h).
+ */
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/**
+ * @enum JsonType
+ * @brief Type of a JSON value
+ */
+enum class JsonType { Null, Boolean, Number, String, Array, Object };
+
+/**
+ * @class JsonValue
+ * @brief One JSON value; arrays and objects own their children
+ */
+class JsonValue {
+public:
+    using Member = std::pair<std::string, JsonValue>;
+
+    JsonValue() = default;
+
+    static JsonValue Boolean(bool b);
+    static JsonValue Number(double n);
+    static JsonValue String(std::string_view utf8);
+    static JsonValue String(std::wstring_view s);
+    static JsonValue Array();
+    static JsonValue Object();
+
+    /**
+     * @brief Parse a UTF-8 document (an optional BOM is skipped)
+     * @param utf8 Document text
+     * @param out Parsed value
+     * @param err Position and reason on failure (optional)
+     * @return false if the text is not valid JSON
+     */
+    static bool Parse(std::string_view utf8, JsonValue& out, std::string* err = nullptr);
+
+    JsonType Type() const { return type_; }
+    bool IsNull() const { return type_ == JsonType::Null; }
+    bool IsBoolean() const { return type_ == JsonType::Boolean; }
+    bool IsNumber() const { return type_ == JsonType::Number; }
+    bool IsString() const { return type_ == JsonType::String; }
+    bool IsArray() const { return type_ == JsonType::Array; }
+    bool IsObject() const { return type_ == JsonType::Object; }
+
+    /**
+     * @return The value, or def if this is not a boolean
+     */
+    bool GetBoolean(bool def = false) const { return type_ == JsonType::Boolean ? bool_ : def; }
+
+    /**
+     * @return The value, or def if this is not a number
+     */
+    double GetNumber(double def = 0) const { return type_ == JsonType::Number ? number_ : def; }
+
+    /**
+     * @brief UTF-8 text of a string (empty for other types)
+     */
+    const std::string& GetUtf8() const { return string_; }
+
+    /**
+     * @return The text, or def if this is not a string
+     */
+    std::wstring GetString(std::wstring_view def = {}) const;
+
+    /**
+     * @brief Member of an object
+     * @return Member value, or nullptr if this is not an object or has no such key
+     */
+    const JsonValue* Find(std::string_view key) const;
+    bool HasKey(std::string_view key) const { return Find(key) != nullptr; }
+
+    /**
+     * @brief Member of an object, or a null value if it is missing
+     */
+    const JsonValue& operator[](std::string_view key) const;
+
+    std::wstring GetNamedString(std::string_view key, std::wstring_view def = {}) const;
+    double GetNamedNumber(std::string_view key, double def) const;
+    bool GetNamedBoolean(std::string_view key, bool def) const;
+
+    /**
+     * @brief Add or replace an object member (a null value becomes an object first)
+     * @return The stored member value
+     */
+    JsonValue& Set(std::string_view key, JsonValue value);
+
+    /**
+     * @brief Members of an object in document order (empty for other types)
+     */
+    const std::vector<Member>& Members() const { return members_; }
+
+    /**
+     * @brief Elements of an array (empty for other types)
+     */
+    const std::vector<JsonValue>& Items() const { return items_; }
+
+    /**
+     * @brief Append an array element (a null value becomes an array first)
+     * @return The stored element
+     */
+    JsonValue& Append(JsonValue value);
+
+    /**
+     * @brief Compact JSON text (UTF-8)
+     */
+    std::string Stringify() const;
+
+private:
+    void StringifyTo(std::string& out) const;
+
+    JsonType type_{JsonType::Null};
+    bool bool_{};
+    double number_{};
+    std::string string_;
+    std::vector<JsonValue> items_;
+    std::vector<Member> members_;
+};
@@ -8,14 +8,39 @@
  */
 
 #include "clipboard_processor.h"
+#include "clipboard_prefetch.h"
+#include "base64.h"
+#include "cancel_token.h"
+#include "filter_config.h"
+#include "filter_engine.h"
+#include "http_client.h"
+#include "image_scale.h"
+#include "api_payload.h"
+#include "job_queue.h"
+#include "json_value.h"
+#include "rate_limit.h"
+#include "response_cache.h"
+#include "string_table.h"
+#include "template_render.h"
+#include "trace.h"
+#include "typed_output.h"
+#include "usage_stats.h"
 
 #include <cwctype>
 #include <cstring>
 #include <string>
 #include <vector>
 #include <cstdio>
+#include <chrono>
 #include <regex>
 #include <format>
+#include <functional>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+#include <memory>
+#include <map>
+#include <set>
 #include "resource.h"
 #include <windows.h>
 #include <objidl.h>
@@ -26,9 +51,8 @@
 #include <gdiplus.h>
 #include <wincrypt.h>
 #include <shlobj.h>
+#include <commdlg.h>
 #include <winrt/base.h>
-#include <winrt/Windows.Foundation.Collections.h>
-#include <winrt/Windows.Data.Json.h>
 
 using namespace std;
 
@@ -41,6 +65,7 @@ constexpr wchar_t kProgressClass[] = L"CbFilterProgress";  // Progress window
 constexpr wchar_t kSetupClass[] = L"CbFilterSetup";        // First-run setup dialog
 constexpr wchar_t kHotkeyInputClass[] = L"CbFilterHotkeyInput"; // Hotkey input dialog
 constexpr wchar_t kFilterMenuClass[] = L"CbFilterMenu";    // Filter menu window
+constexpr wchar_t kStatsClass[] = L"CbFilterStats";        // Usage statistics window
 
 // Hotkey identifier
 constexpr int HOTKEY_ID = 1;
@@ -49,12 +74,27 @@ constexpr int HOTKEY_ID = 1;
 UINT g_hotkeyModifiers = MOD_WIN | MOD_ALT;  // Default: Win+Alt
 UINT g_hotkeyKey = 'V';                       // Default: V key
 wstring g_language = L"ja";              // Default language: Japanese
+bool g_cacheEnabled = true;                   // Response cache on/off
+unsigned long long g_cacheMaxMegabytes = 64;  // Response cache size limit
+bool g_traceEnabled = false;                  // Write a Chrome trace file per filter job
+size_t g_jobWorkers = 4;                      // Filter jobs running at once
+size_t g_jobProviderLimit = 2;                // Default concurrent jobs per API provider
+map<wstring, size_t> g_jobProviderLimits;     // Per-provider overrides
+bool g_jobOrdered = true;                     // Deliver results in submission order
+bool g_prefetchEnabled = false;               // Pre-process clipboard content on every copy
+size_t g_prefetchMaxMegabytes = 64;           // Memory budget of one clipboard snapshot
+bool g_prewarmEnabled = true;                 // Connect and encode while the filter menu is open
+TypingOptions g_typingOptions;                // Batching and pacing of typed filter output
+bool g_statsEnabled = true;                   // Record token usage and latency of every request
+size_t g_statsMaxRecords = 10000;             // Usage records kept in usage.csv
+UsageStats g_usageStats;                      // Usage records (written from worker threads)
 
 // Custom window messages
 constexpr UINT WM_APP_TRAY = WM_APP + 10;  // System tray notification message
-constexpr UINT WM_APP_FILTER_COMPLETE = WM_APP + 11;  // Filter execution complete message
+constexpr UINT WM_APP_FILTER_COMPLETE = WM_APP + 11;  // Filter job complete (sent to main window, lParam = job id)
 constexpr UINT WM_APP_MENU_CLOSE = WM_APP + 12;  // Filter menu close message (sent to parent)
 constexpr UINT WM_APP_MENU_SELECTED = WM_APP + 13;  // Filter menu item selected (sent to menu window itself)
+constexpr UINT WM_APP_FILTER_PARTIAL = WM_APP + 14;  // Streamed partial result available (sent to progress window)
 
 // Timer ID for progress window
 constexpr UINT_PTR TIMER_ID_PROGRESS = 1;
@@ -70,13 +110,21 @@ constexpr int IDC_BTN_EDIT = 303;
 constexpr int IDC_BTN_DELETE = 304;
 constexpr int IDC_BTN_COPY = 305;
 constexpr int IDC_BTN_CLOSE = 306;
+constexpr int IDC_BTN_STATS = 308;
+
+// Control IDs for usage statistics window
+constexpr int IDC_STATS_GROUP = 401;
+constexpr int IDC_STATS_LIST = 402;
+constexpr int IDC_STATS_EXPORT = 403;
+constexpr int IDC_STATS_CLEAR = 404;
+constexpr int IDC_STATS_CLOSE = 405;
 
 // Global application state
 HINSTANCE g_hInst = nullptr;              // Application instance handle
 HWND g_settingsWnd = nullptr;             // Settings window handle
+HWND g_statsWnd = nullptr;                // Usage statistics window handle
 HWND g_editWnd = nullptr;                 // Filter edit dialog handle
 HWND g_modelWnd = nullptr;                // Model configuration dialog handle
-HWND g_progressWnd = nullptr;             // Progress window handle
 HWND g_filterMenuWnd = nullptr;           // Filter menu window handle
 WNDPROC g_promptOldProc = nullptr;        // Original window procedure for prompt edit control
 WNDPROC g_listOldProc = nullptr;          // Original window procedure for list view control
@@ -85,62 +133,6 @@ const wchar_t kCtrlAProp[] = L"cbfilter_oldproc_ctrlA";
 HFONT GetUIFont();
 void SetUIFont(HWND hwnd);
 
-/**
- * @enum IOType
- * @brief Input/output type for filter operations
- */
-enum class IOType { Text, Image };
-
-/**
- * @struct ModelConfig
- * @brief Configuration for an AI model endpoint
- */
-struct ModelConfig {
-    wstring name;        // Display name for the model
-    wstring serverUrl;   // API server URL (e.g., https://api.openai.com/v1)
-    wstring modelName;   // Model identifier (e.g., gpt-4o-mini)
-    wstring apiKey;      // API authentication key
-    wstring providerId;  // API provider id
-};
-
-/**
- * @struct FilterDefinition
- * @brief Definition of a clipboard transformation filter
- */
-struct FilterDefinition {
-    wstring title;      // Display name for the filter
-    IOType input;            // Input type (Text or Image)
-    IOType output;           // Output type (Text or Image)
-    size_t modelIndex;       // Index into g_models vector
-    wstring prompt;     // Prompt text to send to the AI model
-};
-
-/**
- * @struct TemplateDefinition
- * @brief API request template definition loaded from apidef/<provider>.json
- */
-struct TemplateDefinition {
-    wstring id;
-    wstring providerId;
-    IOType input;
-    IOType output;
-    wstring endpoint;
-    wstring resultPath;
-    vector<pair<wstring, wstring>> headers; // key/value with placeholders
-    wstring payload;                                        // JSON text with placeholders
-};
-
-struct ApiProvider {
-    wstring id;
-    wstring defaultEndpoint;
-    vector<TemplateDefinition> templates;
-    wstring modelsEndpoint;
-    wstring modelsMethod;
-    vector<pair<wstring, wstring>> modelsHeaders;
-    wstring modelsPayload;
-    wstring modelsResultPath;
-};
-
 // Global model configurations (loaded from config.ini on startup)
 vector<ModelConfig> g_models {
     {L"Translate", L"https://api.openai.com/v1", L"gpt-5.1", L"You are a translator.", L"OpenAI"},
@@ -149,8 +141,8 @@ vector<ModelConfig> g_models {
 // Global filter definitions (loaded from config.ini on startup)
 // Note: Default filter titles will be loaded from language resources after LoadConfig()
 vector<FilterDefinition> g_filters;
-// API providers (loaded from apidef/*.json)
-vector<ApiProvider> g_providers;
+// API providers (loaded from apidef/*.json) and the request pipeline that uses them
+FilterEngine g_engine;
 
 /**
  * @brief Convert IOType enum to display string
@@ -168,72 +160,33 @@ wstring GetLangPath() {
     path += L"lang.ini"; return path;
 }
 
+StringTable g_strings;  // lang.ini section of g_language (UI thread only)
+
+/**
+ * @brief Parse the g_language section of lang.ini into g_strings
+ */
+void LoadStrings() {
+    string content;
+    FILE* fp = nullptr;
+    if (_wfopen_s(&fp, GetLangPath().c_str(), L"rb") == 0 && fp) {
+        char buf[4096];
+        for (size_t n; (n = fread(buf, 1, sizeof(buf), fp)) > 0;) content.append(buf, n);
+        fclose(fp);
+    }
+    // A missing file still yields a table for the language, so every key falls back to itself
+    g_strings.Load(content, g_language);
+}
+
 /**
  * @brief Get localized string from language resource file (UTF-8 encoded)
  * @param key String key to look up
  * @return Localized string, or key itself if not found
+ *
+ * lang.ini is parsed once per language; lookups are hash lookups that do not allocate.
  */
-wstring GetString(const wstring& key) {
-    wstring langPath = GetLangPath();
-    // Read file as UTF-8
-    FILE* fp = nullptr;
-    if (_wfopen_s(&fp, langPath.c_str(), L"r, ccs=UTF-8") != 0 || !fp) {
-        return key; // Return key if file cannot be opened
-    }
-    
-    wstring section = g_language;
-    wstring result = key; // Default to key if not found
-    bool inTargetSection = false;
-    wchar_t line[2048];
-    
-    while (fgetws(line, 2048, fp)) {
-        // Remove trailing newline
-        size_t len = wcslen(line);
-        if (len > 0 && line[len - 1] == L'\n') {
-            line[len - 1] = L'\0';
-            if (len > 1 && line[len - 2] == L'\r') line[len - 2] = L'\0';
-        }
-        
-        // Skip empty lines and comments
-        if (line[0] == L'\0' || line[0] == L';') continue;
-        
-        // Check for section header [section]
-        if (line[0] == L'[') {
-            size_t end = wcscspn(line + 1, L"]");
-            if (end > 0 && line[end + 1] == L']') {
-                wchar_t sec[256];
-                wcsncpy_s(sec, line + 1, end);
-                sec[end] = L'\0';
-                inTargetSection = (wcscmp(sec, section.c_str()) == 0);
-            }
-            continue;
-        }
-        
-        // Parse key=value if in target section
-        if (inTargetSection) {
-            wchar_t* eq = wcschr(line, L'=');
-            if (eq) {
-                *eq = L'\0';
-                // Trim whitespace from key
-                wchar_t* keyStart = line;
-                while (*keyStart == L' ' || *keyStart == L'\t') keyStart++;
-                wchar_t* keyEnd = keyStart + wcslen(keyStart) - 1;
-                while (keyEnd > keyStart && (*keyEnd == L' ' || *keyEnd == L'\t')) keyEnd--;
-                *(keyEnd + 1) = L'\0';
-                
-                if (wcscmp(keyStart, key.c_str()) == 0) {
-                    // Found the key, get the value
-                    wchar_t* valueStart = eq + 1;
-                    while (*valueStart == L' ' || *valueStart == L'\t') valueStart++;
-                    result = valueStart;
-                    break;
-                }
-            }
-        }
-    }
-    
-    fclose(fp);
-    return result;
+const wstring& GetString(wstring_view key) {
+    if (g_strings.Language() != g_language) LoadStrings();
+    return g_strings.Get(key);
 }
 
 wstring GetDefaultLanguageCode() {
@@ -419,26 +372,11 @@ void LogLine(const wstring& msg) {
 #endif
 
 /**
- * @brief Read UTF-8 text file into wide string
- */
-wstring ReadUtf8File(const wstring& path) {
-    FILE* fp = nullptr;
-    if (_wfopen_s(&fp, path.c_str(), L"rb") != 0 || !fp) return L"";
-    fseek(fp, 0, SEEK_END);
-    long size = ftell(fp);
-    fseek(fp, 0, SEEK_SET);
-    string buf; if (size > 0) { buf.resize(size); fread(&buf[0], 1, size, fp); }
-    fclose(fp);
-    return FromUtf8(buf);
-}
-
-/**
- * @brief Write wide string as UTF-8 file (overwrite)
+ * @brief Write UTF-8 text to a file (overwrite)
  */
-bool WriteUtf8File(const wstring& path, const wstring& content) {
+bool WriteUtf8File(const wstring& path, string_view utf8) {
     FILE* fp = nullptr;
     if (_wfopen_s(&fp, path.c_str(), L"wb") != 0 || !fp) return false;
-    string utf8 = ToUtf8(content);
     if (!utf8.empty()) fwrite(utf8.data(), 1, utf8.size(), fp);
     fclose(fp);
     return true;
@@ -453,179 +391,22 @@ wstring ReplaceAll(wstring s, const wstring& from, const wstring& to) {
     return s;
 }
 
-wstring JsonEscape(const wstring& s) {
-    wstring out;
-    for (wchar_t c : s) {
-        switch (c) {
-        case L'\\': out += L"\\\\"; break;
-        case L'"': out += L"\\\""; break;
-        case L'\n': out += L"\\n"; break;
-        case L'\r': out += L"\\r"; break;
-        case L'\t': out += L"\\t"; break;
-        default: out += c; break;
-        }
-    }
-    return out;
-}
-
-wstring ReplacePlaceholders(const wstring& src, const ModelConfig& m, const wstring& systemPrompt, const wstring& prompt, const wstring& imageB64, const wstring& imageDataUrl, bool jsonEsc) {
-    auto esc = [&](const wstring& v) { return jsonEsc ? JsonEscape(v) : v; };
-    wstring out = src;
-    out = ReplaceAll(out, L"<<model>>", esc(m.modelName));
-    out = ReplaceAll(out, L"<<system_prompt>>", esc(systemPrompt));
-    out = ReplaceAll(out, L"<<prompt>>", esc(prompt));
-    out = ReplaceAll(out, L"<<input_text>>", esc(prompt));
-    out = ReplaceAll(out, L"<<api_key>>", esc(m.apiKey));
-    out = ReplaceAll(out, L"<<image_url>>", esc(imageDataUrl));
-    out = ReplaceAll(out, L"<<image>>", esc(imageB64));
-    return out;
-}
-
-bool ContainsNoCase(const wstring& hay, const wstring& needle) {
-    auto toLow = [](wstring s) { for (auto& c : s) c = static_cast<wchar_t>(towlower(c)); return s; };
-    return toLow(hay).find(toLow(needle)) != wstring::npos;
-}
-
-IOType ParseIOType(const wstring& s) {
-    wstring lower = s;
-    for (auto& c : lower) c = static_cast<wchar_t>(towlower(c));
-    return (lower == L"image") ? IOType::Image : IOType::Text;
-}
-wstring IOTypeToConfig(IOType t) { return t == IOType::Image ? L"image" : L"text"; }
-
-const TemplateDefinition* FindTemplateById(const wstring& id) {
-    for (const auto& p : g_providers) {
-        for (const auto& t : p.templates) if (t.id == id) return &t;
-    }
-    return nullptr;
-}
-
-wstring NormalizeProviderId(const wstring& raw) {
-    if (raw.empty()) return raw;
-    size_t pos = raw.find(L'-');
-    if (pos != wstring::npos) return raw.substr(0, pos);
-    return raw;
-}
-
-const ApiProvider* FindProviderById(const wstring& id) {
-    for (const auto& p : g_providers) if (p.id == id) return &p;
-    return nullptr;
-}
-
-/**
- * @brief Find a template by input and output type
- * @param provider API provider
- * @param input Input type
- * @param output Output type
- * @return Template definition, or nullptr if not found
- */
-const TemplateDefinition* FindTemplateByIO(const ApiProvider& provider, IOType input, IOType output) {
-    for (const auto& t : provider.templates) if (t.input == input && t.output == output) return &t;
-    return nullptr;
-}
-
-/**
- * @brief Find a template by input and output type
- * @param input Input type
- * @param output Output type
- * @return Template definition, or nullptr if not found
- */
-const TemplateDefinition* FindTemplateAny(IOType input, IOType output) {
-    for (const auto& p : g_providers) {
-        if (const auto* t = FindTemplateByIO(p, input, output)) return t;
-    }
-    return nullptr;
-}
-
 /**
  * @brief Ensure model providers are set
  */
 void EnsureModelProviders() {
-    if (g_providers.empty()) return;
-    const wstring first = g_providers.front().id;
-    for (auto& m : g_models) if (m.providerId.empty()) m.providerId = first;
+    EnsureModelProviders(g_models, g_engine.Providers());
 }
 
 /**
  * @brief Load API definitions from JSON files
  */
 void LoadApiDefinitions() {
-    using namespace winrt::Windows::Data::Json;
-    g_providers.clear();
     vector<ApiProvider> providers;
-    wstring dir = GetApiDefDirectory();
-    wstring pattern = dir + L"*.json";
-    WIN32_FIND_DATAW fd{};
-    HANDLE hFind = FindFirstFileW(pattern.c_str(), &fd);
-    if (hFind == INVALID_HANDLE_VALUE) {
-        LogLine(L"apidef directory missing or empty: " + dir);
-        return;
-    }
-    do {
-        if (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) continue;
-        wstring fileName = fd.cFileName;
-        wstring fullPath = dir + fileName;
-        wstring text = ReadUtf8File(fullPath);
-        if (text.empty()) { LogLine(L"apidef file missing or empty: " + fullPath); continue; }
-        try {
-            JsonObject root = JsonObject::Parse(text);
-            ApiProvider provider{};
-            size_t dot = fileName.find_last_of(L'.');
-            provider.id = (dot == wstring::npos) ? fileName : fileName.substr(0, dot);
-            if (root.HasKey(L"default-endpoint")) provider.defaultEndpoint = wstring(root.GetNamedString(L"default-endpoint", L"").c_str());
-            for (auto const& kv : root) {
-                if (kv.Key() == L"models") {
-                    if (kv.Value().ValueType() != JsonValueType::Object) continue;
-                    JsonObject mobj = kv.Value().GetObject();
-                    provider.modelsEndpoint = wstring(mobj.GetNamedString(L"endpoint", L"").c_str());
-                    provider.modelsMethod = wstring(mobj.GetNamedString(L"method", L"GET").c_str());
-                    provider.modelsResultPath = wstring(mobj.GetNamedString(L"result", L"data").c_str());
-                    if (mobj.HasKey(L"headers")) {
-                        JsonObject h = mobj.GetNamedObject(L"headers");
-                        for (auto const& hk : h) provider.modelsHeaders.push_back({ wstring(hk.Key().c_str()), wstring(hk.Value().GetString().c_str()) });
-                    }
-                    if (mobj.HasKey(L"payload")) {
-                        JsonValue val = mobj.GetNamedValue(L"payload");
-                        provider.modelsPayload = val.Stringify().c_str();
-                    }
-                    continue;
-                }
-                if (kv.Value().ValueType() != JsonValueType::Object) continue;
-                wstring key = kv.Key().c_str();
-                JsonObject obj = kv.Value().GetObject();
-                TemplateDefinition t{};
-                t.id = key;
-                t.providerId = provider.id;
-                size_t sep = key.find(L'-');
-                wstring in = sep == wstring::npos ? key : key.substr(0, sep);
-                wstring out = sep == wstring::npos ? key : key.substr(sep + 1);
-                t.input = ParseIOType(in);
-                t.output = ParseIOType(out);
-                t.endpoint = wstring(obj.GetNamedString(L"endpoint", L"/").c_str());
-                t.resultPath = wstring(obj.GetNamedString(L"result", L"").c_str());
-                if (obj.HasKey(L"headers")) {
-                    JsonObject h = obj.GetNamedObject(L"headers");
-                    for (auto const& hk : h) {
-                        t.headers.push_back({ wstring(hk.Key().c_str()), wstring(hk.Value().GetString().c_str()) });
-                    }
-                }
-                if (obj.HasKey(L"payload")) {
-                    JsonValue val = obj.GetNamedValue(L"payload");
-                    t.payload = val.Stringify().c_str();
-                }
-                if (!t.id.empty()) provider.templates.push_back(move(t));
-            }
-            if (!provider.id.empty() && !provider.templates.empty()) providers.push_back(move(provider));
-        } catch (const winrt::hresult_error& e) {
-            wstring msg = L"LoadApiDefinitions parse failed for ";
-            msg += fullPath;
-            msg += L": ";
-            msg += e.message().c_str();
-            LogLine(msg);
-        }
-    } while (FindNextFileW(hFind, &fd));
-    FindClose(hFind);
-    if (!providers.empty()) g_providers = move(providers);
+    vector<wstring> errors;
+    bool loaded = LoadApiProviders(filesystem::path(GetApiDefDirectory()), providers, errors);
+    for (const wstring& e : errors) LogLine(e);
+    if (loaded) g_engine.SetProviders(move(providers));
 }
 
 struct ApiCallResult { wstring text; HBITMAP image{}; };
@@ -643,21 +424,9 @@ wstring ProtectApiKey(const wstring& plain) {
         LogLine(L"CryptProtectData failed: " + to_wstring(GetLastError()));
         return L"";
     }
-    DWORD b64Len = 0;
-    if (!CryptBinaryToStringW(out.pbData, out.cbData, CRYPT_STRING_BASE64 | CRYPT_STRING_NOCRLF, nullptr, &b64Len)) {
-        LocalFree(out.pbData);
-        LogLine(L"CryptBinaryToStringW length failed: " + to_wstring(GetLastError()));
-        return L"";
-    }
-    wstring b64(b64Len, L'\0');
-    if (!CryptBinaryToStringW(out.pbData, out.cbData, CRYPT_STRING_BASE64 | CRYPT_STRING_NOCRLF, b64.data(), &b64Len)) {
-        LocalFree(out.pbData);
-        LogLine(L"CryptBinaryToStringW failed: " + to_wstring(GetLastError()));
-        return L"";
-    }
+    string b64 = Base64Encode(out.pbData, out.cbData);
     LocalFree(out.pbData);
-    b64.resize(b64Len);
-    return L"dpapi:" + b64;
+    return L"dpapi:" + wstring(b64.begin(), b64.end());
 }
 
 /**
@@ -670,18 +439,12 @@ wstring UnprotectApiKey(const wstring& stored) {
     constexpr wchar_t kPrefix[] = L"dpapi:";
     const wstring prefix = kPrefix;
     if (stored.rfind(prefix, 0) != 0) return stored;  // Legacy plaintext
-    wstring b64 = stored.substr(prefix.size());
-    DWORD binSize = 0;
-    if (!CryptStringToBinaryW(b64.c_str(), 0, CRYPT_STRING_BASE64, nullptr, &binSize, nullptr, nullptr)) {
-        LogLine(L"CryptStringToBinaryW length failed: " + to_wstring(GetLastError()));
-        return L"";
-    }
-    vector<BYTE> buf(binSize);
-    if (!CryptStringToBinaryW(b64.c_str(), 0, CRYPT_STRING_BASE64, buf.data(), &binSize, nullptr, nullptr)) {
-        LogLine(L"CryptStringToBinaryW failed: " + to_wstring(GetLastError()));
+    vector<uint8_t> buf;
+    if (!Base64Decode(wstring_view(stored).substr(prefix.size()), buf)) {
+        LogLine(L"Base64Decode failed for stored API key");
         return L"";
     }
-    DATA_BLOB in{ binSize, buf.data() };
+    DATA_BLOB in{ static_cast<DWORD>(buf.size()), buf.data() };
     DATA_BLOB out{};
     if (!CryptUnprotectData(&in, nullptr, nullptr, nullptr, nullptr, CRYPTPROTECT_UI_FORBIDDEN, &out)) {
         LogLine(L"CryptUnprotectData failed: " + to_wstring(GetLastError()));
@@ -700,44 +463,36 @@ wstring UnprotectApiKey(const wstring& stored) {
 /**
  * @brief Create default configuration for first run
  */
- winrt::Windows::Data::Json::JsonObject CreateDefaultConfig() {
-    using namespace winrt::Windows::Data::Json;
+JsonValue CreateDefaultConfig() {
     wstring defPath = GetDefaultConfigPath();
-    wstring text = ReadUtf8File(defPath);
-    if (!text.empty()) {
-        try {
-            return JsonObject::Parse(text);
-        } catch (const winrt::hresult_error& e) {
-            wstring msg = L"defconf.json parse failed: ";
-            msg += e.message().c_str();
-            LogLine(msg);
-        }
+    string text;
+    if (ReadFileBytes(filesystem::path(defPath), text) && !text.empty()) {
+        JsonValue root;
+        string err;
+        if (JsonValue::Parse(text, root, &err) && root.IsObject()) return root;
+        LogLine(L"defconf.json parse failed: " + FromUtf8(err));
     } else {
         LogLine(L"defconf.json missing or empty: " + defPath);
     }
-    JsonObject fallback;
-    fallback.SetNamedValue(L"language", JsonValue::CreateStringValue(L"en"));
-    JsonObject hotkey;
-    hotkey.SetNamedValue(L"modifiers", JsonValue::CreateNumberValue(static_cast<double>(MOD_WIN | MOD_ALT)));
-    hotkey.SetNamedValue(L"key", JsonValue::CreateNumberValue(static_cast<double>('V')));
-    fallback.SetNamedValue(L"hotkey", hotkey);
-    JsonArray models;
-    JsonObject model;
-    model.SetNamedValue(L"name", JsonValue::CreateStringValue(L"Translate"));
-    model.SetNamedValue(L"serverUrl", JsonValue::CreateStringValue(L"https://api.openai.com/v1"));
-    model.SetNamedValue(L"modelName", JsonValue::CreateStringValue(L"gpt-5.1"));
-    model.SetNamedValue(L"providerId", JsonValue::CreateStringValue(L"OpenAI"));
-    models.Append(model);
-    fallback.SetNamedValue(L"models", models);
-    JsonArray filters;
-    JsonObject filter;
-    filter.SetNamedValue(L"title", JsonValue::CreateStringValue(L"Translate"));
-    filter.SetNamedValue(L"input", JsonValue::CreateStringValue(L"text"));
-    filter.SetNamedValue(L"output", JsonValue::CreateStringValue(L"text"));
-    filter.SetNamedValue(L"modelIndex", JsonValue::CreateNumberValue(static_cast<double>(0)));
-    filter.SetNamedValue(L"prompt", JsonValue::CreateStringValue(L"Translate into English."));
-    filters.Append(filter);
-    fallback.SetNamedValue(L"filters", filters);
+    JsonValue fallback = JsonValue::Object();
+    fallback.Set("language", JsonValue::String(L"en"));
+    JsonValue hotkey = JsonValue::Object();
+    hotkey.Set("modifiers", JsonValue::Number(static_cast<double>(MOD_WIN | MOD_ALT)));
+    hotkey.Set("key", JsonValue::Number(static_cast<double>('V')));
+    fallback.Set("hotkey", move(hotkey));
+    JsonValue model = JsonValue::Object();
+    model.Set("name", JsonValue::String(L"Translate"));
+    model.Set("serverUrl", JsonValue::String(L"https://api.openai.com/v1"));
+    model.Set("modelName", JsonValue::String(L"gpt-5.1"));
+    model.Set("providerId", JsonValue::String(L"OpenAI"));
+    fallback.Set("models", JsonValue::Array()).Append(move(model));
+    JsonValue filter = JsonValue::Object();
+    filter.Set("title", JsonValue::String(L"Translate"));
+    filter.Set("input", JsonValue::String(L"text"));
+    filter.Set("output", JsonValue::String(L"text"));
+    filter.Set("modelIndex", JsonValue::Number(0));
+    filter.Set("prompt", JsonValue::String(L"Translate into English."));
+    fallback.Set("filters", JsonValue::Array()).Append(move(filter));
     return fallback;
 }
 
@@ -745,162 +500,214 @@ wstring UnprotectApiKey(const wstring& stored) {
  * @brief Save current model and filter configurations to config.json
  */
 void SaveConfig() {
-    using namespace winrt::Windows::Data::Json;
     wstring cfg = GetConfigPath();
     EnsureModelProviders();
-    JsonObject root;
-    root.SetNamedValue(L"language", JsonValue::CreateStringValue(g_language));
-    JsonObject hotkey;
-    hotkey.SetNamedValue(L"modifiers", JsonValue::CreateNumberValue(static_cast<double>(g_hotkeyModifiers)));
-    hotkey.SetNamedValue(L"key", JsonValue::CreateNumberValue(static_cast<double>(g_hotkeyKey)));
-    root.SetNamedValue(L"hotkey", hotkey);
-
-    JsonArray models;
-    for (const auto& m : g_models) {
-        JsonObject obj;
-        obj.SetNamedValue(L"name", JsonValue::CreateStringValue(m.name));
-        obj.SetNamedValue(L"serverUrl", JsonValue::CreateStringValue(m.serverUrl));
-        obj.SetNamedValue(L"modelName", JsonValue::CreateStringValue(m.modelName));
-        obj.SetNamedValue(L"providerId", JsonValue::CreateStringValue(m.providerId));
-        wstring protectedKey = ProtectApiKey(m.apiKey);
-        if (protectedKey.empty() && !m.apiKey.empty()) protectedKey = m.apiKey;  // Fallback to avoid losing key
-        obj.SetNamedValue(L"apiKey", JsonValue::CreateStringValue(protectedKey));
-        models.Append(obj);
-    }
-    root.SetNamedValue(L"models", models);
-
-    JsonArray filters;
-    for (const auto& f : g_filters) {
-        JsonObject obj;
-        obj.SetNamedValue(L"title", JsonValue::CreateStringValue(f.title));
-        obj.SetNamedValue(L"input", JsonValue::CreateStringValue(f.input == IOType::Text ? L"text" : L"image"));
-        obj.SetNamedValue(L"output", JsonValue::CreateStringValue(f.output == IOType::Text ? L"text" : L"image"));
-        obj.SetNamedValue(L"modelIndex", JsonValue::CreateNumberValue(static_cast<double>(f.modelIndex)));
-        obj.SetNamedValue(L"prompt", JsonValue::CreateStringValue(f.prompt));
-        filters.Append(obj);
-    }
-    root.SetNamedValue(L"filters", filters);
-
-    wstring jsonText = root.Stringify().c_str();
-    if (!WriteUtf8File(cfg, jsonText)) {
+    JsonValue root = JsonValue::Object();
+    root.Set("language", JsonValue::String(g_language));
+    JsonValue hotkey = JsonValue::Object();
+    hotkey.Set("modifiers", JsonValue::Number(static_cast<double>(g_hotkeyModifiers)));
+    hotkey.Set("key", JsonValue::Number(static_cast<double>(g_hotkeyKey)));
+    root.Set("hotkey", move(hotkey));
+    JsonValue cache = JsonValue::Object();
+    cache.Set("enabled", JsonValue::Boolean(g_cacheEnabled));
+    cache.Set("maxMegabytes", JsonValue::Number(static_cast<double>(g_cacheMaxMegabytes)));
+    root.Set("cache", move(cache));
+    JsonValue jobs = JsonValue::Object();
+    jobs.Set("workers", JsonValue::Number(static_cast<double>(g_jobWorkers)));
+    jobs.Set("perProvider", JsonValue::Number(static_cast<double>(g_jobProviderLimit)));
+    JsonValue providerLimits = JsonValue::Object();
+    for (const auto& [id, limit] : g_jobProviderLimits) providerLimits.Set(ToUtf8(id), JsonValue::Number(static_cast<double>(limit)));
+    jobs.Set("providers", move(providerLimits));
+    jobs.Set("delivery", JsonValue::String(g_jobOrdered ? L"ordered" : L"arrival"));
+    root.Set("jobs", move(jobs));
+    JsonValue prefetch = JsonValue::Object();
+    prefetch.Set("enabled", JsonValue::Boolean(g_prefetchEnabled));
+    prefetch.Set("maxMegabytes", JsonValue::Number(static_cast<double>(g_prefetchMaxMegabytes)));
+    root.Set("prefetch", move(prefetch));
+    root.Set("prewarm", JsonValue::Boolean(g_prewarmEnabled));
+    JsonValue typing = JsonValue::Object();
+    typing.Set("maxBatch", JsonValue::Number(static_cast<double>(g_typingOptions.maxBatch)));
+    typing.Set("intervalMs", JsonValue::Number(g_typingOptions.intervalMs));
+    typing.Set("charsPerSecond", JsonValue::Number(g_typingOptions.charsPerSecond));
+    root.Set("typing", move(typing));
+    JsonValue stats = JsonValue::Object();
+    stats.Set("enabled", JsonValue::Boolean(g_statsEnabled));
+    stats.Set("maxRecords", JsonValue::Number(static_cast<double>(g_statsMaxRecords)));
+    root.Set("stats", move(stats));
+    root.Set("trace", JsonValue::Boolean(g_traceEnabled));
+    root.Set("models", ModelsToJson(g_models, [](const wstring& plain) {
+        wstring protectedKey = ProtectApiKey(plain);
+        return protectedKey.empty() ? plain : protectedKey;  // Fallback to avoid losing key
+    }));
+    root.Set("filters", FiltersToJson(g_filters));
+
+    if (!WriteUtf8File(cfg, root.Stringify())) {
         LogLine(L"Failed to write config to " + cfg);
     }
 }
 
-/**
- * @brief Load filters from JSON object
- * @param root JSON object
- * @param target Vector to store filter definitions
- */
-void LoadFiltersFromJson(const winrt::Windows::Data::Json::JsonObject& root, vector<FilterDefinition>& target) {
-    using namespace winrt::Windows::Data::Json;
-    if (!root.HasKey(L"filters")) return;
-    vector<FilterDefinition> v;
-    for (auto const& item : root.GetNamedArray(L"filters")) {
-        if (item.ValueType() != JsonValueType::Object) continue;
-        JsonObject obj = item.GetObject();
-        FilterDefinition f{};
-        f.title = wstring(obj.GetNamedString(L"title", L"").c_str());
-        wstring input = wstring(obj.GetNamedString(L"input", L"text").c_str());
-        wstring output = wstring(obj.GetNamedString(L"output", L"text").c_str());
-        f.input = ParseIOType(input);
-        f.output = ParseIOType(output);
-        f.modelIndex = static_cast<size_t>(obj.GetNamedNumber(L"modelIndex", 0));
-        f.prompt = wstring(obj.GetNamedString(L"prompt", L"").c_str());
-        if (!f.title.empty()) v.push_back(move(f));
-    }
-    if (!v.empty()) target = move(v);
-}
-
 /**
  * @brief Load model and filter configurations from config.json
  */
 void LoadConfig() {
-    using namespace winrt::Windows::Data::Json;
     wstring cfg = GetConfigPath();
-    try {
-        JsonObject root = FileExists(cfg) ? JsonObject::Parse(ReadUtf8File(cfg)) : CreateDefaultConfig();
-        if (root.HasKey(L"language")) g_language = wstring(root.GetNamedString(L"language").c_str());
-        if (root.HasKey(L"hotkey")) {
-            JsonObject hotkey = root.GetNamedObject(L"hotkey");
-            g_hotkeyModifiers = static_cast<UINT>(hotkey.GetNamedNumber(L"modifiers", g_hotkeyModifiers));
-            g_hotkeyKey = static_cast<UINT>(hotkey.GetNamedNumber(L"key", g_hotkeyKey));
-        }
-        if (root.HasKey(L"models")) {
-            vector<ModelConfig> v;
-            for (auto const& item : root.GetNamedArray(L"models")) {
-                if (item.ValueType() != JsonValueType::Object) continue;
-                JsonObject obj = item.GetObject();
-                ModelConfig m{};
-                m.name = wstring(obj.GetNamedString(L"name", L"").c_str());
-                m.serverUrl = wstring(obj.GetNamedString(L"serverUrl", L"").c_str());
-                m.modelName = wstring(obj.GetNamedString(L"modelName", L"").c_str());
-                wstring provider = wstring(obj.GetNamedString(L"providerId", L"").c_str());
-                m.providerId = NormalizeProviderId(provider);
-                m.apiKey = UnprotectApiKey(wstring(obj.GetNamedString(L"apiKey", L"").c_str()));
-                if (!m.name.empty()) v.push_back(move(m));
-            }
-            if (!v.empty()) g_models = move(v);
+    JsonValue root;
+    if (FileExists(cfg)) {
+        string text, err;
+        if (!ReadFileBytes(filesystem::path(cfg), text) || !JsonValue::Parse(text, root, &err) || !root.IsObject()) {
+            LogLine(L"LoadConfig JSON parse failed: " + FromUtf8(err));
+            return;
         }
-        LoadFiltersFromJson(root, g_filters);
-        if (!g_filters.empty()) {
-            for (auto& f : g_filters) if (f.modelIndex >= g_models.size()) f.modelIndex = 0;
-        }
-        EnsureModelProviders();
-    } catch (const winrt::hresult_error& e) {
-        wstring msg = L"LoadConfig JSON parse failed: ";
-        msg += e.message().c_str();
-        LogLine(msg);
-    }
+    } else {
+        root = CreateDefaultConfig();
+    }
+    if (root.HasKey("language")) g_language = root.GetNamedString("language", g_language);
+    if (const JsonValue* hotkey = root.Find("hotkey"); hotkey && hotkey->IsObject()) {
+        g_hotkeyModifiers = static_cast<UINT>(hotkey->GetNamedNumber("modifiers", g_hotkeyModifiers));
+        g_hotkeyKey = static_cast<UINT>(hotkey->GetNamedNumber("key", g_hotkeyKey));
+    }
+    if (const JsonValue* cache = root.Find("cache"); cache && cache->IsObject()) {
+        g_cacheEnabled = cache->GetNamedBoolean("enabled", g_cacheEnabled);
+        g_cacheMaxMegabytes = static_cast<unsigned long long>((std::max)(1.0, cache->GetNamedNumber("maxMegabytes", static_cast<double>(g_cacheMaxMegabytes))));
+    }
+    g_traceEnabled = root.GetNamedBoolean("trace", g_traceEnabled);
+    if (const JsonValue* jobs = root.Find("jobs"); jobs && jobs->IsObject()) {
+        g_jobWorkers = static_cast<size_t>(clamp(jobs->GetNamedNumber("workers", static_cast<double>(g_jobWorkers)), 1.0, 32.0));
+        g_jobProviderLimit = static_cast<size_t>(clamp(jobs->GetNamedNumber("perProvider", static_cast<double>(g_jobProviderLimit)), 1.0, 32.0));
+        for (const auto& [id, limit] : (*jobs)["providers"].Members()) {
+            if (limit.IsNumber()) g_jobProviderLimits[FromUtf8(id)] = static_cast<size_t>(clamp(limit.GetNumber(), 1.0, 32.0));
+        }
+        g_jobOrdered = jobs->GetNamedString("delivery", L"ordered") != L"arrival";
+    }
+    if (const JsonValue* prefetch = root.Find("prefetch"); prefetch && prefetch->IsObject()) {
+        g_prefetchEnabled = prefetch->GetNamedBoolean("enabled", g_prefetchEnabled);
+        g_prefetchMaxMegabytes = static_cast<size_t>(clamp(prefetch->GetNamedNumber("maxMegabytes", static_cast<double>(g_prefetchMaxMegabytes)), 1.0, 1024.0));
+    }
+    g_prewarmEnabled = root.GetNamedBoolean("prewarm", g_prewarmEnabled);
+    if (const JsonValue* typing = root.Find("typing"); typing && typing->IsObject()) {
+        g_typingOptions.maxBatch = static_cast<size_t>(clamp(typing->GetNamedNumber("maxBatch", static_cast<double>(g_typingOptions.maxBatch)), 2.0, 1024.0));
+        g_typingOptions.intervalMs = static_cast<unsigned>(clamp(typing->GetNamedNumber("intervalMs", g_typingOptions.intervalMs), 0.0, 1000.0));
+        g_typingOptions.charsPerSecond = static_cast<unsigned>(clamp(typing->GetNamedNumber("charsPerSecond", g_typingOptions.charsPerSecond), 0.0, 100000.0));
+    }
+    if (const JsonValue* stats = root.Find("stats"); stats && stats->IsObject()) {
+        g_statsEnabled = stats->GetNamedBoolean("enabled", g_statsEnabled);
+        g_statsMaxRecords = static_cast<size_t>(clamp(stats->GetNamedNumber("maxRecords", static_cast<double>(g_statsMaxRecords)), 100.0, 1000000.0));
+    }
+    ParseModels(root, g_models, UnprotectApiKey);
+    ParseFilters(root, g_filters);
+    ValidateFilterModels(g_filters, g_models.size());
+    ValidatePipelines(g_filters);
+    ValidateFanOuts(g_filters);
+    EnsureModelProviders();
 }
 
 /**
- * @brief Get the CLSID for PNG encoder in GDI+
- * @return Pointer to PNG encoder CLSID, or nullptr if not found
+ * @brief Get the CLSID of a GDI+ image encoder
+ * @param mime Encoder MIME type (e.g., image/png)
+ * @return Pointer to encoder CLSID, or nullptr if not found
  */
-const CLSID* GetPngClsid() {
-    static CLSID clsid{};
+const CLSID* GetEncoderClsid(const wchar_t* mime) {
+    static mutex lock;
+    static vector<pair<wstring, CLSID>> encoders;
     static bool init = false;
-    if (init) return clsid == CLSID{} ? nullptr : &clsid;
-    init = true;
-    UINT num = 0, size = 0;
-    if (Gdiplus::GetImageEncodersSize(&num, &size) != Gdiplus::Ok || size == 0) return nullptr;
-    vector<BYTE> buf(size);
-    auto* encoders = reinterpret_cast<Gdiplus::ImageCodecInfo*>(buf.data());
-    if (Gdiplus::GetImageEncoders(num, size, encoders) != Gdiplus::Ok) return nullptr;
-    for (UINT i = 0; i < num; ++i) {
-        if (wcscmp(encoders[i].MimeType, L"image/png") == 0) { clsid = encoders[i].Clsid; return &clsid; }
+    lock_guard<mutex> guard(lock);
+    if (!init) {
+        init = true;
+        UINT num = 0, size = 0;
+        if (Gdiplus::GetImageEncodersSize(&num, &size) != Gdiplus::Ok || size == 0) return nullptr;
+        vector<BYTE> buf(size);
+        auto* info = reinterpret_cast<Gdiplus::ImageCodecInfo*>(buf.data());
+        if (Gdiplus::GetImageEncoders(num, size, info) != Gdiplus::Ok) return nullptr;
+        for (UINT i = 0; i < num; ++i) encoders.emplace_back(info[i].MimeType, info[i].Clsid);
+    }
+    for (const auto& e : encoders) {
+        if (_wcsicmp(e.first.c_str(), mime) == 0) return &e.second;
     }
     return nullptr;
 }
 
 /**
- * @brief Convert a bitmap to base64-encoded PNG string
+ * @brief Downscale a bitmap with the area-averaging resampler
+ * @param src Source bitmap
+ * @param w Target width
+ * @param h Target height
+ * @return New 32bpp bitmap, or nullptr on failure
+ */
+unique_ptr<Gdiplus::Bitmap> DownscaleBitmap(Gdiplus::Bitmap& src, int w, int h) {
+    Gdiplus::Rect srcRect(0, 0, static_cast<INT>(src.GetWidth()), static_cast<INT>(src.GetHeight()));
+    Gdiplus::BitmapData in{};
+    if (src.LockBits(&srcRect, Gdiplus::ImageLockModeRead, PixelFormat32bppARGB, &in) != Gdiplus::Ok) return nullptr;
+    auto dst = make_unique<Gdiplus::Bitmap>(w, h, PixelFormat32bppARGB);
+    Gdiplus::Rect dstRect(0, 0, w, h);
+    Gdiplus::BitmapData out{};
+    if (dst->GetLastStatus() != Gdiplus::Ok ||
+        dst->LockBits(&dstRect, Gdiplus::ImageLockModeWrite, PixelFormat32bppARGB, &out) != Gdiplus::Ok) {
+        src.UnlockBits(&in);
+        return nullptr;
+    }
+    ResampleAreaAverage(static_cast<const uint8_t*>(in.Scan0), srcRect.Width, srcRect.Height, in.Stride,
+        static_cast<uint8_t*>(out.Scan0), w, h, out.Stride);
+    dst->UnlockBits(&out);
+    src.UnlockBits(&in);
+    return dst;
+}
+
+/**
+ * @brief Downscale and encode a bitmap for upload, returning base64 text
  * @param bmp Bitmap handle to convert
+ * @param opt Size limits and target format
  * @param out Output parameter for base64 string
+ * @param mime Output parameter for the MIME type actually used
  * @return true on success, false on failure
+ *
+ * WebP has no GDI+ encoder; it falls back to JPEG with the same quality.
  */
-bool BitmapToBase64Png(HBITMAP bmp, wstring& out) {
-    const CLSID* clsid = GetPngClsid();
+bool BitmapToBase64(HBITMAP bmp, const ImageUploadOptions& opt, string& out, string& mime) {
+    ImageFormat fmt = opt.format;
+    if (fmt == ImageFormat::Webp && !GetEncoderClsid(ImageFormatMime(fmt))) {
+        LogLine(L"WebP encoder unavailable, using JPEG");
+        fmt = ImageFormat::Jpeg;
+    }
+    mime = ToUtf8(ImageFormatMime(fmt));
+    const CLSID* clsid = GetEncoderClsid(ImageFormatMime(fmt));
     if (!clsid) return false;
     Gdiplus::Bitmap bitmap(bmp, nullptr);
+    if (bitmap.GetLastStatus() != Gdiplus::Ok) return false;
+    Gdiplus::Bitmap* image = &bitmap;
+    unique_ptr<Gdiplus::Bitmap> scaled;
+    int w = 0, h = 0;
+    if (ComputeScaledSize(static_cast<int>(bitmap.GetWidth()), static_cast<int>(bitmap.GetHeight()), opt, w, h)) {
+        TraceScope span("downscale_image");
+        span.Arg("pixels", static_cast<long long>(w) * h);
+        scaled = DownscaleBitmap(bitmap, w, h);
+        if (scaled) {
+            image = scaled.get();
+            LogLine(format(L"image downscaled {}x{} -> {}x{}", bitmap.GetWidth(), bitmap.GetHeight(), w, h));
+        }
+    }
+    ULONG quality = static_cast<ULONG>(clamp(opt.quality, 1, 100));
+    Gdiplus::EncoderParameters params{};
+    params.Count = 1;
+    params.Parameter[0].Guid = Gdiplus::EncoderQuality;
+    params.Parameter[0].Type = Gdiplus::EncoderParameterValueTypeLong;
+    params.Parameter[0].NumberOfValues = 1;
+    params.Parameter[0].Value = &quality;
+    const bool lossy = fmt != ImageFormat::Png;
+    TraceScope encodeSpan("encode_image");
     IStream* stream = nullptr;
     if (CreateStreamOnHGlobal(nullptr, TRUE, &stream) != S_OK) return false;
-    if (bitmap.Save(stream, clsid, nullptr) != Gdiplus::Ok) { stream->Release(); return false; }
+    if (image->Save(stream, clsid, lossy ? &params : nullptr) != Gdiplus::Ok) { stream->Release(); return false; }
     HGLOBAL hMem = nullptr;
     if (GetHGlobalFromStream(stream, &hMem) != S_OK) { stream->Release(); return false; }
     SIZE_T size = GlobalSize(hMem);
     BYTE* data = static_cast<BYTE*>(GlobalLock(hMem));
     if (!data || size == 0) { if (data) GlobalUnlock(hMem); stream->Release(); return false; }
-    DWORD outLen = 0;
-    if (!CryptBinaryToStringW(data, static_cast<DWORD>(size), CRYPT_STRING_BASE64 | CRYPT_STRING_NOCRLF, nullptr, &outLen)) {
-        GlobalUnlock(hMem); stream->Release(); return false;
-    }
-    out.resize(outLen);
-    if (!CryptBinaryToStringW(data, static_cast<DWORD>(size), CRYPT_STRING_BASE64 | CRYPT_STRING_NOCRLF, out.data(), &outLen)) {
-        GlobalUnlock(hMem); stream->Release(); return false;
-    }
-    out.resize(outLen);
+    LogLine(format(L"image encoded as {} ({} bytes)", ImageFormatMime(fmt), static_cast<size_t>(size)));
+    encodeSpan.Arg("bytes", static_cast<long long>(size));
+    encodeSpan.End();
+    TraceScope b64Span("base64_encode");
+    b64Span.Arg("bytes", static_cast<long long>(Base64EncodedLength(size)));
+    out = Base64Encode(data, size);
     GlobalUnlock(hMem);
     stream->Release();
     return true;
@@ -911,15 +718,13 @@ bool BitmapToBase64Png(HBITMAP bmp, wstring& out) {
  * @param b64 Base64-encoded PNG data
  * @return Bitmap handle (caller must DeleteObject), or nullptr on failure
  */
-HBITMAP Base64ToBitmap(const wstring& b64) {
-    DWORD binSize = 0;
-    if (!CryptStringToBinaryW(b64.c_str(), 0, CRYPT_STRING_BASE64, nullptr, &binSize, nullptr, nullptr)) return nullptr;
-    vector<BYTE> buf(binSize);
-    if (!CryptStringToBinaryW(b64.c_str(), 0, CRYPT_STRING_BASE64, buf.data(), &binSize, nullptr, nullptr)) return nullptr;
-    HGLOBAL hMem = GlobalAlloc(GMEM_MOVEABLE, binSize);
+HBITMAP Base64ToBitmap(string_view b64) {
+    vector<uint8_t> buf;
+    if (!Base64Decode(b64, buf) || buf.empty()) return nullptr;
+    HGLOBAL hMem = GlobalAlloc(GMEM_MOVEABLE, buf.size());
     if (!hMem) return nullptr;
     void* dst = GlobalLock(hMem);
-    memcpy(dst, buf.data(), binSize);
+    memcpy(dst, buf.data(), buf.size());
     GlobalUnlock(hMem);
     IStream* stream = nullptr;
     if (CreateStreamOnHGlobal(hMem, TRUE, &stream) != S_OK) { GlobalFree(hMem); return nullptr; }
@@ -933,457 +738,402 @@ HBITMAP Base64ToBitmap(const wstring& b64) {
 }
 
 /**
- * @brief Extract content field from OpenAI API JSON response
- * @param json JSON response string
- * @return Extracted content text, or empty string if not found
+ * @struct FilterInput
+ * @brief Clipboard content captured when a filter job is submitted
  */
-wstring ExtractContent(const wstring& json) {
-    size_t p = json.find(L"\"content\"");
-    if (p == wstring::npos) return L"";
-    p = json.find(L"\"", p + 9);
-    if (p == wstring::npos) return L"";
-    ++p;
-    wstring out;
-    while (p < json.size() && json[p] != L'\"') {
-        if (json[p] == L'\\' && p + 1 < json.size()) {
-            if (json[p + 1] == L'n') { out += L'\n'; p += 2; continue; }
-            if (json[p + 1] == L'\"') { out += L'\"'; p += 2; continue; }
-        }
-        out += json[p]; ++p;
-    }
-    return out;
-}
+struct FilterInput {
+    wstring text;      // Text input (Text filters)
+    HBITMAP image{};   // Image input (Image filters, owned by the job; nullptr if prefetched holds the encoding)
+    uint32_t sequence{};                               // Clipboard sequence number at submission (0 = no prefetcher)
+    shared_ptr<const ClipboardSnapshot> prefetched;    // Pre-encoded image of that clipboard content
+};
 
 /**
- * @brief Extract base64 image data from OpenAI image generation API response
- * @param json JSON response string
- * @return Base64-encoded image data, or empty string if not found
- */
- wstring ExtractB64Image(const wstring& json) {
-    size_t p = json.find(L"\"b64_json\"");
-    if (p == wstring::npos) return L"";
-    p = json.find(L"\"", p + 10);
-    if (p == wstring::npos) return L"";
-    ++p;
-    wstring out;
-    while (p < json.size() && json[p] != L'\"') {
-        if (json[p] == L'\\' && p + 1 < json.size()) {
-            if (json[p + 1] == L'"') { out += L'\"'; p += 2; continue; }
-            if (json[p + 1] == L'\\') { out += L'\\'; p += 2; continue; }
-            if (json[p + 1] == L'/') { out += L'/'; p += 2; continue; }
-        }
-        out += json[p]; ++p;
+ * @class Win32ClipboardImage
+ * @brief Copy of the clipboard bitmap for the prefetcher
+ */
+class Win32ClipboardImage : public ClipboardImage {
+public:
+    explicit Win32ClipboardImage(HBITMAP bmp) : bmp_(bmp) {}
+    ~Win32ClipboardImage() override { DeleteObject(bmp_); }
+
+    uint64_t Hash() override {
+        BITMAP bm{};
+        if (!GetObjectW(bmp_, sizeof(BITMAP), &bm) || bm.bmWidth <= 0 || bm.bmHeight <= 0) return 0;
+        BITMAPINFO bi{};
+        bi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+        bi.bmiHeader.biWidth = bm.bmWidth;
+        bi.bmiHeader.biHeight = -bm.bmHeight;
+        bi.bmiHeader.biPlanes = 1;
+        bi.bmiHeader.biBitCount = 32;
+        bi.bmiHeader.biCompression = BI_RGB;
+        vector<uint8_t> pixels(static_cast<size_t>(bm.bmWidth) * bm.bmHeight * 4);
+        HDC hdc = GetDC(nullptr);
+        int lines = GetDIBits(hdc, bmp_, 0, bm.bmHeight, pixels.data(), &bi, DIB_RGB_COLORS);
+        ReleaseDC(nullptr, hdc);
+        if (lines != bm.bmHeight) return 0;
+        return ContentHash(pixels.data(), pixels.size()) ^ (static_cast<uint64_t>(bm.bmWidth) << 32 | static_cast<uint32_t>(bm.bmHeight));
+    }
+
+    bool Encode(const ImageUploadOptions& opt, string& b64, string& mime) override {
+        TraceScope span("prefetch_encode");
+        return BitmapToBase64(bmp_, opt, b64, mime);
     }
-    return out;
-}
+
+private:
+    HBITMAP bmp_;
+};
 
 /**
- * @brief Extract image URL from OpenRouter chat/completions response
- * @param json JSON response string
- * @return Base64-encoded image data (without data:image/png;base64, prefix), or empty string if not found
+ * @class Win32ClipboardSource
+ * @brief The system clipboard, read from the prefetch thread
  */
- wstring ExtractImageFromChatResponse(const wstring& json) {
-    // Look for "images" array in the response
-    size_t imagesPos = json.find(L"\"images\"");
-    if (imagesPos == wstring::npos) {
-        // Try alternative: "image_url" directly
-        imagesPos = json.find(L"\"image_url\"");
-        if (imagesPos == wstring::npos) return L"";
-    }
-    
-    // Find image_url.url field (could be "image_url" or "imageUrl")
-    size_t urlPos = json.find(L"\"image_url\"", imagesPos);
-    if (urlPos == wstring::npos) {
-        urlPos = json.find(L"\"imageUrl\"", imagesPos);
+class Win32ClipboardSource : public ClipboardSource {
+public:
+    uint32_t Sequence() override { return GetClipboardSequenceNumber(); }
+
+    // IsClipboardFormatAvailable needs no OpenClipboard, so a busy clipboard is not reported as empty
+    ClipboardType Detect() override {
+        if (IsClipboardFormatAvailable(CF_UNICODETEXT)) return ClipboardType::Text;
+        if (IsClipboardFormatAvailable(CF_BITMAP) || IsClipboardFormatAvailable(CF_DIB) || IsClipboardFormatAvailable(CF_DIBV5)) return ClipboardType::Bitmap;
+        return ClipboardType::None;
     }
-    if (urlPos == wstring::npos) return L"";
-    
-    // Find url field (could be "url" or nested structure)
-    size_t urlFieldPos = json.find(L"\"url\"", urlPos);
-    if (urlFieldPos == wstring::npos) return L"";
-    
-    // Find the value (data:image/png;base64,...)
-    // Skip to the colon and opening quote
-    size_t colonPos = json.find(L":", urlFieldPos + 5);
-    if (colonPos == wstring::npos) return L"";
-    
-    // Find the opening quote after colon
-    size_t valueStart = json.find(L"\"", colonPos);
-    if (valueStart == wstring::npos) return L"";
-    valueStart++;
-    
-    // Find the closing quote, but handle escaped quotes
-    size_t valueEnd = valueStart;
-    while (valueEnd < json.length()) {
-        if (json[valueEnd] == L'\"' && (valueEnd == valueStart || json[valueEnd - 1] != L'\\')) {
-            break;
-        }
-        valueEnd++;
+
+    bool ReadText(wstring& out) override {
+        out = GetClipboardText();
+        return !out.empty();
     }
-    if (valueEnd >= json.length()) return L"";
-    
-    wstring dataUrl = json.substr(valueStart, valueEnd - valueStart);
-    
-    // Unescape JSON string
-    wstring unescaped;
-    for (size_t i = 0; i < dataUrl.length(); ++i) {
-        if (dataUrl[i] == L'\\' && i + 1 < dataUrl.length()) {
-            if (dataUrl[i + 1] == L'\\') { unescaped += L'\\'; i++; continue; }
-            if (dataUrl[i + 1] == L'\"') { unescaped += L'\"'; i++; continue; }
-            if (dataUrl[i + 1] == L'n') { unescaped += L'\n'; i++; continue; }
-            if (dataUrl[i + 1] == L'r') { unescaped += L'\r'; i++; continue; }
-            if (dataUrl[i + 1] == L't') { unescaped += L'\t'; i++; continue; }
-        }
-        unescaped += dataUrl[i];
-    }
-    dataUrl = unescaped;
-    
-    // Extract base64 part (remove "data:image/png;base64," prefix)
-    size_t commaPos = dataUrl.find(L",");
-    if (commaPos != wstring::npos) {
-        return dataUrl.substr(commaPos + 1);
+
+    unique_ptr<ClipboardImage> ReadImage() override {
+        HBITMAP bmp = GetClipboardBitmap();
+        return bmp ? make_unique<Win32ClipboardImage>(bmp) : nullptr;
     }
-    
-    return dataUrl; // Return as-is if no comma found
-}
+};
+
+unique_ptr<ClipboardPrefetcher> g_prefetcher;  // Background clipboard snapshots (nullptr when prefetch and prewarm are off)
+constexpr chrono::milliseconds kPrefetchWait{2000};  // How long a filter run waits for an encode in progress
 
 /**
- * @brief Prepare endpoint for HTTP request
- * @param serverUrl Server URL
- * @param tplPath Template path
- * @param host Host name
- * @param path Path
- * @param useHttps Use HTTPS
- * @return true if endpoint is valid, false otherwise
+ * @brief Requests a filter sends: each model with the filter whose input and output types pick its template
+ * @return The filter's own model and backups, or those of every fan-out branch or pipeline stage;
+ *         the first model's upload profile encodes the filter's image input
  */
-bool PrepareEndpoint(const wstring& serverUrl, const wstring& tplPath, wstring& host, wstring& path, bool& useHttps) {
-    host = serverUrl;
-    path = tplPath;
-    if (path.empty()) path = L"/v1/chat/completions";
-    // If template path is absolute URL, override host/path
-    if (path.rfind(L"http://", 0) == 0 || path.rfind(L"https://", 0) == 0) {
-        host = path;
-        path = L"";
+vector<pair<size_t, const FilterDefinition*>> FilterRequests(const FilterDefinition& f) {
+    vector<pair<size_t, const FilterDefinition*>> requests;
+    auto add = [&](const FilterDefinition& def) {
+        requests.emplace_back(def.modelIndex, &def);
+        for (size_t idx : def.hedgeModels) requests.emplace_back(idx, &def);
+    };
+    if (!IsFanOut(f) && !IsPipeline(f)) {
+        add(f);
+        return requests;
     }
-    if (host.rfind(L"https://", 0) == 0) { host = host.substr(8); useHttps = true; }
-    else if (host.rfind(L"http://", 0) == 0) { host = host.substr(7); useHttps = false; }
-    size_t slash = host.find(L'/');
-    if (slash != wstring::npos) {
-        path = host.substr(slash) + (path.empty() ? L"" : path);
-        host = host.substr(0, slash);
+    for (size_t fi : IsPipeline(f) ? f.pipeline : f.fanOutFilters) {
+        if (fi < g_filters.size()) add(g_filters[fi]);
     }
-    if (!path.empty() && path.front() != L'/') path = L"/" + path;
-    return !host.empty();
+    for (size_t mi : f.fanOutModels) requests.emplace_back(mi, &f);
+    return requests;
 }
 
 /**
- * @brief Build body from template definition
- * @param tpl Template definition
- * @param m Model configuration
- * @param systemPrompt System prompt
- * @param prompt Prompt text
- * @param imageB64 Base64 encoded image data
- * @param imageDataUrl Image data URL
- * @return Body string
+ * @brief Upload profiles of the models that image filters use, for the prefetcher
  */
-wstring BuildBodyFromTemplate(const TemplateDefinition& tpl, const ModelConfig& m, const wstring& systemPrompt, const wstring& prompt, const wstring& imageB64, const wstring& imageDataUrl) {
-    return ReplacePlaceholders(tpl.payload, m, systemPrompt, prompt, imageB64, imageDataUrl, true);
-}
-
-/**
- * @brief Build header string from template definition
- * @param tpl Template definition
- * @param m Model configuration
- * @param systemPrompt System prompt
- * @param prompt Prompt text
- * @param imageB64 Base64 encoded image data
- * @param imageDataUrl Image data URL
- * @return Header string
- */
-wstring BuildHeaderString(const TemplateDefinition& tpl, const ModelConfig& m, const wstring& systemPrompt, const wstring& prompt, const wstring& imageB64, const wstring& imageDataUrl) {
-    wstring header;
-    for (const auto& kv : tpl.headers) {
-        wstring val = ReplacePlaceholders(kv.second, m, systemPrompt, prompt, imageB64, imageDataUrl, false);
-        header += kv.first + L": " + val + L"\r\n";
+vector<ImageUploadOptions> PrefetchProfiles() {
+    vector<ImageUploadOptions> profiles;
+    auto add = [&](size_t idx) {
+        if (idx >= g_models.size()) return;
+        const ImageUploadOptions& opt = g_models[idx].image;
+        if (none_of(profiles.begin(), profiles.end(), [&](const ImageUploadOptions& p) { return SameUploadOptions(p, opt); })) profiles.push_back(opt);
+    };
+    for (const FilterDefinition& f : g_filters) {
+        if (f.input != IOType::Image) continue;
+        const auto requests = FilterRequests(f);
+        if (!requests.empty()) add(requests.front().first);
     }
-    return header;
+    return profiles;
 }
 
 /**
- * @brief Build header string from vector of key-value pairs
- * @param headers Vector of key-value pairs
- * @param m Model configuration
- * @return Header string
+ * @brief Type of the clipboard content, from the prefetched snapshot when it is current
  */
-wstring BuildHeaderString(const vector<pair<wstring, wstring>>& headers, const ModelConfig& m) {
-    wstring header;
-    for (const auto& kv : headers) {
-        wstring val = ReplacePlaceholders(kv.second, m, L"", L"", L"", L"", false);
-        header += kv.first + L": " + val + L"\r\n";
+ClipboardType DetectClipboardPrefetched() {
+    if (g_prefetcher) {
+        if (auto snap = g_prefetcher->Get(g_prefetcher->Sequence())) return snap->type;
     }
-    return header;
+    return DetectClipboard();
 }
 
 /**
- * @brief Make an HTTP request with headers
- * @param host Host name
- * @param path Path
- * @param useHttps Use HTTPS
- * @param headers Headers
- * @param body Body
- * @param method Method
- * @param err Error message
- * @return Result of the request
+ * @brief Snapshot the clipboard content a filter consumes
+ * @param input Filter input type
+ * @param upload Upload profile of the filter's model (Image filters)
+ * @param in Output parameter receiving text, a prefetched encoding or a bitmap copy
+ * @return true if the clipboard holds usable input
  */
-wstring HttpRequestWithHeaders(const wstring& host, const wstring& path, bool useHttps, const wstring& headers, const string& body, const wstring& method, wstring* err) {
-    wstring result;
-    auto setErr = [&](const wstring& m) { if (err) *err = m; };
-    HINTERNET hs = WinHttpOpen(L"cbfilter/1.0", WINHTTP_ACCESS_TYPE_DEFAULT_PROXY, WINHTTP_NO_PROXY_NAME, WINHTTP_NO_PROXY_BYPASS, 0);
-    if (!hs) { setErr(L"WinHttpOpen failed: " + to_wstring(GetLastError())); return L""; }
-    HINTERNET hc = WinHttpConnect(hs, host.c_str(), INTERNET_DEFAULT_HTTPS_PORT, 0);
-    if (!hc) { setErr(L"WinHttpConnect failed: " + to_wstring(GetLastError())); WinHttpCloseHandle(hs); return L""; }
-    DWORD flags = useHttps ? WINHTTP_FLAG_SECURE : 0;
-    HINTERNET hr = WinHttpOpenRequest(hc, method.c_str(), path.c_str(), nullptr, WINHTTP_NO_REFERER, WINHTTP_DEFAULT_ACCEPT_TYPES, flags);
-    if (!hr) { setErr(L"WinHttpOpenRequest failed: " + to_wstring(GetLastError())); WinHttpCloseHandle(hc); WinHttpCloseHandle(hs); return L""; }
-    const bool hasBody = !body.empty();
-    BOOL ok = WinHttpSendRequest(hr, headers.c_str(), (DWORD)headers.size(), hasBody ? (LPVOID)body.data() : nullptr, hasBody ? (DWORD)body.size() : 0, hasBody ? (DWORD)body.size() : 0, 0);
-    if (!ok) { setErr(L"WinHttpSendRequest failed: " + to_wstring(GetLastError())); }
-    if (ok) ok = WinHttpReceiveResponse(hr, nullptr);
-    if (!ok) { setErr(L"WinHttpReceiveResponse failed: " + to_wstring(GetLastError())); }
-    if (ok) {
-        DWORD status = 0, len = sizeof(status);
-        if (WinHttpQueryHeaders(hr, WINHTTP_QUERY_STATUS_CODE | WINHTTP_QUERY_FLAG_NUMBER, WINHTTP_HEADER_NAME_BY_INDEX, &status, &len, WINHTTP_NO_HEADER_INDEX)) {
-            if (status >= 400) setErr(L"HTTP status " + to_wstring(status));
-        }
-    }
-    if (ok) {
-        for (;;) {
-            DWORD dwSize = 0;
-            if (!WinHttpQueryDataAvailable(hr, &dwSize)) break;
-            if (dwSize == 0) break;
-            string buf; buf.resize(dwSize);
-            DWORD dwDownloaded = 0;
-            if (!WinHttpReadData(hr, buf.data(), dwSize, &dwDownloaded) || dwDownloaded == 0) break;
-            buf.resize(dwDownloaded);
-            wstring wbuf; int wlen = MultiByteToWideChar(CP_UTF8, 0, buf.c_str(), static_cast<int>(buf.size()), nullptr, 0);
-            if (wlen > 0) { size_t cur = result.size(); result.resize(cur + wlen); MultiByteToWideChar(CP_UTF8, 0, buf.c_str(), static_cast<int>(buf.size()), result.data() + cur, wlen); }
-        }
-    }
-    WinHttpCloseHandle(hr); WinHttpCloseHandle(hc); WinHttpCloseHandle(hs);
-    return result;
+bool CaptureFilterInput(IOType input, const ImageUploadOptions& upload, FilterInput& in) {
+    if (g_prefetcher) {
+        in.sequence = g_prefetcher->Sequence();
+        auto snap = g_prefetcher->Get(in.sequence);
+        if (snap && input == IOType::Text && !snap->text.empty()) {
+            in.text = snap->text;
+            return true;
+        }
+        if (snap && input == IOType::Image && snap->FindImage(upload)) {
+            in.prefetched = move(snap);
+            return true;
+        }
+    }
+    TraceScope span(input == IOType::Text ? "GetClipboardText" : "GetClipboardBitmap");
+    if (input == IOType::Text) {
+        in.text = GetClipboardText();
+        if (in.text.empty()) { LogLine(L"fail: no text in clipboard"); return false; }
+    } else {
+        in.image = GetClipboardBitmap();
+        if (!in.image) { LogLine(L"fail: no image in clipboard"); return false; }
+    }
+    return true;
 }
 
 /**
- * @brief Extract value from JSON by path
- * @param json JSON string
- * @param path Path to extract
- * @return Extracted value, or empty string if not found
+ * @brief Put a filter result on the clipboard
+ * @param output Filter output type
+ * @param res Result (the image, if any, is handed over to the clipboard)
+ * @return true on success
  */
-wstring ExtractByPath(const wstring& json, const wstring& path) {
-    using namespace winrt::Windows::Data::Json;
+bool ApplyFilterResult(IOType output, ApiCallResult& res) {
     try {
-        JsonValue val = JsonValue::Parse(json);
-        vector<wstring> parts;
-        size_t start = 0;
-        for (size_t i = 0; i <= path.size(); ++i) {
-            if (i == path.size() || path[i] == L'.') { parts.push_back(path.substr(start, i - start)); start = i + 1; }
-        }
-        IJsonValue cur = val;
-        for (const auto& p : parts) {
-            wstring key = p; int idx = -1;
-            size_t lb = p.find(L'[');
-            if (lb != wstring::npos && p.back() == L']') {
-                key = p.substr(0, lb);
-                idx = _wtoi(p.substr(lb + 1, p.size() - lb - 2).c_str());
-            }
-            if (cur.ValueType() == JsonValueType::Object) {
-                JsonObject obj = cur.GetObject();
-                if (!key.empty()) cur = obj.GetNamedValue(key);
-                else return L"";
-            } else if (cur.ValueType() == JsonValueType::Array) {
-                JsonArray arr = cur.GetArray();
-                if (idx >= 0 && idx < static_cast<int>(arr.Size())) cur = arr.GetAt(idx);
-                else return L"";
-                idx = -1;
-            }
-            if (idx >= 0) {
-                JsonArray arr = cur.GetArray();
-                if (idx >= 0 && idx < static_cast<int>(arr.Size())) cur = arr.GetAt(idx);
-            }
+        if (output == IOType::Text) {
+            SetClipboardText(res.text);
+            return true;
+        }
+        HBITMAP bmp = res.image;
+        res.image = nullptr;
+        try {
+            SetClipboardBitmap(bmp);
+        } catch (...) {
+            DeleteObject(bmp);
+            throw;
         }
-        if (cur.ValueType() == JsonValueType::String) return cur.GetString().c_str();
-        return cur.Stringify().c_str();
+        return true;
     } catch (...) {
-        return L"";
+        LogLine(L"fail: setting clipboard threw");
     }
+    return false;
 }
 
 /**
- * @brief Build multipart/form-data body for API request
- * @param boundary Boundary string
- * @param model Model name
- * @param prompt Prompt text
- * @param imageB64 Base64 encoded image data
- * @return Multipart/form-data body string
+ * @struct PreparedInput
+ * @brief Engine payload for captured input, with the buffers it views
  */
-string BuildMultipartBody(const wstring& boundary, const wstring& model, const wstring& prompt, const wstring& imageB64) {
-    vector<BYTE> img;
-    if (!imageB64.empty()) {
-        DWORD size = 0;
-        if (CryptStringToBinaryW(imageB64.c_str(), 0, CRYPT_STRING_BASE64, nullptr, &size, nullptr, nullptr)) {
-            img.resize(size);
-            if (!CryptStringToBinaryW(imageB64.c_str(), 0, CRYPT_STRING_BASE64, img.data(), &size, nullptr, nullptr)) img.clear();
-            else img.resize(size);
-        }
-    }
-    string b = "";
-    string bnd = ToUtf8(boundary);
-    auto addText = [&](const string& name, const string& value) {
-        b += "--" + bnd + "\r\n";
-        b += "Content-Disposition: form-data; name=\"" + name + "\"\r\n\r\n";
-        b += value + "\r\n";
-    };
-    addText("model", ToUtf8(model));
-    addText("prompt", ToUtf8(prompt));
-    if (!img.empty()) {
-        b += "--" + bnd + "\r\n";
-        b += "Content-Disposition: form-data; name=\"image\"; filename=\"image.png\"\r\n";
-        b += "Content-Type: image/png\r\n\r\n";
-        b.insert(b.end(), img.begin(), img.end());
-        b += "\r\n";
-    }
-    b += "--" + bnd + "--\r\n";
-    return b;
-}
-
-/**
- * @brief Call a template API
- * @param tpl Template definition
- * @param m Model configuration
- * @param systemPrompt System prompt
- * @param prompt Prompt text
- * @param imageB64 Base64 encoded image data
- * @param imageDataUrl Image data URL
- * @return API call result
- */
-ApiCallResult CallTemplate(const TemplateDefinition& tpl, const ModelConfig& m, const wstring& systemPrompt, const wstring& prompt, const wstring& imageB64, const wstring& imageDataUrl) {
-    ApiCallResult result;
-    wstring endpoint = ReplacePlaceholders(tpl.endpoint, m, systemPrompt, prompt, imageB64, imageDataUrl, false);
-    wstring host, path; bool useHttps = true;
-    if (!PrepareEndpoint(m.serverUrl, endpoint, host, path, useHttps)) {
-        LogLine(L"PrepareEndpoint failed");
-        return result;
-    }
-    wstring body = BuildBodyFromTemplate(tpl, m, systemPrompt, prompt, imageB64, imageDataUrl);
-    wstring headers = BuildHeaderString(tpl, m, systemPrompt, prompt, imageB64, imageDataUrl);
-    string utf8;
-    wstring adjHeaders = headers;
-    if (ContainsNoCase(headers, L"multipart/form-data")) {
-        wstring boundary = L"----cbfilterboundary";
-        adjHeaders = ReplaceAll(headers, L"multipart/form-data", L"multipart/form-data; boundary=" + boundary);
-        utf8 = BuildMultipartBody(boundary, m.modelName, prompt, imageB64);
-    } else {
-        utf8 = ToUtf8(body);
-    }
-    LogLine(L"request host: " + host);
-    LogLine(L"request path: " + path);
-    wstring wbody; int wlen = MultiByteToWideChar(CP_UTF8, 0, utf8.c_str(), -1, nullptr, 0);
-    if (wlen > 1) { wbody.resize(wlen - 1); MultiByteToWideChar(CP_UTF8, 0, utf8.c_str(), -1, wbody.data(), wlen - 1); }
-    LogLine(L"body: " + wbody);
-    wstring err;
-    wstring resp = HttpRequestWithHeaders(host, path, useHttps, adjHeaders, utf8, L"POST", &err);
-    if (!err.empty()) LogLine(L"template request error: " + err);
-    if (resp.empty()) return result;
-    if (tpl.output == IOType::Text) {
-        if (!tpl.resultPath.empty()) result.text = ExtractByPath(resp, tpl.resultPath);
-        if (result.text.empty()) result.text = ExtractContent(resp);
-        if (result.text.empty()) LogLine(L"template response empty content. resp=" + resp.substr(0, 512));
+struct PreparedInput {
+    FilterPayload payload;
+    string encodedB64;
+    string encodedMime;
+    shared_ptr<const ClipboardSnapshot> snap;  // Keeps a prefetched encoding alive
+};
+
+/**
+ * @brief Turn captured input into an engine payload, encoding the image unless it was prefetched
+ * @param input Filter input type
+ * @param m Model whose upload profile the image is encoded with
+ * @param in Input captured at submission time
+ * @param out Payload and its buffers (the payload views them, so out must not be moved)
+ * @return false if the input is missing or cannot be encoded
+ */
+bool PrepareFilterInput(IOType input, const ModelConfig& m, const FilterInput& in, PreparedInput& out) {
+    FilterPayload& payload = out.payload;
+    shared_ptr<const ClipboardSnapshot>& snap = out.snap;
+    snap = in.prefetched;
+    if (input == IOType::Text) {
+        if (in.text.empty()) { LogLine(L"fail: no text input"); return false; }
+        payload.text = in.text;
     } else {
-        wstring b64 = tpl.resultPath.empty() ? L"" : ExtractByPath(resp, tpl.resultPath);
-        if (b64.find(L"data:image") != wstring::npos) {
-            size_t c = b64.find(L",");
-            if (c != wstring::npos) b64 = b64.substr(c + 1);
-        }
-        if (b64.empty()) b64 = ExtractB64Image(resp);
-        if (b64.empty()) b64 = ExtractContent(resp);
-        if (b64.find(L"data:image") != wstring::npos) {
-            size_t c = b64.find(L",");
-            if (c != wstring::npos) b64 = b64.substr(c + 1);
+        // Submitted while the prefetcher was still encoding this content: wait for it rather than encode twice
+        const auto waitStart = chrono::steady_clock::now();
+        if ((!snap || !snap->FindImage(m.image)) && g_prefetcher && in.sequence) snap = g_prefetcher->Get(in.sequence, kPrefetchWait);
+        const double waitedMs = chrono::duration<double, milli>(chrono::steady_clock::now() - waitStart).count();
+        if (const EncodedImage* e = snap ? snap->FindImage(m.image) : nullptr) {
+            TraceScope prefetchSpan("prefetched_image");
+            prefetchSpan.Arg("bytes", static_cast<long long>(e->b64.size()));
+            prefetchSpan.Arg("encode_saved_ms", static_cast<long long>((std::max)(0.0, e->encodeMs - waitedMs)));
+            payload.imageB64 = e->b64;
+            payload.imageMime = e->mime;
+        } else {
+            if (!in.image) { LogLine(L"fail: no image input"); return false; }
+            if (!BitmapToBase64(in.image, m.image, out.encodedB64, out.encodedMime)) { LogLine(L"fail: base64 encode image failed"); return false; }
+            payload.imageB64 = out.encodedB64;
+            payload.imageMime = out.encodedMime;
         }
-        if (!b64.empty()) result.image = Base64ToBitmap(b64);
-        if (!result.image) LogLine(L"template response produced no image");
     }
-    return result;
+    return true;
 }
 
 /**
- * @brief Execute a filter transformation on clipboard content
+ * @brief Move an engine result into the host form, decoding an image into a bitmap
+ * @param output Filter output type
+ * @param result Engine output (text is moved out)
+ * @param out Text or bitmap (caller owns the image)
+ * @return false if the image cannot be decoded
+ */
+bool TakeFilterOutput(IOType output, FilterOutput& result, ApiCallResult& out) {
+    if (output == IOType::Text) {
+        out.text = move(result.text);
+        return true;
+    }
+    TraceScope decodeSpan("Base64ToBitmap");
+    decodeSpan.Arg("bytes", static_cast<long long>(result.imageB64.size()));
+    out.image = Base64ToBitmap(result.imageB64);
+    if (!out.image) { LogLine(L"fail: template returned no image"); return false; }
+    return true;
+}
+
+/**
+ * @brief Log the connection handle pool counters after a run
+ */
+void LogPoolStats() {
+    HttpPoolStats pool = HttpSession::Instance().Stats();
+    LogLine(L"connection pool hits=" + to_wstring(pool.hits) + L" misses=" + to_wstring(pool.misses) + L" idle=" + to_wstring(pool.idle));
+}
+
+/**
+ * @brief Execute a filter transformation on captured clipboard content
  * @param f Filter definition to execute
- * @return true on success, false on failure
- * 
- * This function handles four transformation types:
- * - Text -> Text: Text completion/translation
- * - Text -> Image: Image generation from text
- * - Image -> Text: Vision API (image description/analysis)
- * - Image -> Image: Image-to-image transformation
+ * @param m Model configuration used by the filter
+ * @param hedgeModels Backup models raced against m when it is slow (single requests only)
+ * @param in Input captured at submission time
+ * @param out Output parameter for the resulting text or image (caller owns the image)
+ * @param onPartial Receives partial text as it streams in (Text output only, optional)
+ * @param cancel Aborts the filter, including a request in flight (optional)
+ * @return true on success, false on failure or cancellation
+ *
+ * Encodes the image input (or takes the prefetched encoding), runs the
+ * request through g_engine and decodes an image result into a bitmap.
+ * It does not touch the clipboard, so several filters can run concurrently.
  */
-bool RunFilter(const FilterDefinition& f) {
+bool RunFilter(const FilterDefinition& f, const ModelConfig& m, const vector<ModelConfig>& hedgeModels, const FilterInput& in, ApiCallResult& out, const function<void(const wstring&)>& onPartial = nullptr, CancelToken* cancel = nullptr) {
     LogLine(L"RunFilter: " + f.title + L" input=" + IOTypeToString(f.input) + L" output=" + IOTypeToString(f.output));
-    auto modelRef = [&]() -> const ModelConfig& { return g_models[f.modelIndex < g_models.size() ? f.modelIndex : 0]; };
-    const ModelConfig& m = modelRef();
-    const ApiProvider* provider = FindProviderById(m.providerId);
-    if (!provider && !g_providers.empty()) provider = &g_providers.front();
-    const TemplateDefinition* tpl = provider ? FindTemplateByIO(*provider, f.input, f.output) : nullptr;
-    if (!tpl) tpl = FindTemplateAny(f.input, f.output);
-    if (!tpl) { LogLine(L"fail: no matching template"); return false; }
-    try {
-        wstring textInput;
-        wstring imageB64;
-        if (tpl->input == IOType::Text) {
-            textInput = GetClipboardText();
-            if (textInput.empty()) { LogLine(L"fail: no text in clipboard"); return false; }
-        } else {
-            HBITMAP bmp = GetClipboardBitmap();
-            if (!bmp) { LogLine(L"fail: no image in clipboard"); return false; }
-            bool ok = BitmapToBase64Png(bmp, imageB64); DeleteObject(bmp);
-            if (!ok) { LogLine(L"fail: base64 encode image failed"); return false; }
-        }
-        wstring systemPrompt = [&]() -> auto {
-            wstring ithing = f.input == IOType::Text ? L"text" : L"image";
-            wstring othing = f.output == IOType::Text ? L"text" : L"image";
-            return format(
-                L"Follow the instructions strictly and convert the input {0} to the output {1}. "
-                L"No additional text or comments are allowed.",
-                ithing, othing);
-        }();
-        wstring promptText = f.prompt + L"\n\n" + textInput;
-        wstring imageDataUrl = imageB64.empty() ? L"" : (L"data:image/png;base64," + imageB64);
-        ApiCallResult res = CallTemplate(*tpl, m, systemPrompt, promptText, imageB64, imageDataUrl);
-        if (tpl->output == IOType::Text) {
-            if (res.text.empty()) { LogLine(L"fail: template returned empty text"); return false; }
-            SetClipboardText(res.text);
-            return true;
-        } else {
-            if (!res.image) { LogLine(L"fail: template returned no image"); return false; }
-            try {
-                SetClipboardBitmap(res.image);
-            } catch (...) {
-                DeleteObject(res.image);
-                LogLine(L"fail: SetClipboardBitmap threw"); return false;
+    if (!g_engine.ResolveTemplate(m, f.input, f.output)) { LogLine(L"fail: no matching template"); return false; }
+    PreparedInput prepared;
+    if (!PrepareFilterInput(f.input, m, in, prepared)) return false;
+    FilterOutput result;
+    bool ok = g_engine.RunFilter(f, m, hedgeModels, prepared.payload, result, onPartial, cancel);
+    LogPoolStats();
+    if (!ok) return false;
+    return TakeFilterOutput(f.output, result, out);
+}
+
+/**
+ * @brief Execute a pipeline filter: every stage in turn, intermediate results kept in memory
+ * @param f Pipeline filter (for its input and output types)
+ * @param stages Stages (see ExpandPipeline)
+ * @param in Input captured at submission time
+ * @param out Output of the last stage (caller owns the image)
+ * @param onPartial Receives the last stage's text as it streams in (optional)
+ * @param cancel Aborts the stage in flight (optional)
+ * @return true if every stage succeeded
+ *
+ * Only the first stage's input comes from the clipboard; the image input is
+ * encoded with the upload profile of the first stage's model.
+ */
+bool RunPipelineFilter(const FilterDefinition& f, const vector<FilterRun>& stages, const FilterInput& in, ApiCallResult& out, const function<void(const wstring&)>& onPartial = nullptr, CancelToken* cancel = nullptr) {
+    LogLine(L"RunPipelineFilter: " + f.title + L" stages=" + to_wstring(stages.size()));
+    if (stages.empty()) { LogLine(L"fail: pipeline has no stages"); return false; }
+    PreparedInput prepared;
+    if (!PrepareFilterInput(f.input, stages.front().model, in, prepared)) return false;
+    FilterOutput result;
+    if (!g_engine.RunPipeline(stages, prepared.payload, result, onPartial, cancel)) return false;
+    return TakeFilterOutput(f.output, result, out);
+}
+
+/**
+ * @brief Draw bitmaps side by side in a near-square grid on a white background
+ * @param images Bitmaps in grid order (not taken over)
+ * @return New bitmap (caller must DeleteObject), or nullptr on failure
+ */
+HBITMAP ComposeImageGrid(const vector<HBITMAP>& images) {
+    constexpr int kGap = 8;
+    vector<unique_ptr<Gdiplus::Bitmap>> bitmaps;
+    vector<pair<int, int>> sizes;
+    for (HBITMAP h : images) {
+        auto bmp = make_unique<Gdiplus::Bitmap>(h, nullptr);
+        if (bmp->GetLastStatus() != Gdiplus::Ok) return nullptr;
+        sizes.emplace_back(static_cast<int>(bmp->GetWidth()), static_cast<int>(bmp->GetHeight()));
+        bitmaps.push_back(move(bmp));
+    }
+    vector<GridCell> cells;
+    int w = 0, h = 0;
+    LayoutImageGrid(sizes, kGap, cells, w, h);
+    if (w <= 0 || h <= 0) return nullptr;
+    Gdiplus::Bitmap grid(w, h, PixelFormat32bppARGB);
+    if (grid.GetLastStatus() != Gdiplus::Ok) return nullptr;
+    {
+        Gdiplus::Graphics g(&grid);
+        g.Clear(Gdiplus::Color(255, 255, 255, 255));
+        for (size_t i = 0; i < bitmaps.size(); ++i) g.DrawImage(bitmaps[i].get(), cells[i].x, cells[i].y, cells[i].w, cells[i].h);
+    }
+    HBITMAP hOut = nullptr;
+    grid.GetHBITMAP(static_cast<Gdiplus::ARGB>(0xFFFFFFFF), &hOut);
+    return hOut;
+}
+
+/**
+ * @brief Execute a fan-out filter: every branch at once on the same captured input
+ * @param f Fan-out filter (for its input and output types)
+ * @param runs Branches (see ExpandFanOut)
+ * @param in Input captured at submission time
+ * @param out Combined text, or a grid of the images that came back (caller owns the image)
+ * @param strFailed Localized status of a failed branch
+ * @param strDone Localized status of a finished image branch
+ * @param onProgress Receives the combined text (or branch status lines for images) each time a branch finishes (optional)
+ * @param cancel Aborts every branch (optional)
+ * @return true if at least one branch succeeded
+ *
+ * The image input is encoded once, with the upload profile of the first
+ * branch's model, and shared by all branches. Runs on a worker thread, so
+ * the status strings are looked up by the caller on the UI thread.
+ */
+bool RunFanOutFilter(const FilterDefinition& f, const vector<FilterRun>& runs, const FilterInput& in, ApiCallResult& out, const wstring& strFailed, const wstring& strDone, const function<void(const wstring&)>& onProgress = nullptr, CancelToken* cancel = nullptr) {
+    LogLine(L"RunFanOutFilter: " + f.title + L" branches=" + to_wstring(runs.size()));
+    if (runs.empty()) { LogLine(L"fail: fan-out has no branches"); return false; }
+    PreparedInput prepared;
+    if (!PrepareFilterInput(f.input, runs.front().model, in, prepared)) return false;
+    FanOutResultHandler onResult;
+    if (onProgress) {
+        onResult = [&](size_t, const vector<FanOutResult>& results) {
+            if (f.output == IOType::Text) {
+                onProgress(CombineFanOutText(runs, results, strFailed));
+                return;
             }
-            return true;
-        }
-    } catch (const exception& ex) {
-        wstring wmsg;
-        int len = MultiByteToWideChar(CP_UTF8, 0, ex.what(), -1, nullptr, 0);
-        if (len > 1) {
-            wmsg.resize(len - 1); MultiByteToWideChar(CP_UTF8, 0, ex.what(), -1, wmsg.data(), len - 1);
-        }
-        LogLine(L"exception in RunFilter: " + wmsg);
-    } catch (...) {
-        LogLine(L"unknown exception in RunFilter");
+            wstring status;
+            for (size_t i = 0; i < runs.size(); ++i) {
+                if (results[i].done) status += runs[i].label + L": " + (results[i].ok ? strDone : strFailed) + L"\n";
+            }
+            onProgress(status);
+        };
+    }
+    vector<FanOutResult> results;
+    bool ok = g_engine.RunFanOut(runs, prepared.payload, results, onResult, cancel);
+    LogPoolStats();
+    if (!ok) return false;
+    if (f.output == IOType::Text) {
+        out.text = CombineFanOutText(runs, results, strFailed);
+        return true;
     }
-    return false; // fallback
+    TraceScope gridSpan("compose_image_grid");
+    vector<HBITMAP> images;
+    for (const FanOutResult& r : results) {
+        if (!r.ok) continue;
+        if (HBITMAP bmp = Base64ToBitmap(r.output.imageB64)) images.push_back(bmp);
+    }
+    if (images.size() == 1) {
+        out.image = images.front();
+    } else if (!images.empty()) {
+        out.image = ComposeImageGrid(images);
+        for (HBITMAP bmp : images) DeleteObject(bmp);
+    }
+    if (!out.image) { LogLine(L"fail: fan-out returned no image"); return false; }
+    gridSpan.Arg("images", static_cast<long long>(images.size()));
+    return true;
 }
 
 /**
@@ -1535,8 +1285,8 @@ struct SettingsState {
 void PopulateProviderCombo(HWND combo, const wstring& currentId) {
     SendMessageW(combo, CB_RESETCONTENT, 0, 0);
     int sel = -1;
-    for (size_t i = 0; i < g_providers.size(); ++i) {
-        const auto& p = g_providers[i];
+    for (size_t i = 0; i < g_engine.Providers().size(); ++i) {
+        const auto& p = g_engine.Providers()[i];
         int idx = static_cast<int>(SendMessageW(combo, CB_ADDSTRING, 0, reinterpret_cast<LPARAM>(p.id.c_str())));
         SendMessageW(combo, CB_SETITEMDATA, idx, static_cast<LPARAM>(i));
         if (p.id == currentId) sel = idx;
@@ -1562,39 +1312,39 @@ LRESULT CALLBACK ModelDlgProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
         st->original = *st->model;
         SetWindowLongPtr(hwnd, GWLP_USERDATA, reinterpret_cast<LONG_PTR>(st));
         const int m = 10, lw = 110; int y = m;
-        wstring strName = GetString(L"name");
+        const wstring& strName = GetString(L"name");
         CreateWindowW(L"STATIC", strName.c_str(), WS_CHILD | WS_VISIBLE, m, y, lw, 20, hwnd, nullptr, nullptr, nullptr);
         st->hName = CreateWindowW(L"EDIT", st->model->name.c_str(), WS_CHILD | WS_VISIBLE | WS_BORDER | ES_AUTOHSCROLL | WS_TABSTOP,
                                   m + lw + 6, y - 2, 360, 22, hwnd, (HMENU)(INT_PTR)200, nullptr, nullptr);
         EnableCtrlA(st->hName);
         y += 28;
-        wstring strServerUrl = GetString(L"server_url");
+        const wstring& strServerUrl = GetString(L"server_url");
         CreateWindowW(L"STATIC", strServerUrl.c_str(), WS_CHILD | WS_VISIBLE, m, y, lw, 20, hwnd, nullptr, nullptr, nullptr);
         st->hServer = CreateWindowW(L"EDIT", st->model->serverUrl.c_str(), WS_CHILD | WS_VISIBLE | WS_BORDER | ES_AUTOHSCROLL | WS_TABSTOP,
                                     m + lw + 6, y - 2, 360, 22, hwnd, (HMENU)(INT_PTR)201, nullptr, nullptr);
         EnableCtrlA(st->hServer);
         y += 28;
-        wstring strModelName = GetString(L"model_name");
+        const wstring& strModelName = GetString(L"model_name");
         CreateWindowW(L"STATIC", strModelName.c_str(), WS_CHILD | WS_VISIBLE, m, y, lw, 20, hwnd, nullptr, nullptr, nullptr);
         st->hModel = CreateWindowW(L"EDIT", st->model->modelName.c_str(), WS_CHILD | WS_VISIBLE | WS_BORDER | ES_AUTOHSCROLL | WS_TABSTOP,
                                    m + lw + 6, y - 2, 360, 22, hwnd, (HMENU)(INT_PTR)202, nullptr, nullptr);
         EnableCtrlA(st->hModel);
         y += 28;
-        wstring strProvider = GetString(L"provider");
+        const wstring& strProvider = GetString(L"provider");
         CreateWindowW(L"STATIC", strProvider.c_str(), WS_CHILD | WS_VISIBLE, m, y, lw, 20, hwnd, nullptr, nullptr, nullptr);
         st->hProvider = CreateWindowW(L"COMBOBOX", nullptr, WS_CHILD | WS_VISIBLE | CBS_DROPDOWNLIST | WS_TABSTOP,
                                       m + lw + 6, y - 2, 360, 200, hwnd, (HMENU)(INT_PTR)207, nullptr, nullptr);
         PopulateProviderCombo(st->hProvider, st->model->providerId);
         y += 28;
-        wstring strApiKey = GetString(L"api_key");
+        const wstring& strApiKey = GetString(L"api_key");
         CreateWindowW(L"STATIC", strApiKey.c_str(), WS_CHILD | WS_VISIBLE, m, y, lw, 20, hwnd, nullptr, nullptr, nullptr);
         st->hKey = CreateWindowW(L"EDIT", st->model->apiKey.c_str(), WS_CHILD | WS_VISIBLE | WS_BORDER | ES_AUTOHSCROLL | ES_PASSWORD | WS_TABSTOP,
                                  m + lw + 6, y - 2, 360, 22, hwnd, (HMENU)(INT_PTR)203, nullptr, nullptr);
         EnableCtrlA(st->hKey);
         y += 36;
-        wstring strSave = GetString(L"save");
-        wstring strDelete = GetString(L"delete");
-        wstring strClose = GetString(L"close");
+        const wstring& strSave = GetString(L"save");
+        const wstring& strDelete = GetString(L"delete");
+        const wstring& strClose = GetString(L"close");
         CreateWindowW(L"BUTTON", strSave.c_str(), WS_CHILD | WS_VISIBLE | WS_TABSTOP | BS_DEFPUSHBUTTON, m + 20, y, 90, 26, hwnd,
                       (HMENU)(INT_PTR)204, nullptr, nullptr);
         CreateWindowW(L"BUTTON", strDelete.c_str(), WS_CHILD | WS_VISIBLE | WS_TABSTOP, m + 120, y, 90, 26, hwnd,
@@ -1614,7 +1364,7 @@ LRESULT CALLBACK ModelDlgProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
             int tsel = static_cast<int>(SendMessageW(st->hProvider, CB_GETCURSEL, 0, 0));
             if (tsel >= 0) {
                 size_t provIdx = static_cast<size_t>(SendMessageW(st->hProvider, CB_GETITEMDATA, tsel, 0));
-                if (provIdx < g_providers.size()) st->model->providerId = g_providers[provIdx].id;
+                if (provIdx < g_engine.Providers().size()) st->model->providerId = g_engine.Providers()[provIdx].id;
             }
             GetWindowTextW(st->hKey, buf, 512); st->model->apiKey = buf;
             st->result = 1; DestroyWindow(hwnd); return 0;
@@ -1628,13 +1378,13 @@ LRESULT CALLBACK ModelDlgProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
             int tsel = static_cast<int>(SendMessageW(st->hProvider, CB_GETCURSEL, 0, 0));
             if (tsel >= 0) {
                 size_t provIdx = static_cast<size_t>(SendMessageW(st->hProvider, CB_GETITEMDATA, tsel, 0));
-                if (provIdx < g_providers.size()) cur.providerId = g_providers[provIdx].id;
+                if (provIdx < g_engine.Providers().size()) cur.providerId = g_engine.Providers()[provIdx].id;
             }
             GetWindowTextW(st->hKey, buf, 512); cur.apiKey = buf;
             bool dirty = (cur.name != st->original.name) || (cur.serverUrl != st->original.serverUrl) || (cur.modelName != st->original.modelName) || (cur.apiKey != st->original.apiKey) || (cur.providerId != st->original.providerId);
             if (dirty) {
-                wstring strUnsaved = GetString(L"unsaved_changes");
-                wstring strConfirm = GetString(L"confirm");
+                const wstring& strUnsaved = GetString(L"unsaved_changes");
+                const wstring& strConfirm = GetString(L"confirm");
                 int r = MessageBoxW(hwnd, strUnsaved.c_str(), strConfirm.c_str(), MB_YESNOCANCEL | MB_ICONQUESTION);
                 if (r == IDYES) { PostMessageW(hwnd, WM_COMMAND, MAKEWPARAM(204, BN_CLICKED), 0); return 0; }
                 if (r == IDCANCEL) return 0;
@@ -1679,13 +1429,14 @@ bool RegexMatchNoCase(const wstring& text, const wstring& pattern) {
  */
 bool FetchModels(const ApiProvider& provider, const wstring& serverUrl, const wstring& apiKey, vector<wstring>& models, wstring& err) {
     if (provider.modelsEndpoint.empty()) { err = L"models endpoint not defined"; return false; }
-    ModelConfig dummy{ L"", serverUrl, L"", apiKey, provider.id };
-    wstring endpoint = ReplacePlaceholders(provider.modelsEndpoint, dummy, L"", L"", L"", L"", false);
+    const string key = ToUtf8(apiKey);
+    const PlaceholderValues values = MakePlaceholderValues({}, key, {}, {}, {}, {}, {});
+    wstring endpoint = FromUtf8(provider.modelsEndpointTpl.Render(values, false));
     wstring host, path; bool useHttps = true;
     if (!PrepareEndpoint(serverUrl, endpoint, host, path, useHttps)) { err = L"PrepareEndpoint failed"; return false; }
-    wstring headers = BuildHeaderString(provider.modelsHeaders, dummy);
-    string body = ToUtf8(ReplacePlaceholders(provider.modelsPayload, dummy, L"", L"", L"", L"", false));
-    wstring resp;
+    wstring headers = BuildHeaderString(provider.modelsHeaderTpls, values);
+    string body = provider.modelsPayloadTpl.Render(values, false);
+    string resp;
     if (!provider.modelsMethod.empty() && RegexMatchNoCase(provider.modelsMethod, L"post")) {
         resp = HttpRequestWithHeaders(host, path, useHttps, headers, body, L"POST", &err);
     } else {
@@ -1693,40 +1444,27 @@ bool FetchModels(const ApiProvider& provider, const wstring& serverUrl, const ws
         resp = HttpRequestWithHeaders(host, path, useHttps, headers, emptyBody, L"GET", &err);
     }
     if (resp.empty()) return false;
-    try {
-        using namespace winrt::Windows::Data::Json;
-        IJsonValue root = JsonValue::Parse(resp);
-        auto splitPath = [&](const wstring& s) {
-            vector<wstring> parts; size_t start = 0;
-            for (size_t i = 0; i <= s.size(); ++i) if (i == s.size() || s[i] == L'.') { parts.push_back(s.substr(start, i - start)); start = i + 1; }
-            return parts;
-        };
-        auto parts = splitPath(provider.modelsResultPath);
-        IJsonValue cur = root;
-        for (const auto& part : parts) {
-            if (part.empty()) continue;
-            if (cur.ValueType() == JsonValueType::Object) {
-                JsonObject obj = cur.GetObject();
-                if (!obj.HasKey(part)) { err = L"models result path missing"; return false; }
-                cur = obj.GetNamedValue(part);
-            } else {
-                err = L"models result path invalid"; return false;
-            }
+    JsonValue root;
+    string parseErr;
+    if (!JsonValue::Parse(resp, root, &parseErr)) { err = FromUtf8(parseErr); return false; }
+    const JsonValue* cur = &root;
+    const wstring& resultPath = provider.modelsResultPath;
+    for (size_t start = 0, i = 0; i <= resultPath.size(); ++i) {
+        if (i < resultPath.size() && resultPath[i] != L'.') continue;
+        const string part = ToUtf8(resultPath.substr(start, i - start));
+        start = i + 1;
+        if (part.empty()) continue;
+        if (!cur->IsObject()) { err = L"models result path invalid"; return false; }
+        cur = cur->Find(part);
+        if (!cur) { err = L"models result path missing"; return false; }
+    }
+    if (!cur->IsArray()) return false;
+    for (const JsonValue& item : cur->Items()) {
+        if (item.IsObject()) {
+            if (const JsonValue* id = item.Find("id")) models.push_back(id->GetString());
+        } else if (item.IsString()) {
+            models.push_back(item.GetString());
         }
-        JsonArray arr;
-        if (cur.ValueType() == JsonValueType::Array) arr = cur.GetArray();
-        else return false;
-        for (auto const& item : arr) {
-            if (item.ValueType() == JsonValueType::Object) {
-                JsonObject obj = item.GetObject();
-                if (obj.HasKey(L"id")) models.push_back(wstring(obj.GetNamedString(L"id").c_str()));
-            } else if (item.ValueType() == JsonValueType::String) {
-                models.push_back(wstring(item.GetString().c_str()));
-            }
-        }
-    } catch (const winrt::hresult_error& e) {
-        err = e.message().c_str();
-        return false;
     }
     return !models.empty();
 }
@@ -1751,10 +1489,10 @@ wstring PickModelByPatterns(const vector<wstring>& models, const vector<wstring>
  * @return true if setup was successful, false otherwise
  */
 bool PerformInitialSetup(const SetupDialogState& st, wstring& err) {
-    using namespace winrt::Windows::Data::Json;
-    if (g_providers.empty()) { err = L"No providers"; return false; }
-    if (st.providerIndex >= g_providers.size()) { err = L"Invalid provider selection"; return false; }
-    const ApiProvider& provider = g_providers[st.providerIndex];
+    const vector<ApiProvider>& providers = g_engine.Providers();
+    if (providers.empty()) { err = L"No providers"; return false; }
+    if (st.providerIndex >= providers.size()) { err = L"Invalid provider selection"; return false; }
+    const ApiProvider& provider = providers[st.providerIndex];
     vector<wstring> modelList;
     if (!FetchModels(provider, st.serverUrl, st.apiKey, modelList, err)) return false;
     if (modelList.empty()) { err = L"No models"; return false; }
@@ -1778,10 +1516,10 @@ bool PerformInitialSetup(const SetupDialogState& st, wstring& err) {
     addModel(L"Image/Text", it);
     addModel(L"Image/Image", ii);
 
-    JsonObject def = CreateDefaultConfig();
+    JsonValue def = CreateDefaultConfig();
     g_language = st.languageCode.empty() ? g_language : st.languageCode;
-    if (def.HasKey(L"language")) g_language = wstring(def.GetNamedString(L"language", g_language.c_str()).c_str());
-    LoadFiltersFromJson(def, g_filters);
+    if (def.HasKey("language")) g_language = def.GetNamedString("language", g_language);
+    ParseFilters(def, g_filters);
     if (g_filters.empty()) {
         g_filters.push_back({ L"Translate", IOType::Text, IOType::Text, 0, L"Translate into English." });
     }
@@ -1950,7 +1688,7 @@ LRESULT CALLBACK SetupDlgProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
         st = reinterpret_cast<SetupDialogState*>(reinterpret_cast<LPCREATESTRUCT>(lParam)->lpCreateParams);
         SetWindowLongPtr(hwnd, GWLP_USERDATA, reinterpret_cast<LONG_PTR>(st));
         int m = 12, y = m, lw = 150, cw = 320;
-        wstring strLang = GetString(L"language");
+        const wstring& strLang = GetString(L"language");
         HWND hLangLbl = CreateWindowW(L"STATIC", strLang.c_str(), WS_CHILD | WS_VISIBLE | SS_CENTERIMAGE, m, y, lw, 22, hwnd, nullptr, nullptr, nullptr);
         SetUIFont(hLangLbl);
         st->hLang = CreateWindowW(L"COMBOBOX", nullptr, WS_CHILD | WS_VISIBLE | CBS_DROPDOWNLIST | WS_TABSTOP, m + lw + 6, y, cw, 200, hwnd, (HMENU)(INT_PTR)300, nullptr, nullptr);
@@ -1965,7 +1703,7 @@ LRESULT CALLBACK SetupDlgProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
         SendMessageW(st->hLang, CB_SETCURSEL, langSel, 0);
         y += 32;
 
-        wstring strHotkey = GetString(L"hotkey");
+        const wstring& strHotkey = GetString(L"hotkey");
         HWND hHotkeyLbl = CreateWindowW(L"STATIC", strHotkey.c_str(), WS_CHILD | WS_VISIBLE | SS_CENTERIMAGE, m, y, lw, 22, hwnd, nullptr, nullptr, nullptr);
         SetUIFont(hHotkeyLbl);
         wstring currentKey = VKCodeToString(st->vkCode, st->mods);
@@ -1977,24 +1715,24 @@ LRESULT CALLBACK SetupDlgProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
         SetUIFont(st->hKeyButton);
         y += 32;
 
-        wstring strProvider = GetString(L"provider");
+        const wstring& strProvider = GetString(L"provider");
         HWND hProvLbl = CreateWindowW(L"STATIC", strProvider.c_str(), WS_CHILD | WS_VISIBLE | SS_CENTERIMAGE, m, y, lw, 22, hwnd, nullptr, nullptr, nullptr);
         SetUIFont(hProvLbl);
         st->hProvider = CreateWindowW(L"COMBOBOX", nullptr, WS_CHILD | WS_VISIBLE | CBS_DROPDOWNLIST | WS_TABSTOP, m + lw + 6, y, cw, 200, hwnd, (HMENU)(INT_PTR)306, nullptr, nullptr);
         SetUIFont(st->hProvider);
         int psel = 0;
-        for (size_t i = 0; i < g_providers.size(); ++i) {
-            int idx = static_cast<int>(SendMessageW(st->hProvider, CB_ADDSTRING, 0, reinterpret_cast<LPARAM>(g_providers[i].id.c_str())));
+        for (size_t i = 0; i < g_engine.Providers().size(); ++i) {
+            int idx = static_cast<int>(SendMessageW(st->hProvider, CB_ADDSTRING, 0, reinterpret_cast<LPARAM>(g_engine.Providers()[i].id.c_str())));
             SendMessageW(st->hProvider, CB_SETITEMDATA, idx, static_cast<LPARAM>(i));
             if (i == st->providerIndex) psel = idx;
         }
         SendMessageW(st->hProvider, CB_SETCURSEL, psel, 0);
-        if (st->providerIndex < g_providers.size() && !g_providers[st->providerIndex].defaultEndpoint.empty()) {
-            st->serverUrl = g_providers[st->providerIndex].defaultEndpoint;
+        if (st->providerIndex < g_engine.Providers().size() && !g_engine.Providers()[st->providerIndex].defaultEndpoint.empty()) {
+            st->serverUrl = g_engine.Providers()[st->providerIndex].defaultEndpoint;
         }
         y += 32;
 
-        wstring strServerUrl = GetString(L"server_url");
+        const wstring& strServerUrl = GetString(L"server_url");
         HWND hSrvLbl = CreateWindowW(L"STATIC", strServerUrl.c_str(), WS_CHILD | WS_VISIBLE | SS_CENTERIMAGE, m, y, lw, 22, hwnd, nullptr, nullptr, nullptr);
         SetUIFont(hSrvLbl);
         st->hServer = CreateWindowW(L"EDIT", st->serverUrl.c_str(), WS_CHILD | WS_VISIBLE | WS_BORDER | ES_AUTOHSCROLL | WS_TABSTOP, m + lw + 6, y + 1, cw, 22, hwnd, (HMENU)(INT_PTR)307, nullptr, nullptr);
@@ -2002,7 +1740,7 @@ LRESULT CALLBACK SetupDlgProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
         EnableCtrlA(st->hServer);
         y += 32;
 
-        wstring strApiKey = GetString(L"api_key");
+        const wstring& strApiKey = GetString(L"api_key");
         HWND hApiLbl = CreateWindowW(L"STATIC", strApiKey.c_str(), WS_CHILD | WS_VISIBLE | SS_CENTERIMAGE, m, y, lw, 22, hwnd, nullptr, nullptr, nullptr);
         SetUIFont(hApiLbl);
         st->hApiKey = CreateWindowW(L"EDIT", st->apiKey.c_str(), WS_CHILD | WS_VISIBLE | WS_BORDER | ES_AUTOHSCROLL | WS_TABSTOP, m + lw + 6, y + 1, cw, 22, hwnd, (HMENU)(INT_PTR)308, nullptr, nullptr);
@@ -2010,8 +1748,8 @@ LRESULT CALLBACK SetupDlgProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
         EnableCtrlA(st->hApiKey);
         y += 44;
 
-        wstring strCheck = GetString(L"check_connection");
-        wstring strExit = GetString(L"exit_app");
+        const wstring& strCheck = GetString(L"check_connection");
+        const wstring& strExit = GetString(L"exit_app");
         HWND hCheck = CreateWindowW(L"BUTTON", strCheck.c_str(), WS_CHILD | WS_VISIBLE | WS_TABSTOP | BS_DEFPUSHBUTTON, m, y, 160, 30, hwnd, (HMENU)(INT_PTR)309, nullptr, nullptr);
         HWND hExit = CreateWindowW(L"BUTTON", strExit.c_str(), WS_CHILD | WS_VISIBLE | WS_TABSTOP, m + 180, y, 160, 30, hwnd, (HMENU)(INT_PTR)310, nullptr, nullptr);
         SetUIFont(hCheck); SetUIFont(hExit);
@@ -2027,7 +1765,7 @@ LRESULT CALLBACK SetupDlgProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
         if (id == 309) { // Save
             CollectSetupFromUI(st);
             wstring err;
-            if (st->providerIndex >= g_providers.size()) err = GetString(L"provider");
+            if (st->providerIndex >= g_engine.Providers().size()) err = GetString(L"provider");
             if (st->serverUrl.empty()) err = GetString(L"server_url");
             if (!err.empty()) {
                 MessageBoxW(hwnd, err.c_str(), L"cbfilter", MB_OK | MB_ICONWARNING);
@@ -2052,7 +1790,7 @@ LRESULT CALLBACK SetupDlgProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
                 MessageBoxW(hwnd, errMsg.c_str(), L"cbfilter", MB_OK | MB_ICONERROR);
                 return 0;
             }
-            wstring okMsg = GetString(L"connection_success");
+            const wstring& okMsg = GetString(L"connection_success");
             MessageBoxW(hwnd, okMsg.c_str(), L"cbfilter", MB_OK | MB_ICONINFORMATION);
             st->result = 1; DestroyWindow(hwnd); return 0;
         }
@@ -2066,9 +1804,9 @@ LRESULT CALLBACK SetupDlgProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
             LogLine(L"SetupDlgProc: provider selection index=" + to_wstring(psel));
             if (psel >= 0) {
                 size_t provIdx = static_cast<size_t>(SendMessageW(st->hProvider, CB_GETITEMDATA, psel, 0));
-                LogLine(L"SetupDlgProc: provider index=" + to_wstring(provIdx) + L" total providers=" + to_wstring(g_providers.size()));
-                if (provIdx < g_providers.size()) {
-                    const auto& prov = g_providers[provIdx];
+                LogLine(L"SetupDlgProc: provider index=" + to_wstring(provIdx) + L" total providers=" + to_wstring(g_engine.Providers().size()));
+                if (provIdx < g_engine.Providers().size()) {
+                    const auto& prov = g_engine.Providers()[provIdx];
                     LogLine(L"SetupDlgProc: provider id=" + prov.id + L" defaultEndpoint=" + prov.defaultEndpoint);
                     if (!prov.defaultEndpoint.empty()) {
                         SetWindowTextW(st->hServer, prov.defaultEndpoint.c_str());
@@ -2116,7 +1854,7 @@ LRESULT CALLBACK SetupDlgProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
  */
 int ShowModelDialog(HWND parent, ModelConfig& model, size_t index) {
     ModelDialogState st{ &model, index, 0, model };
-    wstring strModelSettings = GetString(L"model_settings");
+    const wstring& strModelSettings = GetString(L"model_settings");
     HWND dlg = CreateWindowExW(WS_EX_DLGMODALFRAME | WS_EX_CONTROLPARENT, kModelClass, strModelSettings.c_str(),
         WS_OVERLAPPED | WS_CAPTION | WS_SYSMENU, CW_USEDEFAULT, CW_USEDEFAULT, 520, 260, parent, nullptr, g_hInst, &st);
     g_modelWnd = dlg;
@@ -2152,7 +1890,7 @@ int ShowSetupDialog() {
     st.providerIndex = 0;
     if (!g_models.empty()) st.serverUrl = g_models.front().serverUrl;
     st.apiKey = L"";
-    wstring title = GetString(L"initial_setup");
+    const wstring& title = GetString(L"initial_setup");
     HWND dlg = CreateWindowExW(WS_EX_DLGMODALFRAME | WS_EX_CONTROLPARENT, kSetupClass, title.c_str(),
         WS_OVERLAPPED | WS_CAPTION | WS_SYSMENU, CW_USEDEFAULT, CW_USEDEFAULT, 520, 280, nullptr, nullptr, g_hInst, &st);
     ShowWindow(dlg, SW_SHOWNORMAL);
@@ -2226,9 +1964,36 @@ void ReassignModelOnDelete(size_t idx) {
     for (auto& f : g_filters) {
         if (f.modelIndex == idx) f.modelIndex = 0;
         else if (f.modelIndex > idx) --f.modelIndex;
+        erase(f.hedgeModels, idx);
+        for (auto& h : f.hedgeModels) if (h > idx) --h;
+        erase(f.fanOutModels, idx);
+        for (auto& h : f.fanOutModels) if (h > idx) --h;
     }
 }
 
+/**
+ * @brief Re-check fan-out and pipeline references after filters were edited or removed
+ */
+void ValidateFilterReferences() {
+    ValidatePipelines(g_filters);
+    ValidateFanOuts(g_filters);
+}
+
+/**
+ * @brief Remove a filter and update the fan-out and pipeline references of the others
+ * @param idx Index of the filter to delete
+ */
+void DeleteFilter(size_t idx) {
+    g_filters.erase(g_filters.begin() + idx);
+    for (auto& f : g_filters) {
+        for (auto* refs : {&f.fanOutFilters, &f.pipeline}) {
+            erase(*refs, idx);
+            for (auto& r : *refs) if (r > idx) --r;
+        }
+    }
+    ValidateFilterReferences();
+}
+
 /**
  * @brief Populate combo box with model names
  * @param combo Combo box control handle
@@ -2236,7 +2001,7 @@ void ReassignModelOnDelete(size_t idx) {
 void PopulateModelCombo(HWND combo) {
     SendMessageW(combo, CB_RESETCONTENT, 0, 0);
     for (const auto& m : g_models) SendMessageW(combo, CB_ADDSTRING, 0, reinterpret_cast<LPARAM>(m.name.c_str()));
-    wstring strAddModel = GetString(L"add_language_model");
+    const wstring& strAddModel = GetString(L"add_language_model");
     SendMessageW(combo, CB_ADDSTRING, 0, reinterpret_cast<LPARAM>(strAddModel.c_str()));
 }
 
@@ -2285,46 +2050,46 @@ LRESULT CALLBACK EditDlgProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
         st->original = *st->filter;
         SetWindowLongPtr(hwnd, GWLP_USERDATA, reinterpret_cast<LONG_PTR>(st));
         const int margin = 12, labelW = 160; int y = margin;
-        wstring strFilterName = GetString(L"filter_name");
+        const wstring& strFilterName = GetString(L"filter_name");
         CreateWindowW(L"STATIC", strFilterName.c_str(), WS_CHILD | WS_VISIBLE, margin, y, labelW, 22, hwnd, nullptr, nullptr, nullptr);
     st->hName = CreateWindowW(L"EDIT", st->filter->title.c_str(), WS_CHILD | WS_VISIBLE | WS_BORDER | ES_AUTOHSCROLL | WS_TABSTOP,
         margin + labelW + 6, y - 2, 400, 24, hwnd, (HMENU)(INT_PTR)100, nullptr, nullptr);
     EnableCtrlA(st->hName);
         y += 32;
-        wstring strInputType = GetString(L"input_type");
+        const wstring& strInputType = GetString(L"input_type");
         CreateWindowW(L"STATIC", strInputType.c_str(), WS_CHILD | WS_VISIBLE, margin, y, labelW, 22, hwnd, nullptr, nullptr, nullptr);
         st->hIn = CreateWindowW(L"COMBOBOX", nullptr, WS_CHILD | WS_VISIBLE | CBS_DROPDOWNLIST | WS_TABSTOP,
             margin + labelW + 6, y - 2, 180, 300, hwnd, (HMENU)(INT_PTR)101, nullptr, nullptr);
-        wstring strText = GetString(L"text_type");
-        wstring strImage = GetString(L"image_type");
+        const wstring& strText = GetString(L"text_type");
+        const wstring& strImage = GetString(L"image_type");
         SendMessageW(st->hIn, CB_ADDSTRING, 0, reinterpret_cast<LPARAM>(strText.c_str()));
         SendMessageW(st->hIn, CB_ADDSTRING, 0, reinterpret_cast<LPARAM>(strImage.c_str()));
         SendMessageW(st->hIn, CB_SETCURSEL, st->filter->input == IOType::Text ? 0 : 1, 0);
-        wstring strOutputType = GetString(L"output_type");
+        const wstring& strOutputType = GetString(L"output_type");
         CreateWindowW(L"STATIC", strOutputType.c_str(), WS_CHILD | WS_VISIBLE, margin, y + 32, labelW, 22, hwnd, nullptr, nullptr, nullptr);
         st->hOut = CreateWindowW(L"COMBOBOX", nullptr, WS_CHILD | WS_VISIBLE | CBS_DROPDOWNLIST | WS_TABSTOP,
             margin + labelW + 6, y + 30, 180, 300, hwnd, (HMENU)(INT_PTR)102, nullptr, nullptr);
         SendMessageW(st->hOut, CB_ADDSTRING, 0, reinterpret_cast<LPARAM>(strText.c_str()));
         SendMessageW(st->hOut, CB_ADDSTRING, 0, reinterpret_cast<LPARAM>(strImage.c_str()));
         SendMessageW(st->hOut, CB_SETCURSEL, st->filter->output == IOType::Text ? 0 : 1, 0);
-        wstring strLanguageModel = GetString(L"language_model");
+        const wstring& strLanguageModel = GetString(L"language_model");
         CreateWindowW(L"STATIC", strLanguageModel.c_str(), WS_CHILD | WS_VISIBLE, margin, y + 64, labelW, 22, hwnd, nullptr, nullptr, nullptr);
         st->hModel = CreateWindowW(L"COMBOBOX", nullptr, WS_CHILD | WS_VISIBLE | CBS_DROPDOWNLIST | WS_TABSTOP,
             margin + labelW + 6, y + 62, 300, 300, hwnd, (HMENU)(INT_PTR)103, nullptr, nullptr);
         for (const auto& m : g_models) SendMessageW(st->hModel, CB_ADDSTRING, 0, reinterpret_cast<LPARAM>(m.name.c_str()));
-        wstring strAddModel = GetString(L"add_language_model");
+        const wstring& strAddModel = GetString(L"add_language_model");
         SendMessageW(st->hModel, CB_ADDSTRING, 0, reinterpret_cast<LPARAM>(strAddModel.c_str()));
         SendMessageW(st->hModel, CB_SETCURSEL, st->filter->modelIndex, 0);
-        wstring strModelSettings = GetString(L"model_settings");
+        const wstring& strModelSettings = GetString(L"model_settings");
         CreateWindowW(L"BUTTON", strModelSettings.c_str(), WS_CHILD | WS_VISIBLE | WS_TABSTOP, margin + labelW + 6 + 310, y + 61, 110, 26, hwnd,
             (HMENU)(INT_PTR)104, nullptr, nullptr);
-        wstring strPrompt = GetString(L"prompt");
+        const wstring& strPrompt = GetString(L"prompt");
         CreateWindowW(L"STATIC", strPrompt.c_str(), WS_CHILD | WS_VISIBLE, margin, y + 96, labelW, 22, hwnd, nullptr, nullptr, nullptr);
     st->hPrompt = CreateWindowW(L"EDIT", st->filter->prompt.c_str(), WS_CHILD | WS_VISIBLE | WS_BORDER | ES_LEFT | ES_MULTILINE | ES_AUTOVSCROLL | WS_TABSTOP,
         margin, y + 120, 600, 180, hwnd, (HMENU)(INT_PTR)105, nullptr, nullptr);
         g_promptOldProc = reinterpret_cast<WNDPROC>(SetWindowLongPtr(st->hPrompt, GWLP_WNDPROC, reinterpret_cast<LONG_PTR>(PromptEditProc)));
-        wstring strSave = GetString(L"save");
-        wstring strClose = GetString(L"close");
+        const wstring& strSave = GetString(L"save");
+        const wstring& strClose = GetString(L"close");
         CreateWindowW(L"BUTTON", strSave.c_str(), WS_CHILD | WS_VISIBLE | WS_TABSTOP | BS_DEFPUSHBUTTON, margin + 360, y + 310, 100, 30, hwnd,
             (HMENU)(INT_PTR)106, nullptr, nullptr);
         CreateWindowW(L"BUTTON", strClose.c_str(), WS_CHILD | WS_VISIBLE | WS_TABSTOP, margin + 470, y + 310, 100, 30, hwnd,
@@ -2338,8 +2103,8 @@ LRESULT CALLBACK EditDlgProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
             FilterDefinition cur = *st->filter;
             CollectFilterFromUI(st, cur);
             if (IsFilterDirty(cur, st->original)) {
-                wstring strUnsaved = GetString(L"unsaved_changes");
-                wstring strConfirm = GetString(L"confirm");
+                const wstring& strUnsaved = GetString(L"unsaved_changes");
+                const wstring& strConfirm = GetString(L"confirm");
                 int r = MessageBoxW(hwnd, strUnsaved.c_str(), strConfirm.c_str(), MB_YESNOCANCEL | MB_ICONQUESTION);
                 if (r == IDYES) { PostMessageW(hwnd, WM_COMMAND, MAKEWPARAM(106, BN_CLICKED), 0); return 0; }
                 if (r == IDCANCEL) return 0;
@@ -2352,7 +2117,7 @@ LRESULT CALLBACK EditDlgProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
         if (id == 103 && code == CBN_SELCHANGE) {
             int sel = static_cast<int>(SendMessageW(st->hModel, CB_GETCURSEL, 0, 0));
             if (sel == static_cast<int>(g_models.size())) {
-                wstring strNewModel = GetString(L"new_model");
+                const wstring& strNewModel = GetString(L"new_model");
                 ModelConfig m{ strNewModel, L"", L"", L"", L"" };
                 g_models.push_back(m);
                 size_t idx = g_models.size() - 1;
@@ -2410,7 +2175,7 @@ LRESULT CALLBACK EditDlgProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
  */
 void ShowEditDialog(HWND parent, FilterDefinition& filter) {
     EditDialogState st{ &filter, filter };
-    wstring strFilterEdit = GetString(L"filter_edit");
+    const wstring& strFilterEdit = GetString(L"filter_edit");
     HWND dlg = CreateWindowExW(WS_EX_DLGMODALFRAME | WS_EX_CONTROLPARENT, kEditClass, strFilterEdit.c_str(),
         WS_OVERLAPPED | WS_CAPTION | WS_SYSMENU, CW_USEDEFAULT, CW_USEDEFAULT, 650, 430, parent, nullptr, g_hInst, &st);
     g_editWnd = dlg;
@@ -2444,6 +2209,150 @@ void UpdateListView(HWND list) {
     }
 }
 
+/**
+ * @struct StatsState
+ * @brief State for usage statistics window
+ */
+struct StatsState {
+    HWND hGroup{};
+    HWND hList{};
+    UsageGroup group{UsageGroup::FilterModel};
+    vector<UsageAggregate> rows;   // Rows shown, for export
+};
+
+/**
+ * @brief Fill the statistics list with the current aggregates (columns depend on the grouping)
+ */
+void UpdateStatsList(StatsState* st) {
+    st->rows = g_usageStats.Aggregate(st->group);
+    HWND list = st->hList;
+    SendMessageW(list, WM_SETREDRAW, FALSE, 0);
+    ListView_DeleteAllItems(list);
+    while (ListView_DeleteColumn(list, 0)) {}
+    struct Column { const wchar_t* key; int width; bool right; };
+    vector<Column> columns;
+    if (st->group != UsageGroup::Model) columns.push_back({L"filter", 140, false});
+    if (st->group != UsageGroup::Filter) columns.push_back({L"model", 110, false});
+    for (const Column& c : initializer_list<Column>{
+             {L"col_requests", 64, true}, {L"col_failures", 56, true}, {L"col_cache_hits", 64, true},
+             {L"col_latency_p50", 64, true}, {L"col_latency_p95", 64, true}, {L"col_first_byte", 80, true},
+             {L"col_tokens_per_sec", 64, true}, {L"col_prompt_tokens", 80, true}, {L"col_output_tokens", 80, true},
+             {L"col_cached_tokens", 80, true}, {L"col_cost", 64, true}}) {
+        columns.push_back(c);
+    }
+    for (size_t i = 0; i < columns.size(); ++i) {
+        LVCOLUMNW col{}; col.mask = LVCF_TEXT | LVCF_WIDTH | LVCF_FMT;
+        col.fmt = columns[i].right ? LVCFMT_RIGHT : LVCFMT_LEFT;
+        col.pszText = const_cast<LPWSTR>(GetString(columns[i].key).c_str()); col.cx = columns[i].width;
+        ListView_InsertColumn(list, static_cast<int>(i), &col);
+    }
+    int idx = 0;
+    for (const UsageAggregate& a : st->rows) {
+        vector<wstring> cells;
+        if (st->group != UsageGroup::Model) cells.push_back(a.filter);
+        if (st->group != UsageGroup::Filter) cells.push_back(a.model);
+        cells.push_back(to_wstring(a.requests));
+        cells.push_back(to_wstring(a.failures));
+        cells.push_back(to_wstring(a.cacheHits));
+        cells.push_back(format(L"{:.0f}", a.p50Ms));
+        cells.push_back(format(L"{:.0f}", a.p95Ms));
+        cells.push_back(format(L"{:.0f}", a.p50FirstByteMs));
+        cells.push_back(format(L"{:.1f}", a.tokensPerSecond));
+        cells.push_back(to_wstring(a.promptTokens));
+        cells.push_back(to_wstring(a.completionTokens));
+        cells.push_back(to_wstring(a.cachedTokens));
+        cells.push_back(format(L"{:.4f}", a.cost));
+        LVITEMW item{}; item.mask = LVIF_TEXT; item.iItem = idx; item.pszText = const_cast<LPWSTR>(cells[0].c_str()); ListView_InsertItem(list, &item);
+        for (size_t c = 1; c < cells.size(); ++c) ListView_SetItemText(list, idx, static_cast<int>(c), const_cast<LPWSTR>(cells[c].c_str()));
+        ++idx;
+    }
+    SendMessageW(list, WM_SETREDRAW, TRUE, 0);
+    InvalidateRect(list, nullptr, TRUE);
+}
+
+/**
+ * @brief Ask for a file name and write the aggregates shown as CSV
+ */
+void ExportStatsCsv(HWND hwnd, const StatsState* st) {
+    wchar_t file[MAX_PATH] = L"cbfilter-usage.csv";
+    OPENFILENAMEW ofn{ sizeof(ofn) };
+    ofn.hwndOwner = hwnd;
+    ofn.lpstrFilter = L"CSV (*.csv)\0*.csv\0";
+    ofn.lpstrFile = file;
+    ofn.nMaxFile = MAX_PATH;
+    ofn.lpstrDefExt = L"csv";
+    ofn.Flags = OFN_OVERWRITEPROMPT | OFN_PATHMUSTEXIST;
+    if (!GetSaveFileNameW(&ofn)) return;
+    if (!WriteUsageCsv(file, st->rows, st->group)) {
+        LogLine(L"Failed to write usage statistics to " + wstring(file));
+        MessageBoxW(hwnd, GetString(L"stats_export_failed").c_str(), L"cbfilter", MB_OK | MB_ICONERROR);
+    }
+}
+
+/**
+ * @brief Window procedure for usage statistics window
+ */
+LRESULT CALLBACK StatsWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
+    auto* st = reinterpret_cast<StatsState*>(GetWindowLongPtr(hwnd, GWLP_USERDATA));
+    switch (msg) {
+    case WM_CREATE: {
+        st = new StatsState(); SetWindowLongPtr(hwnd, GWLP_USERDATA, reinterpret_cast<LONG_PTR>(st));
+        st->hGroup = CreateWindowW(L"COMBOBOX", nullptr, WS_CHILD | WS_VISIBLE | CBS_DROPDOWNLIST | WS_TABSTOP,
+                                   16, 10, 220, 200, hwnd, (HMENU)(INT_PTR)IDC_STATS_GROUP, g_hInst, nullptr);
+        for (const wchar_t* key : { L"group_filter_model", L"group_filter", L"group_model" }) {
+            SendMessageW(st->hGroup, CB_ADDSTRING, 0, reinterpret_cast<LPARAM>(GetString(key).c_str()));
+        }
+        SendMessageW(st->hGroup, CB_SETCURSEL, 0, 0);
+        st->hList = CreateWindowExW(WS_EX_CLIENTEDGE, WC_LISTVIEWW, nullptr,
+                                   WS_CHILD | WS_VISIBLE | LVS_REPORT | LVS_SINGLESEL | WS_TABSTOP,
+                                   16, 42, 900, 300, hwnd, (HMENU)(INT_PTR)IDC_STATS_LIST, g_hInst, nullptr);
+        ListView_SetExtendedListViewStyle(st->hList, LVS_EX_FULLROWSELECT | LVS_EX_GRIDLINES);
+        CreateWindowW(L"BUTTON", GetString(L"export_csv").c_str(), WS_CHILD | WS_VISIBLE | WS_TABSTOP, 16, 352, 120, 26, hwnd, (HMENU)(INT_PTR)IDC_STATS_EXPORT, g_hInst, nullptr);
+        CreateWindowW(L"BUTTON", GetString(L"clear").c_str(), WS_CHILD | WS_VISIBLE | WS_TABSTOP, 144, 352, 80, 26, hwnd, (HMENU)(INT_PTR)IDC_STATS_CLEAR, g_hInst, nullptr);
+        CreateWindowW(L"BUTTON", GetString(L"close").c_str(), WS_CHILD | WS_VISIBLE | WS_TABSTOP, 836, 352, 80, 26, hwnd, (HMENU)(INT_PTR)IDC_STATS_CLOSE, g_hInst, nullptr);
+        UpdateStatsList(st);
+        return 0;
+    }
+    case WM_ACTIVATE:
+        // Requests made while the window was in the background show up when it comes back
+        if (LOWORD(wParam) != WA_INACTIVE && st) UpdateStatsList(st);
+        break;
+    case WM_COMMAND:
+        switch (LOWORD(wParam)) {
+        case IDC_STATS_GROUP:
+            if (HIWORD(wParam) == CBN_SELCHANGE) {
+                const LRESULT sel = SendMessageW(st->hGroup, CB_GETCURSEL, 0, 0);
+                st->group = sel == 1 ? UsageGroup::Filter : sel == 2 ? UsageGroup::Model : UsageGroup::FilterModel;
+                UpdateStatsList(st);
+            }
+            return 0;
+        case IDC_STATS_EXPORT: ExportStatsCsv(hwnd, st); return 0;
+        case IDC_STATS_CLEAR:
+            if (MessageBoxW(hwnd, GetString(L"clear_stats_confirm").c_str(), GetString(L"confirm").c_str(), MB_YESNO | MB_ICONQUESTION) == IDYES) {
+                g_usageStats.Clear();
+                UpdateStatsList(st);
+            }
+            return 0;
+        case IDC_STATS_CLOSE: DestroyWindow(hwnd); return 0;
+        default: return 0;
+        }
+    case WM_CLOSE: DestroyWindow(hwnd); return 0;
+    case WM_NCDESTROY: delete st; SetWindowLongPtr(hwnd, GWLP_USERDATA, 0); if (g_statsWnd == hwnd) g_statsWnd = nullptr; return 0;
+    }
+    return DefWindowProc(hwnd, msg, wParam, lParam);
+}
+
+/**
+ * @brief Show or activate usage statistics window
+ * @param owner Window the statistics are opened from
+ */
+void ShowStatsWindow(HWND owner) {
+    if (g_statsWnd && IsWindow(g_statsWnd)) { ShowWindow(g_statsWnd, SW_SHOWNORMAL); SetForegroundWindow(g_statsWnd); return; }
+    g_statsWnd = CreateWindowExW(WS_EX_CONTROLPARENT, kStatsClass, GetString(L"usage_stats").c_str(), WS_OVERLAPPED | WS_CAPTION | WS_SYSMENU,
+        CW_USEDEFAULT, CW_USEDEFAULT, 950, 430, owner, nullptr, g_hInst, nullptr);
+    ShowWindow(g_statsWnd, SW_SHOW);
+}
+
 /**
  * @brief Window procedure for settings window
  */
@@ -2452,7 +2361,7 @@ LRESULT CALLBACK SettingsWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lPar
     switch (msg) {
     case WM_CREATE: {
         st = new SettingsState(); SetWindowLongPtr(hwnd, GWLP_USERDATA, reinterpret_cast<LONG_PTR>(st));
-        wstring strFilterList = GetString(L"filter_list");
+        const wstring& strFilterList = GetString(L"filter_list");
         CreateWindowW(L"STATIC", strFilterList.c_str(), WS_CHILD | WS_VISIBLE, 16, 10, 200, 20, hwnd, nullptr, nullptr, nullptr);
         st->hList = CreateWindowExW(WS_EX_CLIENTEDGE, WC_LISTVIEWW, nullptr,
                                    WS_CHILD | WS_VISIBLE | LVS_REPORT | LVS_SINGLESEL | LVS_SHOWSELALWAYS | WS_TABSTOP,
@@ -2460,23 +2369,25 @@ LRESULT CALLBACK SettingsWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lPar
         g_listOldProc = reinterpret_cast<WNDPROC>(SetWindowLongPtrW(st->hList, GWLP_WNDPROC, reinterpret_cast<LONG_PTR>(ListViewProc)));
         ListView_SetExtendedListViewStyle(st->hList, LVS_EX_FULLROWSELECT | LVS_EX_GRIDLINES);
         LVCOLUMNW col{}; col.mask = LVCF_TEXT | LVCF_WIDTH;
-        wstring strFilter = GetString(L"filter");
-        wstring strInput = GetString(L"input");
-        wstring strOutput = GetString(L"output");
-        wstring strModel = GetString(L"model");
+        const wstring& strFilter = GetString(L"filter");
+        const wstring& strInput = GetString(L"input");
+        const wstring& strOutput = GetString(L"output");
+        const wstring& strModel = GetString(L"model");
         col.pszText = const_cast<LPWSTR>(strFilter.c_str()); col.cx = 200; ListView_InsertColumn(st->hList, 0, &col);
         col.pszText = const_cast<LPWSTR>(strInput.c_str()); col.cx = 80; ListView_InsertColumn(st->hList, 1, &col);
         col.pszText = const_cast<LPWSTR>(strOutput.c_str()); col.cx = 80; ListView_InsertColumn(st->hList, 2, &col);
         col.pszText = const_cast<LPWSTR>(strModel.c_str()); col.cx = 180; ListView_InsertColumn(st->hList, 3, &col);
-        wstring strCopy = GetString(L"copy");
-        wstring strAdd = GetString(L"add");
-        wstring strEdit = GetString(L"edit");
-        wstring strDelete = GetString(L"delete");
-        wstring strClose = GetString(L"close");
+        const wstring& strCopy = GetString(L"copy");
+        const wstring& strAdd = GetString(L"add");
+        const wstring& strEdit = GetString(L"edit");
+        const wstring& strDelete = GetString(L"delete");
+        const wstring& strClose = GetString(L"close");
         CreateWindowW(L"BUTTON", strCopy.c_str(), WS_CHILD | WS_VISIBLE | WS_TABSTOP, 16, 270, 80, 26, hwnd, (HMENU)(INT_PTR)IDC_BTN_COPY, g_hInst, nullptr);
         CreateWindowW(L"BUTTON", strAdd.c_str(), WS_CHILD | WS_VISIBLE | WS_TABSTOP, 104, 270, 80, 26, hwnd, (HMENU)(INT_PTR)IDC_BTN_ADD, g_hInst, nullptr);
         CreateWindowW(L"BUTTON", strEdit.c_str(), WS_CHILD | WS_VISIBLE | WS_TABSTOP, 192, 270, 80, 26, hwnd, (HMENU)(INT_PTR)IDC_BTN_EDIT, g_hInst, nullptr);
         CreateWindowW(L"BUTTON", strDelete.c_str(), WS_CHILD | WS_VISIBLE | WS_TABSTOP, 280, 270, 80, 26, hwnd, (HMENU)(INT_PTR)IDC_BTN_DELETE, g_hInst, nullptr);
+        const wstring& strStats = GetString(L"usage_stats");
+        CreateWindowW(L"BUTTON", strStats.c_str(), WS_CHILD | WS_VISIBLE | WS_TABSTOP, 368, 270, 120, 26, hwnd, (HMENU)(INT_PTR)IDC_BTN_STATS, g_hInst, nullptr);
         CreateWindowW(L"BUTTON", strClose.c_str(), WS_CHILD | WS_VISIBLE | WS_TABSTOP, 496, 270, 80, 26, hwnd, (HMENU)(INT_PTR)IDC_BTN_CLOSE, g_hInst, nullptr);
 
         // Add hotkey display and change button
@@ -2494,8 +2405,8 @@ LRESULT CALLBACK SettingsWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lPar
     case WM_NOTIFY: {
         LPNMHDR hdr = reinterpret_cast<LPNMHDR>(lParam);
         if (hdr->idFrom == IDC_LIST && hdr->code == NM_DBLCLK) {
-            wstring strUseEdit = GetString(L"use_edit_button");
-            wstring strHint = GetString(L"hint");
+            const wstring& strUseEdit = GetString(L"use_edit_button");
+            const wstring& strHint = GetString(L"hint");
             MessageBoxW(hwnd, strUseEdit.c_str(), strHint.c_str(), MB_OK | MB_ICONINFORMATION); return TRUE;
         }
         return 0;
@@ -2512,7 +2423,7 @@ LRESULT CALLBACK SettingsWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lPar
             return 0;
         }
         case IDC_BTN_ADD: {
-            wstring strNewFilter = GetString(L"new_filter");
+            const wstring& strNewFilter = GetString(L"new_filter");
             FilterDefinition def{ strNewFilter, IOType::Text, IOType::Text, 0, L"" };
             g_filters.push_back(def); UpdateListView(st->hList);
             int idx = static_cast<int>(g_filters.size() - 1); ListView_SetItemState(st->hList, idx, LVIS_SELECTED, LVIS_SELECTED);
@@ -2524,7 +2435,7 @@ LRESULT CALLBACK SettingsWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lPar
         case IDC_BTN_EDIT: {
             int sel = ListView_GetNextItem(st->hList, -1, LVNI_SELECTED);
             if (sel >= 0 && sel < static_cast<int>(g_filters.size())) {
-                ShowEditDialog(hwnd, g_filters[sel]); UpdateListView(st->hList);
+                ShowEditDialog(hwnd, g_filters[sel]); ValidateFilterReferences(); UpdateListView(st->hList);
                 int reselection = sel; if (reselection >= static_cast<int>(g_filters.size())) reselection = static_cast<int>(g_filters.size()) - 1;
                 if (reselection >= 0) ListView_SetItemState(st->hList, reselection, LVIS_SELECTED, LVIS_SELECTED); SaveConfig();
             }
@@ -2532,9 +2443,10 @@ LRESULT CALLBACK SettingsWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lPar
         }
         case IDC_BTN_DELETE: {
             int sel = ListView_GetNextItem(st->hList, -1, LVNI_SELECTED);
-            if (sel >= 0 && sel < static_cast<int>(g_filters.size())) { g_filters.erase(g_filters.begin() + sel); UpdateListView(st->hList); SaveConfig(); }
+            if (sel >= 0 && sel < static_cast<int>(g_filters.size())) { DeleteFilter(static_cast<size_t>(sel)); UpdateListView(st->hList); SaveConfig(); }
             return 0;
         }
+        case IDC_BTN_STATS: ShowStatsWindow(hwnd); return 0;
         case 307: { // Change Hotkey button
             UINT vk = g_hotkeyKey;
             UINT mods = g_hotkeyModifiers;
@@ -2588,7 +2500,7 @@ LRESULT CALLBACK SettingsWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lPar
  */
 void ShowSettingsWindow(HINSTANCE hInst) {
     if (g_settingsWnd && IsWindow(g_settingsWnd)) { ShowWindow(g_settingsWnd, SW_SHOWNORMAL); SetForegroundWindow(g_settingsWnd); return; }
-    wstring strSettings = GetString(L"settings");
+    const wstring& strSettings = GetString(L"settings");
     g_settingsWnd = CreateWindowExW(WS_EX_CONTROLPARENT, kSettingsClass, strSettings.c_str(), WS_OVERLAPPED | WS_CAPTION | WS_SYSMENU,
         CW_USEDEFAULT, CW_USEDEFAULT, 620, 400, nullptr, nullptr, hInst, nullptr);
     ShowWindow(g_settingsWnd, SW_SHOW);
@@ -2622,8 +2534,8 @@ void RemoveTrayIcon(HWND hwnd) { NOTIFYICONDATA nid{}; nid.cbSize = sizeof(NOTIF
  */
 void ShowTrayMenu(HWND hwnd) {
     POINT pt; GetCursorPos(&pt); HMENU tray = CreatePopupMenu();
-    wstring strSettings = GetString(L"settings");
-    wstring strExit = GetString(L"exit");
+    const wstring& strSettings = GetString(L"settings");
+    const wstring& strExit = GetString(L"exit");
     InsertMenuW(tray, 0, MF_BYPOSITION | MF_STRING, MENU_ID_SETTINGS, strSettings.c_str());
     InsertMenuW(tray, 1, MF_BYPOSITION | MF_STRING, MENU_ID_EXIT, strExit.c_str());
     SetForegroundWindow(hwnd);
@@ -2631,22 +2543,213 @@ void ShowTrayMenu(HWND hwnd) {
     if (cmd == MENU_ID_SETTINGS) ShowSettingsWindow(g_hInst); else if (cmd == MENU_ID_EXIT) PostMessageW(hwnd, WM_CLOSE, 0, 0);
 }
 
-// Structure to hold progress window state
-struct ProgressWindowState {
-    FilterDefinition* filter;
-    HWND hwndPreviousActive;
-    DWORD startTime;
-    bool result;
-    HWND hwndProgress;
-    HANDLE hThread;  // Thread handle for filter execution
+/**
+ * @class Win32KeystrokeSink
+ * @brief Types batches into a window with SendInput while it stays in the foreground
+ */
+class Win32KeystrokeSink : public KeystrokeSink {
+public:
+    explicit Win32KeystrokeSink(HWND target) : target_(target) {}
+
+    bool Type(u16string_view units) override {
+        // Held hotkey modifiers would turn the characters into shortcuts: give the user a moment to release them
+        for (int i = 0; i < 100 && ModifiersDown(); ++i) Sleep(10);
+        if (ModifiersDown() || GetForegroundWindow() != target_) return false;
+        inputs_.clear();
+        for (char16_t u : units) {
+            INPUT down{};
+            down.type = INPUT_KEYBOARD;
+            if (u == u'\n' || u == u'\t') {
+                down.ki.wVk = u == u'\n' ? VK_RETURN : VK_TAB;
+            } else {
+                down.ki.wScan = static_cast<WORD>(u);
+                down.ki.dwFlags = KEYEVENTF_UNICODE;
+            }
+            INPUT up = down;
+            up.ki.dwFlags |= KEYEVENTF_KEYUP;
+            inputs_.push_back(down);
+            inputs_.push_back(up);
+        }
+        // Fewer events inserted than sent means the input was blocked (e.g. UIPI for an elevated target)
+        return SendInput(static_cast<UINT>(inputs_.size()), inputs_.data(), sizeof(INPUT)) == inputs_.size();
+    }
+
+private:
+    static bool ModifiersDown() {
+        for (int vk : {VK_CONTROL, VK_MENU, VK_SHIFT, VK_LWIN, VK_RWIN}) {
+            if (GetAsyncKeyState(vk) & 0x8000) return true;
+        }
+        return false;
+    }
+
+    HWND target_;
+    vector<INPUT> inputs_;
 };
 
-// Thread function to run filter asynchronously
-DWORD WINAPI RunFilterThread(LPVOID lpParam) {
-    ProgressWindowState* state = static_cast<ProgressWindowState*>(lpParam);
-    state->result = RunFilter(*state->filter);
-    PostMessageW(state->hwndProgress, WM_APP_FILTER_COMPLETE, 0, reinterpret_cast<LPARAM>(state));
-    return 0;
+/**
+ * @struct FilterJob
+ * @brief One queued filter run with its captured input, progress window and result
+ */
+struct FilterJob {
+    uint64_t id{};                  // Submission order
+    FilterDefinition filter;        // Copied so editing settings does not affect queued jobs
+    ModelConfig model;
+    vector<ModelConfig> hedgeModels; // Backups for a hedged request, snapshotted like model
+    vector<FilterRun> fanOut;       // Branches of a fan-out filter, snapshotted like model (empty otherwise)
+    wstring fanOutFailed;           // Branch status strings, looked up on the UI thread (the string table is not thread-safe)
+    wstring fanOutDone;
+    vector<FilterRun> pipeline;     // Stages of a pipeline filter, snapshotted like model (empty otherwise)
+    FilterInput input;              // Clipboard snapshot taken at submission
+    HWND hwndNotify{};              // Main window receiving WM_APP_FILTER_COMPLETE
+    HWND hwndPreviousActive{};      // Window to paste into
+    atomic<HWND> hwndProgress{};    // Progress window (nullptr once closed)
+    atomic<DWORD> startTime{};      // Tick count when a worker picked the job up (0 = queued)
+    CancelToken cancel;             // Progress window closed by the user: abort the request, discard the result
+    bool result{};
+    ApiCallResult output;
+    mutex partialMutex;             // Guards partial
+    wstring partial;                // Text streamed so far
+    atomic<bool> partialPosted{};   // WM_APP_FILTER_PARTIAL is pending in the queue
+    unique_ptr<KeystrokeInjector> typing; // Types the streamed text into hwndPreviousActive (nullptr: paste the result)
+    unique_ptr<TraceSession> trace; // Span collector (nullptr unless tracing is enabled)
+
+    ~FilterJob() {
+        if (input.image) DeleteObject(input.image);
+        if (output.image) DeleteObject(output.image);
+    }
+};
+
+unique_ptr<JobQueue> g_jobQueue;              // Worker pool running filter jobs
+DeliveryOrder g_jobDelivery;                  // Decides when finished jobs are pasted
+map<uint64_t, shared_ptr<FilterJob>> g_jobs;  // Submitted, not yet delivered (UI thread only)
+uint64_t g_nextJobId = 1;
+size_t g_cancelledJobs = 0;                   // Jobs cancelled from their progress window (UI thread only)
+
+/**
+ * @brief Create the worker pool from the job settings
+ */
+void StartJobQueue() {
+    g_jobQueue = make_unique<JobQueue>(g_jobWorkers, g_jobProviderLimit);
+    for (const auto& [id, limit] : g_jobProviderLimits) g_jobQueue->SetGroupLimit(id, limit);
+    // Chunks, fan-out branches and pipeline stages of the jobs share the same per-provider limits
+    RateLimiters::Instance().SetConcurrency(g_jobProviderLimit, g_jobProviderLimits);
+    g_jobDelivery.SetOrdered(g_jobOrdered);
+}
+
+unique_ptr<JobQueue> g_warmQueue;             // Connection warm-ups, one at a time per host
+CancelToken g_warmCancel;                     // Aborts warm-ups at exit
+
+/**
+ * @brief Use the time the filter menu is open: connect to the filters' endpoints and encode the clipboard image
+ * @param filterIndices Filters offered in the menu (indices into g_filters)
+ * @param ct Clipboard content type
+ *
+ * DNS, TCP and TLS are done by HttpSession::WarmUp, so the request of the
+ * chosen filter goes out on a warm connection; the image is encoded by the
+ * prefetcher unless it already holds a snapshot of the clipboard.
+ */
+void PrewarmFilters(const vector<int>& filterIndices, ClipboardType ct) {
+    if (!g_prewarmEnabled) return;
+    if (ct == ClipboardType::Bitmap && g_prefetcher && !g_prefetcher->Get(g_prefetcher->Sequence())) {
+        g_prefetcher->SetProfiles(PrefetchProfiles());
+        g_prefetcher->Notify();
+    }
+    if (!g_warmQueue) return;
+    set<pair<wstring, bool>> endpoints;
+    for (int fi : filterIndices) {
+        for (const auto& [mi, def] : FilterRequests(g_filters[fi])) {
+            if (mi >= g_models.size()) continue;
+            const ModelConfig& m = g_models[mi];
+            const TemplateDefinition* tpl = g_engine.ResolveTemplate(m, def->input, def->output);
+            if (!tpl) continue;
+            const string model = ToUtf8(m.modelName), apiKey = ToUtf8(m.apiKey);
+            const PlaceholderValues values = MakePlaceholderValues(model, apiKey, {}, {}, {}, {}, {});
+            wstring host, path; bool useHttps = true;
+            if (PrepareEndpoint(m.serverUrl, FromUtf8(tpl->endpointTpl.Render(values, false)), host, path, useHttps)) endpoints.emplace(host, useHttps);
+        }
+    }
+    for (const auto& [host, useHttps] : endpoints) {
+        wstring name;
+        INTERNET_PORT port = 0;
+        if (!SplitHostPort(host, useHttps, name, port)) continue;
+        g_warmQueue->Submit(host, [name, port, useHttps] { HttpSession::Instance().WarmUp(name, port, useHttps, &g_warmCancel); });
+    }
+}
+
+/**
+ * @brief Type the rest of a finished job's result and wait until the target has received it
+ *
+ * Runs on the worker thread, so the progress window stays open (and can
+ * cancel the typing) until the last batch is sent. The streamed text is
+ * normally a prefix of the result; if it is not, typing stops where it is
+ * and the result is left on the clipboard. Hedged requests only stream the
+ * winner's text, once the race is decided (see HedgeStreams).
+ */
+void FinishTyping(FilterJob& job) {
+    TraceScope span("type_output");
+    wstring streamed;
+    {
+        lock_guard<mutex> lock(job.partialMutex);
+        streamed = job.partial;
+    }
+    bool complete = false;
+    if (job.result && !job.cancel.IsCancelled() && job.output.text.starts_with(streamed)) {
+        job.typing->Push(wstring_view(job.output.text).substr(streamed.size()));
+        complete = job.typing->Finish();
+    } else {
+        job.typing->Abort();
+        job.typing->Finish();
+    }
+    TypingStats st = job.typing->Stats();
+    LogLine(L"job " + to_wstring(job.id) + L" typed " + to_wstring(st.units) + L" chars in " + to_wstring(st.batches) +
+            L" batches (" + to_wstring(st.pushed) + L" deltas, backlog peak " + to_wstring(st.maxBacklog) + L")" + (complete ? L"" : L", stopped early"));
+}
+
+/**
+ * @brief Worker-thread body of a filter job
+ */
+void RunFilterJob(const shared_ptr<FilterJob>& job) {
+    TraceAttach attach(job->trace.get());
+    if (!job->cancel.IsCancelled()) {
+        job->startTime = (std::max)(GetTickCount(), 1UL);
+        if (!job->fanOut.empty()) {
+            job->result = RunFanOutFilter(job->filter, job->fanOut, job->input, job->output, job->fanOutFailed, job->fanOutDone, [job](const wstring& combined) {
+                {
+                    lock_guard<mutex> lock(job->partialMutex);
+                    job->partial = combined;
+                }
+                HWND progress = job->hwndProgress;
+                if (progress && !job->partialPosted.exchange(true)) PostMessageW(progress, WM_APP_FILTER_PARTIAL, 0, 0);
+            }, &job->cancel);
+        } else {
+            // Closing the progress window also stops the typing, which may outlast the request
+            CancelRegistration stopTyping(job->typing ? &job->cancel : nullptr, [job] { job->typing->Abort(); });
+            auto onPartial = [job](const wstring& delta) {
+                {
+                    lock_guard<mutex> lock(job->partialMutex);
+                    job->partial += delta;
+                }
+                if (job->typing) job->typing->Push(delta);
+                // Coalesce: only one repaint request in flight regardless of token rate
+                HWND progress = job->hwndProgress;
+                if (progress && !job->partialPosted.exchange(true)) PostMessageW(progress, WM_APP_FILTER_PARTIAL, 0, 0);
+            };
+            if (!job->pipeline.empty()) job->result = RunPipelineFilter(job->filter, job->pipeline, job->input, job->output, onPartial, &job->cancel);
+            else job->result = RunFilter(job->filter, job->model, job->hedgeModels, job->input, job->output, onPartial, &job->cancel);
+            if (job->typing) FinishTyping(*job);
+        }
+    }
+    if (job->cancel.IsCancelled()) {
+        // Release the input and any late result now rather than when the job is delivered
+        if (job->input.image) { DeleteObject(job->input.image); job->input.image = nullptr; }
+        if (job->output.image) { DeleteObject(job->output.image); job->output.image = nullptr; }
+        job->input.prefetched.reset();
+        job->input.text = wstring();
+        job->output.text = wstring();
+        lock_guard<mutex> lock(job->partialMutex);
+        job->partial = wstring();
+    }
+    PostMessageW(job->hwndNotify, WM_APP_FILTER_COMPLETE, 0, static_cast<LPARAM>(job->id));
 }
 
 /**
@@ -2656,41 +2759,39 @@ DWORD WINAPI RunFilterThread(LPVOID lpParam) {
 LRESULT CALLBACK ProgressWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
     if (msg == WM_CREATE) {
         CREATESTRUCT* cs = reinterpret_cast<CREATESTRUCT*>(lParam);
-        ProgressWindowState* state = static_cast<ProgressWindowState*>(cs->lpCreateParams);
-        SetWindowLongPtrW(hwnd, GWLP_USERDATA, reinterpret_cast<LONG_PTR>(state));
+        FilterJob* job = static_cast<FilterJob*>(cs->lpCreateParams);
+        SetWindowLongPtrW(hwnd, GWLP_USERDATA, reinterpret_cast<LONG_PTR>(job));
         
         // Create static text for message
-        wstring strExecuting = GetString(L"executing_filter");
-        CreateWindowW(L"STATIC", strExecuting.c_str(), WS_VISIBLE | WS_CHILD | SS_LEFT,
+        wstring strExecuting = GetString(L"executing_filter") + L" " + job->filter.title;
+        CreateWindowW(L"STATIC", strExecuting.c_str(), WS_VISIBLE | WS_CHILD | SS_LEFT | SS_ENDELLIPSIS,
             20, 20, 300, 20, hwnd, nullptr, g_hInst, nullptr);
         
         // Create static text for elapsed time
         CreateWindowW(L"STATIC", L"", WS_VISIBLE | WS_CHILD | SS_LEFT,
             20, 50, 300, 20, hwnd, reinterpret_cast<HMENU>(1001), g_hInst, nullptr);
+
+        // Preview of streamed text (shown once the first delta arrives)
+        HWND hPreview = CreateWindowExW(WS_EX_CLIENTEDGE, L"EDIT", L"", WS_CHILD | ES_MULTILINE | ES_READONLY | ES_AUTOVSCROLL | WS_VSCROLL,
+            20, 80, 300, 120, hwnd, reinterpret_cast<HMENU>(1002), g_hInst, nullptr);
+        SetUIFont(hPreview);
         
         // Start timer to update elapsed time (every 100ms)
         SetTimer(hwnd, TIMER_ID_PROGRESS, 100, nullptr);
-        
-        // Start filter execution in background thread
-        state->startTime = GetTickCount();
-        state->hwndProgress = hwnd;
-        state->hThread = CreateThread(nullptr, 0, RunFilterThread, state, 0, nullptr);
-        if (!state->hThread) {
-            // Failed to create thread, cleanup and close window
-            delete state;
-            DestroyWindow(hwnd);
-            return -1;
-        }
-        
         return 0;
     }
     
-    ProgressWindowState* state = reinterpret_cast<ProgressWindowState*>(GetWindowLongPtrW(hwnd, GWLP_USERDATA));
-    if (!state) return DefWindowProcW(hwnd, msg, wParam, lParam);
+    FilterJob* job = reinterpret_cast<FilterJob*>(GetWindowLongPtrW(hwnd, GWLP_USERDATA));
+    if (!job) return DefWindowProcW(hwnd, msg, wParam, lParam);
     
     if (msg == WM_TIMER && wParam == TIMER_ID_PROGRESS) {
+        DWORD start = job->startTime;
+        if (!start) {
+            SetWindowTextW(GetDlgItem(hwnd, 1001), GetString(L"waiting_in_queue").c_str());
+            return 0;
+        }
         // Update elapsed time
-        DWORD elapsed = (GetTickCount() - state->startTime) / 1000; // Convert to seconds
+        DWORD elapsed = (GetTickCount() - start) / 1000; // Convert to seconds
         wstring strElapsed = GetString(L"elapsed_time");
         // Replace {0} with elapsed time
         size_t pos = strElapsed.find(L"{0}");
@@ -2706,38 +2807,38 @@ LRESULT CALLBACK ProgressWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lPar
         return 0;
     }
     
-    if (msg == WM_APP_FILTER_COMPLETE) {
-        // Filter execution completed
-        KillTimer(hwnd, TIMER_ID_PROGRESS);
-        // Close thread handle (thread has already completed)
-        if (state->hThread) {
-            CloseHandle(state->hThread);
-            state->hThread = nullptr;
-        }
+    if (msg == WM_APP_FILTER_PARTIAL) {
+        job->partialPosted = false;
+        wstring text;
+        {
+            lock_guard<mutex> lock(job->partialMutex);
+            text = job->partial;
+        }
+        HWND hPreview = GetDlgItem(hwnd, 1002);
+        if (!IsWindowVisible(hPreview)) {
+            RECT rc; GetWindowRect(hwnd, &rc);
+            SetWindowPos(hwnd, nullptr, 0, 0, rc.right - rc.left, rc.bottom - rc.top + 130, SWP_NOMOVE | SWP_NOZORDER | SWP_NOACTIVATE);
+            ShowWindow(hPreview, SW_SHOWNA);
+        }
+        SetWindowTextW(hPreview, ReplaceAll(text, L"\n", L"\r\n").c_str());
+        SendMessageW(hPreview, EM_SETSEL, static_cast<WPARAM>(-1), static_cast<LPARAM>(-1));
+        SendMessageW(hPreview, EM_SCROLLCARET, 0, 0);
+        return 0;
+    }
+
+    if (msg == WM_CLOSE) {
+        // Closed by the user: abort the request in flight (or skip the job if still queued)
+        ++g_cancelledJobs;
+        LogLine(L"job " + to_wstring(job->id) + L" cancelled (" + to_wstring(g_cancelledJobs) + L" cancelled so far)");
+        job->cancel.Cancel();
         DestroyWindow(hwnd);
         return 0;
     }
     
     if (msg == WM_DESTROY) {
-        // Restore focus and send Ctrl+V if successful
-        if (state->result) {
-            if (state->hwndPreviousActive && IsWindow(state->hwndPreviousActive)) {
-                SetForegroundWindow(state->hwndPreviousActive);
-                SetFocus(state->hwndPreviousActive);
-                Sleep(80);
-            }
-            SendCtrlV();
-        } else {
-            wstring strFilterFailed = GetString(L"filter_execution_failed");
-            MessageBoxW(hwnd, strFilterFailed.c_str(), L"cbfilter", MB_OK | MB_ICONERROR);
-        }
-        // Ensure thread handle is closed (safety check in case WM_APP_FILTER_COMPLETE was missed)
-        if (state->hThread) {
-            CloseHandle(state->hThread);
-            state->hThread = nullptr;
-        }
-        delete state;
-        g_progressWnd = nullptr;
+        KillTimer(hwnd, TIMER_ID_PROGRESS);
+        job->hwndProgress = nullptr;
+        SetWindowLongPtrW(hwnd, GWLP_USERDATA, 0);
         return 0;
     }
     
@@ -2745,25 +2846,61 @@ LRESULT CALLBACK ProgressWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lPar
 }
 
 /**
- * @brief Show progress window and execute filter asynchronously
- * @param hwnd Window handle
+ * @brief Find the progress window that owns a window
+ * @param hwnd Window receiving a message
+ * @return Progress window, or nullptr if hwnd does not belong to one
+ */
+HWND FindProgressWindow(HWND hwnd) {
+    HWND root = hwnd ? GetAncestor(hwnd, GA_ROOT) : nullptr;
+    wchar_t cls[64]{};
+    if (root && GetClassNameW(root, cls, 64) && wcscmp(cls, kProgressClass) == 0) return root;
+    return nullptr;
+}
+
+/**
+ * @brief Capture the clipboard, show a progress window and queue the filter
+ * @param hwnd Main window (receives completion notifications)
  * @param filter Filter to execute
- * @param hwndPreviousActive Previous active window to restore focus to
- */
-void ShowProgressAndRunFilter(HWND hwnd, const FilterDefinition& filter, HWND hwndPreviousActive) {
-    ProgressWindowState* state = new ProgressWindowState();
-    state->filter = const_cast<FilterDefinition*>(&filter);
-    state->hwndPreviousActive = hwndPreviousActive;
-    state->result = false;
-    state->hThread = nullptr;
+ * @param hwndPreviousActive Previous active window to paste into
+ */
+void SubmitFilterJob(HWND hwnd, const FilterDefinition& filter, HWND hwndPreviousActive) {
+    auto job = make_shared<FilterJob>();
+    job->filter = filter;
+    job->model = g_models[filter.modelIndex < g_models.size() ? filter.modelIndex : 0];
+    for (size_t idx : filter.hedgeModels) {
+        if (idx < g_models.size() && idx != filter.modelIndex) job->hedgeModels.push_back(g_models[idx]);
+    }
+    if (IsFanOut(filter)) {
+        job->fanOut = ExpandFanOut(filter, g_filters, g_models);
+        // The first branch's model decides how the image input is encoded and which provider queue runs the job
+        if (!job->fanOut.empty()) job->model = job->fanOut.front().model;
+        job->fanOutFailed = GetString(L"fanout_failed");
+        job->fanOutDone = GetString(L"fanout_done");
+    }
+    if (IsPipeline(filter)) {
+        job->pipeline = ExpandPipeline(filter, g_filters, g_models);
+        // The first stage reads the clipboard, so its model encodes the image input
+        if (!job->pipeline.empty()) job->model = job->pipeline.front().model;
+    }
+    job->hwndNotify = hwnd;
+    job->hwndPreviousActive = hwndPreviousActive;
+    if (g_traceEnabled) job->trace = make_unique<TraceSession>(ToUtf8(filter.title));
+    TraceAttach attach(job->trace.get());
+    if (!CaptureFilterInput(filter.input, job->model.image, job->input)) {
+        const wstring& strFilterFailed = GetString(L"filter_execution_failed");
+        MessageBoxW(hwnd, strFilterFailed.c_str(), L"cbfilter", MB_OK | MB_ICONERROR);
+        return;
+    }
+    job->id = g_nextJobId++;
     
-    // Get screen center position for progress window
+    // Center the progress window, cascading windows of jobs already in flight
     int screenWidth = GetSystemMetrics(SM_CXSCREEN);
     int screenHeight = GetSystemMetrics(SM_CYSCREEN);
     int windowWidth = 350;
     int windowHeight = 120;
-    int x = (screenWidth - windowWidth) / 2;
-    int y = (screenHeight - windowHeight) / 2;
+    int cascade = static_cast<int>(g_jobs.size() % 8) * 30;
+    int x = (screenWidth - windowWidth) / 2 + cascade;
+    int y = (screenHeight - windowHeight) / 2 + cascade;
     
     // Create progress window (non-modal, handled by main message loop)
     HWND progressWnd = CreateWindowExW(
@@ -2776,16 +2913,87 @@ void ShowProgressAndRunFilter(HWND hwnd, const FilterDefinition& filter, HWND hw
         hwnd,
         nullptr,
         g_hInst,
-        state
+        job.get()
     );
-    
     if (progressWnd) {
-        g_progressWnd = progressWnd;
-        ShowWindow(progressWnd, SW_SHOWNORMAL);
+        job->hwndProgress = progressWnd;
+        ShowWindow(progressWnd, SW_SHOWNOACTIVATE);
         UpdateWindow(progressWnd);
-        // Window will be handled by main message loop, no need for separate loop here
-    } else {
-        delete state;
+    }
+
+    // Type into the window the filter was started from, unless another job's paste could land in the middle
+    if (filter.typeOutput && filter.output == IOType::Text && job->fanOut.empty() && g_jobs.empty() &&
+        job->hwndPreviousActive && IsWindow(job->hwndPreviousActive)) {
+        job->typing = make_unique<KeystrokeInjector>(make_unique<Win32KeystrokeSink>(job->hwndPreviousActive), g_typingOptions);
+        SetForegroundWindow(job->hwndPreviousActive);
+    }
+
+    g_jobs[job->id] = job;
+    g_jobDelivery.Register(job->id);
+    g_jobQueue->Submit(job->model.providerId, [job]() { RunFilterJob(job); });
+    LogLine(L"SubmitFilterJob: id=" + to_wstring(job->id) + L" outstanding=" + to_wstring(g_jobQueue->Outstanding()));
+}
+
+/**
+ * @brief Write a job's spans to traces\trace-<time>-<id>.json in the config directory
+ */
+void WriteJobTrace(const FilterJob& job) {
+    wstring dir = GetConfigDirectory() + L"traces\\";
+    CreateDirectoryW(dir.c_str(), nullptr);
+    SYSTEMTIME st; GetLocalTime(&st);
+    wstring path = dir + format(L"trace-{:04}{:02}{:02}-{:02}{:02}{:02}-{}.json", st.wYear, st.wMonth, st.wDay, st.wHour, st.wMinute, st.wSecond, job.id);
+    if (!job.trace->WriteChromeJson(path)) LogLine(L"Failed to write trace " + path);
+}
+
+/**
+ * @brief Paste a finished job's result into the window it was started from
+ */
+void DeliverFilterJob(FilterJob& job) {
+    HWND progress = job.hwndProgress;
+    if (progress && IsWindow(progress)) DestroyWindow(progress);
+    if (job.cancel.IsCancelled()) {
+        if (job.trace) WriteJobTrace(job);
+        return;
+    }
+    bool applied = false;
+    {
+        TraceAttach attach(job.trace.get());
+        if (job.result) {
+            TraceScope span(job.filter.output == IOType::Text ? "SetClipboardText" : "SetClipboardBitmap");
+            applied = ApplyFilterResult(job.filter.output, job.output);
+        }
+        // A typed result is already in the target; the clipboard write above keeps the clipboard consistent
+        // with it (and holds the whole result if typing stopped early). Typing that never started is pasted.
+        const bool typedAny = job.typing && job.typing->Stats().units > 0;
+        if (applied && !typedAny) {
+            if (job.hwndPreviousActive && IsWindow(job.hwndPreviousActive)) {
+                TraceScope span("restore_focus");
+                SetForegroundWindow(job.hwndPreviousActive);
+                SetFocus(job.hwndPreviousActive);
+                Sleep(80);
+            }
+            TraceScope span("SendCtrlV");
+            SendCtrlV();
+        }
+    }
+    if (job.trace) WriteJobTrace(job);
+    if (!applied) {
+        wstring strFilterFailed = GetString(L"filter_execution_failed") + L"\n" + job.filter.title;
+        MessageBoxW(nullptr, strFilterFailed.c_str(), L"cbfilter", MB_OK | MB_ICONERROR);
+    }
+}
+
+/**
+ * @brief Handle WM_APP_FILTER_COMPLETE: deliver every job that is now due
+ * @param id Id of the job that finished
+ */
+void OnFilterJobComplete(uint64_t id) {
+    for (uint64_t ready : g_jobDelivery.Complete(id)) {
+        auto it = g_jobs.find(ready);
+        if (it == g_jobs.end()) continue;
+        shared_ptr<FilterJob> job = it->second;
+        g_jobs.erase(it);
+        DeliverFilterJob(*job);
     }
 }
 
@@ -2962,20 +3170,13 @@ LRESULT CALLBACK FilterMenuWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lP
  * then executes the selected filter and pastes the result.
  */
 bool ShowFilterMenuAndRun(HWND hwnd, HWND hwndPreviousActive = nullptr) {
-    // Check if a filter is already running
-    if (g_progressWnd && IsWindow(g_progressWnd)) {
-        SetForegroundWindow(g_progressWnd);
-        MessageBeep(MB_ICONWARNING);
-        return false;
-    }
-
     // Close existing filter menu if one is already open
     if (g_filterMenuWnd && IsWindow(g_filterMenuWnd)) {
         DestroyWindow(g_filterMenuWnd);
         g_filterMenuWnd = nullptr;
     }
 
-    ClipboardType ct = DetectClipboard();
+    ClipboardType ct = DetectClipboardPrefetched();
     FilterMenuState st;
     st.hwndPreviousActive = hwndPreviousActive;
     st.hwndParent = hwnd;
@@ -2988,10 +3189,11 @@ bool ShowFilterMenuAndRun(HWND hwnd, HWND hwndPreviousActive = nullptr) {
     }
 
     if (st.filterIndices.empty()) {
-        wstring strNoFilters = GetString(L"no_compatible_filters");
+        const wstring& strNoFilters = GetString(L"no_compatible_filters");
         MessageBoxW(hwnd, strNoFilters.c_str(), L"cbfilter", MB_OK | MB_ICONINFORMATION);
         return false;
     }
+    PrewarmFilters(st.filterIndices, ct);
 
     // Get cursor position and calculate window size
     POINT pt;
@@ -3060,7 +3262,7 @@ bool ShowFilterMenuAndRun(HWND hwnd, HWND hwndPreviousActive = nullptr) {
     // Check if a filter was selected
     if (st.result >= 0 && st.result < static_cast<int>(g_filters.size())) {
         LogLine(L"ShowFilterMenuAndRun: Executing filter index=" + to_wstring(st.result));
-        ShowProgressAndRunFilter(hwnd, g_filters[st.result], hwndPreviousActive);
+        SubmitFilterJob(hwnd, g_filters[st.result], hwndPreviousActive);
         return true;
     }
 
@@ -3083,26 +3285,36 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
                            + L"Please change the hotkey in Settings.";
             MessageBoxW(hwnd, errMsg.c_str(), L"cbfilter - Hotkey Registration Failed", MB_OK | MB_ICONWARNING);
         }
+        if (g_prefetcher && g_prefetchEnabled) {
+            if (!AddClipboardFormatListener(hwnd)) LogLine(L"AddClipboardFormatListener failed");
+            // Snapshot what is already on the clipboard
+            g_prefetcher->SetProfiles(PrefetchProfiles());
+            g_prefetcher->Notify();
+        }
         return 0;
     }
+    case WM_CLIPBOARDUPDATE:
+        if (g_prefetcher) {
+            g_prefetcher->SetProfiles(PrefetchProfiles());
+            g_prefetcher->Notify();
+        }
+        return 0;
     case WM_APP_TRAY:
         if (lParam == WM_RBUTTONUP || lParam == WM_LBUTTONUP || lParam == WM_CONTEXTMENU) { ShowTrayMenu(hwnd); return 0; }
         else if (lParam == WM_LBUTTONDBLCLK) { ShowSettingsWindow(g_hInst); return 0; }
         break;
     case WM_HOTKEY: {
-        // Check if a filter is already running
-        if (g_progressWnd && IsWindow(g_progressWnd)) {
-            // Bring the progress window to front instead of starting a new filter
-            SetForegroundWindow(g_progressWnd);
-            MessageBeep(MB_ICONWARNING);
-            return 0;
-        }
-        // Save the currently active window before showing menu
+        // Save the currently active window before showing menu (running filters keep going in the queue)
         HWND hwndActive = GetForegroundWindow();
         ShowFilterMenuAndRun(hwnd, hwndActive);
         return 0;
     }
-    case WM_DESTROY: UnregisterHotKey(hwnd, HOTKEY_ID); RemoveTrayIcon(hwnd); PostQuitMessage(0); return 0;
+    case WM_APP_FILTER_COMPLETE:
+        OnFilterJobComplete(static_cast<uint64_t>(lParam));
+        return 0;
+    case WM_DESTROY:
+        if (g_prefetcher && g_prefetchEnabled) RemoveClipboardFormatListener(hwnd);
+        UnregisterHotKey(hwnd, HOTKEY_ID); RemoveTrayIcon(hwnd); PostQuitMessage(0); return 0;
     }
     return DefWindowProc(hwnd, msg, wParam, lParam);
 }
@@ -3131,18 +3343,19 @@ void RegWindowClass(HINSTANCE hInst, LPCWSTR kClass, WNDPROC proc) {
 int WINAPI wWinMain(HINSTANCE hInst, HINSTANCE, PWSTR, int) {
     winrt::init_apartment();
     g_hInst = hInst;
-    using namespace winrt::Windows::Data::Json;
     Gdiplus::GdiplusStartupInput gdiplusStartupInput;
     if (Gdiplus::GdiplusStartup(&g_gdiplusToken, &gdiplusStartupInput, nullptr) != Gdiplus::Ok) return 1;
     INITCOMMONCONTROLSEX icc{ sizeof(icc), ICC_WIN95_CLASSES }; InitCommonControlsEx(&icc);
     INITCOMMONCONTROLSEX icc2{ sizeof(icc2), ICC_LISTVIEW_CLASSES }; InitCommonControlsEx(&icc2);
+#if DEBUG
+    g_engine.SetLogHandler([](const wstring& msg) { LogLine(msg); });
+#endif
     LoadApiDefinitions();
-    JsonObject defCfg = CreateDefaultConfig();
-    if (defCfg.HasKey(L"language")) g_language = wstring(defCfg.GetNamedString(L"language", g_language.c_str()).c_str());
-    if (defCfg.HasKey(L"hotkey")) {
-        JsonObject hk = defCfg.GetNamedObject(L"hotkey");
-        g_hotkeyModifiers = static_cast<UINT>(hk.GetNamedNumber(L"modifiers", g_hotkeyModifiers));
-        g_hotkeyKey = static_cast<UINT>(hk.GetNamedNumber(L"key", g_hotkeyKey));
+    JsonValue defCfg = CreateDefaultConfig();
+    if (defCfg.HasKey("language")) g_language = defCfg.GetNamedString("language", g_language);
+    if (const JsonValue* hk = defCfg.Find("hotkey"); hk && hk->IsObject()) {
+        g_hotkeyModifiers = static_cast<UINT>(hk->GetNamedNumber("modifiers", g_hotkeyModifiers));
+        g_hotkeyKey = static_cast<UINT>(hk->GetNamedNumber("key", g_hotkeyKey));
     }
     // Register setup dialog class early because it may be shown before config is created
     RegWindowClass(hInst, kSetupClass, SetupDlgProc);
@@ -3154,10 +3367,21 @@ int WINAPI wWinMain(HINSTANCE hInst, HINSTANCE, PWSTR, int) {
     }
     LoadConfig();
     EnsureModelProviders();
+    StartJobQueue();
+    if (g_prefetchEnabled || g_prewarmEnabled) g_prefetcher = make_unique<ClipboardPrefetcher>(make_unique<Win32ClipboardSource>(), g_prefetchMaxMegabytes << 20);
+    if (g_prewarmEnabled) g_warmQueue = make_unique<JobQueue>(2, 1);
+    if (g_cacheEnabled && !ResponseCache::Instance().Open(GetConfigDirectory() + L"cache.bin", g_cacheMaxMegabytes << 20)) {
+        LogLine(L"Response cache unavailable");
+    }
+    g_engine.SetCacheEnabled(g_cacheEnabled);
+    if (g_statsEnabled) {
+        if (!g_usageStats.Open(GetConfigDirectory() + L"usage.csv", g_statsMaxRecords)) LogLine(L"Usage statistics are kept in memory only");
+        g_engine.SetUsageHandler([](const UsageRecord& r) { g_usageStats.Record(r); });
+    }
     // Initialize default filters if none loaded
     if (g_filters.empty()) {
-        wstring strTranslate = GetString(L"translate_to_english");
-        wstring strSummarize = GetString(L"summarize");
+        const wstring& strTranslate = GetString(L"translate_to_english");
+        const wstring& strSummarize = GetString(L"summarize");
         g_filters.push_back({ strTranslate, IOType::Text, IOType::Text, 0, L"Translate into English." });
         g_filters.push_back({ strSummarize, IOType::Text, IOType::Text, 0, L"Summarize the following text." });
         SaveConfig();
@@ -3167,6 +3391,7 @@ int WINAPI wWinMain(HINSTANCE hInst, HINSTANCE, PWSTR, int) {
     RegWindowClass(hInst, kModelClass, ModelDlgProc);
     RegWindowClass(hInst, kProgressClass, ProgressWndProc);
     RegWindowClass(hInst, kFilterMenuClass, FilterMenuWndProc);
+    RegWindowClass(hInst, kStatsClass, StatsWndProc);
     RegWindowClass(hInst, kClassName, WndProc);
     HWND hwnd = CreateWindowExW(0, kClassName, L"cbfilter", WS_OVERLAPPED, 0, 0, 0, 0, nullptr, nullptr, hInst, nullptr);
     if (!hwnd) return 1;
@@ -3184,8 +3409,10 @@ int WINAPI wWinMain(HINSTANCE hInst, HINSTANCE, PWSTR, int) {
                 targetWnd = g_editWnd;
             } else if (g_modelWnd && (msg.hwnd == g_modelWnd || IsChild(g_modelWnd, msg.hwnd))) {
                 targetWnd = g_modelWnd;
-            } else if (g_progressWnd && (msg.hwnd == g_progressWnd || IsChild(g_progressWnd, msg.hwnd))) {
-                targetWnd = g_progressWnd;
+            } else if (g_statsWnd && (msg.hwnd == g_statsWnd || IsChild(g_statsWnd, msg.hwnd))) {
+                targetWnd = g_statsWnd;
+            } else if (HWND progressWnd = FindProgressWindow(msg.hwnd)) {
+                targetWnd = progressWnd;
             }
             if (targetWnd) {
                 PostMessageW(targetWnd, WM_CLOSE, 0, 0);
@@ -3195,9 +3422,23 @@ int WINAPI wWinMain(HINSTANCE hInst, HINSTANCE, PWSTR, int) {
         if (g_settingsWnd && IsDialogMessageW(g_settingsWnd, &msg)) continue;
         if (g_editWnd && IsDialogMessageW(g_editWnd, &msg)) continue;
         if (g_modelWnd && IsDialogMessageW(g_modelWnd, &msg)) continue;
-        if (g_progressWnd && IsDialogMessageW(g_progressWnd, &msg)) continue;
+        if (g_statsWnd && IsDialogMessageW(g_statsWnd, &msg)) continue;
+        if (HWND progressWnd = FindProgressWindow(msg.hwnd); progressWnd && IsDialogMessageW(progressWnd, &msg)) continue;
         TranslateMessage(&msg); DispatchMessageW(&msg);
     }
+    // Abort requests and typing in flight so the workers can be joined without waiting for them
+    for (const auto& [id, job] : g_jobs) job->cancel.Cancel();
+    g_warmCancel.Cancel();
+    if (g_jobQueue) g_jobQueue->Shutdown();
+    if (g_warmQueue) g_warmQueue->Shutdown();
+    if (g_prefetcher) {
+        ClipboardPrefetchStats ps = g_prefetcher->Stats();
+        LogLine(format(L"clipboard prefetch: snapshots={} coalesced={} reused={} hits={} misses={}", ps.snapshots, ps.coalesced, ps.reused, ps.hits, ps.misses));
+        g_prefetcher.reset();
+    }
+    HttpSession::Instance().Shutdown();
+    ResponseCache::Instance().Close();
+    g_usageStats.Close();
     if (g_gdiplusToken) Gdiplus::GdiplusShutdown(g_gdiplusToken);
     return 0;
 }
@@ -0,0 +1,358 @@
+/**
+ * @file rate_limit.cpp
+ * @brief Implementation of the per-provider rate limiter and retry loop
+ */
+
+#include "rate_limit.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+using namespace std;
+
+namespace {
+char LowerAscii(char c) {
+    return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+string_view Trim(string_view s) {
+    while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) s.remove_prefix(1);
+    while (!s.empty() && (s.back() == ' ' || s.back() == '\t' || s.back() == '\r')) s.remove_suffix(1);
+    return s;
+}
+
+/**
+ * @brief Parse a leading decimal number
+ * @param used Receives the number of characters consumed
+ */
+bool ParseNumber(string_view s, double& v, size_t& used) {
+    size_t i = 0;
+    while (i < s.size() && ((s[i] >= '0' && s[i] <= '9') || s[i] == '.')) ++i;
+    if (i == 0) return false;
+    v = strtod(string(s.substr(0, i)).c_str(), nullptr);
+    used = i;
+    return true;
+}
+
+/**
+ * @brief Parse a Go-style duration ("1h2m3.5s", "20ms", "6m0s")
+ * @return false if s is not a duration with units
+ */
+bool ParseDurationMs(string_view s, double& ms) {
+    ms = 0;
+    bool any = false;
+    while (!s.empty()) {
+        double v = 0;
+        size_t used = 0;
+        if (!ParseNumber(s, v, used)) return false;
+        s.remove_prefix(used);
+        double unitMs;
+        if (s.substr(0, 2) == "ms") { unitMs = 1; s.remove_prefix(2); }
+        else if (!s.empty() && s[0] == 'h') { unitMs = 3600000; s.remove_prefix(1); }
+        else if (!s.empty() && s[0] == 'm') { unitMs = 60000; s.remove_prefix(1); }
+        else if (!s.empty() && s[0] == 's') { unitMs = 1000; s.remove_prefix(1); }
+        else return false;
+        ms += v * unitMs;
+        any = true;
+    }
+    return any;
+}
+
+/**
+ * @brief Days since 1970-01-01 of a proleptic Gregorian date
+ */
+int64_t DaysFromCivil(int64_t y, unsigned m, unsigned d) {
+    y -= m <= 2;
+    const int64_t era = (y >= 0 ? y : y - 399) / 400;
+    const unsigned yoe = static_cast<unsigned>(y - era * 400);
+    const unsigned doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + static_cast<int64_t>(doe) - 719468;
+}
+
+/**
+ * @brief Parse an IMF-fixdate ("Sun, 06 Nov 1994 08:49:37 GMT")
+ */
+bool ParseHttpDate(string_view s, int64_t& unixMs) {
+    static const char kMonths[] = "janfebmaraprmayjunjulaugsepoctnovdec";
+    size_t comma = s.find(',');
+    if (comma != string_view::npos) s.remove_prefix(comma + 1);
+    s = Trim(s);
+    if (s.size() < 20) return false;
+    auto num = [&](size_t pos, size_t len) {
+        int v = 0;
+        for (size_t i = pos; i < pos + len; ++i) {
+            if (s[i] < '0' || s[i] > '9') return -1;
+            v = v * 10 + (s[i] - '0');
+        }
+        return v;
+    };
+    const char mon[4] = {LowerAscii(s[3]), LowerAscii(s[4]), LowerAscii(s[5]), 0};
+    const char* found = strstr(kMonths, mon);
+    if (!found || (found - kMonths) % 3 != 0) return false;
+    const int day = num(0, 2), year = num(7, 4), hh = num(12, 2), mm = num(15, 2), ss = num(18, 2);
+    if (day < 1 || year < 0 || hh < 0 || mm < 0 || ss < 0) return false;
+    const unsigned month = static_cast<unsigned>((found - kMonths) / 3 + 1);
+    int64_t days = DaysFromCivil(year, month, static_cast<unsigned>(day));
+    unixMs = ((days * 24 + hh) * 60 + mm) * 60000LL + ss * 1000LL;
+    return true;
+}
+
+/**
+ * @struct Window
+ * @brief One server-side limit window (-1 = header not seen)
+ */
+struct Window {
+    long long limit{-1};
+    long long remaining{-1};
+    long long resetMs{-1};
+};
+
+/**
+ * @brief Parse a reset value: a duration, seconds, or an epoch time in seconds or milliseconds
+ */
+bool ParseResetMs(string_view s, int64_t nowUnixMs, double& ms) {
+    double v = 0;
+    size_t used = 0;
+    if (ParseNumber(s, v, used) && used == s.size()) {
+        if (v > 1e12) ms = v - static_cast<double>(nowUnixMs);
+        else if (v > 1e9) ms = v * 1000.0 - static_cast<double>(nowUnixMs);
+        else ms = v * 1000.0;
+        ms = (std::max)(0.0, ms);
+        return true;
+    }
+    return ParseDurationMs(s, ms);
+}
+} // namespace
+
+RateLimitHeaders ParseRateLimitHeaders(string_view raw, int64_t nowUnixMs) {
+    RateLimitHeaders h;
+    // Windows are paired by suffix, e.g. remaining-requests with reset-requests
+    map<string, Window> windows;
+    long long retryAfterMs = -1, retryAfterMsHeader = -1;
+    while (!raw.empty()) {
+        size_t eol = raw.find('\n');
+        string_view line = raw.substr(0, eol);
+        raw.remove_prefix(eol == string_view::npos ? raw.size() : eol + 1);
+        size_t colon = line.find(':');
+        if (colon == string_view::npos) continue;
+        string name;
+        for (char c : Trim(line.substr(0, colon))) name += LowerAscii(c);
+        string_view value = Trim(line.substr(colon + 1));
+        double v = 0;
+        size_t used = 0;
+        if (name == "retry-after-ms") {
+            if (ParseNumber(value, v, used)) retryAfterMsHeader = llround(v);
+        } else if (name == "retry-after") {
+            int64_t at = 0;
+            if (ParseNumber(value, v, used) && used == value.size()) retryAfterMs = llround(v * 1000.0);
+            else if (ParseHttpDate(value, at)) retryAfterMs = (std::max)(int64_t{0}, at - nowUnixMs);
+        } else if (name.rfind("x-ratelimit-limit", 0) == 0) {
+            if (ParseNumber(value, v, used)) windows[name.substr(17)].limit = llround(v);
+        } else if (name.rfind("x-ratelimit-remaining", 0) == 0) {
+            if (ParseNumber(value, v, used)) windows[name.substr(21)].remaining = llround(v);
+        } else if (name.rfind("x-ratelimit-reset", 0) == 0) {
+            if (ParseResetMs(value, nowUnixMs, v)) windows[name.substr(17)].resetMs = llround(v);
+        }
+    }
+    h.retryAfterMs = retryAfterMsHeader >= 0 ? retryAfterMsHeader : retryAfterMs;
+    // Fraction of the window left; without a limit only "none left" is known
+    auto left = [](const Window& w) { return w.limit > 0 ? static_cast<double>(w.remaining) / static_cast<double>(w.limit) : (w.remaining > 0 ? 1.0 : 0.0); };
+    double hLeft = 0;
+    for (const auto& [suffix, w] : windows) {
+        if (w.remaining < 0) continue;
+        if (w.remaining == 0) h.exhaustedResetMs = (std::max)(h.exhaustedResetMs, w.resetMs);
+        // Only request windows drive the bucket (token windows count another unit);
+        // report the one closest to exhaustion, among equals the one that resets last
+        if (!suffix.empty() && suffix.rfind("-requests", 0) != 0) continue;
+        const double wLeft = left(w);
+        if (h.remaining < 0 || wLeft < hLeft || (wLeft == hLeft && w.resetMs > h.resetMs)) {
+            h.limit = w.limit;
+            h.remaining = w.remaining;
+            h.resetMs = w.resetMs;
+            hLeft = wLeft;
+        }
+    }
+    return h;
+}
+
+bool IsRetryableStatus(int status) {
+    return status == 429 || status == 503;
+}
+
+RateLimiter::RateLimiter() : rng_(random_device{}()) {
+    Configure(RateLimitConfig{});
+}
+
+void RateLimiter::Configure(const RateLimitConfig& config) {
+    lock_guard<mutex> lock(mutex_);
+    config_ = config;
+    config_.burst = (std::max)(1u, config_.burst);
+    tokens_ = config_.burst;
+    refilledAt_ = Clock::now();
+}
+
+RateLimitConfig RateLimiter::Config() const {
+    lock_guard<mutex> lock(mutex_);
+    return config_;
+}
+
+double RateLimiter::Jitter(double maxMs) {
+    return uniform_real_distribution<double>(0.0, (std::max)(0.0, maxMs))(rng_);
+}
+
+double RateLimiter::Refill(Clock::time_point now) {
+    // The stricter of the configured rate and the rate the server's headers imply
+    double perMs = config_.requestsPerMinute / 60000.0;
+    double capacity = config_.burst;
+    if (serverPerMs_ > 0 && (perMs <= 0 || serverPerMs_ < perMs)) {
+        perMs = serverPerMs_;
+        capacity = serverCapacity_;
+    }
+    if (perMs <= 0) return 0;
+    if (now > refilledAt_) {
+        tokens_ = (std::min)(capacity, tokens_ + chrono::duration<double, milli>(now - refilledAt_).count() * perMs);
+        refilledAt_ = now;
+    }
+    return perMs;
+}
+
+chrono::milliseconds RateLimiter::Reserve(Clock::time_point now) {
+    lock_guard<mutex> lock(mutex_);
+    double waitMs = 0;
+    if (const double perMs = Refill(now); perMs > 0) {
+        tokens_ -= 1;
+        if (tokens_ < 0) waitMs = -tokens_ / perMs;
+    }
+    if (pausedUntil_ > now) {
+        const double pauseMs = chrono::duration<double, milli>(pausedUntil_ - now).count();
+        // Spread the requests released by a pause instead of firing them all at once
+        waitMs = (std::max)(waitMs, pauseMs + Jitter((std::min)(1000.0, pauseMs * 0.1 + 50.0)));
+    }
+    return chrono::milliseconds(static_cast<long long>(ceil(waitMs)));
+}
+
+void RateLimiter::Observe(const RateLimitHeaders& h, Clock::time_point now) {
+    if (h.exhaustedResetMs > 0) PauseFor(chrono::milliseconds(h.exhaustedResetMs), now);
+    if (h.limit <= 0 || h.remaining < 0 || h.resetMs <= 0) return;
+    lock_guard<mutex> lock(mutex_);
+    // The window refills from remaining to limit by the reset time: treat that as the bucket's rate
+    Refill(now);
+    if (h.limit > h.remaining) serverPerMs_ = static_cast<double>(h.limit - h.remaining) / static_cast<double>(h.resetMs);
+    serverCapacity_ = static_cast<double>(h.limit);
+    tokens_ = (std::min)(tokens_, static_cast<double>(h.remaining));
+}
+
+void RateLimiter::PauseFor(chrono::milliseconds delay, Clock::time_point now) {
+    lock_guard<mutex> lock(mutex_);
+    delay = (std::min)(delay, chrono::milliseconds(config_.maxDelayMs));
+    pausedUntil_ = (std::max)(pausedUntil_, now + delay);
+}
+
+chrono::milliseconds RateLimiter::RetryDelay(int attempt, const RateLimitHeaders& h) {
+    lock_guard<mutex> lock(mutex_);
+    const double capMs = config_.maxDelayMs;
+    double ms;
+    if (h.retryAfterMs >= 0) {
+        // Never earlier than the server asked for
+        ms = (std::min)(capMs, static_cast<double>(h.retryAfterMs));
+        ms += Jitter((std::min)(1000.0, ms * 0.1 + 50.0));
+    } else {
+        // Equal jitter: half fixed so a retry never fires immediately, half random to de-synchronize clients
+        const double step = (std::min)(capMs, config_.baseDelayMs * pow(2.0, (std::min)(attempt, 20)));
+        ms = step / 2 + Jitter(step / 2);
+    }
+    return chrono::milliseconds(static_cast<long long>(ceil(ms)));
+}
+
+void RateLimiter::SetMaxConcurrent(size_t limit) {
+    {
+        lock_guard<mutex> lock(mutex_);
+        maxConcurrent_ = limit;
+    }
+    slotFreed_.notify_all();
+}
+
+bool RateLimiter::AcquireSlot(CancelToken* cancel) {
+    // Registered before the lock is taken: the callback runs under the token's lock and takes ours
+    CancelRegistration wake(cancel, [this] {
+        lock_guard<mutex> lock(mutex_);
+        slotFreed_.notify_all();
+    });
+    unique_lock<mutex> lock(mutex_);
+    slotFreed_.wait(lock, [&] { return maxConcurrent_ == 0 || inFlight_ < maxConcurrent_ || (cancel && cancel->IsCancelled()); });
+    if (cancel && cancel->IsCancelled()) return false;
+    ++inFlight_;
+    return true;
+}
+
+void RateLimiter::ReleaseSlot() {
+    {
+        lock_guard<mutex> lock(mutex_);
+        if (inFlight_ > 0) --inFlight_;
+    }
+    // Every waiter, since one woken by a cancellation leaves without taking the slot
+    slotFreed_.notify_all();
+}
+
+RateLimiters& RateLimiters::Instance() {
+    static RateLimiters limiters;
+    return limiters;
+}
+
+RateLimiter& RateLimiters::For(const wstring& providerId) {
+    lock_guard<mutex> lock(mutex_);
+    auto& slot = limiters_[providerId];
+    if (!slot) {
+        slot = make_unique<RateLimiter>();
+        slot->SetMaxConcurrent(LimitFor(providerId));
+    }
+    return *slot;
+}
+
+void RateLimiters::SetConcurrency(size_t defaultLimit, const map<wstring, size_t>& limits) {
+    lock_guard<mutex> lock(mutex_);
+    defaultConcurrency_ = defaultLimit;
+    concurrency_ = limits;
+    for (auto& [id, limiter] : limiters_) limiter->SetMaxConcurrent(LimitFor(id));
+}
+
+size_t RateLimiters::LimitFor(const wstring& providerId) const {
+    auto it = concurrency_.find(providerId);
+    return it != concurrency_.end() ? it->second : defaultConcurrency_;
+}
+
+int SendWithRetry(RateLimiter& limiter, CancelToken* cancel, const function<RateLimitedResponse()>& send,
+                  const function<void(int, chrono::milliseconds)>& onRetry) {
+    const int maxRetries = limiter.Config().maxRetries;
+    for (int attempt = 0;; ++attempt) {
+        chrono::milliseconds wait = limiter.Reserve();
+        if (wait.count() > 0) {
+            TraceScope span("rate_limit_wait");
+            span.Arg("ms", wait.count());
+            if (!SleepUnlessCancelled(cancel, wait)) return -1;
+        } else if (cancel && cancel->IsCancelled()) {
+            return -1;
+        }
+        if (!limiter.AcquireSlot(cancel)) return -1;
+        RateLimitedResponse r;
+        try {
+            r = send();
+        } catch (...) {
+            limiter.ReleaseSlot();
+            throw;
+        }
+        limiter.ReleaseSlot();
+        const int64_t nowUnixMs = chrono::duration_cast<chrono::milliseconds>(chrono::system_clock::now().time_since_epoch()).count();
+        RateLimitHeaders h = ParseRateLimitHeaders(r.rawHeaders, nowUnixMs);
+        limiter.Observe(h);
+        if (!IsRetryableStatus(r.status) || attempt >= maxRetries) return r.status;
+        // The provider is saturated for everyone using this key: hold back other requests too
+        chrono::milliseconds delay = limiter.RetryDelay(attempt, h);
+        limiter.PauseFor(delay);
+        if (onRetry) onRetry(r.status, delay);
+    }
+}
@@ -0,0 +1,211 @@
+/**
+ * @file rate_limit.h
+ * @brief Per-provider rate limiting and retry of 429/503 responses
+ *
+ * Every request to a provider first reserves a slot from that provider's
+ * RateLimiter. The limiter combines an optional client-side token bucket
+ * (configured in the "rate-limit" object of apidef/<provider>.json) with what
+ * the server reports. The x-ratelimit-limit/remaining/reset-requests headers
+ * feed a second bucket with the rate at which the server's request window
+ * refills; any exhausted window (requests or tokens) or a Retry-After on a
+ * 429/503 pauses all requests to the provider until it resets, so new
+ * requests wait instead of being wasted on a certain 429. The limiter also
+ * holds the provider's request slots: however a job fans out (chunks,
+ * fan-out branches, pipeline stages, hedged attempts), no more requests than
+ * the "jobs" settings allow are in flight to one provider at once.
+ * SendWithRetry retries rejected requests with jittered exponential backoff.
+ */
+
+#pragma once
+
+#include "cancel_token.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <string_view>
+
+/**
+ * @struct RateLimitConfig
+ * @brief Rate limit settings of one provider
+ */
+struct RateLimitConfig {
+    double requestsPerMinute{};  // Client-side token bucket rate (0 = rely on the server's headers only)
+    unsigned burst{1};           // Token bucket capacity
+    int maxRetries{3};           // Retries of a 429/503 response
+    unsigned baseDelayMs{1000};  // First backoff step when the server gives no Retry-After
+    unsigned maxDelayMs{60000};  // Upper bound for backoff and Retry-After
+};
+
+/**
+ * @struct RateLimitHeaders
+ * @brief Rate limit information from one response's headers (-1 = not present)
+ */
+struct RateLimitHeaders {
+    long long retryAfterMs{-1};      // Retry-After or retry-after-ms
+    long long limit{-1};             // Request window closest to exhaustion (x-ratelimit-*-requests or unsuffixed)
+    long long remaining{-1};         // Requests left in that window
+    long long resetMs{-1};           // Time until that window is fully replenished
+    long long exhaustedResetMs{-1};  // Time until every window with nothing left (requests or tokens) has reset
+};
+
+/**
+ * @brief Parse rate limit headers from a raw CRLF-separated header block
+ * @param raw Status line and headers as received
+ * @param nowUnixMs Current time, for Retry-After dates and epoch reset times
+ *
+ * Reset values may be durations ("1s", "6m0s", "20ms"), seconds, or epoch
+ * seconds/milliseconds; Retry-After may be seconds or an HTTP date. Windows
+ * are compared by the fraction of their limit left, since a token window
+ * counts in other units than a request window.
+ */
+RateLimitHeaders ParseRateLimitHeaders(std::string_view raw, int64_t nowUnixMs);
+
+/**
+ * @brief true for statuses that are worth retrying after a delay (429, 503)
+ */
+bool IsRetryableStatus(int status);
+
+/**
+ * @class RateLimiter
+ * @brief Token bucket plus server-imposed pause for one provider
+ */
+class RateLimiter {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    RateLimiter();
+
+    void Configure(const RateLimitConfig& config);
+    RateLimitConfig Config() const;
+
+    /**
+     * @brief Take a send slot
+     * @return How long the caller must wait before sending
+     *
+     * The slot is reserved immediately, so concurrent callers are spaced out
+     * rather than all woken at the same moment.
+     */
+    std::chrono::milliseconds Reserve(Clock::time_point now = Clock::now());
+
+    /**
+     * @brief Apply the limits a response reported
+     *
+     * The request window sets the bucket's rate; an exhausted window of any
+     * kind pauses the provider until it resets.
+     */
+    void Observe(const RateLimitHeaders& h, Clock::time_point now = Clock::now());
+
+    /**
+     * @brief Hold back every request to the provider until now + delay
+     */
+    void PauseFor(std::chrono::milliseconds delay, Clock::time_point now = Clock::now());
+
+    /**
+     * @brief Delay before retry number attempt (0-based) of a rejected request
+     *
+     * Uses Retry-After when present, otherwise exponential backoff from
+     * baseDelayMs; either way capped at maxDelayMs and jittered.
+     */
+    std::chrono::milliseconds RetryDelay(int attempt, const RateLimitHeaders& h);
+
+    /**
+     * @brief Limit the requests to the provider in flight at once (0 = unlimited)
+     */
+    void SetMaxConcurrent(size_t limit);
+
+    /**
+     * @brief Wait for a free request slot (see SetMaxConcurrent)
+     * @param cancel Ends the wait early (optional)
+     * @return false if cancelled first; no slot is held then
+     */
+    bool AcquireSlot(CancelToken* cancel);
+
+    /**
+     * @brief Return a slot taken by AcquireSlot
+     */
+    void ReleaseSlot();
+
+private:
+    double Jitter(double maxMs);
+
+    /**
+     * @brief Add the tokens earned since the last refill (lock held)
+     * @return Effective rate in tokens per millisecond (0 = no bucket)
+     */
+    double Refill(Clock::time_point now);
+
+    mutable std::mutex mutex_;
+    RateLimitConfig config_;
+    double tokens_{};                  // May go negative: reservations waiting for refill
+    double serverPerMs_{};             // Refill rate implied by the last request window headers
+    double serverCapacity_{};          // Window size from x-ratelimit-limit-requests
+    Clock::time_point refilledAt_{};
+    Clock::time_point pausedUntil_{};
+    std::mt19937 rng_;
+    size_t maxConcurrent_{};           // Request slots (0 = unlimited)
+    size_t inFlight_{};                // Slots taken
+    std::condition_variable slotFreed_;
+};
+
+/**
+ * @class RateLimiters
+ * @brief Process-wide limiters keyed by provider id
+ */
+class RateLimiters {
+public:
+    static RateLimiters& Instance();
+
+    /**
+     * @brief Limiter of a provider (created with default settings on first use)
+     */
+    RateLimiter& For(const std::wstring& providerId);
+
+    /**
+     * @brief Set how many requests each provider may have in flight at once
+     * @param defaultLimit Limit of providers not listed in limits (0 = unlimited)
+     * @param limits Per-provider overrides, keyed by provider id
+     *
+     * Applies to existing limiters and to those created later.
+     */
+    void SetConcurrency(size_t defaultLimit, const std::map<std::wstring, size_t>& limits = {});
+
+    RateLimiters(const RateLimiters&) = delete;
+    RateLimiters& operator=(const RateLimiters&) = delete;
+
+private:
+    RateLimiters() = default;
+
+    size_t LimitFor(const std::wstring& providerId) const;
+
+    std::mutex mutex_;
+    std::map<std::wstring, std::unique_ptr<RateLimiter>> limiters_;
+    size_t defaultConcurrency_{};
+    std::map<std::wstring, size_t> concurrency_;
+};
+
+/**
+ * @struct RateLimitedResponse
+ * @brief What SendWithRetry needs to know about one attempt
+ */
+struct RateLimitedResponse {
+    int status{};             // HTTP status (0 = transport failure)
+    std::string rawHeaders;   // Raw response headers
+};
+
+/**
+ * @brief Send through a limiter, retrying 429/503 responses
+ * @param limiter Limiter of the provider (each attempt holds one of its request slots)
+ * @param cancel Ends waits early (optional)
+ * @param send Sends the request once
+ * @param onRetry Called before each retry with the rejected status and the delay (optional)
+ * @return Status of the last attempt, or -1 if cancelled while waiting
+ */
+int SendWithRetry(RateLimiter& limiter, CancelToken* cancel, const std::function<RateLimitedResponse()>& send,
+                  const std::function<void(int status, std::chrono::milliseconds delay)>& onRetry = nullptr);
@@ -0,0 +1,391 @@
+/**
+ * @file response_cache.cpp
+ * @brief Implementation of the memory-mapped response cache
+ */
+
+#include "response_cache.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#ifndef _WIN32
+#include "utf8.h"
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace {
+constexpr uint32_t kFileMagic = 0x43464243;    // "CBFC"
+constexpr uint32_t kFileVersion = 2;           // 2: records carry a checksum
+constexpr uint32_t kRecordMagic = 0x52464243;  // "CBFR"
+constexpr uint64_t kInitialCapacity = 1ULL << 20;
+
+/**
+ * @struct FileHeader
+ * @brief Fixed header at the start of the cache file
+ */
+struct FileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t used;           // Bytes in use including this header
+    uint8_t reserved[48];
+};
+
+/**
+ * @struct RecordHeader
+ * @brief Header preceding each payload; records are 8-byte aligned
+ */
+struct RecordHeader {
+    uint32_t magic;
+    uint32_t size;           // Payload bytes
+    uint64_t hi;
+    uint64_t lo;
+    uint32_t kind;
+    uint32_t checksum;       // RecordChecksum of the fields above and the payload
+};
+
+static_assert(sizeof(FileHeader) == 64 && sizeof(RecordHeader) == 32, "cache file layout");
+
+/**
+ * @brief Total bytes occupied by a record with the given payload size
+ */
+uint64_t RecordBytes(uint32_t size) { return sizeof(RecordHeader) + ((static_cast<uint64_t>(size) + 7) & ~7ULL); }
+
+uint64_t Rotl(uint64_t v, int r) { return (v << r) | (v >> (64 - r)); }
+
+uint64_t Finalize(uint64_t v) {
+    v ^= v >> 30; v *= 0xbf58476d1ce4e5b9ULL;
+    v ^= v >> 27; v *= 0x94d049bb133111ebULL;
+    return v ^ (v >> 31);
+}
+} // namespace
+
+void CacheKeyBuilder::Mix(const uint8_t* p, size_t n) {
+    constexpr uint64_t kPrimeA = 0x100000001b3ULL;
+    constexpr uint64_t kPrimeB = 0x9e3779b97f4a7c15ULL;
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint64_t w; memcpy(&w, p + i, 8);
+        a_ = Rotl((a_ ^ w) * kPrimeA, 29);
+        b_ = Rotl((b_ ^ w) * kPrimeB, 31);
+    }
+    uint64_t tail = 0;
+    if (i < n) memcpy(&tail, p + i, n - i);
+    a_ = (a_ ^ tail ^ n) * kPrimeA;
+    b_ = (b_ ^ tail ^ n) * kPrimeB;
+}
+
+CacheKeyBuilder& CacheKeyBuilder::Add(const void* data, size_t size) {
+    uint64_t len = size;
+    Mix(reinterpret_cast<const uint8_t*>(&len), sizeof(len));
+    Mix(static_cast<const uint8_t*>(data), size);
+    return *this;
+}
+
+CacheKey CacheKeyBuilder::Finish() const {
+    CacheKey k;
+    k.hi = Finalize(a_ ^ Rotl(b_, 17));
+    k.lo = Finalize(b_ ^ Rotl(a_, 41));
+    return k;
+}
+
+namespace {
+/**
+ * @brief Checksum of a record's key, kind, size and payload
+ */
+uint32_t RecordChecksum(const RecordHeader& rec, const uint8_t* payload) {
+    const CacheKey h = CacheKeyBuilder().Add(&rec.size, sizeof(rec.size)).Add(&rec.hi, sizeof(rec.hi)).Add(&rec.lo, sizeof(rec.lo))
+        .Add(&rec.kind, sizeof(rec.kind)).Add(payload, rec.size).Finish();
+    return static_cast<uint32_t>(h.lo ^ (h.lo >> 32));
+}
+} // namespace
+
+ResponseCache& ResponseCache::Instance() {
+    static ResponseCache cache;
+    return cache;
+}
+
+ResponseCache::~ResponseCache() {
+    Close();
+}
+
+uint64_t& ResponseCache::Used() {
+    return reinterpret_cast<FileHeader*>(view_)->used;
+}
+
+#ifdef _WIN32
+bool ResponseCache::Map(uint64_t capacity) {
+    Unmap();
+    mapping_ = CreateFileMappingW(file_, nullptr, PAGE_READWRITE, static_cast<DWORD>(capacity >> 32), static_cast<DWORD>(capacity), nullptr);
+    if (!mapping_) return false;
+    view_ = static_cast<uint8_t*>(MapViewOfFile(mapping_, FILE_MAP_ALL_ACCESS, 0, 0, 0));
+    if (!view_) { CloseHandle(mapping_); mapping_ = nullptr; return false; }
+    capacity_ = capacity;
+    return true;
+}
+
+void ResponseCache::Unmap() {
+    if (view_) { FlushViewOfFile(view_, 0); UnmapViewOfFile(view_); view_ = nullptr; }
+    if (mapping_) { CloseHandle(mapping_); mapping_ = nullptr; }
+    capacity_ = 0;
+}
+#else
+bool ResponseCache::Map(uint64_t capacity) {
+    Unmap();
+    struct stat st{};
+    // Like CreateFileMapping, grow the file to the mapped size
+    if (fstat(file_, &st) != 0) return false;
+    if (static_cast<uint64_t>(st.st_size) < capacity && ftruncate(file_, static_cast<off_t>(capacity)) != 0) return false;
+    void* view = mmap(nullptr, static_cast<size_t>(capacity), PROT_READ | PROT_WRITE, MAP_SHARED, file_, 0);
+    if (view == MAP_FAILED) return false;
+    view_ = static_cast<uint8_t*>(view);
+    capacity_ = capacity;
+    return true;
+}
+
+void ResponseCache::Unmap() {
+    if (view_) { msync(view_, static_cast<size_t>(capacity_), MS_ASYNC); munmap(view_, static_cast<size_t>(capacity_)); view_ = nullptr; }
+    capacity_ = 0;
+}
+#endif
+
+bool ResponseCache::Open(const wstring& path, unsigned long long maxBytes) {
+    lock_guard<mutex> lock(mutex_);
+#ifdef _WIN32
+    if (file_ != INVALID_HANDLE_VALUE) return true;
+    file_ = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file_ == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER size{};
+    GetFileSizeEx(file_, &size);
+    uint64_t capacity = (std::max)(kInitialCapacity, static_cast<uint64_t>(size.QuadPart));
+    if (!Map(capacity)) { CloseHandle(file_); file_ = INVALID_HANDLE_VALUE; return false; }
+#else
+    if (file_ >= 0) return true;
+    file_ = open(WideToUtf8(path).c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (file_ < 0) return false;
+    struct stat st{};
+    // Exclusive like the Windows share mode: a second process must not append to the same file
+    if (flock(file_, LOCK_EX | LOCK_NB) != 0 || fstat(file_, &st) != 0) { close(file_); file_ = -1; return false; }
+    uint64_t capacity = (std::max)(kInitialCapacity, static_cast<uint64_t>(st.st_size));
+    if (!Map(capacity)) { close(file_); file_ = -1; return false; }
+#endif
+    path_ = path;
+    maxBytes_ = maxBytes;
+
+    auto* header = reinterpret_cast<FileHeader*>(view_);
+    if (header->magic != kFileMagic || header->version != kFileVersion || header->used < sizeof(FileHeader) || header->used > capacity_) {
+        memset(header, 0, sizeof(FileHeader));
+        header->magic = kFileMagic;
+        header->version = kFileVersion;
+        header->used = sizeof(FileHeader);
+    }
+    // Rebuild the index; later records for the same key supersede earlier ones. Past a
+    // damaged record (its size field may be damaged too) the scan moves on to the next
+    // aligned offset, so the records after it survive.
+    uint64_t pos = sizeof(FileHeader);
+    uint64_t end = pos;
+    while (pos + sizeof(RecordHeader) <= header->used) {
+        const auto* rec = reinterpret_cast<const RecordHeader*>(view_ + pos);
+        if (rec->magic == kRecordMagic && pos + RecordBytes(rec->size) <= header->used && Verify(pos)) {
+            Index(CacheKey{rec->hi, rec->lo}, pos, rec->size, static_cast<CachedKind>(rec->kind), true);
+            end = pos + RecordBytes(rec->size);
+            pos = end;
+        } else {
+            pos += 8;
+        }
+    }
+    header->used = end;  // Drop a torn tail left by an interrupted write
+    while (liveBytes_ > maxBytes_ && !lru_.empty()) Evict(lru_.back());
+    return true;
+}
+
+void ResponseCache::Close() {
+    lock_guard<mutex> lock(mutex_);
+#ifdef _WIN32
+    if (file_ == INVALID_HANDLE_VALUE) return;
+    uint64_t used = view_ ? Used() : 0;
+    Unmap();
+    if (used) {
+        LARGE_INTEGER end{};
+        end.QuadPart = static_cast<LONGLONG>(used);
+        if (SetFilePointerEx(file_, end, nullptr, FILE_BEGIN)) SetEndOfFile(file_);
+    }
+    CloseHandle(file_);
+    file_ = INVALID_HANDLE_VALUE;
+#else
+    if (file_ < 0) return;
+    uint64_t used = view_ ? Used() : 0;
+    Unmap();
+    if (used && ftruncate(file_, static_cast<off_t>(used)) != 0) used = 0;  // Keeps the padded size; harmless
+    close(file_);
+    file_ = -1;
+#endif
+    index_.clear();
+    lru_.clear();
+    liveBytes_ = 0;
+}
+
+void ResponseCache::Index(const CacheKey& key, uint64_t offset, uint32_t size, CachedKind kind, bool verified) {
+    Evict(key);
+    lru_.push_front(key);
+    index_[key] = Entry{offset, size, kind, verified, lru_.begin()};
+    liveBytes_ += RecordBytes(size);
+}
+
+void ResponseCache::Evict(const CacheKey& key) {
+    auto it = index_.find(key);
+    if (it == index_.end()) return;
+    liveBytes_ -= RecordBytes(it->second.size);
+    lru_.erase(it->second.lru);
+    index_.erase(it);
+}
+
+bool ResponseCache::Verify(uint64_t offset) const {
+    const auto* rec = reinterpret_cast<const RecordHeader*>(view_ + offset);
+    return rec->checksum == RecordChecksum(*rec, view_ + offset + sizeof(RecordHeader));
+}
+
+void ResponseCache::Compact() {
+    // The live records are written to a new file that then replaces the old one, so a
+    // crash leaves one whole file or the other, never records half moved within one
+    vector<Entry*> live;
+    live.reserve(index_.size());
+    for (auto& [key, e] : index_) live.push_back(&e);
+    sort(live.begin(), live.end(), [](const Entry* a, const Entry* b) { return a->offset < b->offset; });
+    FileHeader header{kFileMagic, kFileVersion, sizeof(FileHeader), {}};
+    for (const Entry* e : live) header.used += RecordBytes(e->size);
+    const wstring tmpPath = path_ + L".tmp";
+    const uint64_t capacity = capacity_;
+#ifdef _WIN32
+    HANDLE tmp = CreateFileW(tmpPath.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (tmp == INVALID_HANDLE_VALUE) return;
+    auto write = [&](const void* data, uint64_t size) {
+        for (auto* p = static_cast<const uint8_t*>(data); size > 0;) {
+            DWORD n = 0;
+            if (!WriteFile(tmp, p, static_cast<DWORD>((std::min)(size, uint64_t{1} << 30)), &n, nullptr) || n == 0) return false;
+            p += n;
+            size -= n;
+        }
+        return true;
+    };
+    bool ok = write(&header, sizeof(header));
+    for (const Entry* e : live) ok = ok && write(view_ + e->offset, RecordBytes(e->size));
+    ok = ok && FlushFileBuffers(tmp);
+    CloseHandle(tmp);
+    if (!ok) { DeleteFileW(tmpPath.c_str()); return; }
+    // The old file is opened without sharing, so it has to be closed before it can be replaced
+    Unmap();
+    CloseHandle(file_);
+    ok = MoveFileExW(tmpPath.c_str(), path_.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+    file_ = CreateFileW(path_.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file_ == INVALID_HANDLE_VALUE || !Map(capacity)) {
+        // Cache disabled for the rest of the session; the next Open starts from whichever file is there
+        if (file_ != INVALID_HANDLE_VALUE) CloseHandle(file_);
+        file_ = INVALID_HANDLE_VALUE;
+        index_.clear();
+        lru_.clear();
+        liveBytes_ = 0;
+        return;
+    }
+    if (!ok) return;  // Still the old file, records where they were
+#else
+    const string tmpName = WideToUtf8(tmpPath);
+    int tmp = open(tmpName.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (tmp < 0) return;
+    auto write = [&](const void* data, uint64_t size) {
+        for (auto* p = static_cast<const uint8_t*>(data); size > 0;) {
+            ssize_t n = ::write(tmp, p, static_cast<size_t>(size));
+            if (n <= 0) return false;
+            p += n;
+            size -= static_cast<uint64_t>(n);
+        }
+        return true;
+    };
+    bool ok = flock(tmp, LOCK_EX | LOCK_NB) == 0 && write(&header, sizeof(header));
+    for (const Entry* e : live) ok = ok && write(view_ + e->offset, RecordBytes(e->size));
+    ok = ok && fsync(tmp) == 0 && rename(tmpName.c_str(), WideToUtf8(path_).c_str()) == 0;
+    if (!ok) { close(tmp); unlink(tmpName.c_str()); return; }
+    Unmap();
+    close(file_);
+    file_ = tmp;
+    if (!Map(capacity)) {
+        close(file_);
+        file_ = -1;
+        index_.clear();
+        lru_.clear();
+        liveBytes_ = 0;
+        return;
+    }
+#endif
+    // Moved records are checked again on their first read from the new file
+    uint64_t cursor = sizeof(FileHeader);
+    for (Entry* e : live) {
+        e->offset = cursor;
+        e->verified = false;
+        cursor += RecordBytes(e->size);
+    }
+}
+
+bool ResponseCache::Reserve(uint64_t bytes) {
+    if (Used() + bytes <= capacity_) return true;
+    if (liveBytes_ * 2 < Used()) Compact();
+    if (!view_) return false;
+    if (Used() + bytes <= capacity_) return true;
+    return Map((std::max)(capacity_ * 2, Used() + bytes));
+}
+
+bool ResponseCache::Get(const CacheKey& key, CachedKind& kind, string& payload) {
+    lock_guard<mutex> lock(mutex_);
+    auto it = view_ ? index_.find(key) : index_.end();
+    if (it == index_.end()) { ++misses_; return false; }
+    Entry& e = it->second;
+    if (!e.verified) {
+        if (!Verify(e.offset)) {
+            // Damaged while being moved to the compacted file; never serve it
+            Evict(key);
+            ++misses_;
+            return false;
+        }
+        e.verified = true;
+    }
+    lru_.splice(lru_.begin(), lru_, e.lru);
+    kind = e.kind;
+    payload.assign(reinterpret_cast<const char*>(view_ + e.offset + sizeof(RecordHeader)), e.size);
+    ++hits_;
+    return true;
+}
+
+void ResponseCache::Put(const CacheKey& key, CachedKind kind, string_view payload) {
+    lock_guard<mutex> lock(mutex_);
+    if (!view_ || payload.empty()) return;
+    const uint64_t bytes = RecordBytes(static_cast<uint32_t>(payload.size()));
+    if (payload.size() > UINT32_MAX || bytes > maxBytes_) return;
+    Evict(key);
+    while (liveBytes_ + bytes > maxBytes_ && !lru_.empty()) Evict(lru_.back());
+    if (!Reserve(bytes)) return;
+    const uint64_t offset = Used();
+    RecordHeader rec{kRecordMagic, static_cast<uint32_t>(payload.size()), key.hi, key.lo, static_cast<uint32_t>(kind), 0};
+    rec.checksum = RecordChecksum(rec, reinterpret_cast<const uint8_t*>(payload.data()));
+    memcpy(view_ + offset, &rec, sizeof(rec));
+    memcpy(view_ + offset + sizeof(rec), payload.data(), payload.size());
+    Used() = offset + bytes;  // Publish only after the record is complete
+    Index(key, offset, rec.size, kind, true);  // Written from the payload just checksummed
+}
+
+ResponseCacheStats ResponseCache::Stats() const {
+    lock_guard<mutex> lock(mutex_);
+    ResponseCacheStats s;
+    s.hits = hits_;
+    s.misses = misses_;
+    s.entries = index_.size();
+    s.liveBytes = liveBytes_;
+    return s;
+}
@@ -0,0 +1,165 @@
+/**
+ * @file response_cache.h
+ * @brief Persistent content-addressed cache of filter results
+ *
+ * Results are appended to a memory-mapped file and located through an
+ * in-memory index keyed by a 128-bit hash of everything that determines the
+ * response (provider, template, model, prompts and input). Entries are
+ * evicted least-recently-used first once the live size exceeds the limit, and
+ * the live records are copied to a fresh file that replaces the old one when
+ * evicted records dominate it. Every record carries a checksum of its key and
+ * payload, so a record torn by a crash is skipped rather than served. A
+ * record is checked once, when it is indexed at Open or first read after
+ * compaction moved it; hits on it then cost no more than the copy. The file
+ * is mapped with CreateFileMapping on Windows and mmap elsewhere.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+/**
+ * @struct CacheKey
+ * @brief 128-bit content hash identifying a request
+ */
+struct CacheKey {
+    uint64_t hi{};
+    uint64_t lo{};
+    bool operator==(const CacheKey& o) const { return hi == o.hi && lo == o.lo; }
+};
+
+/**
+ * @class CacheKeyBuilder
+ * @brief Incrementally hashes request fields into a CacheKey
+ *
+ * Every field is length-prefixed, so ("ab", "c") and ("a", "bc") differ.
+ */
+class CacheKeyBuilder {
+public:
+    CacheKeyBuilder& Add(const void* data, size_t size);
+    CacheKeyBuilder& Add(std::wstring_view s) { return Add(s.data(), s.size() * sizeof(wchar_t)); }
+    CacheKeyBuilder& Add(std::string_view s) { return Add(s.data(), s.size()); }
+    CacheKey Finish() const;
+
+private:
+    void Mix(const uint8_t* p, size_t n);
+    uint64_t a_{0xcbf29ce484222325ULL};
+    uint64_t b_{0x84222325cbf29ce4ULL};
+};
+
+/**
+ * @enum CachedKind
+ * @brief Type of a cached payload
+ */
+enum class CachedKind : uint32_t {
+    Text = 1,   // UTF-8 text
+    Image = 2   // Base64 image as returned by the API (ASCII)
+};
+
+/**
+ * @struct ResponseCacheStats
+ * @brief Cache counters
+ */
+struct ResponseCacheStats {
+    unsigned long long hits{};
+    unsigned long long misses{};
+    size_t entries{};
+    unsigned long long liveBytes{};
+    double HitRate() const { return hits + misses ? static_cast<double>(hits) / static_cast<double>(hits + misses) : 0.0; }
+};
+
+/**
+ * @class ResponseCache
+ * @brief Process-wide response cache backed by a memory-mapped append-only file
+ */
+class ResponseCache {
+public:
+    /**
+     * @brief Get the process-wide cache
+     */
+    static ResponseCache& Instance();
+
+    /**
+     * @brief Open (or create) the cache file and rebuild the index
+     * @param path Cache file path
+     * @param maxBytes Upper bound for live payload bytes
+     * @return false if the file could not be opened; the cache then stays disabled
+     */
+    bool Open(const std::wstring& path, unsigned long long maxBytes);
+
+    /**
+     * @brief Flush and close the cache file
+     */
+    void Close();
+
+    /**
+     * @brief Look up a cached result
+     * @param key Request key
+     * @param kind Output: payload type
+     * @param payload Output: payload bytes
+     * @return true on hit
+     */
+    bool Get(const CacheKey& key, CachedKind& kind, std::string& payload);
+
+    /**
+     * @brief Store a result (replaces any previous entry for the key)
+     */
+    void Put(const CacheKey& key, CachedKind kind, std::string_view payload);
+
+    /**
+     * @brief Get hit/miss counters and size
+     */
+    ResponseCacheStats Stats() const;
+
+    ResponseCache(const ResponseCache&) = delete;
+    ResponseCache& operator=(const ResponseCache&) = delete;
+
+private:
+    ResponseCache() = default;
+    ~ResponseCache();
+
+    struct KeyHash {
+        size_t operator()(const CacheKey& k) const { return static_cast<size_t>(k.lo ^ (k.hi >> 7)); }
+    };
+    struct Entry {
+        uint64_t offset{};                 // Record offset in the file
+        uint32_t size{};                   // Payload size
+        CachedKind kind{CachedKind::Text};
+        bool verified{};                   // Checksum checked since the record was last written
+        std::list<CacheKey>::iterator lru; // Position in recency list (front = most recent)
+    };
+
+    bool Map(uint64_t capacity);
+    void Unmap();
+    bool Reserve(uint64_t bytes);
+    void Compact();
+    bool Verify(uint64_t offset) const;
+    void Index(const CacheKey& key, uint64_t offset, uint32_t size, CachedKind kind, bool verified);
+    void Evict(const CacheKey& key);
+    uint64_t& Used();
+
+    mutable std::mutex mutex_;
+    std::wstring path_;
+#ifdef _WIN32
+    HANDLE file_{INVALID_HANDLE_VALUE};
+    HANDLE mapping_{};
+#else
+    int file_{-1};
+#endif
+    uint8_t* view_{};
+    uint64_t capacity_{};
+    unsigned long long maxBytes_{};
+    unsigned long long liveBytes_{};
+    std::unordered_map<CacheKey, Entry, KeyHash> index_;
+    std::list<CacheKey> lru_;
+    unsigned long long hits_{};
+    unsigned long long misses_{};
+};
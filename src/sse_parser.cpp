@@ -0,0 +1,59 @@
+/**
+ * @file sse_parser.cpp
+ * @brief Implementation of the incremental SSE parser
+ */
+
+#include "sse_parser.h"
+
+using namespace std;
+
+void SseParser::Feed(const char* data, size_t size) {
+    size_t start = 0;
+    for (size_t i = 0; i < size; ++i) {
+        if (data[i] != '\n') continue;
+        pending_.append(data + start, i - start);
+        if (!pending_.empty() && pending_.back() == '\r') pending_.pop_back();
+        ProcessLine(pending_);
+        pending_.clear();
+        start = i + 1;
+    }
+    pending_.append(data + start, size - start);
+}
+
+void SseParser::Finish() {
+    if (!pending_.empty()) {
+        if (pending_.back() == '\r') pending_.pop_back();
+        ProcessLine(pending_);
+        pending_.clear();
+    }
+    Dispatch();
+}
+
+void SseParser::ProcessLine(const string& line) {
+    // Blank line terminates the current event
+    if (line.empty()) { Dispatch(); return; }
+    // Lines starting with ':' are comments (keep-alive pings)
+    if (line.front() == ':') return;
+    size_t colon = line.find(':');
+    string field = line.substr(0, colon);
+    string value;
+    if (colon != string::npos) {
+        size_t v = colon + 1;
+        if (v < line.size() && line[v] == ' ') ++v;
+        value = line.substr(v);
+    }
+    if (field == "data") {
+        if (hasData_) data_ += '\n';
+        data_ += value;
+        hasData_ = true;
+    } else if (field == "event") {
+        event_ = value;
+    }
+}
+
+void SseParser::Dispatch() {
+    if (hasData_ && handler_) handler_(event_, data_);
+    event_.clear();
+    data_.clear();
+    hasData_ = false;
+}
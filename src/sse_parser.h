@@ -0,0 +1,49 @@
+/**
+ * @file sse_parser.h
+ * @brief Incremental parser for text/event-stream (server-sent events) bodies
+ *
+ * Network reads do not respect frame boundaries, so the parser buffers
+ * partial lines between Feed() calls and reports each complete event once
+ * its terminating blank line has arrived.
+ */
+
+#pragma once
+
+#include <functional>
+#include <string>
+
+/**
+ * @class SseParser
+ * @brief Splits a byte stream into SSE events
+ */
+class SseParser {
+public:
+    /**
+     * @brief Callback invoked for each complete event
+     * @param event Event name (empty when the frame has no "event:" field)
+     * @param data Event data; multiple "data:" lines are joined with '\n'
+     */
+    using EventHandler = std::function<void(const std::string& event, const std::string& data)>;
+
+    explicit SseParser(EventHandler handler) : handler_(std::move(handler)) {}
+
+    /**
+     * @brief Feed raw bytes received from the network
+     */
+    void Feed(const char* data, size_t size);
+
+    /**
+     * @brief Flush an event that was not terminated by a blank line (end of body)
+     */
+    void Finish();
+
+private:
+    void ProcessLine(const std::string& line);
+    void Dispatch();
+
+    EventHandler handler_;
+    std::string pending_;   // Bytes of an incomplete line
+    std::string event_;
+    std::string data_;
+    bool hasData_{};
+};
@@ -0,0 +1,74 @@
+/**
+ * @file string_table.cpp
+ * @brief Implementation of the localized string table
+ */
+
+#include "string_table.h"
+#include "utf8.h"
+
+using namespace std;
+
+namespace {
+bool IsBlank(char c) { return c == ' ' || c == '\t'; }
+
+string_view TrimLeft(string_view s) {
+    while (!s.empty() && IsBlank(s.front())) s.remove_prefix(1);
+    return s;
+}
+
+string_view Trim(string_view s) {
+    s = TrimLeft(s);
+    while (!s.empty() && IsBlank(s.back())) s.remove_suffix(1);
+    return s;
+}
+} // namespace
+
+size_t StringTable::Load(string_view utf8, wstring_view language) {
+    index_.clear();
+    interned_.clear();
+    pool_.clear();
+    language_ = language;
+    if (utf8.substr(0, 3) == "\xEF\xBB\xBF") utf8.remove_prefix(3);
+    const string section = WideToUtf8(language);
+    bool inSection = false;
+    while (!utf8.empty()) {
+        size_t nl = utf8.find('\n');
+        string_view line = utf8.substr(0, nl);
+        utf8.remove_prefix(nl == string_view::npos ? utf8.size() : nl + 1);
+        if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+        if (line.empty() || line.front() == ';') continue;
+        if (line.front() == '[') {
+            size_t end = line.find(']');
+            if (end != string_view::npos && end > 1) inSection = line.substr(1, end - 1) == section;
+            continue;
+        }
+        if (!inSection) continue;
+        size_t eq = line.find('=');
+        if (eq == string_view::npos) continue;
+        const wstring key = Utf8ToWide(Trim(line.substr(0, eq)));
+        if (key.empty() || index_.count(key)) continue;
+        const wstring& pooledKey = Intern(key);
+        index_.emplace(pooledKey, &Intern(Utf8ToWide(TrimLeft(line.substr(eq + 1)))));
+    }
+    return index_.size();
+}
+
+const wstring* StringTable::Find(wstring_view key) const {
+    auto it = index_.find(key);
+    return it != index_.end() ? it->second : nullptr;
+}
+
+const wstring& StringTable::Get(wstring_view key) {
+    if (const wstring* text = Find(key)) return *text;
+    const wstring& pooled = Intern(key);
+    index_.emplace(pooled, &pooled);
+    return pooled;
+}
+
+const wstring& StringTable::Intern(wstring_view s) {
+    auto it = interned_.find(s);
+    if (it != interned_.end()) return *it->second;
+    const wstring& pooled = pool_.emplace_back(s);
+    interned_.emplace(pooled, &pooled);
+    return pooled;
+}
@@ -0,0 +1,64 @@
+/**
+ * @file string_table.h
+ * @brief Localized UI strings parsed once from lang.ini
+ *
+ * One language section of lang.ini is parsed into a hash table. Keys and
+ * values are interned in a pool (identical texts share one copy), so a lookup
+ * hashes the key and returns a reference into the pool without allocating.
+ * The owner reloads the table only when the UI language changes.
+ */
+
+#pragma once
+
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+/**
+ * @class StringTable
+ * @brief Key-to-text table of one language
+ *
+ * Not thread-safe; used from the UI thread.
+ */
+class StringTable {
+public:
+    /**
+     * @brief Replace the table with one section of INI text
+     * @param utf8 File content (UTF-8, optional BOM, LF or CRLF line ends)
+     * @param language Section to load, e.g. "ja"
+     * @return Number of keys loaded
+     *
+     * Lines starting with ';' are comments; keys are trimmed, values are
+     * trimmed on the left only. The first occurrence of a key wins.
+     */
+    size_t Load(std::string_view utf8, std::wstring_view language);
+
+    /**
+     * @brief Language of the loaded section (empty before the first Load)
+     */
+    const std::wstring& Language() const { return language_; }
+
+    /**
+     * @return Text of a key, or nullptr if the section does not define it
+     */
+    const std::wstring* Find(std::wstring_view key) const;
+
+    /**
+     * @brief Text of a key, or the key itself if it is missing
+     *
+     * A missing key is interned on first use, so repeated misses do not
+     * allocate either.
+     */
+    const std::wstring& Get(std::wstring_view key);
+
+    size_t Size() const { return index_.size(); }
+
+private:
+    const std::wstring& Intern(std::wstring_view s);
+
+    std::wstring language_;
+    std::deque<std::wstring> pool_;  // Interned texts (a deque keeps references stable)
+    std::unordered_map<std::wstring_view, const std::wstring*> interned_;  // Pool entries by content
+    std::unordered_map<std::wstring_view, const std::wstring*> index_;     // Key -> text
+};
@@ -0,0 +1,111 @@
+/**
+ * @file template_render.cpp
+ * @brief Implementation of compiled template rendering
+ */
+
+#include "template_render.h"
+#include "utf8.h"
+
+using namespace std;
+
+namespace {
+/**
+ * @brief Map placeholder token text (without << >>) to its kind
+ */
+Placeholder LookupPlaceholder(string_view name) {
+    if (name == "model") return Placeholder::Model;
+    if (name == "system_prompt") return Placeholder::SystemPrompt;
+    if (name == "prompt") return Placeholder::Prompt;
+    if (name == "input_text") return Placeholder::InputText;
+    if (name == "api_key") return Placeholder::ApiKey;
+    if (name == "image_url") return Placeholder::ImageUrl;
+    if (name == "image") return Placeholder::Image;
+    if (name == "image_mime") return Placeholder::ImageMime;
+    return Placeholder::Literal;
+}
+
+/**
+ * @brief Escape sequence for a character, or nullptr if it is copied as-is
+ */
+const char* EscapeFor(char c) {
+    switch (c) {
+    case '\\': return "\\\\";
+    case '"': return "\\\"";
+    case '\n': return "\\n";
+    case '\r': return "\\r";
+    case '\t': return "\\t";
+    default: return nullptr;
+    }
+}
+} // namespace
+
+size_t JsonEscapedLength(string_view s) {
+    size_t n = s.size();
+    for (char c : s) if (EscapeFor(c)) ++n;
+    return n;
+}
+
+void JsonEscapeAppend(string& out, string_view s) {
+    size_t run = 0;  // Start of the pending unescaped run
+    for (size_t i = 0; i < s.size(); ++i) {
+        const char* esc = EscapeFor(s[i]);
+        if (!esc) continue;
+        out.append(s.data() + run, i - run);
+        out += esc;
+        run = i + 1;
+    }
+    out.append(s.data() + run, s.size() - run);
+}
+
+string JsonEscape(string_view s) {
+    string out;
+    out.reserve(JsonEscapedLength(s));
+    JsonEscapeAppend(out, s);
+    return out;
+}
+
+CompiledTemplate CompiledTemplate::Compile(const wstring& text) {
+    CompiledTemplate t;
+    const string src = WideToUtf8(text);
+    size_t literalStart = 0;
+    size_t pos = 0;
+    auto flushLiteral = [&](size_t end) {
+        if (end > literalStart) t.segments_.push_back({ Placeholder::Literal, src.substr(literalStart, end - literalStart) });
+    };
+    while ((pos = src.find("<<", pos)) != string::npos) {
+        size_t close = src.find(">>", pos + 2);
+        if (close == string::npos) break;
+        Placeholder kind = LookupPlaceholder(string_view(src).substr(pos + 2, close - pos - 2));
+        // Unknown tokens stay part of the surrounding literal
+        if (kind == Placeholder::Literal) { ++pos; continue; }
+        flushLiteral(pos);
+        t.segments_.push_back({ kind, "" });
+        pos = close + 2;
+        literalStart = pos;
+    }
+    flushLiteral(src.size());
+    return t;
+}
+
+string CompiledTemplate::Render(const PlaceholderValues& v, bool jsonEsc) const {
+    // Base64 and data URLs have nothing to escape, so the megabytes of an image are not scanned
+    auto escaped = [&](Placeholder kind) { return jsonEsc && kind != Placeholder::Image && kind != Placeholder::ImageUrl; };
+    size_t total = 0;
+    for (const auto& seg : segments_) {
+        if (seg.kind == Placeholder::Literal) total += seg.literal.size();
+        else total += escaped(seg.kind) ? JsonEscapedLength(v[seg.kind]) : v[seg.kind].size();
+    }
+    string out;
+    out.reserve(total);
+    for (const auto& seg : segments_) {
+        if (seg.kind == Placeholder::Literal) out += seg.literal;
+        else if (escaped(seg.kind)) JsonEscapeAppend(out, v[seg.kind]);
+        else out += v[seg.kind];
+    }
+    return out;
+}
+
+bool CompiledTemplate::Uses(Placeholder p) const {
+    for (const auto& seg : segments_) if (seg.kind == p) return true;
+    return false;
+}
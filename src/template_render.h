@@ -0,0 +1,97 @@
+/**
+ * @file template_render.h
+ * @brief Pre-compiled apidef templates with single-pass placeholder rendering
+ *
+ * Templates from the apidef JSON files are split once into literal and placeholder
+ * segments. Rendering then writes every segment exactly once into a buffer
+ * sized up front, so a multi-megabyte <<image>> value is copied once instead
+ * of being rescanned by every subsequent replacement pass.
+ * Literals, values and the rendered output are UTF-8, so a request body can
+ * be sent without further conversion.
+ */
+
+#pragma once
+
+#include <array>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @enum Placeholder
+ * @brief Placeholders recognized in apidef templates
+ */
+enum class Placeholder {
+    Literal,       // Not a placeholder: segment text is copied verbatim
+    Model,         // <<model>>
+    SystemPrompt,  // <<system_prompt>>
+    Prompt,        // <<prompt>>
+    InputText,     // <<input_text>> (same value as <<prompt>>)
+    ApiKey,        // <<api_key>>
+    ImageUrl,      // <<image_url>>
+    Image,         // <<image>>
+    ImageMime,     // <<image_mime>>
+    Count
+};
+
+/**
+ * @struct PlaceholderValues
+ * @brief UTF-8 values substituted for each placeholder (views must outlive Render)
+ */
+struct PlaceholderValues {
+    std::array<std::string_view, static_cast<size_t>(Placeholder::Count)> values{};
+    std::string_view& operator[](Placeholder p) { return values[static_cast<size_t>(p)]; }
+    std::string_view operator[](Placeholder p) const { return values[static_cast<size_t>(p)]; }
+};
+
+/**
+ * @class CompiledTemplate
+ * @brief Template text pre-split into literal/placeholder segments
+ */
+class CompiledTemplate {
+public:
+    CompiledTemplate() = default;
+
+    /**
+     * @brief Split template text into segments
+     * @param text Template text containing <<placeholder>> tokens
+     */
+    static CompiledTemplate Compile(const std::wstring& text);
+
+    /**
+     * @brief Render the template in a single pass
+     * @param v Placeholder values (<<image>> base64, <<image_url>> a data URL)
+     * @param jsonEsc Apply JSON string escaping to substituted values; image values are copied verbatim
+     * @return Rendered UTF-8 text
+     */
+    std::string Render(const PlaceholderValues& v, bool jsonEsc) const;
+
+    /**
+     * @brief Check whether the template contains the given placeholder
+     */
+    bool Uses(Placeholder p) const;
+
+    bool empty() const { return segments_.empty(); }
+
+private:
+    struct Segment {
+        Placeholder kind{Placeholder::Literal};
+        std::string literal;  // UTF-8
+    };
+    std::vector<Segment> segments_;
+};
+
+/**
+ * @brief Escape UTF-8 text for embedding inside a JSON string literal
+ */
+std::string JsonEscape(std::string_view s);
+
+/**
+ * @brief Append JSON-escaped text to an output buffer
+ */
+void JsonEscapeAppend(std::string& out, std::string_view s);
+
+/**
+ * @brief Length of s after JsonEscape, without building the escaped string
+ */
+size_t JsonEscapedLength(std::string_view s);
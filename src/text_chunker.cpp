@@ -0,0 +1,181 @@
+/**
+ * @file text_chunker.cpp
+ * @brief Implementation of text chunking
+ */
+
+#include "text_chunker.h"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace {
+bool IsSpace(wchar_t c) {
+    return c == L' ' || c == L'\t' || c == L'\r' || c == L'\n' || c == 0x3000 || c == 0x00A0;
+}
+
+bool IsWide(wchar_t c) {
+    return c >= 0x2E80;
+}
+
+bool IsSentenceEnd(wchar_t c) {
+    return c == L'.' || c == L'!' || c == L'?' || c == 0x3002 || c == 0xFF01 || c == 0xFF1F;
+}
+
+/**
+ * @brief Split text at a set of cut points, each cut being a run [start, end) of separator characters
+ */
+vector<TextChunk> CutAt(const wstring& s, const wstring& tailSep, const vector<pair<size_t, size_t>>& cuts) {
+    vector<TextChunk> out;
+    size_t pos = 0;
+    for (const auto& [start, end] : cuts) {
+        out.push_back({s.substr(pos, start - pos), s.substr(start, end - start)});
+        pos = end;
+    }
+    out.push_back({s.substr(pos), tailSep});
+    return out;
+}
+
+/**
+ * @brief Split at blank lines
+ */
+vector<TextChunk> SplitParagraphs(const wstring& s) {
+    vector<pair<size_t, size_t>> cuts;
+    size_t i = 0;
+    while (i < s.size()) {
+        if (s[i] != L'\n') { ++i; continue; }
+        // Extend over the whitespace run around this newline and count its line breaks
+        size_t start = i, end = i, breaks = 0;
+        while (start > 0 && IsSpace(s[start - 1]) && s[start - 1] != L'\n') --start;
+        while (end < s.size() && IsSpace(s[end])) { if (s[end] == L'\n') ++breaks; ++end; }
+        if (breaks >= 2 && start > 0 && end < s.size() && (cuts.empty() || start > cuts.back().second)) cuts.emplace_back(start, end);
+        i = end;
+    }
+    // Trailing whitespace of the whole text becomes the last separator
+    size_t tail = s.size();
+    while (tail > 0 && IsSpace(s[tail - 1])) --tail;
+    return CutAt(s.substr(0, tail), s.substr(tail), cuts);
+}
+
+/**
+ * @brief Split a paragraph after sentence-ending punctuation
+ */
+vector<TextChunk> SplitSentences(const wstring& s, const wstring& sep) {
+    vector<pair<size_t, size_t>> cuts;
+    for (size_t i = 0; i + 1 < s.size(); ++i) {
+        if (!IsSentenceEnd(s[i])) continue;
+        size_t end = i + 1;
+        while (end < s.size() && IsSpace(s[end])) ++end;
+        if (end == s.size()) break;
+        // Latin punctuation needs following whitespace ("3.14" is not a sentence end); CJK does not
+        if (end == i + 1 && !IsWide(s[i])) continue;
+        cuts.emplace_back(i + 1, end);
+        i = end - 1;
+    }
+    return CutAt(s, sep, cuts);
+}
+
+/**
+ * @brief Split an over-long sentence near the budget, preferring whitespace
+ */
+vector<TextChunk> SplitHard(const wstring& s, const wstring& sep, size_t maxTokens) {
+    vector<pair<size_t, size_t>> cuts;
+    size_t begin = 0;
+    while (begin < s.size()) {
+        size_t i = begin, lastSpace = wstring::npos;
+        size_t latin = 0, wide = 0;
+        for (; i < s.size(); ++i) {
+            if (IsWide(s[i])) ++wide; else ++latin;
+            if ((latin + 3) / 4 + wide > maxTokens) break;
+            if (IsSpace(s[i]) && i > begin) lastSpace = i;
+        }
+        if (i >= s.size()) break;
+        size_t cut = lastSpace != wstring::npos ? lastSpace : (std::max)(i, begin + 1);
+        size_t start = cut, end = cut;
+        while (start > begin && IsSpace(s[start - 1])) --start;
+        while (end < s.size() && IsSpace(s[end])) ++end;
+        if (end >= s.size()) break;
+        cuts.emplace_back(start, end);
+        begin = end;
+    }
+    return CutAt(s, sep, cuts);
+}
+} // namespace
+
+size_t EstimateTokens(wstring_view text) {
+    size_t latin = 0, wide = 0;
+    for (wchar_t c : text) { if (IsWide(c)) ++wide; else ++latin; }
+    return (latin + 3) / 4 + wide;
+}
+
+vector<TextChunk> SplitTextIntoChunks(const wstring& text, size_t maxTokens) {
+    if (maxTokens == 0 || EstimateTokens(text) <= maxTokens) return {TextChunk{text, L""}};
+    // Break into pieces that each fit the budget, coarsest boundary first
+    vector<TextChunk> pieces;
+    for (auto& para : SplitParagraphs(text)) {
+        if (EstimateTokens(para.text) <= maxTokens) { pieces.push_back(move(para)); continue; }
+        for (auto& sentence : SplitSentences(para.text, para.separator)) {
+            if (EstimateTokens(sentence.text) <= maxTokens) { pieces.push_back(move(sentence)); continue; }
+            for (auto& part : SplitHard(sentence.text, sentence.separator, maxTokens)) pieces.push_back(move(part));
+        }
+    }
+    // Greedily pack consecutive pieces into chunks
+    vector<TextChunk> chunks;
+    size_t tokens = 0;
+    for (auto& p : pieces) {
+        size_t t = EstimateTokens(p.text);
+        if (!chunks.empty() && tokens + EstimateTokens(chunks.back().separator) + t <= maxTokens) {
+            TextChunk& c = chunks.back();
+            tokens += EstimateTokens(c.separator) + t;
+            c.text += c.separator;
+            c.text += p.text;
+            c.separator = move(p.separator);
+        } else {
+            tokens = t;
+            chunks.push_back(move(p));
+        }
+    }
+    return chunks;
+}
+
+wstring JoinChunks(const vector<TextChunk>& chunks, const vector<wstring>& outputs) {
+    wstring out;
+    for (size_t i = 0; i < chunks.size() && i < outputs.size(); ++i) {
+        out += outputs[i];
+        out += chunks[i].separator;
+    }
+    return out;
+}
+
+vector<TextChunk> StreamingChunker::Append(wstring_view delta) {
+    pending_ += delta;
+    // Only a new paragraph break can complete a chunk
+    if (maxTokens_ == 0 || delta.find(L'\n') == wstring_view::npos) return {};
+    vector<TextChunk> paragraphs = SplitParagraphs(pending_);
+    if (paragraphs.size() < 2) return {};
+    // Every paragraph but the last is final; pack them and keep the last chunk open for more text
+    size_t settled = 0;
+    for (size_t i = 0; i + 1 < paragraphs.size(); ++i) settled += paragraphs[i].text.size() + paragraphs[i].separator.size();
+    vector<TextChunk> chunks = SplitTextIntoChunks(pending_.substr(0, settled), maxTokens_);
+    if (chunks.size() < 2) return {};
+    chunks.pop_back();
+    size_t released = 0;
+    for (const TextChunk& c : chunks) released += c.text.size() + c.separator.size();
+    pending_.erase(0, released);
+    return chunks;
+}
+
+vector<TextChunk> StreamingChunker::Finish() {
+    if (pending_.empty()) return {};
+    vector<TextChunk> chunks = SplitTextIntoChunks(pending_, maxTokens_);
+    pending_.clear();
+    // A text within budget comes back whole; keep its trailing whitespace out of the chunk as a longer split would
+    TextChunk& last = chunks.back();
+    if (last.separator.empty()) {
+        size_t tail = last.text.size();
+        while (tail > 0 && IsSpace(last.text[tail - 1])) --tail;
+        last.separator = last.text.substr(tail);
+        last.text.resize(tail);
+    }
+    return chunks;
+}
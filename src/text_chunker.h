@@ -0,0 +1,81 @@
+/**
+ * @file text_chunker.h
+ * @brief Split long text into token-budgeted chunks on natural boundaries
+ *
+ * Long Text->Text inputs are sent as several smaller requests. Chunks are cut
+ * at paragraph breaks where possible, then at sentence ends, and only as a
+ * last resort in the middle of a sentence. The whitespace between chunks is
+ * kept so the processed pieces can be joined back with the original layout.
+ * StreamingChunker does the same for text that is still arriving.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @struct TextChunk
+ * @brief One piece of the input and the whitespace that followed it
+ */
+struct TextChunk {
+    std::wstring text;       // Chunk content (no leading/trailing separator)
+    std::wstring separator;  // Whitespace between this chunk and the next one
+};
+
+/**
+ * @brief Rough token count of a text
+ *
+ * Uses ~4 characters per token for Latin script and one token per character
+ * for CJK and other wide scripts, which is close enough for budgeting.
+ */
+size_t EstimateTokens(std::wstring_view text);
+
+/**
+ * @brief Split text into chunks of at most maxTokens estimated tokens
+ * @param text Input text
+ * @param maxTokens Token budget per chunk (0 returns the whole text as one chunk)
+ * @return Chunks in input order; joining text + separator reproduces the input
+ */
+std::vector<TextChunk> SplitTextIntoChunks(const std::wstring& text, size_t maxTokens);
+
+/**
+ * @brief Join processed chunk outputs using the original separators
+ * @param chunks Chunks returned by SplitTextIntoChunks
+ * @param outputs Processed text for each chunk
+ */
+std::wstring JoinChunks(const std::vector<TextChunk>& chunks, const std::vector<std::wstring>& outputs);
+
+/**
+ * @class StreamingChunker
+ * @brief Cuts text arriving in pieces into the chunks SplitTextIntoChunks would produce
+ *
+ * A chunk is released once the paragraphs after it show that no more text
+ * can be packed into it, so a stage consuming a stream can start on the
+ * first chunks while the rest is still being generated.
+ */
+class StreamingChunker {
+public:
+    /**
+     * @param maxTokens Token budget per chunk (0 keeps everything for Finish)
+     */
+    explicit StreamingChunker(size_t maxTokens) : maxTokens_(maxTokens) {}
+
+    /**
+     * @brief Add streamed text
+     * @return Chunks completed by it, in order
+     */
+    std::vector<TextChunk> Append(std::wstring_view delta);
+
+    /**
+     * @brief End of the stream
+     * @return The remaining chunks, in order
+     */
+    std::vector<TextChunk> Finish();
+
+private:
+    size_t maxTokens_;
+    std::wstring pending_;   // Text not released yet
+};
@@ -0,0 +1,81 @@
+/**
+ * @file trace.cpp
+ * @brief Implementation of the span tracer
+ */
+
+#include "trace.h"
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+
+using namespace std;
+
+namespace {
+thread_local TraceSession* t_session = nullptr;
+
+/**
+ * @brief Escape a string for a JSON string literal
+ */
+string JsonQuote(const string& s) {
+    string out = "\"";
+    for (char c : s) {
+        if (c == '"' || c == '\\') { out += '\\'; out += c; }
+        else if (static_cast<unsigned char>(c) < 0x20) out += ' ';
+        else out += c;
+    }
+    return out + "\"";
+}
+} // namespace
+
+TraceSession::TraceSession(string name) : name_(move(name)), startUs_(NowUs()) {}
+
+int64_t TraceSession::NowUs() {
+    return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+uint32_t TraceSession::ThreadId() {
+    static atomic<uint32_t> next{1};
+    thread_local uint32_t id = next++;
+    return id;
+}
+
+void TraceSession::Add(const Event& e) {
+    lock_guard<mutex> lock(mutex_);
+    events_.push_back(e);
+}
+
+bool TraceSession::WriteChromeJson(const filesystem::path& path) const {
+    ofstream f(path, ios::binary | ios::trunc);
+    if (!f) return false;
+    lock_guard<mutex> lock(mutex_);
+    f << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    f << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":" << JsonQuote(name_) << "}}";
+    for (const Event& e : events_) {
+        f << ",\n{\"name\":" << JsonQuote(e.name) << ",\"cat\":\"cbfilter\",\"ph\":\"X\",\"pid\":1,\"tid\":" << e.tid
+          << ",\"ts\":" << e.startUs << ",\"dur\":" << e.durUs;
+        if (e.argCount) {
+            f << ",\"args\":{";
+            for (size_t i = 0; i < e.argCount; ++i) {
+                if (i) f << ',';
+                f << JsonQuote(e.args[i].first) << ':' << e.args[i].second;
+            }
+            f << '}';
+        }
+        f << '}';
+    }
+    f << "\n]}\n";
+    return static_cast<bool>(f);
+}
+
+TraceSession* CurrentTrace() {
+    return t_session;
+}
+
+TraceAttach::TraceAttach(TraceSession* session) : previous_(t_session) {
+    t_session = session;
+}
+
+TraceAttach::~TraceAttach() {
+    t_session = previous_;
+}
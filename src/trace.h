@@ -0,0 +1,132 @@
+/**
+ * @file trace.h
+ * @brief Scoped-span latency tracer with Chrome trace_event JSON export
+ *
+ * A TraceSession collects the spans of one filter job. Threads working on the
+ * job bind the session with TraceAttach; TraceScope objects then record a
+ * complete ("X") event from construction to destruction. Without a bound
+ * session a TraceScope costs one thread-local load and a branch. The JSON
+ * written by WriteChromeJson opens directly in Perfetto or chrome://tracing.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * @class TraceSession
+ * @brief Thread-safe collection of spans belonging to one job
+ */
+class TraceSession {
+public:
+    static constexpr size_t kMaxArgs = 4;
+
+    struct Event {
+        const char* name{};   // Static string
+        int64_t startUs{};    // Relative to session start
+        int64_t durUs{};
+        uint32_t tid{};
+        std::pair<const char*, long long> args[kMaxArgs]{};
+        size_t argCount{};
+    };
+
+    /**
+     * @param name Job label written as the process name in the trace
+     */
+    explicit TraceSession(std::string name);
+
+    /**
+     * @brief Microseconds since an arbitrary fixed point (steady clock)
+     */
+    static int64_t NowUs();
+
+    /**
+     * @brief Small, stable id of the calling thread
+     */
+    static uint32_t ThreadId();
+
+    /**
+     * @brief Record a finished span
+     */
+    void Add(const Event& e);
+
+    /**
+     * @brief Session start in NowUs() units
+     */
+    int64_t StartUs() const { return startUs_; }
+
+    /**
+     * @brief Write all spans as a Chrome trace_event JSON file
+     * @return false if the file could not be written
+     */
+    bool WriteChromeJson(const std::filesystem::path& path) const;
+
+private:
+    std::string name_;
+    int64_t startUs_{};
+    mutable std::mutex mutex_;
+    std::vector<Event> events_;
+};
+
+/**
+ * @brief Session bound to the calling thread, or nullptr when tracing is off
+ */
+TraceSession* CurrentTrace();
+
+/**
+ * @class TraceAttach
+ * @brief Binds a session to the current thread for the lifetime of the object
+ */
+class TraceAttach {
+public:
+    explicit TraceAttach(TraceSession* session);
+    ~TraceAttach();
+    TraceAttach(const TraceAttach&) = delete;
+    TraceAttach& operator=(const TraceAttach&) = delete;
+
+private:
+    TraceSession* previous_;
+};
+
+/**
+ * @class TraceScope
+ * @brief Records one span from construction to destruction
+ */
+class TraceScope {
+public:
+    explicit TraceScope(const char* name) : session_(CurrentTrace()) {
+        if (session_) { event_.name = name; event_.startUs = TraceSession::NowUs(); }
+    }
+    ~TraceScope() { End(); }
+
+    /**
+     * @brief Finish the span before the end of the scope (later calls do nothing)
+     */
+    void End() {
+        if (!session_) return;
+        event_.durUs = TraceSession::NowUs() - event_.startUs;
+        event_.startUs -= session_->StartUs();
+        event_.tid = TraceSession::ThreadId();
+        session_->Add(event_);
+        session_ = nullptr;
+    }
+
+    /**
+     * @brief Attach a numeric argument (e.g. byte count) to the span
+     */
+    void Arg(const char* key, long long value) {
+        if (session_ && event_.argCount < TraceSession::kMaxArgs) event_.args[event_.argCount++] = {key, value};
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    TraceSession* session_;
+    TraceSession::Event event_{};
+};
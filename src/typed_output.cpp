@@ -0,0 +1,136 @@
+/**
+ * @file typed_output.cpp
+ * @brief Implementation of the batched keystroke injector
+ */
+
+#include "typed_output.h"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace {
+bool IsHighSurrogate(char16_t c) { return c >= 0xD800 && c <= 0xDBFF; }
+
+/**
+ * @brief Append text as UTF-16 without carriage returns (wchar_t is UTF-16 on Windows, UTF-32 elsewhere)
+ */
+void AppendUtf16(u16string& out, wstring_view text) {
+    for (wchar_t wc : text) {
+        if (wc == L'\r') continue;
+        const auto c = static_cast<char32_t>(wc);
+        if (c > 0xFFFF) {
+            out += static_cast<char16_t>(0xD800 + ((c - 0x10000) >> 10));
+            out += static_cast<char16_t>(0xDC00 + ((c - 0x10000) & 0x3FF));
+        } else {
+            out += static_cast<char16_t>(c);
+        }
+    }
+}
+
+wstring ToWide(u16string_view units) {
+    wstring out;
+    out.reserve(units.size());
+    for (size_t i = 0; i < units.size(); ++i) {
+        char32_t c = units[i];
+        if constexpr (sizeof(wchar_t) > 2) {
+            if (IsHighSurrogate(units[i]) && i + 1 < units.size() && units[i + 1] >= 0xDC00 && units[i + 1] <= 0xDFFF) {
+                c = 0x10000 + ((c - 0xD800) << 10) + (units[++i] - 0xDC00);
+            }
+        }
+        out += static_cast<wchar_t>(c);
+    }
+    return out;
+}
+}  // namespace
+
+KeystrokeInjector::KeystrokeInjector(unique_ptr<KeystrokeSink> sink, const TypingOptions& opt)
+    : sink_(move(sink)), opt_(opt) {
+    worker_ = thread([this] { WorkerLoop(); });
+}
+
+KeystrokeInjector::~KeystrokeInjector() {
+    Abort();
+    if (worker_.joinable()) worker_.join();
+}
+
+void KeystrokeInjector::Push(wstring_view text) {
+    {
+        lock_guard<mutex> lock(mutex_);
+        if (stopping_ || closing_) return;
+        AppendUtf16(pending_, text);
+        ++stats_.pushed;
+        stats_.maxBacklog = (std::max)(stats_.maxBacklog, static_cast<uint64_t>(pending_.size()));
+    }
+    cv_.notify_all();
+}
+
+bool KeystrokeInjector::Finish() {
+    {
+        lock_guard<mutex> lock(mutex_);
+        closing_ = true;
+    }
+    cv_.notify_all();
+    if (worker_.joinable()) worker_.join();
+    lock_guard<mutex> lock(mutex_);
+    return !stats_.aborted;
+}
+
+void KeystrokeInjector::Abort() {
+    {
+        lock_guard<mutex> lock(mutex_);
+        // After Finish() drained the backlog there is nothing left to abort
+        if (!stopping_ && (!closing_ || !pending_.empty())) stats_.aborted = true;
+        stopping_ = true;
+        pending_.clear();
+    }
+    cv_.notify_all();
+}
+
+wstring KeystrokeInjector::Typed() const {
+    lock_guard<mutex> lock(mutex_);
+    return ToWide(typed_);
+}
+
+TypingStats KeystrokeInjector::Stats() const {
+    lock_guard<mutex> lock(mutex_);
+    return stats_;
+}
+
+void KeystrokeInjector::WorkerLoop() {
+    // Units that can go out now: up to maxBatch, keeping a surrogate pair together and
+    // holding back a trailing high surrogate until its partner is pushed
+    auto sendable = [this] {
+        size_t n = (std::min)((std::max)(opt_.maxBatch, size_t{2}), pending_.size());
+        if (n > 0 && IsHighSurrogate(pending_[n - 1]) && (n < pending_.size() || !closing_)) --n;
+        return n;
+    };
+    auto next = chrono::steady_clock::now();
+    unique_lock<mutex> lock(mutex_);
+    for (;;) {
+        cv_.wait(lock, [&] { return stopping_ || closing_ || sendable() > 0; });
+        if (stopping_) break;
+        if (sendable() == 0) break;  // Closing with nothing left
+        // Pace the batches; whatever is pushed while waiting joins this batch
+        if (cv_.wait_until(lock, next, [&] { return stopping_; })) break;
+        const size_t n = sendable();
+        u16string batch = pending_.substr(0, n);
+        pending_.erase(0, n);
+        const auto start = chrono::steady_clock::now();
+        lock.unlock();
+        const bool ok = sink_->Type(batch);
+        lock.lock();
+        if (!ok) {
+            stats_.aborted = true;
+            stopping_ = true;
+            pending_.clear();
+            break;
+        }
+        typed_ += batch;
+        stats_.units += n;
+        ++stats_.batches;
+        unsigned pause = opt_.intervalMs;
+        if (opt_.charsPerSecond > 0) pause = (std::max)(pause, static_cast<unsigned>(n * 1000 / opt_.charsPerSecond));
+        next = start + chrono::milliseconds(pause);
+    }
+}
@@ -0,0 +1,116 @@
+/**
+ * @file typed_output.h
+ * @brief Types streamed text into another window as it arrives
+ *
+ * Instead of waiting for the whole result and pasting it, a filter can type
+ * its streamed deltas into the window it was started from. Deltas are pushed
+ * from the worker thread receiving them and typed on the injector's own
+ * thread in batches: a batch is sent at most every intervalMs (and no faster
+ * than charsPerSecond), and everything that arrives in the meantime is
+ * coalesced into the next batch, so a fast stream costs a few large input
+ * events rather than one per token and the target application keeps up.
+ *
+ * Keystrokes are delivered through KeystrokeSink (SendInput on Windows, a
+ * fake in tests and benchmarks), which can refuse a batch, e.g. when the
+ * target window lost the focus; typing then stops for good.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+
+/**
+ * @struct TypingOptions
+ * @brief Batching and pacing of typed output ("typing" in config.json)
+ */
+struct TypingOptions {
+    size_t maxBatch{64};          // UTF-16 units per batch (a surrogate pair is never split)
+    unsigned intervalMs{15};      // Minimum pause between batches
+    unsigned charsPerSecond{0};   // Upper bound on the typing rate (0 = bounded by the batches only)
+};
+
+/**
+ * @class KeystrokeSink
+ * @brief Receives the batches to type (called from the injector thread only)
+ */
+class KeystrokeSink {
+public:
+    virtual ~KeystrokeSink() = default;
+
+    /**
+     * @brief Type a batch of UTF-16 units ('\n' is Enter, '\t' is Tab)
+     * @return false if the target cannot take input any more; nothing further is typed
+     */
+    virtual bool Type(std::u16string_view units) = 0;
+};
+
+/**
+ * @struct TypingStats
+ * @brief Counters of one typed output
+ */
+struct TypingStats {
+    uint64_t pushed{};   // Deltas pushed
+    uint64_t units{};    // UTF-16 units typed
+    uint64_t batches{};  // Batches sent to the sink
+    uint64_t maxBacklog{}; // Most units waiting at once
+    bool aborted{};      // The sink refused a batch or Abort() was called
+};
+
+/**
+ * @class KeystrokeInjector
+ * @brief Types pushed text through a sink on a background thread
+ */
+class KeystrokeInjector {
+public:
+    KeystrokeInjector(std::unique_ptr<KeystrokeSink> sink, const TypingOptions& opt);
+    ~KeystrokeInjector();
+
+    KeystrokeInjector(const KeystrokeInjector&) = delete;
+    KeystrokeInjector& operator=(const KeystrokeInjector&) = delete;
+
+    /**
+     * @brief Queue text to type; returns at once ('\r' is dropped, so "\r\n" is one Enter)
+     */
+    void Push(std::wstring_view text);
+
+    /**
+     * @brief Wait until everything pushed has been typed, then stop the thread
+     * @return false if typing was aborted before the end
+     */
+    bool Finish();
+
+    /**
+     * @brief Stop typing and drop the backlog; returns at once (a batch being typed is completed)
+     *
+     * Safe to call from any thread, e.g. a CancelToken callback.
+     */
+    void Abort();
+
+    /**
+     * @brief Text typed so far, i.e. the prefix of the pushed text the target received (without '\r')
+     */
+    std::wstring Typed() const;
+
+    TypingStats Stats() const;
+
+private:
+    void WorkerLoop();
+
+    std::unique_ptr<KeystrokeSink> sink_;
+    const TypingOptions opt_;
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    std::u16string pending_;      // Pushed, not yet typed
+    std::u16string typed_;
+    TypingStats stats_;
+    bool closing_{};              // Finish() called: type the backlog, then exit
+    bool stopping_{};             // Abort() called or the sink failed
+    std::thread worker_;
+};
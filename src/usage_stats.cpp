@@ -0,0 +1,300 @@
+/**
+ * @file usage_stats.cpp
+ * @brief Implementation of token usage extraction and the usage statistics store
+ */
+
+#include "usage_stats.h"
+#include "utf8.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <utility>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+namespace {
+constexpr char kCsvHeader[] = "time,filter,model,provider,ok,cache_hit,streamed,latency_ms,first_byte_ms,"
+                              "prompt_tokens,completion_tokens,cached_tokens,usage_reported,cost_usd";
+constexpr size_t kCsvFields = 14;
+
+FILE* OpenAppend(const fs::path& path) {
+#ifdef _WIN32
+    return _wfopen(path.c_str(), L"ab");
+#else
+    return fopen(path.c_str(), "ab");
+#endif
+}
+
+bool ParseCount(const string& value, uint64_t& out) {
+    if (value.empty()) return false;
+    char* end = nullptr;
+    const double n = strtod(value.c_str(), &end);
+    if (end == value.c_str() || n < 0) return false;
+    out = static_cast<uint64_t>(n);
+    return true;
+}
+
+/**
+ * @brief Quote a CSV field if it needs it (line breaks become spaces so a record stays on one line)
+ */
+string CsvField(const wstring& s) {
+    string utf8 = WideToUtf8(s);
+    replace_if(utf8.begin(), utf8.end(), [](char c) { return c == '\r' || c == '\n'; }, ' ');
+    if (utf8.find_first_of(",\"") == string::npos) return utf8;
+    string out = "\"";
+    for (char c : utf8) {
+        if (c == '"') out += '"';
+        out += c;
+    }
+    return out + "\"";
+}
+
+vector<string> SplitCsv(string_view line) {
+    vector<string> fields(1);
+    bool quoted = false;
+    for (size_t i = 0; i < line.size(); ++i) {
+        const char c = line[i];
+        if (quoted) {
+            if (c != '"') fields.back() += c;
+            else if (i + 1 < line.size() && line[i + 1] == '"') { fields.back() += '"'; ++i; }
+            else quoted = false;
+        } else if (c == '"') {
+            quoted = true;
+        } else if (c == ',') {
+            fields.emplace_back();
+        } else {
+            fields.back() += c;
+        }
+    }
+    return fields;
+}
+
+string FormatNumber(const char* fmt, double v) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), fmt, v);
+    return buf;
+}
+
+string ToCsvLine(const UsageRecord& r) {
+    string line = to_string(r.time) + "," + CsvField(r.filter) + "," + CsvField(r.model) + "," + CsvField(r.provider) + ",";
+    line += string(r.ok ? "1" : "0") + "," + (r.cacheHit ? "1" : "0") + "," + (r.streamed ? "1" : "0") + ",";
+    line += FormatNumber("%.1f", r.latencyMs) + "," + FormatNumber("%.1f", r.firstByteMs) + ",";
+    line += to_string(r.usage.prompt) + "," + to_string(r.usage.completion) + "," + to_string(r.usage.cached) + ",";
+    line += string(r.usage.reported ? "1" : "0") + "," + FormatNumber("%.6f", r.cost);
+    return line;
+}
+
+bool FromCsvLine(string_view line, UsageRecord& r) {
+    const vector<string> f = SplitCsv(line);
+    if (f.size() != kCsvFields) return false;
+    char* end = nullptr;
+    r.time = strtoll(f[0].c_str(), &end, 10);
+    if (end == f[0].c_str()) return false;  // Header or a torn line
+    r.filter = Utf8ToWide(f[1]);
+    r.model = Utf8ToWide(f[2]);
+    r.provider = Utf8ToWide(f[3]);
+    r.ok = f[4] == "1";
+    r.cacheHit = f[5] == "1";
+    r.streamed = f[6] == "1";
+    r.latencyMs = strtod(f[7].c_str(), nullptr);
+    r.firstByteMs = strtod(f[8].c_str(), nullptr);
+    r.usage.prompt = strtoull(f[9].c_str(), nullptr, 10);
+    r.usage.completion = strtoull(f[10].c_str(), nullptr, 10);
+    r.usage.cached = strtoull(f[11].c_str(), nullptr, 10);
+    r.usage.reported = f[12] == "1";
+    r.cost = strtod(f[13].c_str(), nullptr);
+    return true;
+}
+
+/**
+ * @brief Nearest-rank percentile of sorted values (0 if empty)
+ */
+double Percentile(const vector<double>& sorted, double q) {
+    if (sorted.empty()) return 0;
+    size_t rank = static_cast<size_t>(ceil(q * static_cast<double>(sorted.size())));
+    return sorted[rank > 0 ? rank - 1 : 0];
+}
+} // namespace
+
+void UsagePaths::Compile() {
+    promptPath = JsonPath::Compile(prompt);
+    completionPath = JsonPath::Compile(completion);
+    cachedPath = JsonPath::Compile(cached);
+    reasoningPath = JsonPath::Compile(reasoning);
+}
+
+bool UsagePaths::Extract(string_view json, TokenUsage& usage) const {
+    static const JsonPath none;
+    string unused;
+    return Extract(json, usage, none, unused);
+}
+
+bool UsagePaths::Extract(string_view json, TokenUsage& usage, const JsonPath& result, string& resultOut) const {
+    vector<string> values;
+    JsonPath::ExtractMany(json, {&result, &promptPath, &cachedPath, &completionPath, &reasoningPath}, values);
+    resultOut = move(values[0]);
+    bool found = ParseCount(values[1], usage.prompt);
+    found |= ParseCount(values[2], usage.cached);
+    uint64_t completion = 0, reasoningTokens = 0;
+    const bool hasCompletion = ParseCount(values[3], completion);
+    const bool hasReasoning = ParseCount(values[4], reasoningTokens);
+    if (hasCompletion || hasReasoning) {
+        usage.completion = completion + reasoningTokens;
+        found = true;
+    }
+    if (found) usage.reported = true;
+    return found;
+}
+
+double UsageCost(const TokenUsage& usage, const TokenPrices& prices) {
+    const uint64_t cached = (std::min)(usage.cached, usage.prompt);
+    const double cachedPrice = prices.cached > 0 ? prices.cached : prices.input;
+    return (static_cast<double>(usage.prompt - cached) * prices.input + static_cast<double>(cached) * cachedPrice +
+            static_cast<double>(usage.completion) * prices.output) / 1e6;
+}
+
+vector<UsageAggregate> AggregateUsage(const vector<UsageRecord>& records, UsageGroup by) {
+    struct Samples {
+        UsageAggregate row;
+        vector<double> latency;
+        vector<double> firstByte;
+        double generationSeconds{};
+        uint64_t generatedTokens{};
+    };
+    map<pair<wstring, wstring>, Samples> groups;
+    for (const UsageRecord& r : records) {
+        const wstring filter = by == UsageGroup::Model ? wstring() : r.filter;
+        const wstring model = by == UsageGroup::Filter ? wstring() : r.model;
+        Samples& s = groups[{filter, model}];
+        s.row.filter = filter;
+        s.row.model = model;
+        if (r.cacheHit) { ++s.row.cacheHits; continue; }
+        ++s.row.requests;
+        if (!r.ok) { ++s.row.failures; continue; }
+        s.latency.push_back(r.latencyMs);
+        s.firstByte.push_back(r.firstByteMs);
+        s.row.promptTokens += r.usage.prompt;
+        s.row.completionTokens += r.usage.completion;
+        s.row.cachedTokens += r.usage.cached;
+        s.row.cost += r.cost;
+        if (r.usage.reported && r.latencyMs > 0) {
+            s.generatedTokens += r.usage.completion;
+            s.generationSeconds += r.latencyMs / 1000.0;
+        }
+    }
+    vector<UsageAggregate> rows;
+    rows.reserve(groups.size());
+    for (auto& [key, s] : groups) {
+        sort(s.latency.begin(), s.latency.end());
+        sort(s.firstByte.begin(), s.firstByte.end());
+        s.row.p50Ms = Percentile(s.latency, 0.5);
+        s.row.p95Ms = Percentile(s.latency, 0.95);
+        s.row.p50FirstByteMs = Percentile(s.firstByte, 0.5);
+        if (s.generationSeconds > 0) s.row.tokensPerSecond = static_cast<double>(s.generatedTokens) / s.generationSeconds;
+        rows.push_back(move(s.row));
+    }
+    return rows;
+}
+
+bool WriteUsageCsv(const fs::path& path, const vector<UsageAggregate>& rows, UsageGroup by) {
+    ofstream out(path, ios::binary | ios::trunc);
+    if (!out) return false;
+    if (by != UsageGroup::Model) out << "filter,";
+    if (by != UsageGroup::Filter) out << "model,";
+    out << "requests,failures,cache_hits,p50_ms,p95_ms,first_byte_p50_ms,tokens_per_second,"
+           "prompt_tokens,completion_tokens,cached_tokens,cost_usd\n";
+    for (const UsageAggregate& a : rows) {
+        if (by != UsageGroup::Model) out << CsvField(a.filter) << ",";
+        if (by != UsageGroup::Filter) out << CsvField(a.model) << ",";
+        out << a.requests << "," << a.failures << "," << a.cacheHits << "," << FormatNumber("%.0f", a.p50Ms) << ","
+            << FormatNumber("%.0f", a.p95Ms) << "," << FormatNumber("%.0f", a.p50FirstByteMs) << ","
+            << FormatNumber("%.1f", a.tokensPerSecond) << "," << a.promptTokens << "," << a.completionTokens << ","
+            << a.cachedTokens << "," << FormatNumber("%.6f", a.cost) << "\n";
+    }
+    out.close();
+    return static_cast<bool>(out);
+}
+
+UsageStats::~UsageStats() {
+    Close();
+}
+
+bool UsageStats::Open(const fs::path& path, size_t maxRecords) {
+    lock_guard<mutex> lock(mutex_);
+    if (file_) { fclose(file_); file_ = nullptr; }
+    path_ = path;
+    maxRecords_ = (std::max)(maxRecords, size_t{1});
+    records_.clear();
+    fileRecords_ = 0;
+    ifstream in(path, ios::binary);
+    string line;
+    while (getline(in, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        UsageRecord r;
+        if (!FromCsvLine(line, r)) continue;
+        records_.push_back(move(r));
+        ++fileRecords_;
+        if (records_.size() > maxRecords_) records_.pop_front();
+    }
+    in.close();
+    if (fileRecords_ > records_.size() || fileRecords_ == 0) return Rewrite();
+    file_ = OpenAppend(path_);
+    return file_ != nullptr;
+}
+
+void UsageStats::Record(const UsageRecord& r) {
+    lock_guard<mutex> lock(mutex_);
+    records_.push_back(r);
+    if (records_.size() > maxRecords_) records_.pop_front();
+    if (!file_) return;
+    if (++fileRecords_ >= 2 * maxRecords_) {
+        Rewrite();
+        return;
+    }
+    const string line = ToCsvLine(r) + "\n";
+    fwrite(line.data(), 1, line.size(), file_);
+    fflush(file_);
+}
+
+vector<UsageRecord> UsageStats::Records() const {
+    lock_guard<mutex> lock(mutex_);
+    return vector<UsageRecord>(records_.begin(), records_.end());
+}
+
+void UsageStats::Clear() {
+    lock_guard<mutex> lock(mutex_);
+    records_.clear();
+    if (!path_.empty()) Rewrite();
+}
+
+void UsageStats::Close() {
+    lock_guard<mutex> lock(mutex_);
+    if (file_) fclose(file_);
+    file_ = nullptr;
+}
+
+/**
+ * @brief Replace the file with the records in memory and reopen it for appending (mutex_ held)
+ */
+bool UsageStats::Rewrite() {
+    if (file_) { fclose(file_); file_ = nullptr; }
+    fs::path tmp = path_;
+    tmp += ".part";
+    {
+        ofstream out(tmp, ios::binary | ios::trunc);
+        out << kCsvHeader << "\n";
+        for (const UsageRecord& r : records_) out << ToCsvLine(r) << "\n";
+        out.close();
+        error_code ec;
+        if (!out) { fs::remove(tmp, ec); return false; }
+        fs::rename(tmp, path_, ec);
+        if (ec) { fs::remove(tmp, ec); return false; }
+    }
+    fileRecords_ = records_.size();
+    file_ = OpenAppend(path_);
+    return file_ != nullptr;
+}
@@ -0,0 +1,197 @@
+/**
+ * @file usage_stats.h
+ * @brief Token usage, latency and cost of every API request, aggregated per filter and model
+ *
+ * Providers report what a request consumed in a usage block of the response
+ * (OpenAI "usage", Gemini "usageMetadata"); each apidef template declares
+ * where, and the engine extracts the counts and records one UsageRecord per
+ * request. UsageStats keeps the newest records in memory and in a CSV file,
+ * so they survive restarts and open in a spreadsheet, and aggregates them
+ * by filter, model or both to compare models on the same work.
+ */
+
+#pragma once
+
+#include "json_path.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @struct TokenUsage
+ * @brief Token counts one response reported
+ */
+struct TokenUsage {
+    uint64_t prompt{};      // Input tokens, cached ones included
+    uint64_t completion{};  // Output tokens, reasoning included
+    uint64_t cached{};      // Input tokens served from the provider's prompt cache
+    bool reported{};        // The response carried at least one of the counts
+};
+
+/**
+ * @struct UsagePaths
+ * @brief Where a template's responses report token counts ("usage" in apidef templates)
+ *
+ * The same paths apply to a whole response and to each frame of a stream;
+ * a later frame's counts replace an earlier one's.
+ */
+struct UsagePaths {
+    std::wstring prompt;      // e.g. usage.prompt_tokens
+    std::wstring completion;  // e.g. usage.completion_tokens
+    std::wstring cached;      // e.g. usage.prompt_tokens_details.cached_tokens
+    std::wstring reasoning;   // Added to completion, for APIs that count thinking separately
+    JsonPath promptPath;
+    JsonPath completionPath;
+    JsonPath cachedPath;
+    JsonPath reasoningPath;
+
+    /**
+     * @brief Compile the path strings
+     */
+    void Compile();
+
+    bool empty() const { return promptPath.empty() && completionPath.empty(); }
+
+    /**
+     * @brief Read the counts present in a response or stream frame (UTF-8 JSON)
+     * @return true if any count was found; counts not found keep their values
+     */
+    bool Extract(std::string_view json, TokenUsage& usage) const;
+
+    /**
+     * @brief Read the counts and a template's result in the same pass over a response
+     * @param result Result path (may be empty)
+     * @param resultOut Receives the result's value, as JsonPath::Extract would (empty if not found)
+     * @return true if any count was found
+     */
+    bool Extract(std::string_view json, TokenUsage& usage, const JsonPath& result, std::string& resultOut) const;
+};
+
+/**
+ * @struct TokenPrices
+ * @brief Price of a model's tokens in USD per million ("prices" in a model's config)
+ */
+struct TokenPrices {
+    double input{};
+    double output{};
+    double cached{};   // Cached input tokens (0 = charged as input)
+
+    bool empty() const { return input <= 0 && output <= 0; }
+};
+
+/**
+ * @brief Cost of a request in USD
+ */
+double UsageCost(const TokenUsage& usage, const TokenPrices& prices);
+
+/**
+ * @struct UsageRecord
+ * @brief One API request (or response cache hit)
+ */
+struct UsageRecord {
+    int64_t time{};          // Unix time the request completed
+    std::wstring filter;     // Filter title
+    std::wstring model;      // Model display name
+    std::wstring provider;   // API provider id
+    bool ok{};
+    bool cacheHit{};         // Answered from the local response cache, no request sent
+    bool streamed{};
+    double latencyMs{};      // Request sent until the response was complete
+    double firstByteMs{};    // Request sent until the response started arriving
+    TokenUsage usage;
+    double cost{};           // USD, from the model's prices when the request was made
+};
+
+/**
+ * @enum UsageGroup
+ * @brief What the aggregates are keyed by
+ */
+enum class UsageGroup { FilterModel, Filter, Model };
+
+/**
+ * @struct UsageAggregate
+ * @brief Totals and percentiles of the records sharing a key
+ */
+struct UsageAggregate {
+    std::wstring filter;           // Empty when grouped by model
+    std::wstring model;            // Empty when grouped by filter
+    size_t requests{};             // Requests sent (cache hits not included)
+    size_t failures{};
+    size_t cacheHits{};
+    double p50Ms{};                // Latency of successful requests
+    double p95Ms{};
+    double p50FirstByteMs{};
+    double tokensPerSecond{};      // Output tokens per second of request time, over requests that reported usage
+    uint64_t promptTokens{};
+    uint64_t completionTokens{};
+    uint64_t cachedTokens{};
+    double cost{};
+};
+
+/**
+ * @brief Aggregate records, sorted by filter and then model
+ */
+std::vector<UsageAggregate> AggregateUsage(const std::vector<UsageRecord>& records, UsageGroup by);
+
+/**
+ * @brief Write aggregates as CSV (UTF-8, one header line)
+ * @return false if the file cannot be written
+ */
+bool WriteUsageCsv(const std::filesystem::path& path, const std::vector<UsageAggregate>& rows, UsageGroup by);
+
+/**
+ * @class UsageStats
+ * @brief Rolling store of the newest usage records, backed by a CSV file
+ *
+ * Each record is appended to the file as it is made. Only the newest
+ * maxRecords are kept; the file is rewritten with them once it holds
+ * twice as many. Thread-safe.
+ */
+class UsageStats {
+public:
+    UsageStats() = default;
+    ~UsageStats();
+
+    /**
+     * @brief Open or create the store and load the records it holds
+     * @param path CSV file
+     * @param maxRecords Records kept
+     * @return false if the file cannot be opened for appending (records are then kept in memory only)
+     */
+    bool Open(const std::filesystem::path& path, size_t maxRecords);
+
+    void Record(const UsageRecord& r);
+
+    /**
+     * @brief Records in the order they were made
+     */
+    std::vector<UsageRecord> Records() const;
+
+    std::vector<UsageAggregate> Aggregate(UsageGroup by) const { return AggregateUsage(Records(), by); }
+
+    /**
+     * @brief Delete every record, in memory and on disk
+     */
+    void Clear();
+
+    void Close();
+
+    UsageStats(const UsageStats&) = delete;
+    UsageStats& operator=(const UsageStats&) = delete;
+
+private:
+    bool Rewrite();
+
+    mutable std::mutex mutex_;
+    std::filesystem::path path_;
+    FILE* file_{};
+    size_t maxRecords_{10000};
+    size_t fileRecords_{};         // Records in the file, including those dropped from memory
+    std::deque<UsageRecord> records_;
+};
@@ -0,0 +1,71 @@
+/**
+ * @file utf8.cpp
+ * @brief Implementation of the UTF-8 conversions
+ */
+
+#include "utf8.h"
+
+#include <cstdint>
+
+using namespace std;
+
+string WideToUtf8(wstring_view w) {
+    string s;
+    s.reserve(w.size());
+    for (size_t i = 0; i < w.size(); ++i) {
+        uint32_t c = static_cast<uint32_t>(w[i]);
+        if constexpr (sizeof(wchar_t) == 2) {
+            if (c >= 0xD800 && c < 0xDC00 && i + 1 < w.size() && w[i + 1] >= 0xDC00 && w[i + 1] < 0xE000) {
+                c = 0x10000 + ((c - 0xD800) << 10) + (static_cast<uint32_t>(w[++i]) - 0xDC00);
+            }
+        }
+        if (c >= 0xD800 && c < 0xE000) c = 0xFFFD;  // Lone surrogate
+        if (c < 0x80) {
+            s += static_cast<char>(c);
+        } else if (c < 0x800) {
+            s += static_cast<char>(0xC0 | (c >> 6));
+            s += static_cast<char>(0x80 | (c & 0x3F));
+        } else if (c < 0x10000) {
+            s += static_cast<char>(0xE0 | (c >> 12));
+            s += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+            s += static_cast<char>(0x80 | (c & 0x3F));
+        } else {
+            s += static_cast<char>(0xF0 | (c >> 18));
+            s += static_cast<char>(0x80 | ((c >> 12) & 0x3F));
+            s += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+            s += static_cast<char>(0x80 | (c & 0x3F));
+        }
+    }
+    return s;
+}
+
+wstring Utf8ToWide(string_view s) {
+    wstring w;
+    w.reserve(s.size());
+    const auto* p = reinterpret_cast<const unsigned char*>(s.data());
+    const auto* end = p + s.size();
+    while (p < end) {
+        uint32_t c = *p++;
+        if (c >= 0x80) {
+            int extra = 0;
+            uint32_t min = 0;
+            if (c >= 0xC2 && c < 0xE0) { extra = 1; c &= 0x1F; min = 0x80; }
+            else if (c >= 0xE0 && c < 0xF0) { extra = 2; c &= 0x0F; min = 0x800; }
+            else if (c >= 0xF0 && c < 0xF5) { extra = 3; c &= 0x07; min = 0x10000; }
+            int i = 0;
+            for (; i < extra && p < end && (*p & 0xC0) == 0x80; ++i) c = (c << 6) | (*p++ & 0x3F);
+            // Stray or truncated sequences, overlong forms and surrogates are replaced
+            if (extra == 0 || i < extra || c < min || c > 0x10FFFF || (c >= 0xD800 && c < 0xE000)) c = 0xFFFD;
+        }
+        if constexpr (sizeof(wchar_t) == 2) {
+            if (c >= 0x10000) {
+                c -= 0x10000;
+                w += static_cast<wchar_t>(0xD800 + (c >> 10));
+                w += static_cast<wchar_t>(0xDC00 + (c & 0x3FF));
+                continue;
+            }
+        }
+        w += static_cast<wchar_t>(c);
+    }
+    return w;
+}
@@ -0,0 +1,24 @@
+/**
+ * @file utf8.h
+ * @brief Portable conversion between wide strings and UTF-8
+ *
+ * The request pipeline works on UTF-8 byte buffers and only converts to
+ * wide strings at the clipboard and UI edges. These helpers do not depend
+ * on Win32, so they also work in the benchmarks; wchar_t may be UTF-16
+ * (Windows) or UTF-32.
+ */
+
+#pragma once
+
+#include <string>
+#include <string_view>
+
+/**
+ * @brief Convert a wide string to UTF-8 (lone surrogates become U+FFFD)
+ */
+std::string WideToUtf8(std::wstring_view w);
+
+/**
+ * @brief Convert UTF-8 to a wide string (invalid sequences become U+FFFD)
+ */
+std::wstring Utf8ToWide(std::string_view s);